@@ -0,0 +1,62 @@
+#include "AngleParamsDlg.hpp"
+#include "ui_AngleParamsDlg.h"
+
+#include <QtMath>
+
+
+
+
+
+std::optional<AngleParams> AngleParamsDlg::ask(QWidget * aParent, double aIdealAngle, double aForce)
+{
+	AngleParamsDlg dlg(aParent, aIdealAngle, aForce);
+	if (dlg.exec() == QDialog::Rejected)
+	{
+		return std::nullopt;
+	}
+	AngleParams ap;
+	ap.mIdealAngle = dlg.idealAngle();
+	ap.mForce = dlg.force();
+	return ap;
+}
+
+
+
+
+
+AngleParamsDlg::AngleParamsDlg(QWidget * aParent, double aIdealAngle, double aForce):
+	Super(aParent),
+	mUI(new Ui::AngleParamsDlg)
+{
+	mUI->setupUi(this);
+	mUI->eAngle->setText(QString::number(qRadiansToDegrees(aIdealAngle)));
+	mUI->eForce->setText(QString::number(aForce));
+	mUI->eAngle->selectAll();
+}
+
+
+
+
+
+AngleParamsDlg::~AngleParamsDlg()
+{
+	// Nothing explicit needed yet
+}
+
+
+
+
+
+double AngleParamsDlg::idealAngle() const
+{
+	return qDegreesToRadians(mUI->eAngle->text().toDouble());
+}
+
+
+
+
+
+double AngleParamsDlg::force() const
+{
+	return mUI->eForce->text().toDouble();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QDialog>
+
+
+
+
+
+// fwd:
+namespace Ui {
+class AngleParamsDlg;
+}
+
+
+
+
+
+struct AngleParams
+{
+	/** The ideal angle, in radians. */
+	double mIdealAngle;
+	double mForce;
+};
+
+
+
+
+
+class AngleParamsDlg:
+	public QDialog
+{
+	Q_OBJECT
+
+	using Super = QDialog;
+
+
+public:
+
+	/** Shows the dialog and returns the values the user provides.
+	The angle is in radians, the user edits it in degrees. */
+	static std::optional<AngleParams> ask(QWidget * aParent, double aIdealAngle, double aForce);
+
+
+private:
+
+	/** The Qt-managed UI. */
+	std::unique_ptr<Ui::AngleParamsDlg> mUI;
+
+
+	explicit AngleParamsDlg(QWidget * aParent, double aIdealAngle, double aForce);
+	~AngleParamsDlg();
+
+	double idealAngle() const;
+	double force() const;
+};
@@ -1,6 +1,30 @@
 #include "CadGraphicsView.hpp"
 
+#include <algorithm>
+#include <QCoreApplication>
 #include <QMouseEvent>
+#include <QWheelEvent>
+
+#include "NetTileRenderer.hpp"
+#include "StrainMap.hpp"
+
+
+
+
+
+namespace {
+
+/** Paints further apart than this are not counted as frames; the view has been idle in between. */
+static const std::chrono::milliseconds MAX_FRAME_TIME(250);
+
+/** The layout of the strain legend, in pixels: the margin from the viewport's corner and the padding around its
+contents, the height of the palette bar and of the tallest histogram bar. */
+static const int LEGEND_MARGIN = 8;
+static const int LEGEND_PADDING = 4;
+static const int LEGEND_PALETTE_HEIGHT = 10;
+static const int LEGEND_HISTOGRAM_HEIGHT = 48;
+
+}  // anonymous namespace
 
 
 
@@ -18,6 +42,9 @@ CadGraphicsView::CadGraphicsView(QWidget * aParentWidget):
 	// Disable zoom anchor (we're providing our own):
 	setTransformationAnchor(QGraphicsView::NoAnchor);
 
+	// Panning and zooming repaint the whole viewport anyway, and blitting the net's tiles is cheap:
+	setViewportUpdateMode(QGraphicsView::FullViewportUpdate);
+
 	auto min = std::numeric_limits<qint32>::min();
 	auto span = std::numeric_limits<quint32>::max();
 	setSceneRect(QRectF(min, min, span, span));
@@ -47,8 +74,223 @@ void CadGraphicsView::zoomTo(QRectF aRect)
 
 
 
+void CadGraphicsView::setNetRenderer(NetTileRenderer * aNetRenderer)
+{
+	if (mNetRenderer != nullptr)
+	{
+		disconnect(mNetRenderer, nullptr, this, nullptr);
+	}
+	mNetRenderer = aNetRenderer;
+	if (mNetRenderer != nullptr)
+	{
+		connect(mNetRenderer, &NetTileRenderer::updated, this, [this]() { viewport()->update(); });
+	}
+	viewport()->update();
+}
+
+
+
+
+
+void CadGraphicsView::setStrainLegend(const StrainMap * aStrainMap)
+{
+	mStrainLegend = aStrainMap;
+	viewport()->update();
+}
+
+
+
+
+
+void CadGraphicsView::startRecording()
+{
+	mRecording.emplace(viewport()->size());
+	mRecordingStart = std::chrono::steady_clock::now();
+}
+
+
+
+
+
+InteractionRecording CadGraphicsView::stopRecording()
+{
+	if (!mRecording)
+	{
+		return InteractionRecording();
+	}
+	auto res = std::move(*mRecording);
+	mRecording.reset();
+	return res;
+}
+
+
+
+
+
+void CadGraphicsView::replayEvent(const InteractionRecording::Event & aEvent)
+{
+	using EventType = InteractionRecording::EventType;
+
+	setTransform(aEvent.mViewTransform);
+	auto button = static_cast<Qt::MouseButton>(aEvent.mButtonOrDelta);
+	switch (aEvent.mType)
+	{
+		case EventType::MouseMove:
+		{
+			Q_EMIT mouseMoved(aEvent.mPos);
+			break;
+		}
+		case EventType::MousePress:
+		{
+			Q_EMIT mousePressed(aEvent.mPos, button);
+			break;
+		}
+		case EventType::MouseRelease:
+		{
+			Q_EMIT mouseReleased(aEvent.mPos, button);
+			break;
+		}
+		case EventType::MouseDblClick:
+		{
+			Q_EMIT mouseDblClicked(aEvent.mPos, button);
+			break;
+		}
+		case EventType::Wheel:
+		{
+			QWheelEvent wheel(
+				aEvent.mPos, mapToGlobal(aEvent.mPos), QPoint(), QPoint(0, aEvent.mButtonOrDelta),
+				Qt::NoButton, Qt::NoModifier, Qt::NoScrollPhase, false
+			);
+			wheelEvent(&wheel);
+			break;
+		}
+	}
+}
+
+
+
+
+
+void CadGraphicsView::recordEvent(InteractionRecording::EventType aType, QPointF aPos, int aButtonOrDelta)
+{
+	if (!mRecording)
+	{
+		return;
+	}
+	auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mRecordingStart);
+	mRecording->addEvent({aType, time, aPos, aButtonOrDelta, transform()});
+}
+
+
+
+
+
+void CadGraphicsView::drawBackground(QPainter * aPainter, const QRectF & aRect)
+{
+	Super::drawBackground(aPainter, aRect);
+	if (mNetRenderer != nullptr)
+	{
+		mNetRenderer->paint(*aPainter, aRect, transform().m11() * devicePixelRatioF());
+	}
+}
+
+
+
+
+
+void CadGraphicsView::drawForeground(QPainter * aPainter, const QRectF & aRect)
+{
+	Super::drawForeground(aPainter, aRect);
+	if (mStrainLegend == nullptr)
+	{
+		return;
+	}
+
+	// The legend is drawn in the viewport's pixels, in the bottom-left corner: the mode name, the histogram of the
+	// springs' values over the palette bar, and the value range below:
+	aPainter->save();
+	aPainter->resetTransform();
+	const auto & palette = StrainMap::palette();
+	const auto & histogram = mStrainLegend->histogram();
+	auto fm = aPainter->fontMetrics();
+	auto width = static_cast<int>(StrainMap::NUM_COLORS);
+	auto height = fm.height() + LEGEND_HISTOGRAM_HEIGHT + LEGEND_PALETTE_HEIGHT + fm.height();
+	QRect contents(
+		LEGEND_MARGIN + LEGEND_PADDING,
+		viewport()->height() - LEGEND_MARGIN - LEGEND_PADDING - height,
+		width, height
+	);
+	aPainter->fillRect(
+		contents.adjusted(-LEGEND_PADDING, -LEGEND_PADDING, LEGEND_PADDING, LEGEND_PADDING),
+		QColor(255, 255, 255, 208)
+	);
+	aPainter->setPen(Qt::black);
+	aPainter->drawText(
+		QRect(contents.left(), contents.top(), width, fm.height()),
+		Qt::AlignLeft | Qt::AlignVCenter,
+		QCoreApplication::translate("StrainMap", StrainMap::modeName(mStrainLegend->mode()))
+	);
+
+	// The histogram bars, each colored by the middle of its range of the palette:
+	auto histogramBottom = contents.top() + fm.height() + LEGEND_HISTOGRAM_HEIGHT;
+	auto maxCount = std::max<size_t>(*std::max_element(histogram.begin(), histogram.end()), 1);
+	auto binWidth = width / static_cast<int>(StrainMap::NUM_HISTOGRAM_BINS);
+	for (size_t bin = 0; bin < StrainMap::NUM_HISTOGRAM_BINS; ++bin)
+	{
+		auto barHeight = static_cast<int>(histogram[bin] * LEGEND_HISTOGRAM_HEIGHT / maxCount);
+		if ((barHeight == 0) && (histogram[bin] > 0))
+		{
+			barHeight = 1;  // Make even a single spring in the bin visible
+		}
+		auto color = palette[(2 * bin + 1) * StrainMap::NUM_COLORS / (2 * StrainMap::NUM_HISTOGRAM_BINS)];
+		aPainter->fillRect(
+			contents.left() + static_cast<int>(bin) * binWidth, histogramBottom - barHeight,
+			binWidth - 1, barHeight,
+			QColor::fromRgb(color)
+		);
+	}
+
+	// The palette bar, one pixel column per color:
+	for (int idx = 0; idx < width; ++idx)
+	{
+		aPainter->fillRect(contents.left() + idx, histogramBottom, 1, LEGEND_PALETTE_HEIGHT, QColor::fromRgb(palette[idx]));
+	}
+
+	// The range:
+	auto maxAbs = mStrainLegend->maxAbsValue();
+	QRect labels(contents.left(), histogramBottom + LEGEND_PALETTE_HEIGHT, width, fm.height());
+	aPainter->drawText(labels, Qt::AlignLeft | Qt::AlignVCenter, QString::number(-maxAbs, 'g', 3));
+	aPainter->drawText(labels, Qt::AlignHCenter | Qt::AlignVCenter, QString::fromUtf8("0"));
+	aPainter->drawText(labels, Qt::AlignRight | Qt::AlignVCenter, QString::number(maxAbs, 'g', 3));
+	aPainter->restore();
+}
+
+
+
+
+
+void CadGraphicsView::paintEvent(QPaintEvent * aEvent)
+{
+	auto start = std::chrono::steady_clock::now();
+	Super::paintEvent(aEvent);
+
+	// A longer pause between the paints means the view was idle, rather than a slow frame:
+	auto sinceLast = start - mLastPaintStart;
+	if (sinceLast < MAX_FRAME_TIME)
+	{
+		mFrameTimes.add(sinceLast);
+	}
+	mLastPaintStart = start;
+	mPaintTimes.add(std::chrono::steady_clock::now() - start);
+}
+
+
+
+
+
 void CadGraphicsView::wheelEvent(QWheelEvent * aEvent)
 {
+	recordEvent(InteractionRecording::EventType::Wheel, aEvent->position(), aEvent->angleDelta().y());
 	auto angle = aEvent->angleDelta().y() / 120.0;
 	auto factor = std::pow(mZoomSpeed, angle);
 	auto scale = transform().m22() * factor;
@@ -88,7 +330,9 @@ void CadGraphicsView::mouseMoveEvent(QMouseEvent * aEvent)
 		setTransform(transform().translate(dx, dy));
 		mMousePanLastPos = aEvent->pos();
 	}
-	Q_EMIT mouseMoved(mapToScene(aEvent->pos()));
+	auto scenePos = mapToScene(aEvent->pos());
+	recordEvent(InteractionRecording::EventType::MouseMove, scenePos, 0);
+	Q_EMIT mouseMoved(scenePos);
 }
 
 
@@ -102,7 +346,9 @@ void CadGraphicsView::mousePressEvent(QMouseEvent * aEvent)
 		// Prepare for panning the view:
 		mMousePanLastPos = aEvent->pos();
 	}
-	Q_EMIT mousePressed(mapToScene(aEvent->pos()), aEvent->button());
+	auto scenePos = mapToScene(aEvent->pos());
+	recordEvent(InteractionRecording::EventType::MousePress, scenePos, aEvent->button());
+	Q_EMIT mousePressed(scenePos, aEvent->button());
 }
 
 
@@ -113,7 +359,9 @@ void CadGraphicsView::mouseReleaseEvent(QMouseEvent * aEvent)
 {
 	// Finish any pending drag-operation by processing the final mousemove:
 	mouseMoveEvent(aEvent);
-	Q_EMIT mouseReleased(mapToScene(aEvent->pos()), aEvent->button());
+	auto scenePos = mapToScene(aEvent->pos());
+	recordEvent(InteractionRecording::EventType::MouseRelease, scenePos, aEvent->button());
+	Q_EMIT mouseReleased(scenePos, aEvent->button());
 }
 
 
@@ -122,6 +370,8 @@ void CadGraphicsView::mouseReleaseEvent(QMouseEvent * aEvent)
 
 void CadGraphicsView::mouseDoubleClickEvent(QMouseEvent * aEvent)
 {
-	Q_EMIT mouseDblClicked(mapToScene(aEvent->pos()), aEvent->button());
+	auto scenePos = mapToScene(aEvent->pos());
+	recordEvent(InteractionRecording::EventType::MouseDblClick, scenePos, aEvent->button());
+	Q_EMIT mouseDblClicked(scenePos, aEvent->button());
 	Super::mouseDoubleClickEvent(aEvent);
 }
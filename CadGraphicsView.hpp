@@ -1,12 +1,27 @@
 #pragma once
 
+#include <chrono>
+#include <optional>
 #include <QGraphicsView>
 
+#include "InteractionRecording.hpp"
+#include "RollingDuration.hpp"
 
 
 
 
-/** A QGraphicsView subclass that presents mouseclicks as signals, as well as other CAD-like improvements. */
+
+// fwd:
+class NetTileRenderer;
+class StrainMap;
+
+
+
+
+
+/** A QGraphicsView subclass that presents mouseclicks as signals, as well as other CAD-like improvements.
+The net itself is drawn as the background, by a NetTileRenderer, so panning and zooming only blit its cached tiles;
+the scene items are drawn over it. */
 class CadGraphicsView:
 	public QGraphicsView
 {
@@ -23,6 +38,32 @@ public:
 	horizontally, or vertically, depending on the aspect ratio). */
 	void zoomTo(QRectF aRect);
 
+	/** Sets the renderer that draws the net as the background of the view; nullptr to draw no net.
+	The renderer must outlive the view, or be reset before being destroyed. */
+	void setNetRenderer(NetTileRenderer * aNetRenderer);
+
+	/** Sets the strain map whose legend (the palette, the histogram and the value range) is drawn in the corner of
+	the view; nullptr to draw no legend. The strain map must outlive the view, or be reset before being destroyed. */
+	void setStrainLegend(const StrainMap * aStrainMap);
+
+	/** Starts recording the mouse and wheel events, as they are handled, into a new recording. */
+	void startRecording();
+
+	/** Stops recording and returns the recorded events; an empty recording if not recording. */
+	InteractionRecording stopRecording();
+
+	bool isRecording() const { return mRecording.has_value(); }
+
+	/** Replays a single recorded event: restores the view's transform of that time and handles the event the same
+	way as the live one, emitting the same signals. */
+	void replayEvent(const InteractionRecording::Event & aEvent);
+
+	/** The durations of the recent paints of the view, for the performance HUD. */
+	const RollingDuration & paintTimes() const { return mPaintTimes; }
+
+	/** The intervals between the starts of the recent paints, while painting continuously (the frame times). */
+	const RollingDuration & frameTimes() const { return mFrameTimes; }
+
 
 Q_SIGNALS:
 
@@ -52,8 +93,33 @@ protected:
 	/** The last processed mouse position (in screen coords) while middle-mouse panning. */
 	QPointF mMousePanLastPos;
 
+	/** Draws the net as the background, nullptr if none. */
+	NetTileRenderer * mNetRenderer = nullptr;
+
+	/** The strain map whose legend is drawn over the scene, nullptr if none. */
+	const StrainMap * mStrainLegend = nullptr;
+
+	/** The events recorded since startRecording(), nullopt if not recording. */
+	std::optional<InteractionRecording> mRecording;
+
+	/** When the recording has started; the events are timestamped relative to this. */
+	std::chrono::steady_clock::time_point mRecordingStart;
+
+	/** The recent paint durations and frame times, see paintTimes() and frameTimes(). */
+	RollingDuration mPaintTimes;
+	RollingDuration mFrameTimes;
+
+	/** When the last paint has started, to measure the frame times. */
+	std::chrono::steady_clock::time_point mLastPaintStart;
+
+
+	/** Adds the event to mRecording, if recording. */
+	void recordEvent(InteractionRecording::EventType aType, QPointF aPos, int aButtonOrDelta);
 
 	// QGraphicsView overrides:
+	virtual void drawBackground(QPainter * aPainter, const QRectF & aRect) override;
+	virtual void drawForeground(QPainter * aPainter, const QRectF & aRect) override;
+	virtual void paintEvent(QPaintEvent * aEvent) override;
 	virtual void wheelEvent(QWheelEvent * aEvent) override;
 	virtual QSize sizeHint() const override;
 	virtual void mouseMoveEvent(QMouseEvent * aEvent) override;
@@ -1,13 +1,248 @@
 #include "Document.hpp"
 
+#include <algorithm>
 #include <QFile>
 
+#include "Parallel.hpp"
+
 
 
 
 
 static const char gDocumentHeader[] = "SpringAngles document\n";
 
+/** The version written by saveToIO(). Version 1 adds the angles between the springs, and the solver checkpoint
+after them. */
+static const char gDocumentVersion[] = "1\n";
+
+
+
+
+
+namespace {
+
+/** The number of objects formatted by a single task when saving. */
+static const size_t SAVE_CHUNK_OBJECTS = 16384;
+
+/** The number of chunks formatted at once when saving, per worker thread. */
+static const size_t SAVE_WINDOW_CHUNKS_PER_THREAD = 2;
+
+
+
+
+
+/** Writes a single value on its own line; doubles are written with full precision, so that a solve resumes exactly. */
+void writeValue(QIODevice * aIO, double aValue)
+{
+	aIO->write(QByteArray::number(aValue, 'g', 17));
+	aIO->write("\n", 1);
+}
+
+void writeValue(QIODevice * aIO, size_t aValue)
+{
+	aIO->write(QByteArray::number(static_cast<qulonglong>(aValue)));
+	aIO->write("\n", 1);
+}
+
+
+
+
+
+/** Writes aNumObjects objects, each formatted by aFormatFn(QByteArray & aOut, size_t aIdx), in their order.
+The objects are formatted in chunks by the tasks of the shared TaskScheduler, the chunks are then written in order,
+so that the output is the same as if formatted one by one. Only a window of chunks is held at a time: the next window
+is being formatted while the current one is written, so the memory used doesn't grow with the net. */
+template <typename FormatFn>
+void writeObjects(QIODevice * aIO, size_t aNumObjects, FormatFn && aFormatFn)
+{
+	auto numChunks = (aNumObjects + SAVE_CHUNK_OBJECTS - 1) / SAVE_CHUNK_OBJECTS;
+	auto windowSize = SAVE_WINDOW_CHUNKS_PER_THREAD * Parallel::numThreads();
+	std::vector<QByteArray> current(windowSize), next(windowSize);
+
+	// Declared after the buffers, so that it waits for the tasks before the buffers are gone:
+	TaskScheduler::TaskGroup tasks(TaskScheduler::Priority::IO);
+	auto formatWindow = [&](std::vector<QByteArray> & aChunks, size_t aFirstChunkIdx)
+	{
+		auto endChunkIdx = std::min(aFirstChunkIdx + windowSize, numChunks);
+		for (auto chunkIdx = aFirstChunkIdx; chunkIdx < endChunkIdx; ++chunkIdx)
+		{
+			tasks.run([&aFormatFn, &out = aChunks[chunkIdx - aFirstChunkIdx], chunkIdx, aNumObjects]()
+				{
+					auto firstIdx = chunkIdx * SAVE_CHUNK_OBJECTS;
+					auto endIdx = std::min(firstIdx + SAVE_CHUNK_OBJECTS, aNumObjects);
+					for (auto idx = firstIdx; idx < endIdx; ++idx)
+					{
+						aFormatFn(out, idx);
+					}
+				}
+			);
+		}
+	};
+
+	formatWindow(current, 0);
+	tasks.wait();
+	for (size_t firstChunkIdx = 0; firstChunkIdx < numChunks; firstChunkIdx += windowSize)
+	{
+		// Format the next window while writing this one:
+		formatWindow(next, firstChunkIdx + windowSize);
+		auto numInWindow = std::min(windowSize, numChunks - firstChunkIdx);
+		for (size_t i = 0; i < numInWindow; ++i)
+		{
+			aIO->write(current[i]);
+			current[i].clear();
+		}
+		tasks.wait();
+		current.swap(next);
+	}
+}
+
+
+
+
+
+/** Writes the number of points, followed by their coords. */
+void writePoints(QIODevice * aIO, const std::vector<QPointF> & aPoints)
+{
+	writeValue(aIO, aPoints.size());
+	for (const auto & pt: aPoints)
+	{
+		writeValue(aIO, pt.x());
+		writeValue(aIO, pt.y());
+	}
+}
+
+
+
+
+
+/** Reads a single value from its own line. Throws a std::runtime_error with the specified message on failure. */
+double readDouble(QIODevice * aIO, const char * aErrorMessage)
+{
+	bool isOK = true;
+	auto res = aIO->readLine().trimmed().toDouble(&isOK);
+	if (!isOK)
+	{
+		throw std::runtime_error(aErrorMessage);
+	}
+	return res;
+}
+
+size_t readSize(QIODevice * aIO, const char * aErrorMessage)
+{
+	bool isOK = true;
+	auto res = aIO->readLine().trimmed().toULongLong(&isOK);
+	if (!isOK)
+	{
+		throw std::runtime_error(aErrorMessage);
+	}
+	return static_cast<size_t>(res);
+}
+
+
+
+
+
+/** Reads the points written by writePoints(). */
+std::vector<QPointF> readPoints(QIODevice * aIO)
+{
+	auto num = readSize(aIO, "Failed to read the solver checkpoint point count.");
+	std::vector<QPointF> res;
+	res.reserve(num);
+	for (size_t i = 0; i < num; ++i)
+	{
+		auto x = readDouble(aIO, "Failed to read the solver checkpoint X coord.");
+		auto y = readDouble(aIO, "Failed to read the solver checkpoint Y coord.");
+		res.emplace_back(x, y);
+	}
+	return res;
+}
+
+
+
+
+
+/** Writes the solver checkpoint, preceded by "1" if present, or just "0" if not. */
+void writeSolverCheckpoint(QIODevice * aIO, const std::optional<Solver::Checkpoint> & aCheckpoint)
+{
+	if (!aCheckpoint)
+	{
+		aIO->write("0\n", 2);
+		return;
+	}
+	aIO->write("1\n", 2);
+	const auto & settings = aCheckpoint->mSettings;
+	writeValue(aIO, static_cast<size_t>(settings.mScheme));
+	writeValue(aIO, settings.mMomentum);
+	writeValue(aIO, settings.mAndersonDepth);
+	writeValue(aIO, settings.mTolerance);
+	writeValue(aIO, settings.mMaxIterations);
+	const auto & result = aCheckpoint->mResult;
+	writeValue(aIO, result.mNumIterations);
+	writeValue(aIO, result.mNumFallbacks);
+	writeValue(aIO, result.mResidual);
+	writeValue(aIO, result.mMaxDisplacement);
+	writePoints(aIO, aCheckpoint->mPositions);
+	writePoints(aIO, aCheckpoint->mVelocities);
+	writeValue(aIO, aCheckpoint->mFireTimeStep);
+	writeValue(aIO, aCheckpoint->mFireAlpha);
+	writeValue(aIO, aCheckpoint->mFireNumPositiveSteps);
+	writeValue(aIO, aCheckpoint->mAndersonPosDiffs.size());
+	for (size_t i = 0; i < aCheckpoint->mAndersonPosDiffs.size(); ++i)
+	{
+		writePoints(aIO, aCheckpoint->mAndersonPosDiffs[i]);
+		writePoints(aIO, aCheckpoint->mAndersonDispDiffs[i]);
+	}
+	writePoints(aIO, aCheckpoint->mAndersonLastPositions);
+	writePoints(aIO, aCheckpoint->mAndersonLastDisplacements);
+	writeValue(aIO, static_cast<size_t>(aCheckpoint->mTopologyHash));
+}
+
+
+
+
+
+/** Reads the solver checkpoint written by writeSolverCheckpoint(). */
+std::optional<Solver::Checkpoint> readSolverCheckpoint(QIODevice * aIO)
+{
+	auto hasCheckpoint = readSize(aIO, "Failed to read the solver checkpoint flag.");
+	if (hasCheckpoint == 0)
+	{
+		return std::nullopt;
+	}
+	Solver::Checkpoint res;
+	auto scheme = readSize(aIO, "Failed to read the solver scheme.");
+	if (scheme > static_cast<size_t>(Solver::Scheme::Multigrid))
+	{
+		throw std::runtime_error("Unknown solver scheme.");
+	}
+	res.mSettings.mScheme = static_cast<Solver::Scheme>(scheme);
+	res.mSettings.mMomentum = readDouble(aIO, "Failed to read the solver momentum.");
+	res.mSettings.mAndersonDepth = readSize(aIO, "Failed to read the solver Anderson depth.");
+	res.mSettings.mTolerance = readDouble(aIO, "Failed to read the solver tolerance.");
+	res.mSettings.mMaxIterations = readSize(aIO, "Failed to read the solver max iterations.");
+	res.mResult.mNumIterations = readSize(aIO, "Failed to read the solver iteration count.");
+	res.mResult.mNumFallbacks = readSize(aIO, "Failed to read the solver fallback count.");
+	res.mResult.mResidual = readDouble(aIO, "Failed to read the solver residual.");
+	res.mResult.mMaxDisplacement = readDouble(aIO, "Failed to read the solver displacement.");
+	res.mPositions = readPoints(aIO);
+	res.mVelocities = readPoints(aIO);
+	res.mFireTimeStep = readDouble(aIO, "Failed to read the solver FIRE time step.");
+	res.mFireAlpha = readDouble(aIO, "Failed to read the solver FIRE alpha.");
+	res.mFireNumPositiveSteps = readSize(aIO, "Failed to read the solver FIRE step count.");
+	auto andersonDepth = readSize(aIO, "Failed to read the solver Anderson history size.");
+	for (size_t i = 0; i < andersonDepth; ++i)
+	{
+		res.mAndersonPosDiffs.push_back(readPoints(aIO));
+		res.mAndersonDispDiffs.push_back(readPoints(aIO));
+	}
+	res.mAndersonLastPositions = readPoints(aIO);
+	res.mAndersonLastDisplacements = readPoints(aIO);
+	res.mTopologyHash = readSize(aIO, "Failed to read the solver checkpoint topology hash.");
+	return res;
+}
+
+}  // anonymous namespace
+
 
 
 
@@ -45,10 +280,12 @@ void Document::loadFromIO(QIODevice * aIO)
 		throw std::runtime_error("Not a SpringAngles document.");
 	}
 	line = aIO->readLine();
-	if (line.compare("0\n") != 0)
+	auto isVersion0 = (line.compare("0\n") == 0);
+	if (!isVersion0 && (line.compare(gDocumentVersion) != 0))
 	{
 		throw std::runtime_error("Unknown document version.");
 	}
+	mSolverCheckpoint.reset();
 
 	// Read points:
 	bool isOK = true;
@@ -57,6 +294,7 @@ void Document::loadFromIO(QIODevice * aIO)
 	{
 		throw std::runtime_error("Failed to read point count.");
 	}
+	mSpringNet.reservePoints(numPoints);
 	for (qulonglong i = 0; i < numPoints; ++i)
 	{
 		auto x = aIO->readLine().toDouble(&isOK);
@@ -79,6 +317,7 @@ void Document::loadFromIO(QIODevice * aIO)
 	{
 		throw std::runtime_error("Failed to read spring count.");
 	}
+	mSpringNet.reserveSprings(numSprings);
 	for (qulonglong i = 0; i < numSprings; ++i)
 	{
 		auto idealLength = aIO->readLine().toDouble(&isOK);
@@ -103,6 +342,27 @@ void Document::loadFromIO(QIODevice * aIO)
 		}
 		mSpringNet.addSpring(idealLength, force, ptIdx1, ptIdx2);
 	}
+
+	// Read angles:
+	if (!isVersion0)
+	{
+		auto numAngles = readSize(aIO, "Failed to read angle count.");
+		mSpringNet.reserveAngles(numAngles);
+		for (size_t i = 0; i < numAngles; ++i)
+		{
+			auto idealAngle = readDouble(aIO, "Failed to read angle ideal angle.");
+			auto force = readDouble(aIO, "Failed to read angle force.");
+			auto springIdx1 = readSize(aIO, "Failed to read angle spring index 1.");
+			auto springIdx2 = readSize(aIO, "Failed to read angle spring index 2.");
+			mSpringNet.addAngle(idealAngle, force, springIdx1, springIdx2);
+		}
+	}
+
+	// Read the solver checkpoint:
+	if (!isVersion0)
+	{
+		mSolverCheckpoint = readSolverCheckpoint(aIO);
+	}
 }
 
 
@@ -127,32 +387,96 @@ void Document::saveToFile(const QString & aFileName)
 void Document::saveToIO(QIODevice * aIO)
 {
 	aIO->write(gDocumentHeader, sizeof(gDocumentHeader) - 1);
-	aIO->write("0\n", 2);  // Version
+	aIO->write(gDocumentVersion, sizeof(gDocumentVersion) - 1);
 
 	// Write points:
 	aIO->write(QByteArray::number(mSpringNet.numPoints()));
 	aIO->write("\n", 1);
-	for (const auto & p: mSpringNet.points())
-	{
-		aIO->write(QByteArray::number(p->x()));
-		aIO->write("\n", 1);
-		aIO->write(QByteArray::number(p->y()));
-		aIO->write("\n", 1);
-		aIO->write(p->isFixed() ? "1\n" : "0\n", 2);
-	}
+	writeObjects(aIO, mSpringNet.numPoints(), [this](QByteArray & aOut, size_t aIdx)
+		{
+			const auto & p = mSpringNet.point(aIdx);
+			aOut.append(QByteArray::number(p.x()));
+			aOut.append('\n');
+			aOut.append(QByteArray::number(p.y()));
+			aOut.append('\n');
+			aOut.append(mSpringNet.isPointFixed(aIdx) ? "1\n" : "0\n");
+		}
+	);
 
 	// Write springs:
 	aIO->write(QByteArray::number(mSpringNet.numSprings()));
 	aIO->write("\n", 1);
-	for (const auto & s: mSpringNet.springs())
+	const auto & springs = mSpringNet.springs();
+	writeObjects(aIO, springs.size(), [&springs](QByteArray & aOut, size_t aIdx)
+		{
+			const auto & s = springs[aIdx];
+			aOut.append(QByteArray::number(s.idealLength()));
+			aOut.append('\n');
+			aOut.append(QByteArray::number(s.force()));
+			aOut.append('\n');
+			aOut.append(QByteArray::number(s.pointIdx1()));
+			aOut.append('\n');
+			aOut.append(QByteArray::number(s.pointIdx2()));
+			aOut.append('\n');
+		}
+	);
+
+	// Write angles:
+	writeValue(aIO, mSpringNet.numAngles());
+	for (const auto & a: mSpringNet.angles())
+	{
+		writeValue(aIO, a.idealAngle());
+		writeValue(aIO, a.force());
+		writeValue(aIO, a.springIdx1());
+		writeValue(aIO, a.springIdx2());
+	}
+
+	// Write the solver checkpoint:
+	writeSolverCheckpoint(aIO, mSolverCheckpoint);
+}
+
+
+
+
+
+SpringNet::Reordering Document::reorder(SpringNet::PointOrdering aOrdering)
+{
+	auto res = mSpringNet.reorder(aOrdering);
+	if (mSolverCheckpoint)
 	{
-		aIO->write(QByteArray::number(s->idealLength()));
-		aIO->write("\n", 1);
-		aIO->write(QByteArray::number(s->force()));
-		aIO->write("\n", 1);
-		aIO->write(QByteArray::number(s->pointIdx1()));
-		aIO->write("\n", 1);
-		aIO->write(QByteArray::number(s->pointIdx2()));
-		aIO->write("\n", 1);
+		mSolverCheckpoint->permutePoints(res.mPointNewToOld, mSpringNet);
+	}
+	return res;
+}
+
+
+
+
+
+Document::MemoryUsage Document::memoryUsage() const
+{
+	MemoryUsage res;
+	res.mSpringNet = mSpringNet.memoryUsage();
+	if (mSolverCheckpoint)
+	{
+		auto pointsSize = [](const std::vector<QPointF> & aPoints)
+		{
+			return aPoints.capacity() * sizeof(QPointF);
+		};
+		res.mSolverCheckpoint = (
+			pointsSize(mSolverCheckpoint->mPositions) +
+			pointsSize(mSolverCheckpoint->mVelocities) +
+			pointsSize(mSolverCheckpoint->mAndersonLastPositions) +
+			pointsSize(mSolverCheckpoint->mAndersonLastDisplacements)
+		);
+		for (const auto & v: mSolverCheckpoint->mAndersonPosDiffs)
+		{
+			res.mSolverCheckpoint += pointsSize(v);
+		}
+		for (const auto & v: mSolverCheckpoint->mAndersonDispDiffs)
+		{
+			res.mSolverCheckpoint += pointsSize(v);
+		}
 	}
+	return res;
 }
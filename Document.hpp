@@ -1,7 +1,9 @@
 #pragma once
 
 #include "SpringNet.hpp"
+#include "Solver.hpp"
 
+#include <optional>
 #include <QObject>
 
 
@@ -17,18 +19,41 @@ class Document:
 	SpringNet mSpringNet;
 	QString mFileName;
 
+	/** The state of an unfinished solve, saved with the document so that it can be resumed after loading. */
+	std::optional<Solver::Checkpoint> mSolverCheckpoint;
+
 
 public:
 
+	/** The memory used by the document, in bytes. */
+	struct MemoryUsage
+	{
+		SpringNet::MemoryUsage mSpringNet;
+		size_t mSolverCheckpoint = 0;
+
+		size_t total() const { return mSpringNet.total() + mSolverCheckpoint; }
+	};
+
+
 	Document();
 
 	SpringNet & springNet() { return mSpringNet; }
 	const SpringNet & springNet() const { return mSpringNet; }
 	const QString & fileName() const { return mFileName; }
 	void setFileName(const QString & aFileName) { mFileName = aFileName; }
+	const std::optional<Solver::Checkpoint> & solverCheckpoint() const { return mSolverCheckpoint; }
+	void setSolverCheckpoint(std::optional<Solver::Checkpoint> aCheckpoint) { mSolverCheckpoint = std::move(aCheckpoint); }
+
+	/** Returns the memory used by the net and the solver checkpoint. */
+	MemoryUsage memoryUsage() const;
 
 	void loadFromFile(const QString & aFileName);
 	void loadFromIO(QIODevice * aIO);
 	void saveToFile(const QString & aFileName);
 	void saveToIO(QIODevice * aIO);
+
+	/** Reorders the net's points, springs and angles for cache locality (SpringNet::reorder()), and the solver
+	checkpoint with them. The new order is what gets saved; the returned permutation lets the caller remap
+	any other indices it holds. */
+	SpringNet::Reordering reorder(SpringNet::PointOrdering aOrdering);
 };
@@ -0,0 +1,404 @@
+#include "Ensemble.hpp"
+
+#include <cmath>
+#include <numbers>
+#include <algorithm>
+
+#include "SolverTrace.hpp"
+
+
+
+
+
+namespace {
+
+/** The number of samples in a single block, the unit of work of the tasks and of the ordered merging. */
+static const size_t BLOCK_SIZE = 16;
+
+/** How many blocks (per lane) may wait for merging, before the lanes stop taking new ones.
+Bounds the memory used when one block is slow. */
+static const size_t MAX_PENDING_BLOCKS_PER_LANE = 4;
+
+
+
+
+
+/** The random measurement errors for a single sample.
+Implemented here rather than by the <random> distributions, whose output differs between the standard libraries,
+so that the samples are reproducible everywhere. */
+class SampleRandom
+{
+	uint64_t mState;
+
+	/** The second value from the last Box-Muller transform, if not used yet. */
+	double mSpareNormal = 0;
+	bool mHasSpareNormal = false;
+
+
+public:
+
+	SampleRandom(uint64_t aSeed, size_t aSampleIdx):
+		mState(aSeed ^ (static_cast<uint64_t>(aSampleIdx) * 0xd1b54a32d192ed03ull))
+	{
+	}
+
+
+	/** Returns the next uniformly distributed 64-bit value (SplitMix64). */
+	uint64_t next()
+	{
+		auto z = (mState += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+
+	/** Returns a value uniformly distributed in (0, 1]. */
+	double uniform()
+	{
+		return static_cast<double>((next() >> 11) + 1) * 0x1.0p-53;
+	}
+
+
+	/** Returns a value with the standard normal distribution. */
+	double normal()
+	{
+		if (mHasSpareNormal)
+		{
+			mHasSpareNormal = false;
+			return mSpareNormal;
+		}
+		auto radius = std::sqrt(-2 * std::log(uniform()));
+		auto angle = 2 * std::numbers::pi * uniform();
+		mSpareNormal = radius * std::sin(angle);
+		mHasSpareNormal = true;
+		return radius * std::cos(angle);
+	}
+};
+
+}  // anonymous namespace
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Ensemble::PointStatistics:
+
+void Ensemble::PointStatistics::add(QPointF aPos)
+{
+	mCount += 1;
+	auto dx = aPos.x() - mMeanX;
+	auto dy = aPos.y() - mMeanY;
+	mMeanX += dx / static_cast<double>(mCount);
+	mMeanY += dy / static_cast<double>(mCount);
+
+	// The co-moments use the deviation from the old mean times the deviation from the new one:
+	mM2X += dx * (aPos.x() - mMeanX);
+	mM2Y += dy * (aPos.y() - mMeanY);
+	mM2XY += dx * (aPos.y() - mMeanY);
+}
+
+
+
+
+
+void Ensemble::PointStatistics::merge(const PointStatistics & aOther)
+{
+	if (aOther.mCount == 0)
+	{
+		return;
+	}
+	if (mCount == 0)
+	{
+		*this = aOther;
+		return;
+	}
+
+	// Chan et al.'s pairwise combination:
+	auto n1 = static_cast<double>(mCount);
+	auto n2 = static_cast<double>(aOther.mCount);
+	auto n = n1 + n2;
+	auto dx = aOther.mMeanX - mMeanX;
+	auto dy = aOther.mMeanY - mMeanY;
+	mMeanX += dx * n2 / n;
+	mMeanY += dy * n2 / n;
+	mM2X += aOther.mM2X + dx * dx * n1 * n2 / n;
+	mM2Y += aOther.mM2Y + dy * dy * n1 * n2 / n;
+	mM2XY += aOther.mM2XY + dx * dy * n1 * n2 / n;
+	mCount += aOther.mCount;
+}
+
+
+
+
+
+LeastSquares::PointCovariance Ensemble::PointStatistics::covariance() const
+{
+	LeastSquares::PointCovariance res;
+	if (mCount < 2)
+	{
+		return res;
+	}
+	auto denom = static_cast<double>(mCount - 1);
+	res.mVarX = mM2X / denom;
+	res.mVarY = mM2Y / denom;
+	res.mCovXY = mM2XY / denom;
+	res.mIsDetermined = true;
+	return res;
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Ensemble:
+
+Ensemble::Ensemble(const SpringNet & aNet, const Settings & aSettings):
+	mSettings(aSettings),
+	mBaseNet(aNet)
+{
+	auto res = mBaseLeastSquares.solve(mBaseNet, mSettings.mTolerance, mSettings.mMaxIterations);
+	if (!res.mHasConverged)
+	{
+		throw std::runtime_error("The least-squares solve of the net does not converge.");
+	}
+	mBasePositions = mBaseNet.positions();
+	mStatistics.resize(mBaseNet.numPoints());
+	mSettings.mNumScatterSamples = std::min(mSettings.mNumScatterSamples, mSettings.mNumSamples);
+}
+
+
+
+
+
+Ensemble::~Ensemble()
+{
+	stop();
+}
+
+
+
+
+
+void Ensemble::start()
+{
+	stop();
+	mShouldStop = false;
+	auto numLanes = mSettings.mNumThreads;
+	if (numLanes == 0)
+	{
+		numLanes = TaskScheduler::instance().numThreads();
+	}
+	numLanes = std::min(numLanes, std::max<size_t>(numBlocks(), 1));
+	mSettings.mNumThreads = numLanes;
+	mLanes.clear();
+	for (size_t i = 0; i < numLanes; ++i)
+	{
+		mLanes.push_back(std::make_unique<Lane>(Lane{mBaseNet, mBaseLeastSquares}));
+	}
+	for (size_t i = 0; i < numLanes; ++i)
+	{
+		mTasks.run([this, i]() { laneTask(i); });
+	}
+}
+
+
+
+
+
+void Ensemble::stop()
+{
+	mShouldStop = true;
+	mTasks.cancelAndWait();
+
+	// The blocks after a gap will never be merged, so that the statistics stay in the sample order;
+	// the next start() takes the blocks from the gap:
+	std::lock_guard lock(mMtx);
+	mPendingBlocks.clear();
+	mIdleLanes.clear();
+	mNextBlock = mNumMergedBlocks;
+}
+
+
+
+
+
+size_t Ensemble::numFailedSamples() const
+{
+	std::lock_guard lock(mMtx);
+	return mNumFailed;
+}
+
+
+
+
+
+std::vector<Ensemble::PointStatistics> Ensemble::statistics() const
+{
+	std::lock_guard lock(mMtx);
+	return mStatistics;
+}
+
+
+
+
+
+std::vector<std::vector<QPointF>> Ensemble::scatterSamples() const
+{
+	std::lock_guard lock(mMtx);
+	return mScatterSamples;
+}
+
+
+
+
+
+void Ensemble::laneTask(size_t aLaneIdx)
+{
+	auto maxPending = MAX_PENDING_BLOCKS_PER_LANE * mSettings.mNumThreads;
+	size_t blockIdx;
+	{
+		std::lock_guard lock(mMtx);
+		if (mShouldStop || (mNextBlock >= numBlocks()))
+		{
+			return;
+		}
+		if (mNextBlock >= mNumMergedBlocks + maxPending)
+		{
+			// Don't hold a worker waiting for the merging, mergeBlock() resumes the lane:
+			mIdleLanes.push_back(aLaneIdx);
+			return;
+		}
+		blockIdx = mNextBlock++;
+	}
+	auto & lane = *mLanes[aLaneIdx];
+	BlockResult result;
+	if (!processBlock(blockIdx, lane.mNet, lane.mLeastSquares, result))
+	{
+		return;
+	}
+	mergeBlock(blockIdx, std::move(result));
+	mTasks.run([this, aLaneIdx]() { laneTask(aLaneIdx); });
+}
+
+
+
+
+
+bool Ensemble::processBlock(size_t aBlockIdx, SpringNet & aNet, LeastSquares & aLeastSquares, BlockResult & aResult)
+{
+	TRACE_SCOPE("ensembleBlock");
+	aResult.mStatistics.resize(aNet.numPoints());
+	auto firstSample = aBlockIdx * BLOCK_SIZE;
+	auto endSample = std::min(firstSample + BLOCK_SIZE, mSettings.mNumSamples);
+	auto numS = aNet.numSprings();
+	for (auto sampleIdx = firstSample; sampleIdx < endSample; ++sampleIdx)
+	{
+		if (mShouldStop)
+		{
+			return false;
+		}
+
+		// Perturb the lengths and solve, starting from the unperturbed solution:
+		SampleRandom rnd(mSettings.mSeed, sampleIdx);
+		for (size_t springIdx = 0; springIdx < numS; ++springIdx)
+		{
+			const auto & baseSpring = mBaseNet.spring(springIdx);
+			auto force = baseSpring.force();
+			auto idealLength = baseSpring.idealLength();
+			if (force > 0)
+			{
+				auto sigma = (mSettings.mSigmaConstant + mSettings.mSigmaRelative * idealLength) / std::sqrt(force);
+				idealLength += sigma * rnd.normal();
+			}
+			aNet.setSpringParams(springIdx, idealLength, force);
+		}
+		aNet.setPositions(mBasePositions);
+		LeastSquares::SolveResult res;
+		try
+		{
+			res = aLeastSquares.solve(aNet, mSettings.mTolerance, mSettings.mMaxIterations);
+		}
+		catch (const std::exception &)
+		{
+			// A numerically singular sample, leave it out
+		}
+		if ((res.mNumFactorizations > 0) || (res.mNumRankOneUpdates > 0))
+		{
+			aLeastSquares.restoreFactorization(mBaseLeastSquares);
+		}
+		if (!res.mHasConverged)
+		{
+			aResult.mNumFailed += 1;
+			continue;
+		}
+
+		// Accumulate:
+		const auto & points = aNet.points();
+		auto numP = points.size();
+		for (size_t ptIdx = 0; ptIdx < numP; ++ptIdx)
+		{
+			aResult.mStatistics[ptIdx].add(points[ptIdx]);
+		}
+		if (sampleIdx < mSettings.mNumScatterSamples)
+		{
+			aResult.mScatterSamples.push_back(aNet.positions());
+		}
+	}
+	return true;
+}
+
+
+
+
+
+void Ensemble::mergeBlock(size_t aBlockIdx, BlockResult && aResult)
+{
+	std::vector<size_t> idleLanes;
+	{
+		std::lock_guard lock(mMtx);
+		if (mShouldStop)
+		{
+			return;
+		}
+		mPendingBlocks.emplace(aBlockIdx, std::move(aResult));
+		while (true)
+		{
+			auto itr = mPendingBlocks.find(mNumMergedBlocks);
+			if (itr == mPendingBlocks.end())
+			{
+				break;
+			}
+			auto & block = itr->second;
+			auto numP = mStatistics.size();
+			for (size_t ptIdx = 0; ptIdx < numP; ++ptIdx)
+			{
+				mStatistics[ptIdx].merge(block.mStatistics[ptIdx]);
+			}
+			for (auto & positions: block.mScatterSamples)
+			{
+				mScatterSamples.push_back(std::move(positions));
+			}
+			mNumFailed += block.mNumFailed;
+			mPendingBlocks.erase(itr);
+			mNumMergedBlocks += 1;
+			mNumMergedSamples = std::min(mNumMergedBlocks * BLOCK_SIZE, mSettings.mNumSamples);
+		}
+		std::swap(idleLanes, mIdleLanes);
+	}
+	for (auto laneIdx: idleLanes)
+	{
+		mTasks.run([this, laneIdx]() { laneTask(laneIdx); });
+	}
+}
+
+
+
+
+
+size_t Ensemble::numBlocks() const
+{
+	return (mSettings.mNumSamples + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <QPointF>
+
+#include "LeastSquares.hpp"
+#include "SpringNet.hpp"
+#include "TaskScheduler.hpp"
+
+
+
+
+
+/** Monte Carlo estimate of the precision of the adjusted points: the ideal lengths of all the springs are perturbed
+by random measurement errors, the net is re-solved, and the statistics of the resulting point positions are collected.
+The samples are solved in parallel, by the tasks of the shared TaskScheduler at the Solve priority, one block of samples
+per task. The tasks form mNumThreads chains (lanes), each lane owning a copy of the net and of the least-squares
+factorization and queueing its next block when done; each sample is warm-started from the unperturbed solution, so usually only a few triangular solves
+are needed per sample.
+The statistics are kept as running (Welford) accumulators, so memory doesn't grow with the number of samples.
+The samples are processed in fixed-size blocks that are merged strictly in their order, and each sample's random
+errors depend only on the seed and the sample's index, so the results are the same regardless of the number of threads
+and of their timing. */
+class Ensemble
+{
+public:
+
+	/** The parameters of the ensemble. */
+	struct Settings
+	{
+		size_t mNumSamples = 1000;
+
+		/** The standard deviation of a length measurement is
+		(mSigmaConstant + mSigmaRelative * idealLength) / sqrt(force),
+		so that the force acts as the measurement's weight, same as in the least-squares adjustment. */
+		double mSigmaConstant = 0.01;
+		double mSigmaRelative = 0;
+
+		/** The seed for the random measurement errors. */
+		uint64_t mSeed = 1;
+
+		/** The number of blocks solved in parallel, 0 for the number of the scheduler's threads. */
+		size_t mNumThreads = 0;
+
+		/** How many of the first samples' positions are kept, for drawing them as a scatter plot. */
+		size_t mNumScatterSamples = 100;
+
+		double mTolerance = 1e-6;
+		size_t mMaxIterations = 100;
+	};
+
+
+	/** The running statistics of a single point's position. */
+	struct PointStatistics
+	{
+		size_t mCount = 0;
+		double mMeanX = 0;
+		double mMeanY = 0;
+
+		/** The sums of the squared (co-)deviations from the mean. */
+		double mM2X = 0;
+		double mM2Y = 0;
+		double mM2XY = 0;
+
+		/** Adds a single sample of the position. */
+		void add(QPointF aPos);
+
+		/** Adds all the samples summarized by aOther. */
+		void merge(const PointStatistics & aOther);
+
+		QPointF mean() const { return {mMeanX, mMeanY}; }
+
+		/** Returns the sample covariance; undetermined if there are less than two samples. */
+		LeastSquares::PointCovariance covariance() const;
+	};
+
+
+	/** Prepares the ensemble for the specified net, which is copied; the copy is solved by least squares, to get the
+	unperturbed solution that the samples start from.
+	Throws a std::runtime_error if the net cannot be solved (it is not fully determined). */
+	Ensemble(const SpringNet & aNet, const Settings & aSettings);
+
+	/** Stops the workers, if running. */
+	~Ensemble();
+
+	/** Starts the workers. */
+	void start();
+
+	/** Stops the workers and waits for the running blocks to finish. The statistics of the already merged blocks stay. */
+	void stop();
+
+	/** Returns true once all the samples have been processed. */
+	bool isFinished() const { return (mNumMergedSamples.load() == mSettings.mNumSamples); }
+
+	const Settings & settings() const { return mSettings; }
+
+	/** Returns the number of samples included in the statistics so far. */
+	size_t numSamplesDone() const { return mNumMergedSamples.load(); }
+
+	/** Returns the number of samples (included in numSamplesDone()) whose solve didn't converge; they are left out of
+	the statistics. */
+	size_t numFailedSamples() const;
+
+	/** Returns the positions of the points in the unperturbed solution. */
+	const std::vector<QPointF> & basePositions() const { return mBasePositions; }
+
+	/** Returns a snapshot of the statistics of all the points, over the samples merged so far. */
+	std::vector<PointStatistics> statistics() const;
+
+	/** Returns a snapshot of the positions of the points in the scatter samples merged so far. */
+	std::vector<std::vector<QPointF>> scatterSamples() const;
+
+
+protected:
+
+	/** The statistics of a block of samples, before it is merged. */
+	struct BlockResult
+	{
+		std::vector<PointStatistics> mStatistics;
+		std::vector<std::vector<QPointF>> mScatterSamples;
+		size_t mNumFailed = 0;
+	};
+
+
+	/** The state owned by a single lane of the block tasks. */
+	struct Lane
+	{
+		SpringNet mNet;
+		LeastSquares mLeastSquares;
+	};
+
+
+	Settings mSettings;
+
+	/** The copy of the net, solved without perturbations. The workers copy it. */
+	SpringNet mBaseNet;
+
+	/** The least-squares state after solving mBaseNet. Each lane copies it once, and whenever a sample has changed
+	the factorization, restores only the numeric factor from it (keeping its own copy of the symbolic analysis), so
+	that each sample is solved the same way regardless of which worker solves it. */
+	LeastSquares mBaseLeastSquares;
+
+	std::vector<QPointF> mBasePositions;
+
+	/** The lanes, created by start(). */
+	std::vector<std::unique_ptr<Lane>> mLanes;
+
+	/** The block tasks of all the lanes. */
+	TaskScheduler::TaskGroup mTasks{TaskScheduler::Priority::Solve};
+
+	/** Set to stop the workers. */
+	std::atomic<bool> mShouldStop = false;
+
+	/** Protects the members below. */
+	mutable std::mutex mMtx;
+
+	/** The lanes waiting for the merging to catch up, before they may take a new block; resumed by mergeBlock(). */
+	std::vector<size_t> mIdleLanes;
+
+	/** The index of the next block to be taken by a worker. */
+	size_t mNextBlock = 0;
+
+	/** The number of blocks merged into the statistics; the blocks are merged in their order. */
+	size_t mNumMergedBlocks = 0;
+
+	/** The blocks finished out of order, waiting for the blocks before them to be merged. */
+	std::map<size_t, BlockResult> mPendingBlocks;
+
+	std::vector<PointStatistics> mStatistics;
+	std::vector<std::vector<QPointF>> mScatterSamples;
+	size_t mNumFailed = 0;
+
+	/** The number of samples in the merged blocks. Readable without locking. */
+	std::atomic<size_t> mNumMergedSamples = 0;
+
+
+	/** A single task of the specified lane: takes the next block and solves it, then queues the lane's next task.
+	If too many blocks wait for merging, parks the lane in mIdleLanes instead. */
+	void laneTask(size_t aLaneIdx);
+
+	/** Solves the samples of the specified block, using the lane's own copies of the net and least-squares state.
+	Returns false if stopped before the whole block was processed. */
+	bool processBlock(size_t aBlockIdx, SpringNet & aNet, LeastSquares & aLeastSquares, BlockResult & aResult);
+
+	/** Merges the block's result into the statistics, followed by any pending blocks that can be merged after it.
+	Resumes the idle lanes. */
+	void mergeBlock(size_t aBlockIdx, BlockResult && aResult);
+
+	/** Returns the number of blocks that the samples are split into. */
+	size_t numBlocks() const;
+};
@@ -0,0 +1,63 @@
+#include "EnsembleDlg.hpp"
+#include "ui_EnsembleDlg.h"
+
+
+
+
+
+std::optional<Ensemble::Settings> EnsembleDlg::ask(
+	QWidget * aParent,
+	const Ensemble::Settings & aSettings
+)
+{
+	EnsembleDlg dlg(aParent, aSettings);
+	if (dlg.exec() == QDialog::Rejected)
+	{
+		return std::nullopt;
+	}
+	else
+	{
+		return dlg.settings(aSettings);
+	}
+}
+
+
+
+
+
+EnsembleDlg::EnsembleDlg(QWidget * aParent, const Ensemble::Settings & aSettings):
+	Super(aParent),
+	mUI(new Ui::EnsembleDlg)
+{
+	mUI->setupUi(this);
+	mUI->eNumSamples->setText(QString::number(aSettings.mNumSamples));
+	mUI->eSigmaConstant->setText(QString::number(aSettings.mSigmaConstant));
+	mUI->eSigmaRelative->setText(QString::number(aSettings.mSigmaRelative));
+	mUI->eSeed->setText(QString::number(aSettings.mSeed));
+	mUI->eNumThreads->setText(QString::number(aSettings.mNumThreads));
+	mUI->eNumSamples->selectAll();
+}
+
+
+
+
+
+EnsembleDlg::~EnsembleDlg()
+{
+	// Nothing explicit needed yet
+}
+
+
+
+
+
+Ensemble::Settings EnsembleDlg::settings(const Ensemble::Settings & aSettings) const
+{
+	auto res = aSettings;
+	res.mNumSamples = mUI->eNumSamples->text().toULongLong();
+	res.mSigmaConstant = mUI->eSigmaConstant->text().toDouble();
+	res.mSigmaRelative = mUI->eSigmaRelative->text().toDouble();
+	res.mSeed = mUI->eSeed->text().toULongLong();
+	res.mNumThreads = mUI->eNumThreads->text().toULongLong();
+	return res;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QDialog>
+
+#include "Ensemble.hpp"
+
+
+
+
+// fwd:
+namespace Ui {
+class EnsembleDlg;
+}
+
+
+
+
+
+/** Dialog for asking the user for the parameters of a Monte Carlo ensemble. */
+class EnsembleDlg:
+	public QDialog
+{
+	Q_OBJECT
+
+	using Super = QDialog;
+
+
+public:
+
+	/** Shows the dialog with the specified values prefilled.
+	Returns the settings with the values the user provided, or nullopt if the user cancelled. */
+	static std::optional<Ensemble::Settings> ask(
+		QWidget * aParent,
+		const Ensemble::Settings & aSettings
+	);
+
+
+private:
+
+	/** The Qt-managed UI. */
+	std::unique_ptr<Ui::EnsembleDlg> mUI;
+
+	explicit EnsembleDlg(QWidget * aParent, const Ensemble::Settings & aSettings);
+	~EnsembleDlg();
+
+	/** Returns aSettings updated with the values currently entered by the user. */
+	Ensemble::Settings settings(const Ensemble::Settings & aSettings) const;
+};
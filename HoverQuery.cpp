@@ -0,0 +1,399 @@
+#include "HoverQuery.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Geometry.hpp"
+
+
+
+
+
+namespace {
+
+/** The average number of points per cell of the grid, and the max number of cells in either direction. */
+static const size_t GRID_POINTS_PER_CELL = 4;
+static const size_t GRID_MAX_CELLS_PER_SIDE = 4096;
+
+/** How many cells around the cursor's cell a fresh query searches at least; the margin lets the following queries
+reuse the window while the cursor moves within the cell. */
+static const size_t MIN_WINDOW_RADIUS = 1;
+
+}  // anonymous namespace
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// HoverQuery::Grid:
+
+void HoverQuery::Grid::build(const SpringNet & aNet)
+{
+	mNumCellsX = 0;
+	mNumCellsY = 0;
+	mPointStarts.clear();
+	mPoints.clear();
+	mSpringStarts.clear();
+	mSprings.clear();
+	mAngleStarts.clear();
+	mAngles.clear();
+	const auto & points = aNet.points();
+	if (points.empty())
+	{
+		return;
+	}
+
+	// The extent of the points and the angle markers (which may lie outside of the points' bounds):
+	std::vector<QPointF> markers;
+	markers.reserve(aNet.numAngles());
+	for (const auto & angle: aNet.angles())
+	{
+		markers.push_back(angle.markerPos(aNet));
+	}
+	auto minX = points[0].x(), maxX = minX;
+	auto minY = points[0].y(), maxY = minY;
+	auto extend = [&](const auto & aPt)
+	{
+		minX = std::min(minX, aPt.x());
+		minY = std::min(minY, aPt.y());
+		maxX = std::max(maxX, aPt.x());
+		maxY = std::max(maxY, aPt.y());
+	};
+	std::for_each(points.begin(), points.end(), extend);
+	std::for_each(markers.begin(), markers.end(), extend);
+	mOrigin = QPointF(minX, minY);
+
+	// Square cells, about GRID_POINTS_PER_CELL points per cell if the points were spread evenly:
+	auto width = maxX - minX;
+	auto height = maxY - minY;
+	auto numCells = static_cast<double>(std::max<size_t>(1, points.size() / GRID_POINTS_PER_CELL));
+	mCellSize = std::max(std::sqrt(width * height / numCells), std::max(width, height) / numCells);
+	if (mCellSize <= 0)
+	{
+		mCellSize = 1;
+	}
+	mNumCellsX = std::min(GRID_MAX_CELLS_PER_SIDE, static_cast<size_t>(width / mCellSize) + 1);
+	mNumCellsY = std::min(GRID_MAX_CELLS_PER_SIDE, static_cast<size_t>(height / mCellSize) + 1);
+	mCellSize = std::max({mCellSize, width / mNumCellsX, height / mNumCellsY});
+	auto numGridCells = mNumCellsX * mNumCellsY;
+
+	// Counting sort of the points and the markers by their cell:
+	auto sortByCell = [this, numGridCells](const auto & aPositions, std::vector<size_t> & aStarts, std::vector<uint32_t> & aObjects)
+	{
+		auto num = aPositions.size();
+		std::vector<uint32_t> objectCells(num);
+		aStarts.assign(numGridCells + 1, 0);
+		for (size_t idx = 0; idx < num; ++idx)
+		{
+			objectCells[idx] = static_cast<uint32_t>(cellY(aPositions[idx].y()) * mNumCellsX + cellX(aPositions[idx].x()));
+			aStarts[objectCells[idx] + 1] += 1;
+		}
+		for (size_t cell = 1; cell <= numGridCells; ++cell)
+		{
+			aStarts[cell] += aStarts[cell - 1];
+		}
+		auto cursors = aStarts;
+		aObjects.resize(num);
+		for (size_t idx = 0; idx < num; ++idx)
+		{
+			aObjects[cursors[objectCells[idx]]++] = static_cast<uint32_t>(idx);
+		}
+	};
+	sortByCell(points, mPointStarts, mPoints);
+	sortByCell(markers, mAngleStarts, mAngles);
+
+	// The springs go into every cell they cross; count them first, then fill in:
+	const auto & springs = aNet.springs();
+	auto numS = springs.size();
+	mSpringStarts.assign(numGridCells + 1, 0);
+	for (size_t idx = 0; idx < numS; ++idx)
+	{
+		forEachSegmentCell(springs[idx].point1(aNet), springs[idx].point2(aNet), [this](size_t aCell)
+			{
+				mSpringStarts[aCell + 1] += 1;
+			}
+		);
+	}
+	for (size_t cell = 1; cell <= numGridCells; ++cell)
+	{
+		mSpringStarts[cell] += mSpringStarts[cell - 1];
+	}
+	auto cursors = mSpringStarts;
+	mSprings.resize(mSpringStarts.back());
+	for (size_t idx = 0; idx < numS; ++idx)
+	{
+		forEachSegmentCell(springs[idx].point1(aNet), springs[idx].point2(aNet), [this, &cursors, idx](size_t aCell)
+			{
+				mSprings[cursors[aCell]++] = static_cast<uint32_t>(idx);
+			}
+		);
+	}
+}
+
+
+
+
+
+size_t HoverQuery::Grid::cellX(double aX) const
+{
+	auto cell = std::floor((aX - mOrigin.x()) / mCellSize);
+	return static_cast<size_t>(std::clamp(cell, 0.0, static_cast<double>(mNumCellsX - 1)));
+}
+
+
+
+
+
+size_t HoverQuery::Grid::cellY(double aY) const
+{
+	auto cell = std::floor((aY - mOrigin.y()) / mCellSize);
+	return static_cast<size_t>(std::clamp(cell, 0.0, static_cast<double>(mNumCellsY - 1)));
+}
+
+
+
+
+
+QRectF HoverQuery::Grid::cellsRect(size_t aX0, size_t aY0, size_t aX1, size_t aY1) const
+{
+	return QRectF(
+		QPointF(mOrigin.x() + aX0 * mCellSize, mOrigin.y() + aY0 * mCellSize),
+		QPointF(mOrigin.x() + (aX1 + 1) * mCellSize, mOrigin.y() + (aY1 + 1) * mCellSize)
+	);
+}
+
+
+
+
+
+void HoverQuery::Grid::appendCell(
+	size_t aCellX, size_t aCellY,
+	std::vector<uint32_t> & aPoints, std::vector<uint32_t> & aSprings, std::vector<uint32_t> & aAngles
+) const
+{
+	auto cell = aCellY * mNumCellsX + aCellX;
+	aPoints.insert(aPoints.end(), mPoints.begin() + mPointStarts[cell], mPoints.begin() + mPointStarts[cell + 1]);
+	aSprings.insert(aSprings.end(), mSprings.begin() + mSpringStarts[cell], mSprings.begin() + mSpringStarts[cell + 1]);
+	aAngles.insert(aAngles.end(), mAngles.begin() + mAngleStarts[cell], mAngles.begin() + mAngleStarts[cell + 1]);
+}
+
+
+
+
+
+template <typename Fn>
+void HoverQuery::Grid::forEachSegmentCell(QPointF aPt1, QPointF aPt2, Fn && aFn) const
+{
+	// Walk the rows of cells that the segment spans, in each row take the cells between where the segment enters
+	// and leaves the row:
+	auto minY = std::min(aPt1.y(), aPt2.y());
+	auto maxY = std::max(aPt1.y(), aPt2.y());
+	auto y0 = cellY(minY);
+	auto y1 = cellY(maxY);
+	auto dx = aPt2.x() - aPt1.x();
+	auto dy = aPt2.y() - aPt1.y();
+	for (auto y = y0; y <= y1; ++y)
+	{
+		auto xa = aPt1.x();
+		auto xb = aPt2.x();
+		if (y0 != y1)
+		{
+			auto rowTop = (y == y0) ? minY : mOrigin.y() + y * mCellSize;
+			auto rowBottom = (y == y1) ? maxY : mOrigin.y() + (y + 1) * mCellSize;
+			xa = aPt1.x() + (rowTop - aPt1.y()) * dx / dy;
+			xb = aPt1.x() + (rowBottom - aPt1.y()) * dx / dy;
+		}
+		auto x0 = cellX(std::min(xa, xb));
+		auto x1 = cellX(std::max(xa, xb));
+		for (auto x = x0; x <= x1; ++x)
+		{
+			aFn(y * mNumCellsX + x);
+		}
+	}
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// HoverQuery:
+
+HoverQuery::Result HoverQuery::query(const SpringNet & aNet, QPointF aPos, double aSnapDistSq)
+{
+	if (
+		!mIsGridValid ||
+		(mTopologyVersion != aNet.topologyVersion()) ||
+		(mGeometryVersion != aNet.geometryVersion())
+	)
+	{
+		mGrid.build(aNet);
+		mTopologyVersion = aNet.topologyVersion();
+		mGeometryVersion = aNet.geometryVersion();
+		mIsGridValid = true;
+		mIsWindowValid = false;
+	}
+
+	Result res;
+	if (mGrid.isEmpty())
+	{
+		return res;
+	}
+
+	// The cursor has most likely moved only a little, try the previous window first:
+	if (mIsWindowValid && queryWindow(aNet, aPos, aSnapDistSq, res))
+	{
+		return res;
+	}
+
+	// Search a window around the cursor, growing it until the answer is guaranteed (at the latest once it covers the
+	// whole grid):
+	auto cx = mGrid.cellX(aPos.x());
+	auto cy = mGrid.cellY(aPos.y());
+	for (auto radius = MIN_WINDOW_RADIUS; ; radius *= 2)
+	{
+		auto x0 = cx - std::min(cx, radius);
+		auto y0 = cy - std::min(cy, radius);
+		auto x1 = std::min(mGrid.numCellsX() - 1, cx + radius);
+		auto y1 = std::min(mGrid.numCellsY() - 1, cy + radius);
+		fillWindow(x0, y0, x1, y1);
+		mIsWindowValid = true;
+		auto isWholeGrid = (x0 == 0) && (y0 == 0) && (x1 + 1 == mGrid.numCellsX()) && (y1 + 1 == mGrid.numCellsY());
+		if (queryWindow(aNet, aPos, aSnapDistSq, res) || isWholeGrid)
+		{
+			return res;
+		}
+	}
+}
+
+
+
+
+
+void HoverQuery::fillWindow(size_t aX0, size_t aY0, size_t aX1, size_t aY1)
+{
+	mWindow.mX0 = aX0;
+	mWindow.mY0 = aY0;
+	mWindow.mX1 = aX1;
+	mWindow.mY1 = aY1;
+	mWindow.mRect = mGrid.cellsRect(aX0, aY0, aX1, aY1);
+	mWindow.mPoints.clear();
+	mWindow.mSprings.clear();
+	mWindow.mAngles.clear();
+	for (auto y = aY0; y <= aY1; ++y)
+	{
+		for (auto x = aX0; x <= aX1; ++x)
+		{
+			mGrid.appendCell(x, y, mWindow.mPoints, mWindow.mSprings, mWindow.mAngles);
+		}
+	}
+
+	// A spring crossing several cells has been added once for each:
+	std::sort(mWindow.mSprings.begin(), mWindow.mSprings.end());
+	mWindow.mSprings.erase(std::unique(mWindow.mSprings.begin(), mWindow.mSprings.end()), mWindow.mSprings.end());
+}
+
+
+
+
+
+bool HoverQuery::queryWindow(const SpringNet & aNet, QPointF aPos, double aSnapDistSq, Result & aResult) const
+{
+	// Any object not registered in the window is at least this far, unless the window reaches the grid's edge
+	// (there are no objects beyond the edge):
+	auto margin = std::numeric_limits<double>::infinity();
+	if (mWindow.mX0 > 0)
+	{
+		margin = std::min(margin, aPos.x() - mWindow.mRect.left());
+	}
+	if (mWindow.mY0 > 0)
+	{
+		margin = std::min(margin, aPos.y() - mWindow.mRect.top());
+	}
+	if (mWindow.mX1 + 1 < mGrid.numCellsX())
+	{
+		margin = std::min(margin, mWindow.mRect.right() - aPos.x());
+	}
+	if (mWindow.mY1 + 1 < mGrid.numCellsY())
+	{
+		margin = std::min(margin, mWindow.mRect.bottom() - aPos.y());
+	}
+	if (margin < 0)
+	{
+		return false;
+	}
+	auto marginSq = margin * margin;
+
+	// The nearest point and spring; on a tie the lower index wins, same as in SpringNet's full scans:
+	Result res;
+	for (auto idx: mWindow.mPoints)
+	{
+		auto distSq = Geometry::distanceSquared(aNet.point(idx), aPos);
+		if ((distSq < res.mPointDistSq) || ((distSq == res.mPointDistSq) && (idx < res.mPointIdx)))
+		{
+			res.mPointDistSq = distSq;
+			res.mPointIdx = idx;
+		}
+	}
+	if (!(res.mPointDistSq < marginSq))
+	{
+		return false;
+	}
+	if (aNet.numSprings() > 0)
+	{
+		for (auto idx: mWindow.mSprings)
+		{
+			auto distSq = aNet.spring(idx).distanceSquared(aNet, aPos);
+			if ((distSq < res.mSpringDistSq) || ((distSq == res.mSpringDistSq) && (idx < res.mSpringIdx)))
+			{
+				res.mSpringDistSq = distSq;
+				res.mSpringIdx = idx;
+			}
+		}
+		if (!(res.mSpringDistSq < marginSq))
+		{
+			return false;
+		}
+	}
+
+	// Decide the object, same as SpringNet::nearestObject():
+	if ((aNet.numSprings() == 0) || (res.mPointDistSq < aSnapDistSq))
+	{
+		res.mObject = {SpringNet::ObjectType::Point, res.mPointIdx};
+		aResult = res;
+		return true;
+	}
+	if (aNet.numAngles() > 0)
+	{
+		// The angles can only be picked by their marker, the one with the lowest index within the snap distance:
+		if (aSnapDistSq > marginSq)
+		{
+			return false;
+		}
+		auto angleIdx = aNet.numAngles();
+		for (auto idx: mWindow.mAngles)
+		{
+			if ((idx < angleIdx) && (Geometry::distanceSquared(aPos, aNet.angle(idx).markerPos(aNet)) < aSnapDistSq))
+			{
+				angleIdx = idx;
+			}
+		}
+		if (angleIdx < aNet.numAngles())
+		{
+			res.mObject = {SpringNet::ObjectType::Angle, angleIdx};
+			aResult = res;
+			return true;
+		}
+	}
+	if ((res.mSpringDistSq < aSnapDistSq) || (res.mSpringDistSq < res.mPointDistSq))
+	{
+		res.mObject = {SpringNet::ObjectType::Spring, res.mSpringIdx};
+	}
+	else
+	{
+		res.mObject = {SpringNet::ObjectType::Point, res.mPointIdx};
+	}
+	aResult = res;
+	return true;
+}
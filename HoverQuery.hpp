@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <QPointF>
+#include <QRectF>
+
+#include "SpringNet.hpp"
+
+
+
+
+
+/** Answers the "what is under the mouse" queries of the hover, snapping and picking, for a single SpringNet.
+A single query finds the nearest point, the nearest spring and the angle marker within the snap distance, and decides
+the nearest object the same way as SpringNet::nearestObject() does.
+The objects are kept in a uniform grid, rebuilt only when the net's topology or geometry changes. Each query remembers
+the window of cells it has searched and the objects found in there; as long as the next query's answers are provably
+within the same window (the cursor has moved less than about a cell), the window's objects are reused without
+touching the grid at all. */
+class HoverQuery
+{
+public:
+
+	/** The answer to a single query. */
+	struct Result
+	{
+		/** The object that SpringNet::nearestObject() returns for the same position and snap distance. */
+		std::pair<SpringNet::ObjectType, size_t> mObject = {SpringNet::ObjectType::None, 0};
+
+		/** The nearest point and the square of its distance; infinite distance if the net has no points. */
+		size_t mPointIdx = 0;
+		double mPointDistSq = std::numeric_limits<double>::infinity();
+
+		/** The nearest spring and the square of its distance; infinite distance if the net has no springs. */
+		size_t mSpringIdx = 0;
+		double mSpringDistSq = std::numeric_limits<double>::infinity();
+
+		/** Returns true if the nearest point is within the snap distance of the query (SpringNet::snapToPoint()). */
+		bool isPointWithin(double aSnapDistSq) const { return mPointDistSq < aSnapDistSq; }
+	};
+
+
+	/** Returns the objects nearest to aPos in aNet. aSnapDistSq is the square of the snap distance, in scene units. */
+	Result query(const SpringNet & aNet, QPointF aPos, double aSnapDistSq);
+
+
+protected:
+
+	/** A uniform grid over the points, springs and angle markers of a net.
+	Points and markers are registered in the cell that contains them, springs in every cell they cross, so that an
+	object that isn't registered in any cell of a rectangle doesn't reach into the rectangle. */
+	class Grid
+	{
+	public:
+
+		/** Builds the grid over the current positions of aNet's objects. */
+		void build(const SpringNet & aNet);
+
+		bool isEmpty() const { return (mNumCellsX == 0); }
+		size_t numCellsX() const { return mNumCellsX; }
+		size_t numCellsY() const { return mNumCellsY; }
+
+		size_t cellX(double aX) const;
+		size_t cellY(double aY) const;
+
+		/** Returns the scene rect covered by the cells [aX0 .. aX1] x [aY0 .. aY1]. */
+		QRectF cellsRect(size_t aX0, size_t aY0, size_t aX1, size_t aY1) const;
+
+		/** Appends the objects registered in the specified cell to the vectors. */
+		void appendCell(
+			size_t aCellX, size_t aCellY,
+			std::vector<uint32_t> & aPoints, std::vector<uint32_t> & aSprings, std::vector<uint32_t> & aAngles
+		) const;
+
+
+	protected:
+
+		/** The top-left corner of the cell [0, 0]. */
+		QPointF mOrigin;
+		double mCellSize = 1;
+		size_t mNumCellsX = 0;
+		size_t mNumCellsY = 0;
+
+		/** The objects in each cell, in the CSR layout: the points in cell C are
+		mPoints[mPointStarts[C] .. mPointStarts[C + 1]), same for the springs and angles. */
+		std::vector<size_t> mPointStarts;
+		std::vector<uint32_t> mPoints;
+		std::vector<size_t> mSpringStarts;
+		std::vector<uint32_t> mSprings;
+		std::vector<size_t> mAngleStarts;
+		std::vector<uint32_t> mAngles;
+
+
+		/** Calls aFn(cellIdx) for each cell that the segment from aPt1 to aPt2 crosses. */
+		template <typename Fn>
+		void forEachSegmentCell(QPointF aPt1, QPointF aPt2, Fn && aFn) const;
+	};
+
+
+	/** The part of the grid searched by the last query, with all the objects registered in there. */
+	struct Window
+	{
+		/** The cells of the window, inclusive. */
+		size_t mX0 = 0, mY0 = 0, mX1 = 0, mY1 = 0;
+
+		/** The scene rect covered by the window's cells. */
+		QRectF mRect;
+
+		/** The objects registered in the window's cells; each spring only once. */
+		std::vector<uint32_t> mPoints;
+		std::vector<uint32_t> mSprings;
+		std::vector<uint32_t> mAngles;
+	};
+
+
+	Grid mGrid;
+
+	/** The versions of the net that mGrid has been built for; mGrid is only valid if mIsGridValid. */
+	uint64_t mTopologyVersion = 0;
+	uint64_t mGeometryVersion = 0;
+	bool mIsGridValid = false;
+
+	/** The window searched by the last query, valid only if mIsWindowValid. */
+	Window mWindow;
+	bool mIsWindowValid = false;
+
+
+	/** Fills mWindow with the objects in the cells [aX0 .. aX1] x [aY0 .. aY1]. */
+	void fillWindow(size_t aX0, size_t aY0, size_t aX1, size_t aY1);
+
+	/** Evaluates the query on the objects in mWindow. Returns false if the window cannot guarantee the answer, because
+	an object outside of it might be nearer, or an angle marker outside of it might be within the snap distance. */
+	bool queryWindow(const SpringNet & aNet, QPointF aPos, double aSnapDistSq, Result & aResult) const;
+};
@@ -0,0 +1,184 @@
+#include "InteractionRecording.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <QFile>
+
+
+
+
+
+static const char gRecordingHeader[] = "SpringAngles interaction recording\n";
+static const char gRecordingVersion[] = "1\n";
+
+
+
+
+
+namespace {
+
+/** All the event types, in the order of EventType. */
+static const InteractionRecording::EventType ALL_EVENT_TYPES[] =
+{
+	InteractionRecording::EventType::MouseMove,
+	InteractionRecording::EventType::MousePress,
+	InteractionRecording::EventType::MouseRelease,
+	InteractionRecording::EventType::MouseDblClick,
+	InteractionRecording::EventType::Wheel,
+};
+
+/** The number of fields on an event's line: type, time, pos x, pos y, button / delta, 6 transform components. */
+static const qsizetype NUM_EVENT_FIELDS = 11;
+
+}  // anonymous namespace
+
+
+
+
+
+InteractionRecording::InteractionRecording(QSize aViewportSize):
+	mViewportSize(aViewportSize)
+{
+}
+
+
+
+
+
+void InteractionRecording::saveToFile(const QString & aFileName) const
+{
+	QFile f(aFileName);
+	if (!f.open(QIODevice::WriteOnly))
+	{
+		throw std::runtime_error("Cannot open file for writing.");
+	}
+	saveToIO(f);
+}
+
+
+
+
+
+void InteractionRecording::loadFromFile(const QString & aFileName)
+{
+	QFile f(aFileName);
+	if (!f.open(QIODevice::ReadOnly))
+	{
+		throw std::runtime_error("Cannot open file for reading.");
+	}
+	loadFromIO(f);
+}
+
+
+
+
+
+const char * InteractionRecording::eventTypeName(EventType aType)
+{
+	switch (aType)
+	{
+		case EventType::MouseMove:     return "mouseMove";
+		case EventType::MousePress:    return "mousePress";
+		case EventType::MouseRelease:  return "mouseRelease";
+		case EventType::MouseDblClick: return "mouseDblClick";
+		case EventType::Wheel:         return "wheel";
+	}
+	return "unknown";
+}
+
+
+
+
+
+void InteractionRecording::saveToIO(QIODevice & aIO) const
+{
+	aIO.write(gRecordingHeader, sizeof(gRecordingHeader) - 1);
+	aIO.write(gRecordingVersion, sizeof(gRecordingVersion) - 1);
+	aIO.write(QByteArray::number(mViewportSize.width()) + " " + QByteArray::number(mViewportSize.height()) + "\n");
+
+	// One event per line:
+	for (const auto & e: mEvents)
+	{
+		const auto & t = e.mViewTransform;
+		aIO.write(
+			QByteArray(eventTypeName(e.mType)) + " " +
+			QByteArray::number(static_cast<qlonglong>(e.mTime.count())) + " " +
+			QByteArray::number(e.mPos.x(), 'g', 17) + " " +
+			QByteArray::number(e.mPos.y(), 'g', 17) + " " +
+			QByteArray::number(e.mButtonOrDelta) + " " +
+			QByteArray::number(t.m11(), 'g', 17) + " " +
+			QByteArray::number(t.m12(), 'g', 17) + " " +
+			QByteArray::number(t.m21(), 'g', 17) + " " +
+			QByteArray::number(t.m22(), 'g', 17) + " " +
+			QByteArray::number(t.dx(), 'g', 17) + " " +
+			QByteArray::number(t.dy(), 'g', 17) + "\n"
+		);
+	}
+}
+
+
+
+
+
+void InteractionRecording::loadFromIO(QIODevice & aIO)
+{
+	auto hdr = QByteArray(gRecordingHeader, sizeof(gRecordingHeader) - 1);
+	if (aIO.readLine().compare(hdr) != 0)
+	{
+		throw std::runtime_error("Not a SpringAngles interaction recording.");
+	}
+	if (aIO.readLine().compare(gRecordingVersion) != 0)
+	{
+		throw std::runtime_error("Unknown interaction recording version.");
+	}
+	auto viewport = aIO.readLine().trimmed().split(' ');
+	bool isWidthOK = false, isHeightOK = false;
+	if (viewport.size() == 2)
+	{
+		mViewportSize = QSize(viewport[0].toInt(&isWidthOK), viewport[1].toInt(&isHeightOK));
+	}
+	if (!isWidthOK || !isHeightOK)
+	{
+		throw std::runtime_error("Failed to read the viewport size.");
+	}
+
+	mEvents.clear();
+	while (!aIO.atEnd())
+	{
+		auto line = aIO.readLine().trimmed();
+		if (line.isEmpty())
+		{
+			continue;
+		}
+		auto fields = line.split(' ');
+		if (fields.size() != NUM_EVENT_FIELDS)
+		{
+			throw std::runtime_error("Malformed event: " + line.toStdString());
+		}
+		Event e{};
+		auto isTypeFound = false;
+		for (auto type: ALL_EVENT_TYPES)
+		{
+			if (fields[0] == eventTypeName(type))
+			{
+				e.mType = type;
+				isTypeFound = true;
+				break;
+			}
+		}
+		bool isOK[NUM_EVENT_FIELDS - 1];
+		e.mTime = std::chrono::microseconds(fields[1].toLongLong(&isOK[0]));
+		e.mPos = QPointF(fields[2].toDouble(&isOK[1]), fields[3].toDouble(&isOK[2]));
+		e.mButtonOrDelta = fields[4].toInt(&isOK[3]);
+		e.mViewTransform = QTransform(
+			fields[5].toDouble(&isOK[4]), fields[6].toDouble(&isOK[5]),
+			fields[7].toDouble(&isOK[6]), fields[8].toDouble(&isOK[7]),
+			fields[9].toDouble(&isOK[8]), fields[10].toDouble(&isOK[9])
+		);
+		if (!isTypeFound || (std::find(std::begin(isOK), std::end(isOK), false) != std::end(isOK)))
+		{
+			throw std::runtime_error("Malformed event: " + line.toStdString());
+		}
+		mEvents.push_back(e);
+	}
+}
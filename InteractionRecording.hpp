@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <QPointF>
+#include <QSize>
+#include <QTransform>
+
+
+
+
+
+// fwd:
+class QIODevice;
+class QString;
+
+
+
+
+
+/** A recorded stream of the mouse and wheel events of a CadGraphicsView, as received by its handlers.
+Recorded by CadGraphicsView::startRecording(), replayed by CadGraphicsView::replayEvent(), so that the latency of the
+handlers (hovering, dragging, snapping) can be measured on real user sessions, without a user.
+Each event keeps the view's transform at that time, so that the replay sees the same zoom and pan as the user did. */
+class InteractionRecording
+{
+public:
+
+	enum class EventType
+	{
+		MouseMove,
+		MousePress,
+		MouseRelease,
+		MouseDblClick,
+		Wheel,
+	};
+
+
+	struct Event
+	{
+		EventType mType;
+
+		/** The time since the recording has started. */
+		std::chrono::microseconds mTime;
+
+		/** The mouse position in scene coords; for Wheel, in viewport coords (the zoom is applied around it). */
+		QPointF mPos;
+
+		/** The mouse button (Qt::MouseButton) for the press, release and dbl-click; the wheel's angle delta for Wheel. */
+		int mButtonOrDelta;
+
+		/** The view's transform when the event was handled: after any panning it did, before any wheel zoom. */
+		QTransform mViewTransform;
+	};
+
+
+	/** Creates an empty recording of a view with the specified viewport size. */
+	explicit InteractionRecording(QSize aViewportSize = QSize());
+
+	QSize viewportSize() const { return mViewportSize; }
+	const std::vector<Event> & events() const { return mEvents; }
+
+	/** Appends the event to the recording. */
+	void addEvent(const Event & aEvent) { mEvents.push_back(aEvent); }
+
+	/** Writes the recording as text into the file. Throws a std::runtime_error on failure. */
+	void saveToFile(const QString & aFileName) const;
+
+	/** Reads the recording from the file, replacing the current contents. Throws a std::runtime_error on failure. */
+	void loadFromFile(const QString & aFileName);
+
+	/** Returns the name of the event type, as used in the file and the replay reports. */
+	static const char * eventTypeName(EventType aType);
+
+
+protected:
+
+	QSize mViewportSize;
+	std::vector<Event> mEvents;
+
+
+	void saveToIO(QIODevice & aIO) const;
+	void loadFromIO(QIODevice & aIO);
+};
@@ -0,0 +1,43 @@
+#include "LatencyStats.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+
+
+
+
+void LatencyStats::add(std::chrono::steady_clock::duration aDuration)
+{
+	mMs.push_back(std::chrono::duration<double, std::milli>(aDuration).count());
+}
+
+
+
+
+
+QJsonObject LatencyStats::toJson() const
+{
+	QJsonObject res;
+	res["count"] = static_cast<qint64>(mMs.size());
+	if (mMs.empty())
+	{
+		return res;
+	}
+	auto sorted = mMs;
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&sorted](double aPercent)
+	{
+		// The nearest-rank percentile:
+		auto rank = static_cast<size_t>(std::ceil(aPercent / 100 * sorted.size()));
+		return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+	};
+	res["meanMs"] = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+	res["p50Ms"] = percentile(50);
+	res["p90Ms"] = percentile(90);
+	res["p95Ms"] = percentile(95);
+	res["p99Ms"] = percentile(99);
+	res["maxMs"] = sorted.back();
+	return res;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <QJsonObject>
+
+
+
+
+
+/** Collects the durations of repeated operations (frames, event handlers) and summarizes them as percentiles, for
+the benchmark and the interaction replay reports. */
+class LatencyStats
+{
+public:
+
+	/** Adds the duration of a single operation. */
+	void add(std::chrono::steady_clock::duration aDuration);
+
+	/** Returns the number of durations added so far. */
+	size_t count() const { return mMs.size(); }
+
+	/** Returns the count, mean, the 50th / 90th / 95th / 99th percentile and max of the durations, in milliseconds,
+	as a JSON object. Only the count if there are no durations. */
+	QJsonObject toJson() const;
+
+
+protected:
+
+	/** The durations, in milliseconds. */
+	std::vector<double> mMs;
+};
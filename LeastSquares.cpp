@@ -0,0 +1,983 @@
+#include "LeastSquares.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <QtGlobal>
+
+#include "SpringNet.hpp"
+#include "SolverTrace.hpp"
+
+
+
+
+
+namespace {
+
+/** Marks a point that has no unknowns. */
+static const size_t NO_UNKNOWN = std::numeric_limits<size_t>::max();
+
+/** Point sets up to this size are not split any further by the nested dissection. */
+static const size_t DISSECTION_LEAF_SIZE = 64;
+
+/** Pivots smaller than this (relative to the largest diagonal entry) are considered zero, the normal equations are then singular. */
+static const double SINGULAR_PIVOT_RATIO = 1e-12;
+
+/** If more springs and angles than this have changed their force since the factorization, it is recomputed instead
+of updated. */
+static const size_t MAX_RANK_ONE_UPDATES = 16;
+
+/** If an iteration of solve() doesn't shrink the step at least by this ratio, the factorization is recomputed for
+the current positions. */
+static const double SLOW_CONVERGENCE_RATIO = 0.5;
+
+/** The tuning constants of the robust loss functions, for 95 % efficiency on normally distributed residuals. */
+static const double HUBER_THRESHOLD = 1.345;
+static const double TUKEY_THRESHOLD = 4.685;
+static const double CAUCHY_THRESHOLD = 2.385;
+
+/** The robust solve stops reweighting after this many rounds even if the weights haven't settled. */
+static const size_t MAX_REWEIGHTINGS = 30;
+
+/** The robust solve stops once no weight factor changes by more than this. */
+static const double REWEIGHT_TOLERANCE = 1e-3;
+
+/** The smallest weight factor used by the robust solve; zero weights could leave points undetermined. */
+static const double MIN_WEIGHT_SCALE = 1e-6;
+
+/** Scales the median absolute residual to the standard deviation, for normally distributed residuals. */
+static const double MAD_TO_SIGMA = 1.4826;
+
+/** Springs with a normalized residual above this are reported as suspects (the w-test at 0.1 % significance). */
+static const double SUSPECT_THRESHOLD = 3.29;
+
+/** Springs whose residual has a smaller share of the spring's variance than this are not controlled by the other
+springs, their normalized residual cannot be computed. */
+static const double MIN_REDUNDANCY = 1e-6;
+
+
+
+
+
+/** Orders the points aPts[aBegin .. aEnd) by geometric nested dissection and appends them to aOrder.
+The set is split in half across its longer extent, the points of the second half that are connected to the first
+half (by a spring, or by sharing an angle) form the separator; both halves are ordered recursively, and the separator goes last. For planar nets this
+keeps the fill of the factorization close to the optimum.
+aMark and aLastMark are scratch space, used for marking the first half. */
+void orderByNestedDissection(
+	const SpringNet & aNet,
+	const SpringNet::Adjacency & aAdjacency,
+	std::vector<size_t> & aPts,
+	size_t aBegin,
+	size_t aEnd,
+	std::vector<size_t> & aMark,
+	size_t & aLastMark,
+	std::vector<size_t> & aOrder
+)
+{
+	if (aEnd - aBegin <= DISSECTION_LEAF_SIZE)
+	{
+		aOrder.insert(aOrder.end(), aPts.begin() + static_cast<ptrdiff_t>(aBegin), aPts.begin() + static_cast<ptrdiff_t>(aEnd));
+		return;
+	}
+
+	// Split across the longer extent of the bounding box:
+	auto minX = std::numeric_limits<double>::max(), maxX = std::numeric_limits<double>::lowest();
+	auto minY = minX, maxY = maxX;
+	for (auto i = aBegin; i < aEnd; ++i)
+	{
+		const auto & pt = aNet.point(aPts[i]);
+		minX = std::min(minX, pt.x());
+		maxX = std::max(maxX, pt.x());
+		minY = std::min(minY, pt.y());
+		maxY = std::max(maxY, pt.y());
+	}
+	auto isSplitByX = (maxX - minX >= maxY - minY);
+	auto begin = aPts.begin() + static_cast<ptrdiff_t>(aBegin);
+	auto mid = aPts.begin() + static_cast<ptrdiff_t>(aBegin + (aEnd - aBegin) / 2);
+	auto end = aPts.begin() + static_cast<ptrdiff_t>(aEnd);
+	std::nth_element(begin, mid, end,
+		[&aNet, isSplitByX](size_t aPtIdx1, size_t aPtIdx2)
+		{
+			const auto & pt1 = aNet.point(aPtIdx1);
+			const auto & pt2 = aNet.point(aPtIdx2);
+			return isSplitByX ? (pt1.x() < pt2.x()) : (pt1.y() < pt2.y());
+		}
+	);
+
+	// Move the points of the second half that are connected to the first half to the end, as the separator:
+	auto mark = ++aLastMark;
+	for (auto itr = begin; itr != mid; ++itr)
+	{
+		aMark[*itr] = mark;
+	}
+	auto separator = std::partition(mid, end,
+		[&aNet, &aAdjacency, &aMark, mark](size_t aPtIdx)
+		{
+			for (auto itr = aAdjacency.springsBegin(aPtIdx), springsEnd = aAdjacency.springsEnd(aPtIdx); itr != springsEnd; ++itr)
+			{
+				const auto & spring = aNet.spring(*itr);
+				auto otherIdx = (spring.pointIdx1() == aPtIdx) ? spring.pointIdx2() : spring.pointIdx1();
+				if (aMark[otherIdx] == mark)
+				{
+					return false;
+				}
+			}
+			for (auto itr = aAdjacency.anglesBegin(aPtIdx), anglesEnd = aAdjacency.anglesEnd(aPtIdx); itr != anglesEnd; ++itr)
+			{
+				const auto & angle = aNet.angle(*itr);
+				if (
+					(aMark[angle.stationIdx()] == mark) ||
+					(aMark[angle.pointIdx1()] == mark) ||
+					(aMark[angle.pointIdx2()] == mark)
+				)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+	);
+
+	auto midIdx = static_cast<size_t>(mid - aPts.begin());
+	auto separatorIdx = static_cast<size_t>(separator - aPts.begin());
+	orderByNestedDissection(aNet, aAdjacency, aPts, aBegin, midIdx, aMark, aLastMark, aOrder);
+	orderByNestedDissection(aNet, aAdjacency, aPts, midIdx, separatorIdx, aMark, aLastMark, aOrder);
+	aOrder.insert(aOrder.end(), separator, end);
+}
+
+
+
+
+
+/** Returns the factor that the weight of an observation with the specified standardized residual is multiplied
+with, for the specified loss function. */
+double robustWeightScale(LeastSquares::RobustLoss aLoss, double aResidual)
+{
+	auto r = std::abs(aResidual);
+	switch (aLoss)
+	{
+		case LeastSquares::RobustLoss::Huber:
+		{
+			return (r <= HUBER_THRESHOLD) ? 1 : (HUBER_THRESHOLD / r);
+		}
+		case LeastSquares::RobustLoss::Tukey:
+		{
+			if (r >= TUKEY_THRESHOLD)
+			{
+				return 0;
+			}
+			auto t = 1 - (r / TUKEY_THRESHOLD) * (r / TUKEY_THRESHOLD);
+			return t * t;
+		}
+		case LeastSquares::RobustLoss::Cauchy:
+		{
+			return 1 / (1 + (r / CAUCHY_THRESHOLD) * (r / CAUCHY_THRESHOLD));
+		}
+	}
+	return 1;
+}
+
+}  // anonymous namespace
+
+
+
+
+
+const char * LeastSquares::lossName(RobustLoss aLoss)
+{
+	switch (aLoss)
+	{
+		case RobustLoss::Huber:  return QT_TRANSLATE_NOOP("LeastSquares", "Huber");
+		case RobustLoss::Tukey:  return QT_TRANSLATE_NOOP("LeastSquares", "Tukey biweight");
+		case RobustLoss::Cauchy: return QT_TRANSLATE_NOOP("LeastSquares", "Cauchy");
+	}
+	return QT_TRANSLATE_NOOP("LeastSquares", "Unknown");
+}
+
+
+
+
+
+const std::vector<LeastSquares::RobustLoss> & LeastSquares::allLosses()
+{
+	static const std::vector<RobustLoss> losses =
+	{
+		RobustLoss::Huber,
+		RobustLoss::Tukey,
+		RobustLoss::Cauchy,
+	};
+	return losses;
+}
+
+
+
+
+
+LeastSquares::SolveResult LeastSquares::solve(SpringNet & aNet, double aTolerance, size_t aMaxIterations)
+{
+	mWeightScales.clear();
+	return solveWeighted(aNet, aTolerance, aMaxIterations, false);
+}
+
+
+
+
+
+LeastSquares::SolveResult LeastSquares::solveWeighted(
+	SpringNet & aNet,
+	double aTolerance,
+	size_t aMaxIterations,
+	bool aAllowStaleWeights
+)
+{
+	TRACE_SCOPE("leastSquaresSolve");
+	SolveResult res;
+	analyse(aNet);
+	auto positions = aNet.positions();
+	auto areWeightsCurrent = mIsFactorized && updateWeights(aNet, res.mNumRankOneUpdates);
+	if (!mIsFactorized || (!areWeightsCurrent && !aAllowStaleWeights))
+	{
+		factorize(aNet, positions);
+		mFactorizedGeometryVersion = aNet.geometryVersion();
+		res.mNumFactorizations += 1;
+		areWeightsCurrent = true;
+	}
+	auto isFactorizationCurrent = areWeightsCurrent && (mFactorizedGeometryVersion == aNet.geometryVersion());
+	auto numUnknowns = mFactorization.size();
+	auto numP = aNet.numPoints();
+	std::vector<double> rhs;
+	auto prevStep = std::numeric_limits<double>::max();
+	while (res.mNumIterations < aMaxIterations)
+	{
+		// The right-hand side of the normal equations, for the length errors at the current positions:
+		rhs.assign(numUnknowns, 0);
+		auto numS = aNet.numSprings();
+		for (size_t springIdx = 0; springIdx < numS; ++springIdx)
+		{
+			const auto & s = aNet.springs()[springIdx];
+			auto unknown1 = mPointToUnknown[s.pointIdx1()];
+			auto unknown2 = mPointToUnknown[s.pointIdx2()];
+			auto diff = positions[s.pointIdx1()] - positions[s.pointIdx2()];
+			auto length = std::sqrt(QPointF::dotProduct(diff, diff));
+			if (length <= 0)
+			{
+				continue;
+			}
+			auto weightedError = springWeight(aNet, springIdx) * (s.idealLength() - length) / length;
+			if (unknown1 != NO_UNKNOWN)
+			{
+				rhs[unknown1] += weightedError * diff.x();
+				rhs[unknown1 + 1] += weightedError * diff.y();
+			}
+			if (unknown2 != NO_UNKNOWN)
+			{
+				rhs[unknown2] -= weightedError * diff.x();
+				rhs[unknown2 + 1] -= weightedError * diff.y();
+			}
+		}
+		auto numA = aNet.numAngles();
+		for (size_t angleIdx = 0; angleIdx < numA; ++angleIdx)
+		{
+			const auto & a = aNet.angle(angleIdx);
+			AngleRow row;
+			if (!angleRow(a, positions, row))
+			{
+				continue;
+			}
+			auto weightedError = angleWeight(aNet, angleIdx) * Angle::angleError(a.idealAngle(), row.mCurrentAngle);
+			for (size_t i = 0; i < row.mNumUnknowns; ++i)
+			{
+				rhs[row.mUnknowns[i]] += weightedError * row.mValues[i];
+			}
+		}
+		mFactorization.solve(rhs);
+
+		double maxStepSq = 0;
+		for (size_t idx = 0; idx < numP; ++idx)
+		{
+			auto unknown = mPointToUnknown[idx];
+			if (unknown == NO_UNKNOWN)
+			{
+				continue;
+			}
+			QPointF step(rhs[unknown], rhs[unknown + 1]);
+			positions[idx] += step;
+			maxStepSq = std::max(maxStepSq, QPointF::dotProduct(step, step));
+		}
+		res.mNumIterations += 1;
+		res.mMaxStep = std::sqrt(maxStepSq);
+		TRACE_COUNTER("leastSquaresStep", res.mMaxStep);
+		if (!std::isfinite(res.mMaxStep))
+		{
+			break;
+		}
+		if (res.mMaxStep < aTolerance)
+		{
+			res.mHasConverged = true;
+			break;
+		}
+
+		// The points have moved too far from where the factorization was computed, recompute it:
+		if ((res.mMaxStep > prevStep * SLOW_CONVERGENCE_RATIO) && !isFactorizationCurrent)
+		{
+			factorize(aNet, positions);
+			mFactorizedGeometryVersion = 0;
+			res.mNumFactorizations += 1;
+			isFactorizationCurrent = true;
+		}
+		else
+		{
+			isFactorizationCurrent = false;
+		}
+		prevStep = res.mMaxStep;
+	}
+	if (std::isfinite(res.mMaxStep))
+	{
+		aNet.setPositions(positions);
+	}
+	return res;
+}
+
+
+
+
+
+LeastSquares::RobustResult LeastSquares::robustSolve(
+	SpringNet & aNet,
+	RobustLoss aLoss,
+	double aTolerance,
+	size_t aMaxIterations
+)
+{
+	TRACE_SCOPE("robustSolve");
+	RobustResult res;
+	auto addSolve = [&res](const SolveResult & aSolve)
+	{
+		res.mSolve.mNumIterations += aSolve.mNumIterations;
+		res.mSolve.mNumFactorizations += aSolve.mNumFactorizations;
+		res.mSolve.mNumRankOneUpdates += aSolve.mNumRankOneUpdates;
+		res.mSolve.mMaxStep = aSolve.mMaxStep;
+		res.mSolve.mHasConverged = aSolve.mHasConverged;
+	};
+
+	// Start from the plain solution, and get the residuals' standard deviations there:
+	mWeightScales.clear();
+	addSolve(solveWeighted(aNet, aTolerance, aMaxIterations, false));
+	factorize(aNet, aNet.positions());
+	mFactorizedGeometryVersion = aNet.geometryVersion();
+	res.mSolve.mNumFactorizations += 1;
+	std::vector<double> residualDeviations;
+	res.mScale = computeResidualDeviations(aNet, residualDeviations);
+	if (res.mScale <= 0)
+	{
+		// (Almost) all the springs fit perfectly, there's nothing to down-weight
+		return res;
+	}
+
+	// Tukey's loss can reject good springs when started from the plain solution, which is skewed by the outliers;
+	// it starts from the Huber solution instead:
+	auto loss = (aLoss == RobustLoss::Tukey) ? RobustLoss::Huber : aLoss;
+	auto numS = aNet.numSprings();
+	mWeightScales.assign(numS, 1);
+	try
+	{
+		while (res.mNumReweightings < MAX_REWEIGHTINGS)
+		{
+			double maxChange = 0;
+			for (size_t idx = 0; idx < numS; ++idx)
+			{
+				if (residualDeviations[idx] <= 0)
+				{
+					// Not controlled by the other springs, cannot be judged
+					continue;
+				}
+				const auto & s = aNet.spring(idx);
+				auto standardizedResidual = (s.currentLength(aNet) - s.idealLength()) * std::sqrt(s.force()) / res.mScale;
+				auto weightScale = std::max(robustWeightScale(loss, standardizedResidual), MIN_WEIGHT_SCALE);
+				maxChange = std::max(maxChange, std::abs(weightScale - mWeightScales[idx]));
+				mWeightScales[idx] = weightScale;
+			}
+			res.mNumReweightings += 1;
+			TRACE_COUNTER("robustWeightChange", maxChange);
+			if (maxChange < REWEIGHT_TOLERANCE)
+			{
+				if (loss == aLoss)
+				{
+					break;
+				}
+				loss = aLoss;
+				continue;
+			}
+
+			// The factorization for the previous weights is usually close enough to converge, it is only recomputed
+			// when the convergence slows down:
+			addSolve(solveWeighted(aNet, aTolerance, aMaxIterations, true));
+		}
+	}
+	catch (...)
+	{
+		mWeightScales.clear();
+		throw;
+	}
+
+	// Report the springs whose normalized residual fails the test:
+	for (size_t idx = 0; idx < numS; ++idx)
+	{
+		if (residualDeviations[idx] <= 0)
+		{
+			continue;
+		}
+		const auto & s = aNet.spring(idx);
+		auto normalizedResidual = std::abs(s.currentLength(aNet) - s.idealLength()) / (res.mScale * residualDeviations[idx]);
+		if (normalizedResidual > SUSPECT_THRESHOLD)
+		{
+			res.mSuspects.push_back({idx, normalizedResidual, mWeightScales[idx]});
+		}
+	}
+	std::sort(res.mSuspects.begin(), res.mSuspects.end(),
+		[](const Suspect & aSuspect1, const Suspect & aSuspect2)
+		{
+			return (aSuspect1.mNormalizedResidual > aSuspect2.mNormalizedResidual);
+		}
+	);
+	mWeightScales.clear();
+	return res;
+}
+
+
+
+
+
+void LeastSquares::updateCovariances(const SpringNet & aNet)
+{
+	if (areCovariancesUpToDate(aNet))
+	{
+		return;
+	}
+	TRACE_SCOPE("covariance");
+	analyse(aNet);
+
+	// The covariances need the factorization at exactly the current positions; the forces may be updated:
+	size_t numUpdates = 0;
+	auto isExact = (
+		mIsFactorized &&
+		(mFactorizedGeometryVersion == aNet.geometryVersion()) &&
+		updateWeights(aNet, numUpdates)
+	);
+	if (!isExact)
+	{
+		factorize(aNet, aNet.positions());
+		mFactorizedGeometryVersion = aNet.geometryVersion();
+	}
+	mFactorization.computeSelectedInverse();
+	auto numUnknowns = mFactorization.size();
+
+	// The a-posteriori variance of unit weight:
+	double sumSquares = 0;
+	for (const auto & s: aNet.springs())
+	{
+		auto lenDif = s.currentLength(aNet) - s.idealLength();
+		sumSquares += s.force() * lenDif * lenDif;
+	}
+	auto numA = aNet.numAngles();
+	for (size_t angleIdx = 0; angleIdx < numA; ++angleIdx)
+	{
+		const auto & a = aNet.angle(angleIdx);
+		auto angleDif = Angle::angleError(a.idealAngle(), a.currentAngle(aNet));
+		sumSquares += angleWeight(aNet, angleIdx) * angleDif * angleDif;
+	}
+	auto numObservations = aNet.numSprings() + numA;
+	mVarianceFactor = ((numObservations > numUnknowns) && (sumSquares > 0)) ? (sumSquares / static_cast<double>(numObservations - numUnknowns)) : 1;
+
+	// Pick the 2x2 diagonal blocks of the inverse:
+	auto numP = aNet.numPoints();
+	mCovariances.assign(numP, PointCovariance());
+	for (size_t idx = 0; idx < numP; ++idx)
+	{
+		auto & cov = mCovariances[idx];
+		auto unknown = mPointToUnknown[idx];
+		if (unknown == NO_UNKNOWN)
+		{
+			cov.mIsDetermined = aNet.isPointFixed(idx);
+			continue;
+		}
+		cov.mVarX = mFactorization.inverseEntry(unknown, unknown) * mVarianceFactor;
+		cov.mVarY = mFactorization.inverseEntry(unknown + 1, unknown + 1) * mVarianceFactor;
+		cov.mCovXY = mFactorization.inverseEntry(unknown + 1, unknown) * mVarianceFactor;
+		cov.mIsDetermined = true;
+	}
+	mCovarianceTopologyVersion = aNet.topologyVersion();
+	mCovarianceParamsVersion = aNet.paramsVersion();
+	mCovarianceGeometryVersion = aNet.geometryVersion();
+}
+
+
+
+
+
+bool LeastSquares::areCovariancesUpToDate(const SpringNet & aNet) const
+{
+	return (
+		(mCovarianceTopologyVersion == aNet.topologyVersion()) &&
+		(mCovarianceParamsVersion == aNet.paramsVersion()) &&
+		(mCovarianceGeometryVersion == aNet.geometryVersion())
+	);
+}
+
+
+
+
+
+LeastSquares::ErrorEllipse LeastSquares::errorEllipse(const PointCovariance & aCovariance)
+{
+	const auto & cov = aCovariance;
+
+	// The eigenvalues and eigenvectors of the symmetric 2x2 matrix:
+	auto mean = (cov.mVarX + cov.mVarY) / 2;
+	auto halfDif = (cov.mVarX - cov.mVarY) / 2;
+	auto radius = std::sqrt(halfDif * halfDif + cov.mCovXY * cov.mCovXY);
+	return {
+		std::sqrt(std::max(mean + radius, 0.0)),
+		std::sqrt(std::max(mean - radius, 0.0)),
+		std::atan2(cov.mCovXY, halfDif) / 2
+	};
+}
+
+
+
+
+
+double LeastSquares::springWeight(const SpringNet & aNet, size_t aSpringIdx) const
+{
+	auto force = aNet.spring(aSpringIdx).force();
+	return mWeightScales.empty() ? force : (force * mWeightScales[aSpringIdx]);
+}
+
+
+
+
+
+double LeastSquares::angleWeight(const SpringNet & aNet, size_t aAngleIdx) const
+{
+	const auto & angle = aNet.angle(aAngleIdx);
+	auto armLength = angle.armLength(aNet);
+	return angle.force() * armLength * armLength;
+}
+
+
+
+
+
+bool LeastSquares::angleRow(const Angle & aAngle, const std::vector<QPointF> & aPositions, AngleRow & aRow) const
+{
+	size_t indices[3] = {aAngle.stationIdx(), aAngle.pointIdx1(), aAngle.pointIdx2()};
+	QPointF gradients[3];
+	if (!Angle::evaluate(aPositions[indices[0]], aPositions[indices[1]], aPositions[indices[2]], aRow.mCurrentAngle, gradients))
+	{
+		return false;
+	}
+	aRow.mNumUnknowns = 0;
+	for (size_t i = 0; i < 3; ++i)
+	{
+		auto unknown = mPointToUnknown[indices[i]];
+		if (unknown == NO_UNKNOWN)
+		{
+			continue;
+		}
+		aRow.mUnknowns[aRow.mNumUnknowns] = unknown;
+		aRow.mValues[aRow.mNumUnknowns++] = gradients[i].x();
+		aRow.mUnknowns[aRow.mNumUnknowns] = unknown + 1;
+		aRow.mValues[aRow.mNumUnknowns++] = gradients[i].y();
+	}
+	return true;
+}
+
+
+
+
+
+double LeastSquares::computeResidualDeviations(const SpringNet & aNet, std::vector<double> & aDeviations)
+{
+	TRACE_SCOPE("residualDeviations");
+	mFactorization.computeSelectedInverse();
+
+	// The cofactor of a residual is 1 / weight - a * Qxx * a', a being the spring's row of the design matrix:
+	auto numS = aNet.numSprings();
+	aDeviations.assign(numS, 0);
+	std::vector<double> testValues;
+	testValues.reserve(numS);
+	for (size_t springIdx = 0; springIdx < numS; ++springIdx)
+	{
+		const auto & s = aNet.spring(springIdx);
+		auto length = s.currentLength(aNet);
+		if ((length <= 0) || (s.force() <= 0))
+		{
+			continue;
+		}
+		size_t unknowns[4];
+		double a[4];
+		size_t num = 0;
+		auto unknown1 = mPointToUnknown[s.pointIdx1()];
+		auto unknown2 = mPointToUnknown[s.pointIdx2()];
+		if (unknown1 != NO_UNKNOWN)
+		{
+			unknowns[num] = unknown1;
+			a[num++] = s.diffX(aNet) / length;
+			unknowns[num] = unknown1 + 1;
+			a[num++] = s.diffY(aNet) / length;
+		}
+		if (unknown2 != NO_UNKNOWN)
+		{
+			unknowns[num] = unknown2;
+			a[num++] = -s.diffX(aNet) / length;
+			unknowns[num] = unknown2 + 1;
+			a[num++] = -s.diffY(aNet) / length;
+		}
+		double aqa = 0;
+		for (size_t i = 0; i < num; ++i)
+		{
+			for (size_t j = 0; j < num; ++j)
+			{
+				aqa += a[i] * a[j] * mFactorization.inverseEntry(unknowns[i], unknowns[j]);
+			}
+		}
+		auto cofactor = 1 / springWeight(aNet, springIdx) - aqa;
+		if (cofactor * springWeight(aNet, springIdx) < MIN_REDUNDANCY)
+		{
+			// The spring is not controlled by the others
+			continue;
+		}
+		aDeviations[springIdx] = std::sqrt(cofactor);
+		testValues.push_back(std::abs(length - s.idealLength()) / aDeviations[springIdx]);
+	}
+	if (testValues.empty())
+	{
+		return 0;
+	}
+
+	// The standard deviation of unit weight, estimated robustly so that the outliers don't inflate it:
+	auto median = testValues.begin() + static_cast<ptrdiff_t>(testValues.size() / 2);
+	std::nth_element(testValues.begin(), median, testValues.end());
+	return *median * MAD_TO_SIGMA;
+}
+
+
+
+
+
+void LeastSquares::analyse(const SpringNet & aNet)
+{
+	if (mFactorization.isAnalysed() && (mAnalysedTopologyVersion == aNet.topologyVersion()))
+	{
+		return;
+	}
+	TRACE_SCOPE("leastSquaresAnalysis");
+	mIsFactorized = false;
+	auto adjacency = aNet.buildAdjacency();
+	auto numP = aNet.numPoints();
+
+	// Order the adjusted points:
+	std::vector<size_t> pts;
+	for (size_t idx = 0; idx < numP; ++idx)
+	{
+		if (!aNet.isPointFixed(idx) && (adjacency.numSpringsAt(idx) > 0))
+		{
+			pts.push_back(idx);
+		}
+	}
+	std::vector<size_t> order;
+	order.reserve(pts.size());
+	std::vector<size_t> mark(numP, 0);
+	size_t lastMark = 0;
+	orderByNestedDissection(aNet, adjacency, pts, 0, pts.size(), mark, lastMark, order);
+	mPointToUnknown.assign(numP, NO_UNKNOWN);
+	auto numPts = order.size();
+	for (size_t i = 0; i < numPts; ++i)
+	{
+		mPointToUnknown[order[i]] = 2 * i;
+	}
+
+	// The pattern: the X-Y coupling within each point, and the coupling between the two points of each spring:
+	auto numUnknowns = 2 * numPts;
+	std::vector<std::vector<size_t>> pattern(numUnknowns);
+	for (size_t i = 0; i < numPts; ++i)
+	{
+		pattern[2 * i + 1].push_back(2 * i);
+	}
+	for (const auto & s: aNet.springs())
+	{
+		auto unknown1 = mPointToUnknown[s.pointIdx1()];
+		auto unknown2 = mPointToUnknown[s.pointIdx2()];
+		if ((unknown1 == NO_UNKNOWN) || (unknown2 == NO_UNKNOWN) || (unknown1 == unknown2))
+		{
+			continue;
+		}
+		auto lower = std::min(unknown1, unknown2);
+		auto upper = std::max(unknown1, unknown2);
+		for (size_t col = 0; col < 2; ++col)
+		{
+			pattern[upper + col].push_back(lower);
+			pattern[upper + col].push_back(lower + 1);
+		}
+	}
+
+	// Each angle couples all three of its points:
+	for (const auto & a: aNet.angles())
+	{
+		size_t unknowns[3] = {mPointToUnknown[a.stationIdx()], mPointToUnknown[a.pointIdx1()], mPointToUnknown[a.pointIdx2()]};
+		for (size_t i = 0; i < 3; ++i)
+		{
+			for (size_t j = i + 1; j < 3; ++j)
+			{
+				if ((unknowns[i] == NO_UNKNOWN) || (unknowns[j] == NO_UNKNOWN))
+				{
+					continue;
+				}
+				auto lower = std::min(unknowns[i], unknowns[j]);
+				auto upper = std::max(unknowns[i], unknowns[j]);
+				for (size_t col = 0; col < 2; ++col)
+				{
+					pattern[upper + col].push_back(lower);
+					pattern[upper + col].push_back(lower + 1);
+				}
+			}
+		}
+	}
+	mFactorization.analyse(numUnknowns, std::move(pattern));
+	mAnalysedTopologyVersion = aNet.topologyVersion();
+}
+
+
+
+
+
+void LeastSquares::assembleNormalEquations(const SpringNet & aNet, const std::vector<QPointF> & aPositions)
+{
+	TRACE_SCOPE("normalEquations");
+	mFactorization.setZero();
+	auto numS = aNet.numSprings();
+	for (size_t springIdx = 0; springIdx < numS; ++springIdx)
+	{
+		const auto & s = aNet.springs()[springIdx];
+		auto unknown1 = mPointToUnknown[s.pointIdx1()];
+		auto unknown2 = mPointToUnknown[s.pointIdx2()];
+		auto diff = aPositions[s.pointIdx1()] - aPositions[s.pointIdx2()];
+		auto length = std::sqrt(QPointF::dotProduct(diff, diff));
+		if (length <= 0)
+		{
+			// The direction is undefined, the spring doesn't determine anything
+			continue;
+		}
+
+		// The observation equation is u . (p1 - p2) = length, u being the unit direction from p2 to p1:
+		double u[2] = {diff.x() / length, diff.y() / length};
+		auto weight = springWeight(aNet, springIdx);
+		for (size_t a = 0; a < 2; ++a)
+		{
+			for (size_t b = 0; b < 2; ++b)
+			{
+				auto value = weight * u[a] * u[b];
+				if (unknown1 != NO_UNKNOWN)
+				{
+					if (a >= b)
+					{
+						mFactorization.add(unknown1 + a, unknown1 + b, value);
+					}
+				}
+				if (unknown2 != NO_UNKNOWN)
+				{
+					if (a >= b)
+					{
+						mFactorization.add(unknown2 + a, unknown2 + b, value);
+					}
+				}
+				if ((unknown1 != NO_UNKNOWN) && (unknown2 != NO_UNKNOWN))
+				{
+					mFactorization.add(unknown1 + a, unknown2 + b, -value);
+				}
+			}
+		}
+	}
+
+	// The angles, the observation's row of the design matrix being the angle's gradient:
+	auto numA = aNet.numAngles();
+	for (size_t angleIdx = 0; angleIdx < numA; ++angleIdx)
+	{
+		AngleRow row;
+		if (!angleRow(aNet.angle(angleIdx), aPositions, row))
+		{
+			continue;
+		}
+		auto weight = angleWeight(aNet, angleIdx);
+		auto numPts = row.mNumUnknowns / 2;
+		for (size_t p = 0; p < numPts; ++p)
+		{
+			for (size_t q = p; q < numPts; ++q)
+			{
+				for (size_t a = 0; a < 2; ++a)
+				{
+					for (size_t b = 0; b < 2; ++b)
+					{
+						if ((p == q) && (a < b))
+						{
+							continue;
+						}
+						auto value = weight * row.mValues[2 * p + a] * row.mValues[2 * q + b];
+						mFactorization.add(row.mUnknowns[2 * p + a], row.mUnknowns[2 * q + b], value);
+					}
+				}
+			}
+		}
+	}
+}
+
+
+
+
+
+void LeastSquares::factorize(const SpringNet & aNet, const std::vector<QPointF> & aPositions)
+{
+	assembleNormalEquations(aNet, aPositions);
+
+	// Treat tiny pivots as zero:
+	double maxDiagonal = 0;
+	auto numUnknowns = mFactorization.size();
+	for (size_t idx = 0; idx < numUnknowns; ++idx)
+	{
+		maxDiagonal = std::max(maxDiagonal, mFactorization.diagonal(idx));
+	}
+	mIsFactorized = mFactorization.factorize(maxDiagonal * SINGULAR_PIVOT_RATIO);
+	if (!mIsFactorized)
+	{
+		throw std::runtime_error("The net is not fully determined by the fixed points and springs.");
+	}
+	mFactorizedPositions = aPositions;
+	auto numS = aNet.numSprings();
+	auto numA = aNet.numAngles();
+	mFactorizedWeights.resize(numS + numA);
+	for (size_t idx = 0; idx < numS; ++idx)
+	{
+		mFactorizedWeights[idx] = springWeight(aNet, idx);
+	}
+	for (size_t idx = 0; idx < numA; ++idx)
+	{
+		mFactorizedWeights[numS + idx] = angleWeight(aNet, idx);
+	}
+}
+
+
+
+
+
+void LeastSquares::restoreFactorization(const LeastSquares & aOther)
+{
+	if (
+		!mFactorization.isAnalysed() ||
+		!aOther.mFactorization.isAnalysed() ||
+		(mAnalysedTopologyVersion != aOther.mAnalysedTopologyVersion)
+	)
+	{
+		*this = aOther;
+		return;
+	}
+	mIsFactorized = aOther.mIsFactorized;
+	if (!mIsFactorized)
+	{
+		return;
+	}
+	mFactorization.copyNumericFrom(aOther.mFactorization);
+	mFactorizedGeometryVersion = aOther.mFactorizedGeometryVersion;
+	mFactorizedPositions.assign(aOther.mFactorizedPositions.begin(), aOther.mFactorizedPositions.end());
+	mFactorizedWeights.assign(aOther.mFactorizedWeights.begin(), aOther.mFactorizedWeights.end());
+	mWeightScales.assign(aOther.mWeightScales.begin(), aOther.mWeightScales.end());
+}
+
+
+
+
+
+bool LeastSquares::updateWeights(const SpringNet & aNet, size_t & aNumUpdates)
+{
+	std::vector<size_t> changedSprings;
+	auto numS = aNet.numSprings();
+	for (size_t idx = 0; idx < numS; ++idx)
+	{
+		if (springWeight(aNet, idx) != mFactorizedWeights[idx])
+		{
+			changedSprings.push_back(idx);
+			if (changedSprings.size() > MAX_RANK_ONE_UPDATES)
+			{
+				return false;
+			}
+		}
+	}
+	std::vector<size_t> changedAngles;
+	auto numA = aNet.numAngles();
+	for (size_t idx = 0; idx < numA; ++idx)
+	{
+		if (angleWeight(aNet, idx) != mFactorizedWeights[numS + idx])
+		{
+			changedAngles.push_back(idx);
+			if (changedSprings.size() + changedAngles.size() > MAX_RANK_ONE_UPDATES)
+			{
+				return false;
+			}
+		}
+	}
+
+	// The change of a spring's force changes the normal equations by (force difference) * a * a',
+	// a being the spring's row of the design matrix at the factorized positions:
+	std::vector<size_t> indices;
+	std::vector<double> values;
+	for (const auto springIdx: changedSprings)
+	{
+		const auto & s = aNet.spring(springIdx);
+		auto diff = mFactorizedPositions[s.pointIdx1()] - mFactorizedPositions[s.pointIdx2()];
+		auto length = std::sqrt(QPointF::dotProduct(diff, diff));
+		if (length > 0)
+		{
+			indices.clear();
+			values.clear();
+			auto unknown1 = mPointToUnknown[s.pointIdx1()];
+			auto unknown2 = mPointToUnknown[s.pointIdx2()];
+			if (unknown1 != NO_UNKNOWN)
+			{
+				indices.insert(indices.end(), {unknown1, unknown1 + 1});
+				values.insert(values.end(), {diff.x() / length, diff.y() / length});
+			}
+			if (unknown2 != NO_UNKNOWN)
+			{
+				indices.insert(indices.end(), {unknown2, unknown2 + 1});
+				values.insert(values.end(), {-diff.x() / length, -diff.y() / length});
+			}
+			if (!mFactorization.rankOneUpdate(indices, values, springWeight(aNet, springIdx) - mFactorizedWeights[springIdx]))
+			{
+				mIsFactorized = false;
+				return false;
+			}
+		}
+		mFactorizedWeights[springIdx] = springWeight(aNet, springIdx);
+		aNumUpdates += 1;
+	}
+
+	// The same for the angles:
+	for (const auto angleIdx: changedAngles)
+	{
+		AngleRow row;
+		if (angleRow(aNet.angle(angleIdx), mFactorizedPositions, row))
+		{
+			indices.assign(row.mUnknowns, row.mUnknowns + row.mNumUnknowns);
+			values.assign(row.mValues, row.mValues + row.mNumUnknowns);
+			if (!mFactorization.rankOneUpdate(indices, values, angleWeight(aNet, angleIdx) - mFactorizedWeights[numS + angleIdx]))
+			{
+				mIsFactorized = false;
+				return false;
+			}
+		}
+		mFactorizedWeights[numS + angleIdx] = angleWeight(aNet, angleIdx);
+		aNumUpdates += 1;
+	}
+	return true;
+}
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <QPointF>
+
+#include "SparseLdlt.hpp"
+
+
+
+
+
+// fwd:
+class SpringNet;
+class Angle;
+
+
+
+
+
+/** The least-squares formulation of a SpringNet: each spring is an observation of the distance between its two
+points, weighted by the spring's force; each angle is an observation of the angle at its station, weighted by its
+force times the squared arm length (so that a unit angle force weighs the same as a unit spring force at the arms'
+ends); the coordinates of the points that are neither fixed nor isolated are the unknowns.
+Solves the net directly (Gauss-Newton) and provides the precision of the adjusted points (their covariance matrices,
+standard deviations and error ellipses), using a sparse LDL' factorization of the normal equations and its selected
+inverse, so that only the 2x2 diagonal blocks of the inverse are ever formed.
+The fill-reducing ordering and the symbolic factorization are kept until the net's topology changes. The numeric
+factorization is kept as well, and is updated by rank-one modifications when only a few springs' forces change;
+the covariances are kept until the points move or the spring parameters change. */
+class LeastSquares
+{
+public:
+
+	/** The covariance matrix of a single point's coordinates. */
+	struct PointCovariance
+	{
+		double mVarX = 0;
+		double mVarY = 0;
+		double mCovXY = 0;
+
+		/** False for points that are not a part of the adjustment (isolated points). Fixed points are determined,
+		with a zero covariance. */
+		bool mIsDetermined = false;
+	};
+
+
+	/** The standard error ellipse of a point: the semi-axes are the standard deviations along the principal axes. */
+	struct ErrorEllipse
+	{
+		double mSemiMajor;
+		double mSemiMinor;
+
+		/** The angle of the major axis from the X axis, in radians. */
+		double mAngle;
+	};
+
+
+	/** The outcome of solve(). */
+	struct SolveResult
+	{
+		size_t mNumIterations = 0;
+
+		/** The number of full numeric factorizations performed. */
+		size_t mNumFactorizations = 0;
+
+		/** The number of springs and angles whose force change was applied to the factorization as a rank-one update. */
+		size_t mNumRankOneUpdates = 0;
+
+		/** The largest distance that any point has moved in the last iteration. */
+		double mMaxStep = 0;
+
+		bool mHasConverged = false;
+	};
+
+
+	/** The loss functions for the robust solve, each one down-weights large residuals differently. */
+	enum class RobustLoss
+	{
+		/** Quadratic for small residuals, linear for large ones; outliers keep some influence. */
+		Huber,
+
+		/** Tukey's biweight; residuals beyond the threshold get no weight at all. */
+		Tukey,
+
+		/** Cauchy (Lorentzian); the weight decreases smoothly with the residual. */
+		Cauchy,
+	};
+
+
+	/** A spring suspected of a gross measurement error. */
+	struct Suspect
+	{
+		size_t mSpringIdx;
+
+		/** The spring's residual divided by its standard deviation (Baarda's w-test statistic). */
+		double mNormalizedResidual;
+
+		/** The factor that the robust solve has multiplied the spring's weight with. */
+		double mWeightScale;
+	};
+
+
+	/** The outcome of robustSolve(). */
+	struct RobustResult
+	{
+		/** The work done by all the solves, mMaxStep and mHasConverged are of the last one. */
+		SolveResult mSolve;
+
+		/** The number of times the weights were recomputed. */
+		size_t mNumReweightings = 0;
+
+		/** The robust estimate of the standard deviation of unit weight, at the plain solution. */
+		double mScale = 0;
+
+		/** The suspect springs, the most suspicious first. */
+		std::vector<Suspect> mSuspects;
+	};
+
+
+	LeastSquares() = default;
+
+	/** Returns the user-visible name of the loss function, untranslated; the GUI translates it in the "LeastSquares"
+	context. */
+	static const char * lossName(RobustLoss aLoss);
+
+	/** Returns all the loss functions, in the order they should be presented to the user. */
+	static const std::vector<RobustLoss> & allLosses();
+
+	/** Moves the points of the net to the weighted least-squares solution, by Gauss-Newton iterations.
+	The factorization of the normal equations is reused from the previous call for as long as the iterations keep
+	converging fast, and is only recomputed when they slow down. After editing a few springs' lengths or forces, the
+	previous factorization (with rank-one updates for the changed forces) is usually good enough, so re-solving takes
+	only a few triangular solves.
+	Stops once no point moves more than aTolerance in an iteration, or after aMaxIterations.
+	Throws a std::runtime_error if the net is not fully determined (the normal equations are singular). */
+	SolveResult solve(SpringNet & aNet, double aTolerance, size_t aMaxIterations);
+
+	/** Moves the points of the net to the robust solution, by iteratively reweighted least squares: the springs
+	with large residuals (relative to a robust estimate of the standard deviation of unit weight, taken at the plain
+	solution and kept fixed) are down-weighted according to the loss function, and the net is re-solved, until the
+	weights settle. The re-solves reuse the factorization the same way as solve() does.
+	Afterwards, each spring's residual is normalized by its standard deviation in the plain solution, so that springs in
+	weakly controlled parts of the net are judged fairly, and the ones failing the test are returned as suspects.
+	Throws a std::runtime_error if the net is not fully determined (the normal equations are singular). */
+	RobustResult robustSolve(SpringNet & aNet, RobustLoss aLoss, double aTolerance, size_t aMaxIterations);
+
+	/** Resets the numeric factorization (and the positions and weights it was computed for) to aOther's, reusing
+	this object's storage and symbolic analysis. Used by the workers that solve many variants of the same net, to
+	get back to the common starting factorization without copying the whole object.
+	Falls back to a full copy if the two were analysed for different topologies. Doesn't touch the covariances. */
+	void restoreFactorization(const LeastSquares & aOther);
+
+	/** Recomputes the covariances of all the points for the current state of the net, unless they are already up
+	to date. Throws a std::runtime_error if the net is not determined well enough for the covariances to exist
+	(there are not enough fixed points or springs, so the normal equations are singular). */
+	void updateCovariances(const SpringNet & aNet);
+
+	/** Returns true if the covariances have been computed for the current state of the net. */
+	bool areCovariancesUpToDate(const SpringNet & aNet) const;
+
+	/** Returns the covariance of the specified point, as computed by the last updateCovariances(). */
+	const PointCovariance & pointCovariance(size_t aPtIdx) const { return mCovariances[aPtIdx]; }
+
+	/** Returns the standard error ellipse of the specified point, as computed by the last updateCovariances(). */
+	ErrorEllipse errorEllipse(size_t aPtIdx) const { return errorEllipse(mCovariances[aPtIdx]); }
+
+	/** Returns the standard error ellipse for the specified covariance matrix. */
+	static ErrorEllipse errorEllipse(const PointCovariance & aCovariance);
+
+	/** Returns the a-posteriori variance of unit weight (the weighted sum of squared spring length and angle errors
+	over the redundancy), that the covariances have been scaled with. 1 if the net has no redundancy. */
+	double varianceFactor() const { return mVarianceFactor; }
+
+	/** Returns the number of unknowns (twice the number of adjusted points). */
+	size_t numUnknowns() const { return mFactorization.size(); }
+
+
+protected:
+
+	/** The versions of the net that the ordering and symbolic factorization were computed for. */
+	uint64_t mAnalysedTopologyVersion = 0;
+
+	/** True if mFactorization holds a valid numeric factorization. */
+	bool mIsFactorized = false;
+
+	/** The geometry version of the net that the numeric factorization was computed for; 0 if it was computed for
+	positions that were never stored in the net (in the middle of solve()). */
+	uint64_t mFactorizedGeometryVersion = 0;
+
+	/** The point positions that the numeric factorization was computed for. */
+	std::vector<QPointF> mFactorizedPositions;
+
+	/** The observation weights that the numeric factorization represents: the springs' in the same order as the
+	springs, followed by the angles'. */
+	std::vector<double> mFactorizedWeights;
+
+	/** The factors that the robust solve multiplies the spring forces with, to get their weights.
+	Empty when the weights are the plain forces (all factors 1). */
+	std::vector<double> mWeightScales;
+
+	/** The versions of the net that the covariances were computed for. */
+	uint64_t mCovarianceTopologyVersion = 0;
+	uint64_t mCovarianceParamsVersion = 0;
+	uint64_t mCovarianceGeometryVersion = 0;
+
+	/** The index of the X unknown of each point (the Y unknown follows it), in the fill-reducing order.
+	NO_UNKNOWN for points that are not adjusted. */
+	std::vector<size_t> mPointToUnknown;
+
+	/** The factorization of the normal equations, in the unknowns' order. */
+	SparseLdlt mFactorization;
+
+	/** The covariances of the points, in the same order as the points. */
+	std::vector<PointCovariance> mCovariances;
+
+	double mVarianceFactor = 1;
+
+
+	/** An angle's row of the design matrix: the gradient of the angle with respect to the unknowns of its points
+	that are adjusted. */
+	struct AngleRow
+	{
+		size_t mUnknowns[6];
+		double mValues[6];
+		size_t mNumUnknowns = 0;
+		double mCurrentAngle = 0;
+	};
+
+
+	/** Returns the weight of the specified spring in the adjustment: its force, scaled by mWeightScales. */
+	double springWeight(const SpringNet & aNet, size_t aSpringIdx) const;
+
+	/** Returns the weight of the specified angle in the adjustment: its force times the squared arm length.
+	The robust solve doesn't re-weight the angles. */
+	double angleWeight(const SpringNet & aNet, size_t aAngleIdx) const;
+
+	/** Fills aRow with the specified angle's row of the design matrix, and its value, at the specified positions.
+	Returns false if the angle is undefined there (an arm has a zero length). */
+	bool angleRow(const Angle & aAngle, const std::vector<QPointF> & aPositions, AngleRow & aRow) const;
+
+	/** Implements solve(), with the current weights.
+	If aAllowStaleWeights is true, a factorization computed for different weights is used as long as the iterations
+	converge fast enough with it (they still converge to the solution for the current weights). */
+	SolveResult solveWeighted(SpringNet & aNet, double aTolerance, size_t aMaxIterations, bool aAllowStaleWeights);
+
+	/** Computes the standard deviation of each spring's residual (relative to the standard deviation of unit weight),
+	from the selected inverse of the current factorization. Springs that are not controlled by the others get 0.
+	Returns the robust estimate of the standard deviation of unit weight (the scaled median of the residuals divided by
+	their deviations), 0 if it cannot be estimated. */
+	double computeResidualDeviations(const SpringNet & aNet, std::vector<double> & aDeviations);
+
+	/** Assigns the unknowns to the points in a fill-reducing order and analyses the pattern of the normal equations.
+	Only does the work if the net's topology has changed since the last time. */
+	void analyse(const SpringNet & aNet);
+
+	/** Fills mFactorization with the normal equations for the specified positions and the current spring and angle
+	forces. */
+	void assembleNormalEquations(const SpringNet & aNet, const std::vector<QPointF> & aPositions);
+
+	/** Computes the numeric factorization for the specified positions and the current spring forces.
+	Throws a std::runtime_error if the normal equations are singular. */
+	void factorize(const SpringNet & aNet, const std::vector<QPointF> & aPositions);
+
+	/** Brings the factorization up to date with the current spring and angle forces by rank-one updates, if only a
+	few of them have changed. Returns false if there are too many changes or the update fails; the factorization then
+	needs to be recomputed. aNumUpdates is incremented by the number of updates applied. */
+	bool updateWeights(const SpringNet & aNet, size_t & aNumUpdates);
+};
@@ -1,7 +1,141 @@
 #include "MainWindow.hpp"
 
+#include <cstring>
+#include <iostream>
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QFile>
+#include <QJsonDocument>
+
+#include "InteractionRecording.hpp"
+#include "Solver.hpp"
+#include "SolverTrace.hpp"
+
+
+
+
+
+namespace {
+
+/** Solves the document given on the commandline without any GUI, optionally saving the result and the solver trace.
+Returns the process exit code. */
+int runHeadlessSolve(const QCoreApplication & aApp)
+{
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Adjusts a SpringAngles document without showing any GUI.");
+	parser.addHelpOption();
+	QCommandLineOption solveOption("solve", "The document to adjust.", "file");
+	QCommandLineOption schemeOption("scheme", "The solver scheme to use (such as \"Anderson mixing\").", "name");
+	QCommandLineOption outputOption("output", "Save the adjusted document into this file.", "file");
+	QCommandLineOption traceOption("trace", "Export the solver trace into this file (.json or .csv).", "file");
+	parser.addOptions({solveOption, schemeOption, outputOption, traceOption});
+	parser.process(aApp);
+
+	Solver::Settings settings;
+	if (parser.isSet(schemeOption))
+	{
+		auto schemeName = parser.value(schemeOption);
+		bool isFound = false;
+		for (auto scheme: Solver::allSchemes())
+		{
+			if (schemeName.compare(QString::fromUtf8(Solver::schemeName(scheme)), Qt::CaseInsensitive) == 0)
+			{
+				settings.mScheme = scheme;
+				isFound = true;
+				break;
+			}
+		}
+		if (!isFound)
+		{
+			std::cerr << "Unknown solver scheme: " << schemeName.toStdString() << std::endl;
+			return 1;
+		}
+	}
+
+	try
+	{
+		Document doc;
+		doc.loadFromFile(parser.value(solveOption));
+		Solver solver(doc.springNet(), settings);
+		const auto & res = solver.solve();
+		std::cout
+			<< Solver::schemeName(settings.mScheme) << ": "
+			<< (res.mHasConverged ? "converged" : (res.mHasDiverged ? "diverged" : "not converged"))
+			<< " after " << res.mNumIterations << " iterations (" << res.mNumFallbacks << " fallbacks), residual "
+			<< res.mResidual << std::endl;
+		if (parser.isSet(outputOption))
+		{
+			doc.saveToFile(parser.value(outputOption));
+		}
+		if (parser.isSet(traceOption))
+		{
+			if (!SolverTrace::isEnabled())
+			{
+				std::cerr << "This build doesn't collect solver traces (SPRINGANGLES_ENABLE_TRACE is off)." << std::endl;
+			}
+			SolverTrace::get().exportToFile(parser.value(traceOption));
+		}
+		return res.mHasConverged ? 0 : 2;
+	}
+	catch (const std::exception & exc)
+	{
+		std::cerr << exc.what() << std::endl;
+		return 1;
+	}
+}
+
+
+
+
+
+/** Replays the interaction recording given on the commandline on the document, through the main window's handlers,
+and writes the per-event-type handler latencies as JSON. Returns the process exit code. */
+int runReplay(const QApplication & aApp)
+{
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Replays recorded interactions on a SpringAngles document and reports the handler latencies.");
+	parser.addHelpOption();
+	QCommandLineOption replayOption("replay", "The interaction recording to replay.", "file");
+	QCommandLineOption documentOption("document", "The document to replay the interactions on.", "file");
+	QCommandLineOption outputOption("output", "Write the JSON into this file instead of the standard output.", "file");
+	parser.addOptions({replayOption, documentOption, outputOption});
+	parser.process(aApp);
+
+	try
+	{
+		InteractionRecording recording;
+		recording.loadFromFile(parser.value(replayOption));
+		MainWindow w;
+		if (parser.isSet(documentOption))
+		{
+			auto doc = std::make_unique<Document>();
+			doc->loadFromFile(parser.value(documentOption));
+			w.setDocument(std::move(doc));
+		}
+		w.show();
+		QApplication::processEvents();
+		auto json = QJsonDocument(w.replayInteractions(recording)).toJson();
+		if (!parser.isSet(outputOption))
+		{
+			std::cout << json.toStdString();
+			return 0;
+		}
+		QFile f(parser.value(outputOption));
+		if (!f.open(QIODevice::WriteOnly) || (f.write(json) != json.size()))
+		{
+			std::cerr << "Cannot write the output file." << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+	catch (const std::exception & exc)
+	{
+		std::cerr << exc.what() << std::endl;
+		return 1;
+	}
+}
+
+}  // anonymous namespace
 
 
 
@@ -9,6 +143,30 @@
 
 int main(int argc, char *argv[])
 {
+	// The headless solve doesn't need any GUI, so it runs without a QApplication:
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--solve") == 0)
+		{
+			QCoreApplication a(argc, argv);
+			return runHeadlessSolve(a);
+		}
+	}
+
+	// The replay runs the full GUI, but doesn't need a display:
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--replay") == 0)
+		{
+			if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+			{
+				qputenv("QT_QPA_PLATFORM", "offscreen");
+			}
+			QApplication a(argc, argv);
+			return runReplay(a);
+		}
+	}
+
 	QApplication a(argc, argv);
 	MainWindow w;
 
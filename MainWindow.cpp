@@ -1,13 +1,26 @@
 #include "MainWindow.hpp"
 
+#include <map>
+#include <numeric>
 #include <QActionGroup>
 #include <QGraphicsLineItem>
+#include <QGraphicsPathItem>
+#include <QPen>
+#include <QtMath>
+#include <QCoreApplication>
 #include <QFileDialog>
+#include <QLocale>
 #include <QMessageBox>
 
 #include "ui_MainWindow.h"
+#include "AngleParamsDlg.hpp"
+#include "EnsembleDlg.hpp"
+#include "LatencyStats.hpp"
+#include "MeasurementImport.hpp"
+#include "NetExportDlg.hpp"
 #include "PointCoordsDlg.hpp"
 #include "SpringParamsDlg.hpp"
+#include "SolverTrace.hpp"
 
 
 
@@ -16,6 +29,78 @@
 namespace {
 /** The max distance (in pixels) to snap to points. */
 static const double POINT_SNAP_THRESHOLD = 10;
+
+/** How many springs away from the dragged point are re-adjusted while dragging. */
+static const size_t DRAG_ADJUST_RING_SIZE = 3;
+
+/** The time budget for the local re-adjustment in each mouse-move while dragging. */
+static const std::chrono::microseconds DRAG_ADJUST_BUDGET(8000);
+
+/** The local re-adjustment while dragging stops once no point moves more than this in a round. */
+static const double DRAG_ADJUST_TOLERANCE = 1e-4;
+
+/** How often the UI takes over the positions from the background adjustment, in msec (about once per frame). */
+static const int BACKGROUND_SOLVE_POLL_INTERVAL = 16;
+
+/** The background adjustment stops once no point moves more than this in an iteration. */
+static const double BACKGROUND_SOLVE_TOLERANCE = 1e-6;
+
+/** The background adjustment stops after this many iterations even if not converged. */
+static const size_t BACKGROUND_SOLVE_MAX_ITERATIONS = 100000;
+
+/** The least-squares solve stops after this many iterations even if not converged. */
+static const size_t LEAST_SQUARES_MAX_ITERATIONS = 100;
+
+/** How many of the most suspicious springs are listed after the robust solve. */
+static const size_t MAX_LISTED_SUSPECTS = 10;
+
+/** The error ellipses are exaggerated so that the largest one is this big, relative to the average spring length. */
+static const double ERROR_ELLIPSE_SIZE_RATIO = 0.25;
+
+/** How often the progress of the Monte Carlo ensemble is shown. */
+static const std::chrono::milliseconds ENSEMBLE_PROGRESS_INTERVAL(250);
+
+/** The size of the dots of the ensemble scatter, relative to the average spring length. */
+static const double ENSEMBLE_SCATTER_DOT_RATIO = 0.005;
+
+/** How often the performance HUD is refreshed. */
+static const std::chrono::milliseconds PERFORMANCE_HUD_INTERVAL(500);
+
+/** How often the whole scene is updated while the net moves (dragging, the background adjustment); in between, only
+the net's positions are shown. */
+static const std::chrono::milliseconds SCENE_REFRESH_INTERVAL(250);
+
+/** How long the net must stay without edits before it is auto-adjusted. */
+static const std::chrono::milliseconds AUTO_ADJUST_DEBOUNCE_INTERVAL(300);
+
+/** How many springs away from the edited points the auto-adjustment re-adjusts locally. */
+static const size_t AUTO_ADJUST_RING_SIZE = 5;
+
+/** The time budget for the local auto-adjustment. */
+static const std::chrono::microseconds AUTO_ADJUST_LOCAL_BUDGET(20000);
+
+/** The local auto-adjustment stops once no point moves more than this in a round. If the edge of the re-adjusted
+neighborhood has moved more than this, or the local adjustment hasn't settled, the whole net is adjusted in the
+background. */
+static const double AUTO_ADJUST_LOCAL_TOLERANCE = 1e-4;
+
+
+
+
+
+/** Updates the point indices after the specified point has been removed from the net: drops the point, shifts the
+indices after it. */
+static void removePointIndex(std::vector<size_t> & aPtIndices, size_t aRemovedPtIdx)
+{
+	std::erase(aPtIndices, aRemovedPtIdx);
+	for (auto & idx: aPtIndices)
+	{
+		if (idx > aRemovedPtIdx)
+		{
+			idx -= 1;
+		}
+	}
+}
 }  // anonymous namespace
 
 
@@ -42,7 +127,16 @@ void GraphicsPointItem::paint(
 		aPainter->setPen(p);
 		paintRaw(aPainter);
 	}
-	aPainter->setPen(pen());
+	if (mIsUndetermined)
+	{
+		auto p = pen();
+		p.setColor(QColor::fromRgb(0xff, 0, 0));
+		aPainter->setPen(p);
+	}
+	else
+	{
+		aPainter->setPen(pen());
+	}
 	paintRaw(aPainter);
 }
 
@@ -88,7 +182,17 @@ void GraphicsSpringItem::paint(
 		aPainter->setPen(p);
 		aPainter->drawLine(line());
 	}
-	aPainter->setPen(pen());
+	if (mIsSuspect)
+	{
+		auto p = pen();
+		p.setWidth(p.width() + 1);
+		p.setColor(QColor::fromRgb(0xff, 0, 0));
+		aPainter->setPen(p);
+	}
+	else
+	{
+		aPainter->setPen(pen());
+	}
 	aPainter->drawLine(line());
 	aPainter->drawText(line().center(), txt);
 }
@@ -98,6 +202,82 @@ void GraphicsSpringItem::paint(
 
 
 
+//////////////////////////////////////////////////////////////////////////////
+// GraphicsAngleItem:
+
+GraphicsAngleItem::GraphicsAngleItem(const SpringNet & aNet, const Angle & aAngle):
+	mIdealAngle(aAngle.idealAngle()),
+	mCurrentAngle(aAngle.currentAngle(aNet)),
+	mMarkerPos(aAngle.markerPos(aNet))
+{
+	const auto & station = aNet.point(aAngle.stationIdx());
+	auto radius = QLineF(station, mMarkerPos).length();
+	setPath(NetTileRenderer::angleArc(station, aNet.point(aAngle.pointIdx1()), mCurrentAngle, radius));
+}
+
+
+
+
+
+void GraphicsAngleItem::paint(
+	QPainter * aPainter,
+	const QStyleOptionGraphicsItem * aOption,
+	QWidget * aWidget
+)
+{
+	Q_UNUSED(aOption);
+	Q_UNUSED(aWidget);
+
+	auto txt = QString("%1\u00b0 / %2\u00b0").arg(qRadiansToDegrees(mCurrentAngle)).arg(qRadiansToDegrees(mIdealAngle));
+	if (isSelected())
+	{
+		auto p = pen();
+		p.setWidth(p.width() + 3);
+		p.setColor(QColor::fromRgb(0, 0xff, 0xff));
+		aPainter->setPen(p);
+		aPainter->drawPath(path());
+	}
+	aPainter->setPen(pen());
+	aPainter->drawPath(path());
+	aPainter->drawText(mMarkerPos, txt);
+}
+
+
+
+
+
+//////////////////////////////////////////////////////////////////////////////
+// GraphicsErrorEllipseItem:
+
+GraphicsErrorEllipseItem::GraphicsErrorEllipseItem(
+	QPointF aCenter,
+	const LeastSquares::ErrorEllipse & aEllipse,
+	double aExaggeration
+):
+	Super(
+		-aEllipse.mSemiMajor * aExaggeration,
+		-aEllipse.mSemiMinor * aExaggeration,
+		2 * aEllipse.mSemiMajor * aExaggeration,
+		2 * aEllipse.mSemiMinor * aExaggeration
+	)
+{
+	setPos(aCenter);
+	setRotation(qRadiansToDegrees(aEllipse.mAngle));
+	QPen p(QColor::fromRgb(0, 0x80, 0));
+	p.setCosmetic(true);
+	setPen(p);
+	setZValue(-1);
+	setToolTip(QObject::tr("Standard error ellipse (exaggerated %1x): %2 x %3")
+		.arg(aExaggeration)
+		.arg(aEllipse.mSemiMajor)
+		.arg(aEllipse.mSemiMinor)
+	);
+}
+
+
+
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // MainWindow:
 
@@ -109,12 +289,38 @@ MainWindow::MainWindow(QWidget * aParent):
 {
 	mUI->setupUi(this);
 	mUI->gvMain->setScene(mGraphicsScene.get());
+	mUI->gvMain->setNetRenderer(&mNetRenderer);
+
+	// The scene only holds a few overlay items, which are re-created on each update; indexing them isn't worth it:
+	mGraphicsScene->setItemIndexMethod(QGraphicsScene::NoIndex);
 
 	connectActions();
+	createSolverSchemeActions();
+	createRobustLossActions();
+	createSpringColorActions();
 	connect(mUI->gvMain, &CadGraphicsView::mouseReleased,   this, &MainWindow::gvMouseReleased);
 	connect(mUI->gvMain, &CadGraphicsView::mousePressed,    this, &MainWindow::gvMousePressed);
 	connect(mUI->gvMain, &CadGraphicsView::mouseMoved,      this, &MainWindow::gvMouseMoved);
 	connect(mUI->gvMain, &CadGraphicsView::mouseDblClicked, this, &MainWindow::gvMouseDblClicked);
+	connect(&mBackgroundSolveTimer, &QTimer::timeout, this, &MainWindow::backgroundSolveStep);
+	connect(&mEnsembleTimer, &QTimer::timeout, this, &MainWindow::ensembleStep);
+	connect(&mPerformanceHudTimer, &QTimer::timeout, this, &MainWindow::updatePerformanceHud);
+	connect(&mAutoAdjustTimer, &QTimer::timeout, this, &MainWindow::autoAdjust);
+	connect(this, &MainWindow::covariancesFinished, this, &MainWindow::applyCovariances, Qt::QueuedConnection);
+	mAutoAdjustTimer.setSingleShot(true);
+	connect(&mSceneRefreshTimer, &QTimer::timeout, this, &MainWindow::updateScene);
+	mSceneRefreshTimer.setSingleShot(true);
+
+	mPerformanceHud = new QLabel;
+	mPerformanceHud->hide();
+	statusBar()->addPermanentWidget(mPerformanceHud);
+
+	mNetTableDock = new NetTableDock(this);
+	mNetTableDock->setNet(&mDocument->springNet());
+	mNetTableDock->hide();
+	addDockWidget(Qt::RightDockWidgetArea, mNetTableDock);
+	mUI->menu_Net->addAction(mNetTableDock->toggleViewAction());
+	connect(mNetTableDock, &NetTableDock::objectSelected, this, &MainWindow::netTableObjectSelected);
 
 	setCurrentTool(CurrentTool::SelectObject);
 	updateScene();
@@ -126,7 +332,41 @@ MainWindow::MainWindow(QWidget * aParent):
 
 MainWindow::~MainWindow()
 {
-	// Nothing explicit needed yet
+	mCovarianceTasks.cancelAndWait();
+}
+
+
+
+
+
+QJsonObject MainWindow::replayInteractions(const InteractionRecording & aRecording)
+{
+	using EventType = InteractionRecording::EventType;
+
+	// Make the viewport the recorded size, so that the view's transforms map to the same part of the net:
+	if (aRecording.viewportSize().isValid())
+	{
+		auto viewport = mUI->gvMain->viewport()->size();
+		resize(size() + aRecording.viewportSize() - viewport);
+		QCoreApplication::processEvents();
+	}
+
+	// Time each event's handlers; the repaints they schedule run afterwards, untimed, same as in the live app:
+	std::map<EventType, LatencyStats> stats;
+	for (const auto & e: aRecording.events())
+	{
+		auto start = std::chrono::steady_clock::now();
+		mUI->gvMain->replayEvent(e);
+		stats[e.mType].add(std::chrono::steady_clock::now() - start);
+		QCoreApplication::processEvents();
+	}
+
+	QJsonObject res;
+	for (const auto & [type, typeStats]: stats)
+	{
+		res[InteractionRecording::eventTypeName(type)] = typeStats.toJson();
+	}
+	return res;
 }
 
 
@@ -140,12 +380,17 @@ void MainWindow::connectActions()
 	connect(mUI->actFileOpen,   &QAction::triggered, this, &MainWindow::fileOpen);
 	connect(mUI->actFileSave,   &QAction::triggered, this, &MainWindow::fileSave);
 	connect(mUI->actFileSaveAs, &QAction::triggered, this, &MainWindow::fileSaveAs);
+	connect(mUI->actFileImportMeasurements, &QAction::triggered, this, &MainWindow::fileImportMeasurements);
+	connect(mUI->actFileExportNet, &QAction::triggered, this, &MainWindow::fileExportNet);
+	connect(mUI->actFileExportSolverTrace, &QAction::triggered, this, &MainWindow::fileExportSolverTrace);
+	connect(mUI->actFileRecordInteractions, &QAction::toggled, this, &MainWindow::fileRecordInteractions);
 	connect(mUI->actFileExit,   &QAction::triggered, this, &MainWindow::close);
 
 	// Tool:
 	connect(mUI->actToolSelectObject,  &QAction::triggered, this, &MainWindow::toolSelectObject);
 	connect(mUI->actToolAddFixedPoint, &QAction::triggered, this, &MainWindow::toolAddFixedPoint);
 	connect(mUI->actToolAddSpring,     &QAction::triggered, this, &MainWindow::toolAddSpring);
+	connect(mUI->actToolAddAngle,      &QAction::triggered, this, &MainWindow::toolAddAngle);
 	connect(mUI->actToolRemoveObject,  &QAction::triggered, this, &MainWindow::toolRemoveObject);
 
 	// Zoom:
@@ -153,7 +398,97 @@ void MainWindow::connectActions()
 	connect(mUI->actZoomOut, &QAction::triggered, this, &MainWindow::zoomOut);
 	connect(mUI->actZoomAll, &QAction::triggered, this, &MainWindow::zoomAll);
 
-	connect(mUI->actAdjust, &QAction::triggered, this, &MainWindow::doAdjust);
+	// Net:
+	connect(mUI->actAdjust,                   &QAction::triggered, this, &MainWindow::doAdjust);
+	connect(mUI->actNetSolve,                 &QAction::triggered, this, &MainWindow::netSolve);
+	connect(mUI->actNetPauseResumeSolve,      &QAction::triggered, this, &MainWindow::netPauseResumeSolve);
+	connect(mUI->actNetLeastSquaresSolve,     &QAction::triggered, this, &MainWindow::netLeastSquaresSolve);
+	connect(mUI->actNetRobustSolve,           &QAction::triggered, this, &MainWindow::netRobustSolve);
+	connect(mUI->actNetHighlightUndetermined, &QAction::toggled,   this, &MainWindow::netHighlightUndetermined);
+	connect(mUI->actNetPinUndetermined,       &QAction::toggled,   this, &MainWindow::netPinUndetermined);
+	connect(mUI->actNetShowErrorEllipses,     &QAction::toggled,   this, &MainWindow::netShowErrorEllipses);
+	connect(mUI->actNetRunEnsemble,           &QAction::triggered, this, &MainWindow::netRunEnsemble);
+	connect(mUI->actNetClearEnsemble,         &QAction::triggered, this, &MainWindow::netClearEnsemble);
+	connect(mUI->actNetShowEnsembleScatter,   &QAction::toggled,   this, &MainWindow::netShowEnsembleScatter);
+	connect(mUI->actNetReorderRcm,            &QAction::triggered, this, &MainWindow::netReorderRcm);
+	connect(mUI->actNetReorderHilbert,        &QAction::triggered, this, &MainWindow::netReorderHilbert);
+	connect(mUI->actNetShowMemoryUsage,       &QAction::triggered, this, &MainWindow::netShowMemoryUsage);
+	connect(mUI->actNetShowPerformanceHud,    &QAction::toggled,   this, &MainWindow::netShowPerformanceHud);
+	connect(mUI->actNetAutoAdjust,            &QAction::toggled,   this, &MainWindow::netAutoAdjust);
+}
+
+
+
+
+
+void MainWindow::createSolverSchemeActions()
+{
+	auto group = new QActionGroup(this);
+	for (auto scheme: Solver::allSchemes())
+	{
+		auto act = mUI->menuNetSolverScheme->addAction(QCoreApplication::translate("Solver", Solver::schemeName(scheme)));
+		act->setCheckable(true);
+		act->setChecked(scheme == mSolverScheme);
+		group->addAction(act);
+		connect(act, &QAction::triggered, this, [this, scheme]()
+			{
+				mSolverScheme = scheme;
+			}
+		);
+	}
+}
+
+
+
+
+
+void MainWindow::createRobustLossActions()
+{
+	auto group = new QActionGroup(this);
+	for (auto loss: LeastSquares::allLosses())
+	{
+		auto act = mUI->menuNetRobustLoss->addAction(QCoreApplication::translate("LeastSquares", LeastSquares::lossName(loss)));
+		act->setCheckable(true);
+		act->setChecked(loss == mRobustLoss);
+		group->addAction(act);
+		connect(act, &QAction::triggered, this, [this, loss]()
+			{
+				mRobustLoss = loss;
+			}
+		);
+	}
+}
+
+
+
+
+
+void MainWindow::createSpringColorActions()
+{
+	auto group = new QActionGroup(this);
+	auto actPlain = mUI->menuNetSpringColors->addAction(tr("Plain"));
+	actPlain->setCheckable(true);
+	actPlain->setChecked(!mStrainMapMode.has_value());
+	group->addAction(actPlain);
+	connect(actPlain, &QAction::triggered, this, [this]()
+		{
+			mStrainMapMode.reset();
+			updateScene();
+		}
+	);
+	for (auto mode: StrainMap::allModes())
+	{
+		auto act = mUI->menuNetSpringColors->addAction(QCoreApplication::translate("StrainMap", StrainMap::modeName(mode)));
+		act->setCheckable(true);
+		act->setChecked(mode == mStrainMapMode);
+		group->addAction(act);
+		connect(act, &QAction::triggered, this, [this, mode]()
+			{
+				mStrainMapMode = mode;
+				updateScene();
+			}
+		);
+	}
 }
 
 
@@ -162,8 +497,7 @@ void MainWindow::connectActions()
 
 void MainWindow::fileNew()
 {
-	mDocument = std::make_unique<Document>();
-	updateScene();
+	setDocument(std::make_unique<Document>());
 }
 
 
@@ -201,7 +535,32 @@ void MainWindow::fileOpenByName(const QString & aFileName)
 		);
 		return;
 	}
-	mDocument = std::move(doc);
+	setDocument(std::move(doc));
+}
+
+
+
+
+
+void MainWindow::setDocument(std::unique_ptr<Document> aDocument)
+{
+	stopBackgroundSolve();
+	mDocument = std::move(aDocument);
+	mAutoAdjustTimer.stop();
+	mAutoAdjustPoints.clear();
+	mNetTableDock->setNet(&mDocument->springNet());
+	if (mUI->actNetReorderOnLoad->isChecked())
+	{
+		mDocument->reorder(SpringNet::PointOrdering::ReverseCuthillMcKee);
+	}
+	mPausedSolve = mDocument->solverCheckpoint();
+	updatePausedSolveVersions();
+	if (mPausedSolve)
+	{
+		statusBar()->showMessage(tr("The document contains a paused solve (%1 iterations), resume it by Net / Pause / resume solve.")
+			.arg(mPausedSolve->mResult.mNumIterations)
+		);
+	}
 	updateScene();
 }
 
@@ -215,6 +574,19 @@ void MainWindow::fileSave()
 	{
 		return fileSaveAs();
 	}
+	// Save the unfinished solve, so that it can be resumed after loading:
+	if (mBackgroundSolver != nullptr)
+	{
+		// The saved positions must match the checkpoint, so the worker is held while taking both:
+		mBackgroundSolver->stop();
+		mBackgroundSolver->applyPositions();
+		mDocument->setSolverCheckpoint(mBackgroundSolver->checkpoint());
+		mBackgroundSolver->start();
+	}
+	else
+	{
+		mDocument->setSolverCheckpoint(pausedSolve());
+	}
 	try
 	{
 		mDocument->saveToFile(mDocument->fileName());
@@ -254,332 +626,1531 @@ void MainWindow::fileSaveAs()
 
 
 
-void MainWindow::toolSelectObject()
-{
-	setCurrentTool(CurrentTool::SelectObject);
-}
-
-
-
-
-
-void MainWindow::toolAddFixedPoint()
+void MainWindow::fileImportMeasurements()
 {
-	setCurrentTool(CurrentTool::AddFixedPoint);
-}
-
-
-
+	auto fnam = QFileDialog::getOpenFileName(
+		this,
+		tr("SpringAngles: Import measurements"),
+		{},
+		tr("Measurements (*.csv *.txt);;All files (*)")
+	);
+	if (fnam.isEmpty())
+	{
+		return;
+	}
 
+	// Parse the whole file first, so that an error leaves the net untouched:
+	SpringNet::Bulk bulk;
+	try
+	{
+		bulk = MeasurementImport::parseFile(fnam);
+	}
+	catch (const std::exception & exc)
+	{
+		QMessageBox::warning(
+			this,
+			tr("SpringAngles: Cannot import measurements"),
+			tr("Cannot import measurements from %1: %2").arg(fnam, QString::fromUtf8(exc.what()))
+		);
+		return;
+	}
 
-void MainWindow::toolAddSpring()
-{
-	setCurrentTool(CurrentTool::AddSpring);
+	stopBackgroundSolve();
+	auto & springNet = mDocument->springNet();
+	auto firstNewPointIdx = springNet.numPoints();
+	try
+	{
+		springNet.addBulk(bulk);
+	}
+	catch (const std::exception & exc)
+	{
+		QMessageBox::warning(
+			this,
+			tr("SpringAngles: Cannot import measurements"),
+			tr("Cannot import measurements from %1: %2").arg(fnam, QString::fromUtf8(exc.what()))
+		);
+		return;
+	}
+	statusBar()->showMessage(tr("Imported %1 stations and %2 tape readings.")
+		.arg(bulk.mPoints.size())
+		.arg(bulk.mSprings.size())
+	);
+	std::vector<size_t> newPoints(bulk.mPoints.size());
+	std::iota(newPoints.begin(), newPoints.end(), firstNewPointIdx);
+	scheduleAutoAdjust(newPoints);
+	updateScene();
+	zoomAll();
 }
 
 
 
 
 
-void MainWindow::toolRemoveObject()
+void MainWindow::fileExportNet()
 {
-	setCurrentTool(CurrentTool::RemoveObject);
+	auto options = NetExportDlg::ask(this, mNetExportOptions);
+	if (!options)
+	{
+		return;
+	}
+	mNetExportOptions = *options;
+	auto fnam = QFileDialog::getSaveFileName(
+		this,
+		tr("SpringAngles: Export net"),
+		{},
+		tr("SVG (*.svg);;DXF (*.dxf)")
+	);
+	if (fnam.isEmpty())
+	{
+		return;
+	}
+	try
+	{
+		NetExport::exportToFile(mDocument->springNet(), fnam, mNetExportOptions);
+	}
+	catch (const std::exception & exc)
+	{
+		QMessageBox::warning(
+			this,
+			tr("SpringAngles: Cannot export net"),
+			tr("Cannot export the net to %1: %2").arg(fnam, QString::fromUtf8(exc.what()))
+		);
+	}
 }
 
 
 
 
 
-void MainWindow::zoomIn()
+void MainWindow::fileExportSolverTrace()
 {
-	// TODO
+	if (!SolverTrace::isEnabled())
+	{
+		QMessageBox::information(
+			this,
+			tr("SpringAngles: Solver trace"),
+			tr("This build doesn't collect solver traces. Rebuild with the SPRINGANGLES_ENABLE_TRACE CMake option.")
+		);
+		return;
+	}
+	auto fnam = QFileDialog::getSaveFileName(
+		this,
+		tr("SpringAngles: Export solver trace"),
+		{},
+		tr("Chrome trace (*.json);;CSV (*.csv)")
+	);
+	if (fnam.isEmpty())
+	{
+		return;
+	}
+	try
+	{
+		SolverTrace::get().exportToFile(fnam);
+	}
+	catch (const std::exception & exc)
+	{
+		QMessageBox::warning(
+			this,
+			tr("SpringAngles: Cannot export solver trace"),
+			tr("Cannot export solver trace to %1: %2").arg(fnam, QString::fromUtf8(exc.what()))
+		);
+	}
 }
 
 
 
 
 
-void MainWindow::zoomOut()
+void MainWindow::fileRecordInteractions(bool aShouldRecord)
 {
-	// TODO
-}
-
+	if (aShouldRecord)
+	{
+		mUI->gvMain->startRecording();
+		statusBar()->showMessage(tr("Recording the interactions, uncheck File / Record interactions to save them."));
+		return;
+	}
+	if (!mUI->gvMain->isRecording())
+	{
+		return;
+	}
+	auto recording = mUI->gvMain->stopRecording();
+	statusBar()->clearMessage();
+	auto fnam = QFileDialog::getSaveFileName(
+		this,
+		tr("SpringAngles: Save interaction recording"),
+		{},
+		tr("Interaction recordings (*.SpringAnglesRecording)")
+	);
+	if (fnam.isEmpty())
+	{
+		return;
+	}
+	try
+	{
+		recording.saveToFile(fnam);
+	}
+	catch (const std::exception & exc)
+	{
+		QMessageBox::warning(
+			this,
+			tr("SpringAngles: Cannot save recording"),
+			tr("Cannot save the interaction recording to %1: %2").arg(fnam, QString::fromUtf8(exc.what()))
+		);
+	}
+}
+
+
+
+
+
+void MainWindow::toolSelectObject()
+{
+	setCurrentTool(CurrentTool::SelectObject);
+}
+
+
+
+
+
+void MainWindow::toolAddFixedPoint()
+{
+	setCurrentTool(CurrentTool::AddFixedPoint);
+}
+
+
+
+
+
+void MainWindow::toolAddSpring()
+{
+	setCurrentTool(CurrentTool::AddSpring);
+}
+
+
+
+
+
+void MainWindow::toolAddAngle()
+{
+	setCurrentTool(CurrentTool::AddAngle);
+}
+
+
+
+
+
+void MainWindow::toolRemoveObject()
+{
+	setCurrentTool(CurrentTool::RemoveObject);
+}
+
+
+
+
+
+void MainWindow::zoomIn()
+{
+	// TODO
+}
+
+
+
+
+
+void MainWindow::zoomOut()
+{
+	// TODO
+}
+
+
+
+
+
+void MainWindow::zoomAll()
+{
+	// The net is drawn by mNetRenderer, not by scene items, so its bounds need to be added to the overlays':
+	auto all = mGraphicsScene->itemsBoundingRect();
+	const auto & points = mDocument->springNet().points();
+	if (!points.empty())
+	{
+		auto minX = points[0].x(), maxX = minX;
+		auto minY = points[0].y(), maxY = minY;
+		for (const auto & pt: points)
+		{
+			minX = std::min(minX, pt.x());
+			maxX = std::max(maxX, pt.x());
+			minY = std::min(minY, pt.y());
+			maxY = std::max(maxY, pt.y());
+		}
+		all = all.united(QRectF(QPointF(minX, minY), QPointF(maxX, maxY)).adjusted(-1, -1, 1, 1));
+	}
+	mUI->gvMain->zoomTo(all);
+	mUI->gvMain->centerOn(all.center());
+}
+
+
+
+
+
+void MainWindow::netSolve()
+{
+	startBackgroundSolve();
+}
+
+
+
+
+
+void MainWindow::netPauseResumeSolve()
+{
+	if (mBackgroundSolver != nullptr)
+	{
+		mBackgroundSolver->stop();
+		mBackgroundSolver->applyPositions();
+		mPausedSolve = mBackgroundSolver->checkpoint();
+		updatePausedSolveVersions();
+		stopBackgroundSolve();
+		statusBar()->showMessage(tr("The solve has been paused after %1 iterations.").arg(mPausedSolve->mResult.mNumIterations));
+		return;
+	}
+	auto checkpoint = pausedSolve();
+	if (!checkpoint)
+	{
+		statusBar()->showMessage(tr("There is no paused solve to resume."));
+		return;
+	}
+	try
+	{
+		mBackgroundSolver = std::make_unique<SolverThread>(mDocument->springNet(), *checkpoint);
+	}
+	catch (const std::exception & exc)
+	{
+		mPausedSolve.reset();
+		statusBar()->showMessage(tr("Cannot resume the solve: %1").arg(QString::fromUtf8(exc.what())));
+		return;
+	}
+	mPausedSolve.reset();
+	mBackgroundSolver->start();
+	mBackgroundSolveTimer.start(BACKGROUND_SOLVE_POLL_INTERVAL);
+}
+
+
+
+
+
+void MainWindow::netLeastSquaresSolve()
+{
+	stopBackgroundSolve();
+	LeastSquares::SolveResult res;
+	try
+	{
+		res = mLeastSquares.solve(mDocument->springNet(), BACKGROUND_SOLVE_TOLERANCE, LEAST_SQUARES_MAX_ITERATIONS);
+	}
+	catch (const std::exception & exc)
+	{
+		QMessageBox::warning(
+			this,
+			tr("SpringAngles: Cannot solve"),
+			tr("Cannot solve the net by least squares: %1").arg(QString::fromUtf8(exc.what()))
+		);
+		return;
+	}
+	statusBar()->showMessage(
+		tr("Least squares: %1 after %2 iterations (%3 factorizations, %4 rank-one updates), residual %5")
+		.arg(res.mHasConverged ? tr("converged") : tr("not converged"))
+		.arg(res.mNumIterations)
+		.arg(res.mNumFactorizations)
+		.arg(res.mNumRankOneUpdates)
+		.arg(mDocument->springNet().residual())
+	);
+	updateScene();
+}
+
+
+
+
+
+void MainWindow::netRobustSolve()
+{
+	stopBackgroundSolve();
+	auto & springNet = mDocument->springNet();
+	LeastSquares::RobustResult res;
+	try
+	{
+		res = mLeastSquares.robustSolve(springNet, mRobustLoss, BACKGROUND_SOLVE_TOLERANCE, LEAST_SQUARES_MAX_ITERATIONS);
+	}
+	catch (const std::exception & exc)
+	{
+		QMessageBox::warning(
+			this,
+			tr("SpringAngles: Cannot solve"),
+			tr("Cannot solve the net robustly: %1").arg(QString::fromUtf8(exc.what()))
+		);
+		return;
+	}
+	mSuspects = std::move(res.mSuspects);
+	mSuspectsTopologyVersion = springNet.topologyVersion();
+	statusBar()->showMessage(
+		tr("Robust solve (%1): %2 reweightings, %3 iterations (%4 factorizations), %5 suspect springs")
+		.arg(QCoreApplication::translate("LeastSquares", LeastSquares::lossName(mRobustLoss)))
+		.arg(res.mNumReweightings)
+		.arg(res.mSolve.mNumIterations)
+		.arg(res.mSolve.mNumFactorizations)
+		.arg(mSuspects.size())
+	);
+	updateScene();
+	if (mSuspects.empty())
+	{
+		return;
+	}
+
+	// List the most suspicious springs:
+	QString list;
+	auto numListed = std::min(mSuspects.size(), MAX_LISTED_SUSPECTS);
+	for (size_t i = 0; i < numListed; ++i)
+	{
+		const auto & suspect = mSuspects[i];
+		const auto & s = springNet.spring(suspect.mSpringIdx);
+		list.append(
+			tr("Spring %1 (ideal length %2, current length %3): normalized residual %4, weight scaled by %5\n")
+			.arg(suspect.mSpringIdx)
+			.arg(s.idealLength())
+			.arg(s.currentLength(springNet))
+			.arg(suspect.mNormalizedResidual, 0, 'f', 2)
+			.arg(suspect.mWeightScale, 0, 'g', 3)
+		);
+	}
+	if (mSuspects.size() > numListed)
+	{
+		list.append(tr("... and %1 more").arg(mSuspects.size() - numListed));
+	}
+	QMessageBox::information(
+		this,
+		tr("SpringAngles: Suspect springs"),
+		tr("These springs are likely to have a wrong ideal length:\n\n%1").arg(list)
+	);
+}
+
+
+
+
+
+void MainWindow::netHighlightUndetermined()
+{
+	updateScene();
+}
+
+
+
+
+
+void MainWindow::netPinUndetermined()
+{
+	// The worker reads the pins, hold it while they change:
+	if (mBackgroundSolver != nullptr)
+	{
+		mBackgroundSolver->stop();
+	}
+	updateRigidity();
+	applyRigidityPins();
+	if (mBackgroundSolver != nullptr)
+	{
+		mBackgroundSolver->start();
+	}
+}
+
+
+
+
+
+void MainWindow::netShowErrorEllipses()
+{
+	updateScene();
+}
+
+
+
+
+
+void MainWindow::netRunEnsemble()
+{
+	auto settings = EnsembleDlg::ask(this, mEnsembleSettings);
+	if (!settings)
+	{
+		return;
+	}
+	mEnsembleSettings = *settings;
+	netClearEnsemble();
+	stopBackgroundSolve();
+	const auto & springNet = mDocument->springNet();
+	try
+	{
+		mEnsemble = std::make_unique<Ensemble>(springNet, mEnsembleSettings);
+	}
+	catch (const std::exception & exc)
+	{
+		QMessageBox::warning(
+			this,
+			tr("SpringAngles: Cannot run the ensemble"),
+			tr("Cannot run the Monte Carlo ensemble: %1").arg(QString::fromUtf8(exc.what()))
+		);
+		return;
+	}
+	mEnsembleTopologyVersion = springNet.topologyVersion();
+	mEnsembleParamsVersion = springNet.paramsVersion();
+	mEnsemble->start();
+	mEnsembleTimer.start(ENSEMBLE_PROGRESS_INTERVAL);
+}
+
+
+
+
+
+void MainWindow::netClearEnsemble()
+{
+	mEnsembleTimer.stop();
+	if (mEnsemble == nullptr)
+	{
+		return;
+	}
+	mEnsemble.reset();
+	updateScene();
+}
+
+
+
+
+
+void MainWindow::netShowEnsembleScatter()
+{
+	updateScene();
+}
+
+
+
+
+
+void MainWindow::netReorderRcm()
+{
+	reorderNet(SpringNet::PointOrdering::ReverseCuthillMcKee);
+}
+
+
+
+
+
+void MainWindow::netReorderHilbert()
+{
+	reorderNet(SpringNet::PointOrdering::Hilbert);
+}
+
+
+
+
+
+
+void MainWindow::netShowMemoryUsage()
+{
+	const auto & springNet = mDocument->springNet();
+	auto usage = mDocument->memoryUsage();
+	QLocale locale;
+	QMessageBox::information(
+		this,
+		tr("SpringAngles: Memory usage"),
+		tr("Points (%1): %2\nSprings (%3): %4\nAngles (%5): %6\nSolver checkpoint: %7\n\nTotal: %8")
+		.arg(springNet.numPoints())
+		.arg(locale.formattedDataSize(static_cast<qint64>(usage.mSpringNet.mPoints)))
+		.arg(springNet.numSprings())
+		.arg(locale.formattedDataSize(static_cast<qint64>(usage.mSpringNet.mSprings)))
+		.arg(springNet.numAngles())
+		.arg(locale.formattedDataSize(static_cast<qint64>(usage.mSpringNet.mAngles)))
+		.arg(locale.formattedDataSize(static_cast<qint64>(usage.mSolverCheckpoint)))
+		.arg(locale.formattedDataSize(static_cast<qint64>(usage.total())))
+	);
+}
+
+
+
+
+
+void MainWindow::netAutoAdjust(bool aIsEnabled)
+{
+	if (!aIsEnabled)
+	{
+		mAutoAdjustTimer.stop();
+		mAutoAdjustPoints.clear();
+	}
+}
+
+
+
+
+
+void MainWindow::netShowPerformanceHud(bool aShouldShow)
+{
+	mPerformanceHud->setVisible(aShouldShow);
+	if (aShouldShow)
+	{
+		mPerformanceHudLastIterations = (mBackgroundSolver == nullptr) ? 0 : mBackgroundSolver->numIterations();
+		mPerformanceHudLastRefresh = std::chrono::steady_clock::now();
+		updatePerformanceHud();
+		mPerformanceHudTimer.start(PERFORMANCE_HUD_INTERVAL);
+	}
+	else
+	{
+		mPerformanceHudTimer.stop();
+	}
+}
+
+
+
+
+
+void MainWindow::gvMouseMoved(QPointF aScenePos)
+{
+	switch (mCurrentTool)
+	{
+		case CurrentTool::SelectObject:
+		{
+			if (QApplication::mouseButtons() & Qt::LeftButton)
+			{
+				switch (mCurrentObject.first)
+				{
+					case SpringNet::ObjectType::Point:
+					{
+						auto & springNet = mDocument->springNet();
+						springNet.setPointPos(mCurrentObject.second, aScenePos);
+						mHasDraggedPoint = true;
+						if (mDragRegion.has_value())
+						{
+							springNet.adjustLocal(*mDragRegion, DRAG_ADJUST_TOLERANCE, DRAG_ADJUST_BUDGET);
+						}
+						updateNetPositions();
+						break;
+					}
+					default: break;
+				}
+			}
+			else
+			{
+				selectNearestObject(aScenePos);
+			}
+			break;
+		}
+		case CurrentTool::AddSpring:
+		{
+			if (QApplication::mouseButtons() & Qt::LeftButton)
+			{
+				auto hover = hoverQuery(aScenePos);
+				if (hover.isPointWithin(snapThresholdSquared()))
+				{
+					auto snapPt = mDocument->springNet().point(hover.mPointIdx);
+					aScenePos = QPointF(snapPt.x(), snapPt.y());
+				}
+				mNewSpringLine->setLine(mMouseDownPos, aScenePos);
+				auto length = mNewSpringLine->line().length();
+				mNewSpringLine->setIdealLength(length);
+			}
+			break;
+		}
+		case CurrentTool::AddAngle:
+		{
+			// Highlight the springs that the angle would be added between:
+			const auto & springNet = mDocument->springNet();
+			if (springNet.numSprings() == 0)
+			{
+				break;
+			}
+			clearHighlights();
+			if (QApplication::mouseButtons() & Qt::LeftButton)
+			{
+				highlightObject(mCurrentObject);
+			}
+			highlightObject({SpringNet::ObjectType::Spring, hoverQuery(aScenePos).mSpringIdx});
+			break;
+		}
+		case CurrentTool::RemoveObject:
+		{
+			selectNearestObject(aScenePos);
+			break;
+		}
+		default: break;
+	}
+}
+
+
+
+
+
+void MainWindow::gvMousePressed(QPointF aScenePos, Qt::MouseButton aButton)
+{
+	if (aButton != Qt::LeftButton)
+	{
+		return;
+	}
+	mMouseDownPos = aScenePos;
+	stopBackgroundSolve();
+
+	// The release may edit the net, the pending auto-adjustment waits until after it (gvMouseReleased() re-arms it):
+	mAutoAdjustTimer.stop();
+	switch (mCurrentTool)
+	{
+		case CurrentTool::SelectObject:
+		{
+			mCurrentObject = mDocument->springNet().nearestObject(mMouseDownPos, snapThresholdSquared());
+			mNetTableDock->selectObject(mCurrentObject);
+			mDragRegion.reset();
+			mHasDraggedPoint = false;
+			if (mCurrentObject.first == SpringNet::ObjectType::Point)
+			{
+				// The neighborhood re-adjusted while dragging, found once for the whole drag:
+				mDragRegion = mDocument->springNet().dragRegion(mCurrentObject.second, DRAG_ADJUST_RING_SIZE);
+			}
+			break;
+		}
+		case CurrentTool::AddSpring:
+		{
+			auto startPtIdx = mDocument->springNet().nearestPointIdx(aScenePos);
+			auto startPt = mDocument->springNet().point(startPtIdx);
+			mMouseDownPos = QPointF(startPt.x(), startPt.y());
+			mNewSpringLine->setLine(startPt, startPt);
+			mNewSpringLine->show();
+			break;
+		}
+		case CurrentTool::AddAngle:
+		{
+			// The first spring of the angle stays highlighted while dragging to the second one:
+			if (mDocument->springNet().numSprings() > 0)
+			{
+				mCurrentObject = {SpringNet::ObjectType::Spring, mDocument->springNet().nearestSpringIdx(aScenePos)};
+			}
+			break;
+		}
+		default: break;
+	}
+}
+
+
+
+
+
+void MainWindow::gvMouseDblClicked(QPointF aScenePos, Qt::MouseButton aButton)
+{
+	if (aButton != Qt::LeftButton)
+	{
+		return;
+	}
+	switch (mCurrentTool)
+	{
+		case CurrentTool::SelectObject:
+		{
+			auto nearestObj = mDocument->springNet().nearestObject(aScenePos, snapThresholdSquared());
+			switch (nearestObj.first)
+			{
+				case SpringNet::ObjectType::None: break;
+				case SpringNet::ObjectType::Point:
+				{
+					auto newCoords = PointCoordsDlg::ask(this, mDocument->springNet().point(nearestObj.second));
+					if (newCoords != std::nullopt)
+					{
+						// The background adjustment reads the net, it must not run while the net is edited:
+						stopBackgroundSolve();
+						mDocument->springNet().setPointPos(nearestObj.second, *newCoords);
+						scheduleAutoAdjust({nearestObj.second});
+						updateScene();
+					}
+					break;
+				}
+				case SpringNet::ObjectType::Spring:
+				{
+					const auto & spring = mDocument->springNet().spring(nearestObj.second);
+					auto newParams = SpringParamsDlg::ask(this, spring.idealLength(), spring.force());
+					if (newParams != std::nullopt)
+					{
+						stopBackgroundSolve();
+						mDocument->springNet().setSpringParams(nearestObj.second, newParams->mIdealLength, newParams->mForce);
+						scheduleAutoAdjust({spring.pointIdx1(), spring.pointIdx2()});
+						updateScene();
+					}
+					break;
+				}
+				case SpringNet::ObjectType::Angle:
+				{
+					const auto & angle = mDocument->springNet().angle(nearestObj.second);
+					auto newParams = AngleParamsDlg::ask(this, angle.idealAngle(), angle.force());
+					if (newParams != std::nullopt)
+					{
+						stopBackgroundSolve();
+						mDocument->springNet().setAngleParams(nearestObj.second, newParams->mIdealAngle, newParams->mForce);
+						scheduleAutoAdjust({angle.stationIdx(), angle.pointIdx1(), angle.pointIdx2()});
+						updateScene();
+					}
+					break;
+				}
+			}
+			break;
+		}
+		default: break;
+	}
+}
+
+
+
+
+
+void MainWindow::gvMouseReleased(QPointF aScenePos, Qt::MouseButton aButton)
+{
+	if (aButton != Qt::LeftButton)
+	{
+		return;
+	}
+	if (!mAutoAdjustPoints.empty() && !mAutoAdjustTimer.isActive())
+	{
+		// The press has held back the auto-adjustment of the earlier edits:
+		mAutoAdjustTimer.start(AUTO_ADJUST_DEBOUNCE_INTERVAL);
+	}
+	switch (mCurrentTool)
+	{
+		case CurrentTool::SelectObject:  return gvMouseReleasedSelectObject (aScenePos);
+		case CurrentTool::AddFixedPoint: return gvMouseReleasedAddFixedPoint(aScenePos);
+		case CurrentTool::AddSpring:     return gvMouseReleasedAddSpring    (aScenePos);
+		case CurrentTool::AddAngle:      return gvMouseReleasedAddAngle     (aScenePos);
+		case CurrentTool::RemoveObject:  return gvMouseReleasedRemoveObject (aScenePos);
+	}
+}
+
+
+
+
+
+void MainWindow::gvMouseReleasedSelectObject(QPointF aScenePos)
+{
+	gvMouseMoved(aScenePos);
+	auto hasDraggedPoint = ((mCurrentObject.first == SpringNet::ObjectType::Point) && mHasDraggedPoint);
+	mCurrentObject = {SpringNet::ObjectType::None, 0};
+	mDragRegion.reset();
+	mHasDraggedPoint = false;
+	if (hasDraggedPoint)
+	{
+		// Only the neighborhood has been adjusted while dragging, let the rest of the net catch up:
+		startBackgroundSolve();
+	}
+}
+
+
+
+
+
+void MainWindow::gvMouseReleasedAddFixedPoint(QPointF aScenePos)
+{
+	auto coords = PointCoordsDlg::ask(this, aScenePos);
+	if (!coords)
+	{
+		return;
+	}
+	auto & springNet = mDocument->springNet();
+	springNet.addPoint(*coords, true);
+	scheduleAutoAdjust({springNet.numPoints() - 1});
+	updateScene();
+}
+
+
+
+
+
+void MainWindow::gvMouseReleasedAddSpring(QPointF aScenePos)
+{
+	mNewSpringLine->hide();
+	if (mDocument->springNet().numPoints() == 0)
+	{
+		return;
+	}
+	auto startPointIdx = mDocument->springNet().nearestPointIdx(mMouseDownPos);
+	auto startPoint = mDocument->springNet().point(startPointIdx);
+	auto snap = mDocument->springNet().snapToPoint(aScenePos, snapThresholdSquared());
+	size_t endPointIdx;
+	std::optional<SpringParams> springParams;
+	if (snap.first)
+	{
+		if (snap.second == startPointIdx)
+		{
+			// Trying to connect the spring to the same point on both ends
+			return;
+		}
+		auto pt2 = mDocument->springNet().point(snap.second);
+		auto diffX = startPoint.x() - pt2.x();
+		auto diffY = startPoint.y() - pt2.y();
+		auto len = std::sqrt(diffX * diffX + diffY * diffY);
+		springParams = SpringParamsDlg::ask(this, len, 1);
+		endPointIdx = snap.second;
+	}
+	else
+	{
+		// Not snapping to a point
+		auto diffX = startPoint.x() - aScenePos.x();
+		auto diffY = startPoint.y() - aScenePos.y();
+		auto len = std::sqrt(diffX * diffX + diffY * diffY);
+		springParams = SpringParamsDlg::ask(this, len, 1);
+		if (!springParams)
+		{
+			return;
+		}
+		// Add a new point for the spring:
+		auto x = startPoint.x() - diffX * springParams->mIdealLength / len;
+		auto y = startPoint.y() - diffY * springParams->mIdealLength / len;
+		mDocument->springNet().addPoint({x, y}, false);
+		endPointIdx = mDocument->springNet().numPoints() - 1;
+	}
+
+	// Add the spring:
+	if (!springParams)
+	{
+		return;
+	}
+	mDocument->springNet().addSpring(springParams->mIdealLength, springParams->mForce, startPointIdx, endPointIdx);
+	scheduleAutoAdjust({startPointIdx, endPointIdx});
 
+	updateScene();
+}
 
 
 
-void MainWindow::zoomAll()
+
+
+void MainWindow::gvMouseReleasedAddAngle(QPointF aScenePos)
 {
-	auto all = mGraphicsScene->itemsBoundingRect();
-	mUI->gvMain->zoomTo(all);
-	mUI->gvMain->centerOn(all.center());
+	auto & springNet = mDocument->springNet();
+	if (springNet.numSprings() < 2)
+	{
+		return;
+	}
+	auto springIdx1 = springNet.nearestSpringIdx(mMouseDownPos);
+	auto springIdx2 = springNet.nearestSpringIdx(aScenePos);
+	if (springIdx1 == springIdx2)
+	{
+		// Pressed and released on the same spring
+		return;
+	}
+
+	// Check the springs and measure the current angle, to offer it as the default:
+	double currentAngle;
+	try
+	{
+		currentAngle = Angle(springNet, 0, 1, springIdx1, springIdx2).currentAngle(springNet);
+	}
+	catch (const std::exception & exc)
+	{
+		QMessageBox::warning(
+			this,
+			tr("SpringAngles: Cannot add angle"),
+			tr("Cannot add the angle: %1").arg(QString::fromUtf8(exc.what()))
+		);
+		return;
+	}
+	auto angleParams = AngleParamsDlg::ask(this, currentAngle, 1);
+	if (!angleParams)
+	{
+		return;
+	}
+	springNet.addAngle(angleParams->mIdealAngle, angleParams->mForce, springIdx1, springIdx2);
+	const auto & angle = springNet.angle(springNet.numAngles() - 1);
+	scheduleAutoAdjust({angle.stationIdx(), angle.pointIdx1(), angle.pointIdx2()});
+	updateScene();
 }
 
 
 
 
 
-void MainWindow::gvMouseMoved(QPointF aScenePos)
+void MainWindow::gvMouseReleasedRemoveObject(QPointF aScenePos)
 {
-	switch (mCurrentTool)
+	auto & springNet = mDocument->springNet();
+	auto nearestObj = springNet.nearestObject(aScenePos, snapThresholdSquared());
+
+	// The points that lose a constraint by the removal:
+	std::vector<size_t> affectedPoints;
+	switch (nearestObj.first)
 	{
-		case CurrentTool::SelectObject:
+		case SpringNet::ObjectType::None: return;
+		case SpringNet::ObjectType::Point:
 		{
-			if (QApplication::mouseButtons() & Qt::LeftButton)
+			for (const auto & s: springNet.springs())
 			{
-				switch (mCurrentObject.first)
+				if (s.pointIdx1() == nearestObj.second)
 				{
-					case SpringNet::ObjectType::Point:
-					{
-						mDocument->springNet().point(mCurrentObject.second).set(aScenePos);
-						updateScene();
-						break;
-					}
-					default: break;
+					affectedPoints.push_back(s.pointIdx2());
+				}
+				else if (s.pointIdx2() == nearestObj.second)
+				{
+					affectedPoints.push_back(s.pointIdx1());
 				}
 			}
-			else
-			{
-				selectNearestObject(aScenePos);
-			}
+			springNet.removePoint(nearestObj.second);
+			removePointIndex(affectedPoints, nearestObj.second);
+			removePointIndex(mAutoAdjustPoints, nearestObj.second);
 			break;
 		}
-		case CurrentTool::AddSpring:
+		case SpringNet::ObjectType::Spring:
 		{
-			if (QApplication::mouseButtons() & Qt::LeftButton)
-			{
-				auto snap = mDocument->springNet().snapToPoint(aScenePos, snapThresholdSquared());
-				if (snap.first)
-				{
-					auto snapPt = mDocument->springNet().point(snap.second);
-					aScenePos = QPointF(snapPt.x(), snapPt.y());
-				}
-				mNewSpringLine->setLine(mMouseDownPos, aScenePos);
-				auto length = mNewSpringLine->line().length();
-				mNewSpringLine->setIdealLength(length);
-			}
+			const auto & s = springNet.spring(nearestObj.second);
+			affectedPoints = {s.pointIdx1(), s.pointIdx2()};
+			springNet.removeSpring(nearestObj.second);
 			break;
 		}
-		case CurrentTool::RemoveObject:
+		case SpringNet::ObjectType::Angle:
 		{
-			selectNearestObject(aScenePos);
+			const auto & a = springNet.angle(nearestObj.second);
+			affectedPoints = {a.stationIdx(), a.pointIdx1(), a.pointIdx2()};
+			springNet.removeAngle(nearestObj.second);
 			break;
 		}
-		default: break;
 	}
+	scheduleAutoAdjust(affectedPoints);
+	updateScene();
 }
 
 
 
 
 
-void MainWindow::gvMousePressed(QPointF aScenePos, Qt::MouseButton aButton)
+void MainWindow::doAdjust()
 {
-	if (aButton != Qt::LeftButton)
+	stopBackgroundSolve();
+	mDocument->springNet().adjust();
+	updateScene();
+}
+
+
+
+
+
+void MainWindow::startBackgroundSolve()
+{
+	Solver::Settings settings;
+	settings.mScheme = mSolverScheme;
+	settings.mTolerance = BACKGROUND_SOLVE_TOLERANCE;
+	settings.mMaxIterations = BACKGROUND_SOLVE_MAX_ITERATIONS;
+	mBackgroundSolver = std::make_unique<SolverThread>(mDocument->springNet(), settings);
+	mBackgroundSolver->start();
+	mBackgroundSolveTimer.start(BACKGROUND_SOLVE_POLL_INTERVAL);
+}
+
+
+
+
+
+void MainWindow::scheduleAutoAdjust(const std::vector<size_t> & aPtIndices)
+{
+	if (!mUI->actNetAutoAdjust->isChecked())
 	{
 		return;
 	}
-	mMouseDownPos = aScenePos;
-	switch (mCurrentTool)
+	stopBackgroundSolve();
+	mAutoAdjustPoints.insert(mAutoAdjustPoints.end(), aPtIndices.begin(), aPtIndices.end());
+	mAutoAdjustTimer.start(AUTO_ADJUST_DEBOUNCE_INTERVAL);
+}
+
+
+
+
+
+void MainWindow::autoAdjust()
+{
+	if (QApplication::activeModalWidget() != nullptr)
 	{
-		case CurrentTool::SelectObject:
-		{
-			mCurrentObject = mDocument->springNet().nearestObject(mMouseDownPos, snapThresholdSquared());
-			break;
-		}
-		case CurrentTool::AddSpring:
-		{
-			auto startPtIdx = mDocument->springNet().nearestPointIdx(aScenePos);
-			auto startPt = mDocument->springNet().point(startPtIdx);
-			mMouseDownPos = QPointF(startPt.x(), startPt.y());
-			mNewSpringLine->setLine(startPt, startPt);
-			mNewSpringLine->show();
-			break;
+		// An edit's dialog is open, its edit will follow; the net mustn't be solved in the background until then:
+		mAutoAdjustTimer.start(AUTO_ADJUST_DEBOUNCE_INTERVAL);
+		return;
+	}
+	if (QApplication::mouseButtons() & Qt::LeftButton)
+	{
+		// The net is being dragged or edited by the mouse, the release would race the background solve:
+		mAutoAdjustTimer.start(AUTO_ADJUST_DEBOUNCE_INTERVAL);
+		return;
+	}
+	auto ptIndices = std::move(mAutoAdjustPoints);
+	mAutoAdjustPoints.clear();
+	auto & springNet = mDocument->springNet();
+	if (ptIndices.empty() || (mBackgroundSolver != nullptr))
+	{
+		// Nothing edited, or the user has started an adjustment of the whole net since
+		return;
+	}
+
+	// Settle the neighborhood of the edits first, most of the change is there:
+	auto local = springNet.adjustAround(ptIndices, AUTO_ADJUST_RING_SIZE, AUTO_ADJUST_LOCAL_TOLERANCE, AUTO_ADJUST_LOCAL_BUDGET);
+	if ((local.mLastMove > AUTO_ADJUST_LOCAL_TOLERANCE) || (local.mEdgeMove > AUTO_ADJUST_LOCAL_TOLERANCE))
+	{
+		// The edits reach further, let the rest of the net catch up, starting from the locally adjusted positions:
+		startBackgroundSolve();
+	}
+	updateScene();
+}
+
+
+
+
+
+void MainWindow::stopBackgroundSolve()
+{
+	mBackgroundSolveTimer.stop();
+	mBackgroundSolver.reset();
+}
+
+
+
+
+
+std::optional<Solver::Checkpoint> MainWindow::pausedSolve()
+{
+	if (mPausedSolve && !isPausedSolveValid())
+	{
+		// The net has been edited since pausing: the solve would undo the moves, or no longer fits the springs / angles
+		mPausedSolve.reset();
+	}
+	return mPausedSolve;
+}
+
+
+
+
+
+bool MainWindow::isPausedSolveValid() const
+{
+	const auto & springNet = mDocument->springNet();
+	return (
+		mPausedSolve.has_value() &&
+		(mPausedSolveTopologyVersion == springNet.topologyVersion()) &&
+		(mPausedSolveParamsVersion == springNet.paramsVersion()) &&
+		(mPausedSolveGeometryVersion == springNet.geometryVersion())
+	);
+}
+
+
+
+
+
+void MainWindow::updatePausedSolveVersions()
+{
+	const auto & springNet = mDocument->springNet();
+	mPausedSolveTopologyVersion = springNet.topologyVersion();
+	mPausedSolveParamsVersion = springNet.paramsVersion();
+	mPausedSolveGeometryVersion = springNet.geometryVersion();
+}
+
+
+
+
+
+void MainWindow::backgroundSolveStep()
+{
+	if (mBackgroundSolver == nullptr)
+	{
+		mBackgroundSolveTimer.stop();
+		return;
+	}
+	// Read the flag before taking the positions, so that the final positions are never missed:
+	auto hasFinished = mBackgroundSolver->hasFinished();
+	auto hasMoved = mBackgroundSolver->applyPositions();
+	if (hasFinished)
+	{
+		const auto & res = mBackgroundSolver->result();
+		statusBar()->showMessage(
+			tr("%1: %2 after %3 iterations (%4 fallbacks), residual %5")
+			.arg(QCoreApplication::translate("Solver", Solver::schemeName(mBackgroundSolver->settings().mScheme)))
+			.arg(res.mHasConverged ? tr("converged") : (res.mHasDiverged ? tr("diverged") : tr("not converged")))
+			.arg(res.mNumIterations)
+			.arg(res.mNumFallbacks)
+			.arg(res.mResidual)
+		);
+		stopBackgroundSolve();
+		updateScene();
+	}
+	else if (hasMoved)
+	{
+		updateNetPositions();
+	}
+}
+
+
+
+
+
+void MainWindow::ensembleStep()
+{
+	if (mEnsemble == nullptr)
+	{
+		mEnsembleTimer.stop();
+		return;
+	}
+	const auto & springNet = mDocument->springNet();
+	if (
+		(mEnsembleTopologyVersion != springNet.topologyVersion()) ||
+		(mEnsembleParamsVersion != springNet.paramsVersion())
+	)
+	{
+		netClearEnsemble();
+		statusBar()->showMessage(tr("The net has changed, the Monte Carlo ensemble has been discarded."));
+		return;
+	}
+	auto isFinished = mEnsemble->isFinished();
+	if (isFinished)
+	{
+		mEnsembleTimer.stop();
+		mEnsemble->stop();
+	}
+	statusBar()->showMessage(
+		tr("Monte Carlo ensemble: %1 of %2 samples%3 (%4 threads)%5")
+		.arg(mEnsemble->numSamplesDone())
+		.arg(mEnsemble->settings().mNumSamples)
+		.arg(isFinished ? tr(", finished") : QString())
+		.arg(mEnsemble->settings().mNumThreads)
+		.arg((mEnsemble->numFailedSamples() > 0) ? tr(", %1 did not converge").arg(mEnsemble->numFailedSamples()) : QString())
+	);
+	updateScene();
+}
+
+
+
+
+
+void MainWindow::updatePerformanceHud()
+{
+	auto now = std::chrono::steady_clock::now();
+	const auto & gv = *mUI->gvMain;
+	auto txt = tr("Frame %1 ms (max %2) | Paint %3 ms (max %4) | Hover %5 ms | Scene update %6 ms")
+		.arg(gv.frameTimes().meanMs(), 0, 'f', 1)
+		.arg(gv.frameTimes().maxMs(), 0, 'f', 1)
+		.arg(gv.paintTimes().meanMs(), 0, 'f', 1)
+		.arg(gv.paintTimes().maxMs(), 0, 'f', 1)
+		.arg(mHoverQueryTimes.meanMs(), 0, 'f', 3)
+		.arg(mUpdateSceneTimes.meanMs(), 0, 'f', 1);
+
+	if (mBackgroundSolver != nullptr)
+	{
+		auto numIterations = mBackgroundSolver->numIterations();
+		auto seconds = std::chrono::duration<double>(now - mPerformanceHudLastRefresh).count();
+		auto iterationsPerSec = (seconds > 0) ? (numIterations - std::min(numIterations, mPerformanceHudLastIterations)) / seconds : 0;
+		txt += tr(" | Solver %1 it/s, residual %2").arg(iterationsPerSec, 0, 'f', 0).arg(mBackgroundSolver->residual());
+		mPerformanceHudLastIterations = numIterations;
+	}
+	else
+	{
+		txt += tr(" | Solver idle");
+		mPerformanceHudLastIterations = 0;
+	}
+	mPerformanceHudLastRefresh = now;
+
+	QLocale locale;
+	txt += tr(" | Memory %1").arg(locale.formattedDataSize(static_cast<qint64>(mDocument->memoryUsage().total())));
+	mPerformanceHud->setText(txt);
+}
+
+
+
+
+
+HoverQuery::Result MainWindow::hoverQuery(QPointF aScenePos)
+{
+	auto start = std::chrono::steady_clock::now();
+	auto res = mHoverQuery.query(mDocument->springNet(), aScenePos, snapThresholdSquared());
+	mHoverQueryTimes.add(std::chrono::steady_clock::now() - start);
+	return res;
+}
+
+
+
+
+
+void MainWindow::reorderNet(SpringNet::PointOrdering aOrdering)
+{
+	stopBackgroundSolve();
+	auto & springNet = mDocument->springNet();
+	auto areSuspectsValid = (mSuspectsTopologyVersion == springNet.topologyVersion());
+	auto wasPausedSolveValid = isPausedSolveValid();
+	auto reordering = mDocument->reorder(aOrdering);
+
+	// Remap what refers to the old order, so that it survives the reordering:
+	for (auto & ptIdx: mAutoAdjustPoints)
+	{
+		ptIdx = reordering.mPointOldToNew[ptIdx];
+	}
+	if (areSuspectsValid)
+	{
+		for (auto & suspect: mSuspects)
+		{
+			suspect.mSpringIdx = reordering.mSpringOldToNew[suspect.mSpringIdx];
 		}
-		default: break;
+		mSuspectsTopologyVersion = springNet.topologyVersion();
+	}
+	if (wasPausedSolveValid)
+	{
+		mPausedSolve->permutePoints(reordering.mPointNewToOld, springNet);
+		updatePausedSolveVersions();
 	}
+	statusBar()->showMessage(tr("The net has been reordered (%1 points, %2 springs, %3 angles).")
+		.arg(springNet.numPoints())
+		.arg(springNet.numSprings())
+		.arg(springNet.numAngles())
+	);
+	updateScene();
 }
 
 
 
 
 
-void MainWindow::gvMouseDblClicked(QPointF aScenePos, Qt::MouseButton aButton)
+void MainWindow::setCurrentTool(CurrentTool aNewTool)
 {
-	if (aButton != Qt::LeftButton)
+	mCurrentTool = aNewTool;
+	mUI->actToolSelectObject->setChecked(aNewTool == CurrentTool::SelectObject);
+	mUI->actToolAddFixedPoint->setChecked(aNewTool == CurrentTool::AddFixedPoint);
+	mUI->actToolAddSpring->setChecked(aNewTool == CurrentTool::AddSpring);
+	mUI->actToolAddAngle->setChecked(aNewTool == CurrentTool::AddAngle);
+	mUI->actToolRemoveObject->setChecked(aNewTool == CurrentTool::RemoveObject);
+}
+
+
+
+
+
+void MainWindow::updateScene()
+{
+	TRACE_SCOPE("sceneSync");
+	auto start = std::chrono::steady_clock::now();
+	mSceneRefreshTimer.stop();
+	updateRigidity();
+	auto shouldHighlightUndetermined = (mUI->actNetHighlightUndetermined->isChecked() && (mRigidity != nullptr));
+	const auto & springNet = mDocument->springNet();
+	NetTileRenderer::Highlights highlights;
+	if (shouldHighlightUndetermined)
 	{
-		return;
+		auto numPoints = springNet.numPoints();
+		highlights.mUndeterminedPoints.resize(numPoints);
+		for (size_t idx = 0; idx < numPoints; ++idx)
+		{
+			highlights.mUndeterminedPoints[idx] = !mRigidity->isPointDetermined(idx);
+		}
 	}
-	switch (mCurrentTool)
+	if (!mSuspects.empty() && (mSuspectsTopologyVersion == springNet.topologyVersion()))
 	{
-		case CurrentTool::SelectObject:
+		highlights.mSuspectSprings.resize(springNet.numSprings());
+		for (const auto & suspect: mSuspects)
 		{
-			auto nearestObj = mDocument->springNet().nearestObject(aScenePos, snapThresholdSquared());
-			switch (nearestObj.first)
-			{
-				case SpringNet::ObjectType::None: break;
-				case SpringNet::ObjectType::Point:
-				{
-					auto newCoords = PointCoordsDlg::ask(this, mDocument->springNet().point(nearestObj.second));
-					if (newCoords != std::nullopt)
-					{
-						mDocument->springNet().point(nearestObj.second).set(newCoords->x(), newCoords->y());
-						updateScene();
-					}
-					break;
-				}
-				case SpringNet::ObjectType::Spring:
-				{
-					auto & spring = mDocument->springNet().spring(nearestObj.second);
-					auto newParams = SpringParamsDlg::ask(this, spring.idealLength(), spring.force());
-					if (newParams != std::nullopt)
-					{
-						spring.setIdealLength(newParams->mIdealLength);
-						spring.setForce(newParams->mForce);
-						updateScene();
-					}
-					break;
-				}
-			}
-			break;
+			highlights.mSuspectSprings[suspect.mSpringIdx] = true;
 		}
-		default: break;
 	}
+	std::vector<uint8_t> springColors;
+	if (mStrainMapMode.has_value())
+	{
+		mStrainMap.compute(springNet, *mStrainMapMode);
+		springColors = mStrainMap.colorIndices();
+	}
+	mUI->gvMain->setStrainLegend(mStrainMapMode.has_value() ? &mStrainMap : nullptr);
+	mNetRenderer.setNet(springNet, std::move(highlights), std::move(springColors));
+	mNetTableDock->netChanged();
+
+	mGraphicsScene->clear();
+	mHighlightItems.clear();
+	addErrorEllipseItems();
+	addEnsembleItems();
+	mNewSpringLine = new GraphicsSpringItem(0, 0, 0, 0, 0);
+	mGraphicsScene->addItem(mNewSpringLine);
+
+	mNewSpringLine->hide();
+	mUpdateSceneTimes.add(std::chrono::steady_clock::now() - start);
 }
 
 
 
 
 
-void MainWindow::gvMouseReleased(QPointF aScenePos, Qt::MouseButton aButton)
+void MainWindow::updateNetPositions()
 {
-	if (aButton != Qt::LeftButton)
-	{
-		return;
-	}
-	switch (mCurrentTool)
+	TRACE_SCOPE("sceneSync");
+	auto start = std::chrono::steady_clock::now();
+	mNetRenderer.setPositions(mDocument->springNet());
+	if (!mSceneRefreshTimer.isActive())
 	{
-		case CurrentTool::SelectObject:  return gvMouseReleasedSelectObject (aScenePos);
-		case CurrentTool::AddFixedPoint: return gvMouseReleasedAddFixedPoint(aScenePos);
-		case CurrentTool::AddSpring:     return gvMouseReleasedAddSpring    (aScenePos);
-		case CurrentTool::RemoveObject:  return gvMouseReleasedRemoveObject (aScenePos);
+		mSceneRefreshTimer.start(SCENE_REFRESH_INTERVAL);
 	}
+	mUpdateSceneTimes.add(std::chrono::steady_clock::now() - start);
 }
 
 
 
 
 
-void MainWindow::gvMouseReleasedSelectObject(QPointF aScenePos)
+void MainWindow::updateRigidity()
 {
-	gvMouseMoved(aScenePos);
-	mCurrentObject = {SpringNet::ObjectType::None, 0};
+	if (!mUI->actNetHighlightUndetermined->isChecked() && !mUI->actNetPinUndetermined->isChecked())
+	{
+		return;
+	}
+	const auto & springNet = mDocument->springNet();
+	if ((mRigidity != nullptr) && (mRigidityTopologyVersion == springNet.topologyVersion()))
+	{
+		return;
+	}
+	mRigidity = std::make_unique<RigidityAnalysis>(springNet);
+	mRigidityTopologyVersion = springNet.topologyVersion();
+	applyRigidityPins();
+	if (mRigidity->undeterminedPoints().empty())
+	{
+		statusBar()->showMessage(tr("The net is rigid."));
+	}
+	else
+	{
+		statusBar()->showMessage(
+			tr("%1 undetermined points in %2 flexible parts, %3 degrees of freedom%4.")
+			.arg(mRigidity->undeterminedPoints().size())
+			.arg(mRigidity->flexibleGroups().size())
+			.arg(mRigidity->numDegreesOfFreedom())
+			.arg(mRigidity->isAnchored() ? QString() : tr("; the net needs at least two fixed points"))
+		);
+	}
 }
 
 
 
 
 
-void MainWindow::gvMouseReleasedAddFixedPoint(QPointF aScenePos)
+void MainWindow::applyRigidityPins()
 {
-	auto coords = PointCoordsDlg::ask(this, aScenePos);
-	if (!coords)
+	auto & springNet = mDocument->springNet();
+	springNet.unpinAllPoints();
+	if (!mUI->actNetPinUndetermined->isChecked() || (mRigidity == nullptr))
 	{
 		return;
 	}
-	mDocument->springNet().addPoint(*coords, true);
-	updateScene();
+	for (const auto ptIdx: mRigidity->undeterminedPoints())
+	{
+		springNet.setPointPinned(ptIdx, true);
+	}
 }
 
 
 
 
 
-void MainWindow::gvMouseReleasedAddSpring(QPointF aScenePos)
+void MainWindow::addErrorEllipseItems()
 {
-	mNewSpringLine->hide();
-	if (mDocument->springNet().numPoints() == 0)
+	if (!mUI->actNetShowErrorEllipses->isChecked())
 	{
 		return;
 	}
-	auto startPointIdx = mDocument->springNet().nearestPointIdx(mMouseDownPos);
-	auto startPoint = mDocument->springNet().point(startPointIdx);
-	auto snap = mDocument->springNet().snapToPoint(aScenePos, snapThresholdSquared());
-	size_t endPointIdx;
-	std::optional<SpringParams> springParams;
-	if (snap.first)
+	requestCovariances();
+	const auto & springNet = mDocument->springNet();
+	if (!mCovariances.has_value() || (mCovariances->mTopologyVersion != springNet.topologyVersion()))
 	{
-		if (snap.second == startPointIdx)
-		{
-			// Trying to connect the spring to the same point on both ends
-			return;
-		}
-		auto pt2 = mDocument->springNet().point(snap.second);
-		auto diffX = startPoint.x() - pt2.x();
-		auto diffY = startPoint.y() - pt2.y();
-		auto len = std::sqrt(diffX * diffX + diffY * diffY);
-		springParams = SpringParamsDlg::ask(this, len, 1);
-		endPointIdx = snap.second;
+		// Nothing computed for these points yet
+		return;
 	}
-	else
+	const auto & covariances = mCovariances->mPointCovariances;
+
+	// Exaggerate the ellipses so that the largest one is visible, relative to the average spring length:
+	auto numPoints = covariances.size();
+	double maxSemiMajor = 0;
+	for (size_t idx = 0; idx < numPoints; ++idx)
 	{
-		// Not snapping to a point
-		auto diffX = startPoint.x() - aScenePos.x();
-		auto diffY = startPoint.y() - aScenePos.y();
-		auto len = std::sqrt(diffX * diffX + diffY * diffY);
-		springParams = SpringParamsDlg::ask(this, len, 1);
-		if (!springParams)
+		if (covariances[idx].mIsDetermined)
 		{
-			return;
+			maxSemiMajor = std::max(maxSemiMajor, LeastSquares::errorEllipse(covariances[idx]).mSemiMajor);
 		}
-		// Add a new point for the spring:
-		auto x = startPoint.x() - diffX * springParams->mIdealLength / len;
-		auto y = startPoint.y() - diffY * springParams->mIdealLength / len;
-		mDocument->springNet().addPoint({x, y}, false);
-		endPointIdx = mDocument->springNet().numPoints() - 1;
 	}
-
-	// Add the spring:
-	if (!springParams)
+	auto exaggeration = errorEllipseExaggeration(maxSemiMajor);
+	if (exaggeration <= 0)
 	{
 		return;
 	}
-	mDocument->springNet().addSpring(springParams->mIdealLength, springParams->mForce, startPointIdx, endPointIdx);
-
-	updateScene();
+	for (size_t idx = 0; idx < numPoints; ++idx)
+	{
+		const auto & cov = covariances[idx];
+		if (!cov.mIsDetermined || springNet.isPointFixed(idx))
+		{
+			continue;
+		}
+		mGraphicsScene->addItem(new GraphicsErrorEllipseItem(springNet.point(idx), LeastSquares::errorEllipse(cov), exaggeration));
+	}
 }
 
 
 
 
 
-void MainWindow::gvMouseReleasedRemoveObject(QPointF aScenePos)
+void MainWindow::requestCovariances()
 {
-	auto nearestObj = mDocument->springNet().nearestObject(aScenePos, snapThresholdSquared());
-	switch (nearestObj.first)
+	const auto & springNet = mDocument->springNet();
+	if (
+		mIsComputingCovariances ||
+		(
+			mCovariances.has_value() &&
+			(mCovariances->mTopologyVersion == springNet.topologyVersion()) &&
+			(mCovariances->mParamsVersion == springNet.paramsVersion()) &&
+			(mCovariances->mGeometryVersion == springNet.geometryVersion())
+		)
+	)
 	{
-		case SpringNet::ObjectType::None: return;
-		case SpringNet::ObjectType::Point:
-		{
-			mDocument->springNet().removePoint(nearestObj.second);
-			break;
-		}
-		case SpringNet::ObjectType::Spring:
+		return;
+	}
+	if ((mBackgroundSolver != nullptr) || (QApplication::mouseButtons() & Qt::LeftButton))
+	{
+		// The net is still moving, the covariances will be computed once it settles
+		return;
+	}
+
+	// The task works on a copy of the net, so that the net can be edited meanwhile:
+	mIsComputingCovariances = true;
+	mCovarianceTasks.run(
+		[this, net = springNet]()
 		{
-			mDocument->springNet().removeSpring(nearestObj.second);
-			break;
+			Covariances res{net.topologyVersion(), net.paramsVersion(), net.geometryVersion(), {}, {}};
+			try
+			{
+				mCovarianceLeastSquares.updateCovariances(net);
+				auto numPoints = net.numPoints();
+				res.mPointCovariances.reserve(numPoints);
+				for (size_t idx = 0; idx < numPoints; ++idx)
+				{
+					res.mPointCovariances.push_back(mCovarianceLeastSquares.pointCovariance(idx));
+				}
+			}
+			catch (const std::exception & exc)
+			{
+				res.mError = QString::fromUtf8(exc.what());
+			}
+			{
+				std::lock_guard lock(mFinishedCovariancesMutex);
+				mFinishedCovariances = std::move(res);
+			}
+			Q_EMIT covariancesFinished();
 		}
-	}
-	updateScene();
+	);
 }
 
 
 
 
 
-void MainWindow::doAdjust()
+void MainWindow::applyCovariances()
 {
-	mDocument->springNet().adjust();
+	std::optional<Covariances> res;
+	{
+		std::lock_guard lock(mFinishedCovariancesMutex);
+		res.swap(mFinishedCovariances);
+	}
+	mIsComputingCovariances = false;
+	if (!res.has_value())
+	{
+		return;
+	}
+	if (!res->mError.isEmpty())
+	{
+		statusBar()->showMessage(tr("Cannot compute the error ellipses: %1").arg(res->mError));
+	}
+	mCovariances = std::move(res);
+
+	// Shows the ellipses, and requests the covariances again if the net has changed meanwhile:
 	updateScene();
 }
 
@@ -587,46 +2158,90 @@ void MainWindow::doAdjust()
 
 
 
-void MainWindow::setCurrentTool(CurrentTool aNewTool)
+void MainWindow::addEnsembleItems()
 {
-	mCurrentTool = aNewTool;
-	mUI->actToolSelectObject->setChecked(aNewTool == CurrentTool::SelectObject);
-	mUI->actToolAddFixedPoint->setChecked(aNewTool == CurrentTool::AddFixedPoint);
-	mUI->actToolAddSpring->setChecked(aNewTool == CurrentTool::AddSpring);
-	mUI->actToolRemoveObject->setChecked(aNewTool == CurrentTool::RemoveObject);
+	const auto & springNet = mDocument->springNet();
+	if (
+		(mEnsemble == nullptr) ||
+		(mEnsembleTopologyVersion != springNet.topologyVersion()) ||
+		(mEnsembleParamsVersion != springNet.paramsVersion())
+	)
+	{
+		return;
+	}
+	auto statistics = mEnsemble->statistics();
+	auto numPoints = statistics.size();
+	std::vector<LeastSquares::ErrorEllipse> ellipses(numPoints);
+	double maxSemiMajor = 0;
+	for (size_t idx = 0; idx < numPoints; ++idx)
+	{
+		ellipses[idx] = LeastSquares::errorEllipse(statistics[idx].covariance());
+		maxSemiMajor = std::max(maxSemiMajor, ellipses[idx].mSemiMajor);
+	}
+	auto exaggeration = errorEllipseExaggeration(maxSemiMajor);
+	if (exaggeration <= 0)
+	{
+		return;
+	}
+	QPen p(QColor::fromRgb(0, 0, 0xc0));
+	p.setCosmetic(true);
+
+	if (mUI->actNetShowEnsembleScatter->isChecked())
+	{
+		// The samples' deviations from the mean, exaggerated the same way as the ellipses
+		// (the exaggeration is derived from the average spring length, which sizes the dots):
+		auto avgLength = exaggeration * maxSemiMajor / ERROR_ELLIPSE_SIZE_RATIO;
+		auto dotSize = ENSEMBLE_SCATTER_DOT_RATIO * avgLength;
+		QPainterPath path;
+		for (const auto & positions: mEnsemble->scatterSamples())
+		{
+			for (size_t idx = 0; idx < numPoints; ++idx)
+			{
+				auto mean = statistics[idx].mean();
+				auto pos = mean + (positions[idx] - mean) * exaggeration;
+				path.addRect(pos.x() - dotSize / 2, pos.y() - dotSize / 2, dotSize, dotSize);
+			}
+		}
+		auto item = mGraphicsScene->addPath(path, p, QBrush(p.color()));
+		item->setZValue(-1);
+		return;
+	}
+	for (size_t idx = 0; idx < numPoints; ++idx)
+	{
+		if ((statistics[idx].mCount < 2) || springNet.isPointFixed(idx))
+		{
+			continue;
+		}
+		auto item = new GraphicsErrorEllipseItem(statistics[idx].mean(), ellipses[idx], exaggeration);
+		item->setPen(p);
+		item->setToolTip(tr("Monte Carlo error ellipse from %1 samples (exaggerated %2x): %3 x %4")
+			.arg(statistics[idx].mCount)
+			.arg(exaggeration)
+			.arg(ellipses[idx].mSemiMajor)
+			.arg(ellipses[idx].mSemiMinor)
+		);
+		mGraphicsScene->addItem(item);
+	}
 }
 
 
 
 
 
-void MainWindow::updateScene()
+double MainWindow::errorEllipseExaggeration(double aMaxSemiMajor) const
 {
-	mGraphicsScene->clear();
-	mItemsForPoints.clear();
-	mItemsForSprings.clear();
-	for (const auto & p: mDocument->springNet().points())
-	{
-		auto pt = new GraphicsPointItem(*p, p->isFixed());
-		mGraphicsScene->addItem(pt);
-		pt->setFlag(QGraphicsItem::ItemIsSelectable);
-		mItemsForPoints.push_back(pt);
-	}
-	for (const auto & s: mDocument->springNet().springs())
-	{
-		auto x1 = s->point1().x();
-		auto y1 = s->point1().y();
-		auto x2 = s->point2().x();
-		auto y2 = s->point2().y();
-		auto line = new GraphicsSpringItem(x1, y1, x2, y2, s->idealLength());
-		mGraphicsScene->addItem(line);
-		line->setFlag(QGraphicsItem::ItemIsSelectable);
-		mItemsForSprings.push_back(line);
+	const auto & springNet = mDocument->springNet();
+	if ((aMaxSemiMajor <= 0) || (springNet.numSprings() == 0))
+	{
+		return 0;
 	}
-	mNewSpringLine = new GraphicsSpringItem(0, 0, 0, 0, 0);
-	mGraphicsScene->addItem(mNewSpringLine);
-
-	mNewSpringLine->hide();
+	double sumLengths = 0;
+	for (const auto & s: springNet.springs())
+	{
+		sumLengths += s.idealLength();
+	}
+	auto avgLength = sumLengths / static_cast<double>(springNet.numSprings());
+	return ERROR_ELLIPSE_SIZE_RATIO * avgLength / aMaxSemiMajor;
 }
 
 
@@ -652,41 +2267,93 @@ double MainWindow::snapThresholdSquared() const
 
 
 
-QGraphicsItem * MainWindow::itemForPoint(size_t aPointIdx)
+QGraphicsItem * MainWindow::createItemForObject(std::pair<SpringNet::ObjectType, size_t> aObjectDef)
 {
-	if (aPointIdx >= mDocument->springNet().numPoints())
+	const auto & springNet = mDocument->springNet();
+	switch (aObjectDef.first)
 	{
-		return nullptr;
+		case SpringNet::ObjectType::None:
+		{
+			return nullptr;
+		}
+		case SpringNet::ObjectType::Point:
+		{
+			if (aObjectDef.second >= springNet.numPoints())
+			{
+				return nullptr;
+			}
+			auto pt = new GraphicsPointItem(springNet.point(aObjectDef.second), springNet.isPointFixed(aObjectDef.second));
+			if (mUI->actNetHighlightUndetermined->isChecked() && (mRigidity != nullptr))
+			{
+				pt->setIsUndetermined(!mRigidity->isPointDetermined(aObjectDef.second));
+			}
+			return pt;
+		}
+		case SpringNet::ObjectType::Spring:
+		{
+			if (aObjectDef.second >= springNet.numSprings())
+			{
+				return nullptr;
+			}
+			const auto & s = springNet.spring(aObjectDef.second);
+			auto line = new GraphicsSpringItem(
+				s.point1(springNet).x(), s.point1(springNet).y(),
+				s.point2(springNet).x(), s.point2(springNet).y(),
+				s.idealLength()
+			);
+			if (mSuspectsTopologyVersion == springNet.topologyVersion())
+			{
+				for (const auto & suspect: mSuspects)
+				{
+					if (suspect.mSpringIdx == aObjectDef.second)
+					{
+						line->setIsSuspect(true);
+					}
+				}
+			}
+			return line;
+		}
+		case SpringNet::ObjectType::Angle:
+		{
+			if (aObjectDef.second >= springNet.numAngles())
+			{
+				return nullptr;
+			}
+			return new GraphicsAngleItem(springNet, springNet.angle(aObjectDef.second));
+		}
 	}
-	return mItemsForPoints[aPointIdx];
+	return nullptr;
 }
 
 
 
 
 
-QGraphicsItem * MainWindow::itemForSpring(size_t aSpringIdx)
+void MainWindow::highlightObject(std::pair<SpringNet::ObjectType, size_t> aObjectDef)
 {
-	if (aSpringIdx >= mDocument->springNet().numSprings())
+	auto item = createItemForObject(aObjectDef);
+	if (item == nullptr)
 	{
-		return nullptr;
+		return;
 	}
-	return mItemsForSprings[aSpringIdx];
+	item->setFlag(QGraphicsItem::ItemIsSelectable);
+	mGraphicsScene->addItem(item);
+	item->setSelected(true);
+	mHighlightItems.push_back(item);
 }
 
 
 
 
 
-QGraphicsItem * MainWindow::itemForObject(std::pair<SpringNet::ObjectType, size_t> aObjectDef)
+void MainWindow::clearHighlights()
 {
-	switch (aObjectDef.first)
+	for (auto item: mHighlightItems)
 	{
-		case SpringNet::ObjectType::None:   return nullptr;
-		case SpringNet::ObjectType::Point:  return itemForPoint(aObjectDef.second);
-		case SpringNet::ObjectType::Spring: return itemForSpring(aObjectDef.second);
+		mGraphicsScene->removeItem(item);
+		delete item;
 	}
-	return nullptr;
+	mHighlightItems.clear();
 }
 
 
@@ -695,11 +2362,36 @@ QGraphicsItem * MainWindow::itemForObject(std::pair<SpringNet::ObjectType, size_
 
 void MainWindow::selectNearestObject(QPointF aScenePos)
 {
-	auto nearest = mDocument->springNet().nearestObject(aScenePos, snapThresholdSquared());
-	auto item = itemForObject(nearest);
-	if (item != nullptr)
+	auto nearest = hoverQuery(aScenePos).mObject;
+	if (nearest.first != SpringNet::ObjectType::None)
+	{
+		clearHighlights();
+		highlightObject(nearest);
+	}
+}
+
+
+
+
+
+void MainWindow::netTableObjectSelected(std::pair<SpringNet::ObjectType, size_t> aObjectDef)
+{
+	clearHighlights();
+	highlightObject(aObjectDef);
+	const auto & springNet = mDocument->springNet();
+	switch (aObjectDef.first)
 	{
-		mGraphicsScene->clearSelection();
-		item->setSelected(true);
+		case SpringNet::ObjectType::Point:
+		{
+			mUI->gvMain->centerOn(springNet.point(aObjectDef.second));
+			break;
+		}
+		case SpringNet::ObjectType::Spring:
+		{
+			const auto & s = springNet.spring(aObjectDef.second);
+			mUI->gvMain->centerOn((s.point1(springNet) + s.point2(springNet)) / 2);
+			break;
+		}
+		default: break;
 	}
 }
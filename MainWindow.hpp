@@ -1,9 +1,28 @@
 #pragma once
 
 #include "Document.hpp"
+#include "Ensemble.hpp"
+#include "HoverQuery.hpp"
+#include "InteractionRecording.hpp"
+#include "LeastSquares.hpp"
+#include "NetExport.hpp"
+#include "NetTableDock.hpp"
+#include "NetTileRenderer.hpp"
+#include "RigidityAnalysis.hpp"
+#include "RollingDuration.hpp"
+#include "Solver.hpp"
+#include "SolverThread.hpp"
+#include "StrainMap.hpp"
+#include "TaskScheduler.hpp"
+#include <mutex>
 #include <QMainWindow>
 #include <QGraphicsScene>
 #include <QGraphicsLineItem>
+#include <QGraphicsEllipseItem>
+#include <QGraphicsPathItem>
+#include <QJsonObject>
+#include <QLabel>
+#include <QTimer>
 
 
 
@@ -27,6 +46,9 @@ class GraphicsPointItem:
 	/** A fixed point has a different graphics representation. */
 	bool mIsFixed;
 
+	/** An undetermined point (not rigidly connected to the fixed points) is highlighted. */
+	bool mIsUndetermined = false;
+
 
 public:
 	GraphicsPointItem(QPointF aPt, bool aIsFixed):
@@ -35,6 +57,8 @@ public:
 	{
 	}
 
+	void setIsUndetermined(bool aIsUndetermined) { mIsUndetermined = aIsUndetermined; update(); }
+
 
 	void paint(
 		QPainter * aPainter,
@@ -57,6 +81,9 @@ class GraphicsSpringItem:
 	/** The ideal length, to be displayed in the middle of the line. */
 	double mIdealLength;
 
+	/** A spring suspected of a gross error (by the robust solve) is highlighted. */
+	bool mIsSuspect = false;
+
 	using Super = QGraphicsLineItem;
 
 
@@ -69,6 +96,8 @@ public:
 
 	void setIdealLength(double aIdealLength) { mIdealLength = aIdealLength; update(); }
 
+	void setIsSuspect(bool aIsSuspect) { mIsSuspect = aIsSuspect; update(); }
+
 	void setLine(QPointF aPt1, QPointF aPt2)
 	{
 		Super::setLine(aPt1.x(), aPt1.y(), aPt2.x(), aPt2.y());
@@ -85,6 +114,54 @@ public:
 
 
 
+/** QGraphicsItem descendant that is used for drawing angles: an arc at the station, between the two springs. */
+class GraphicsAngleItem:
+	public QGraphicsPathItem
+{
+	using Super = QGraphicsPathItem;
+
+	/** The ideal and current angle, in radians, to be displayed in the middle of the arc. */
+	double mIdealAngle;
+	double mCurrentAngle;
+
+	/** The middle of the arc. */
+	QPointF mMarkerPos;
+
+
+public:
+
+	/** Creates the arc for the specified angle of the specified net, through the angle's marker position. */
+	GraphicsAngleItem(const SpringNet & aNet, const Angle & aAngle);
+
+	void paint(
+		QPainter * aPainter,
+		const QStyleOptionGraphicsItem * aOption,
+		QWidget * aWidget = nullptr
+	) override;
+};
+
+
+
+
+
+/** QGraphicsItem descendant that is used for drawing the error ellipse of a point. */
+class GraphicsErrorEllipseItem:
+	public QGraphicsEllipseItem
+{
+	using Super = QGraphicsEllipseItem;
+
+
+public:
+
+	/** Creates the ellipse centered at the specified point, with the semi-axes multiplied by aExaggeration
+	(the real ellipses are usually too small to be seen at the scale of the net). */
+	GraphicsErrorEllipseItem(QPointF aCenter, const LeastSquares::ErrorEllipse & aEllipse, double aExaggeration);
+};
+
+
+
+
+
 /** The main window of the application. */
 class MainWindow:
 	public QMainWindow
@@ -100,6 +177,7 @@ class MainWindow:
 		SelectObject,
 		AddFixedPoint,
 		AddSpring,
+		AddAngle,
 		RemoveObject,
 	} mCurrentTool;
 
@@ -109,15 +187,28 @@ public:
     MainWindow(QWidget * aParent = nullptr);
 	~MainWindow();
 
+	/** Replaces the current document with the specified (new or loaded) one and shows it.
+	Resets all the per-document state (the solves, the pending auto-adjust). */
+	void setDocument(std::unique_ptr<Document> aDocument);
+
+	/** Replays the recorded interactions on the view, through the same handlers as the live events, measuring how
+	long each event takes to handle. The window is resized so that the view has the recorded viewport size.
+	Returns the latency statistics per event type (see LatencyStats::toJson()). */
+	QJsonObject replayInteractions(const InteractionRecording & aRecording);
+
 
 private:
 
 	/** The Qt-managed UI. */
 	std::unique_ptr<Ui::MainWindow> mUI;
 
-	/** The scene calculated from the document and displayed in gvMain. */
+	/** The scene displayed in gvMain, holding the overlays drawn over the net: the selection, the new spring line,
+	the error ellipses and the ensemble. */
 	std::unique_ptr<QGraphicsScene> mGraphicsScene;
 
+	/** Draws the net itself in gvMain, as the background of mGraphicsScene. */
+	NetTileRenderer mNetRenderer;
+
 	/** The document encompassing all the data. */
 	std::unique_ptr<Document> mDocument;
 
@@ -127,19 +218,156 @@ private:
 	/** The line used to show newly created spring. */
 	GraphicsSpringItem * mNewSpringLine = nullptr;
 
-	/** The QGraphicsItem-s representing the points, in the same order as the points. */
-	std::vector<QGraphicsItem *> mItemsForPoints;
-
-	/** The QGraphicsItem-s representing the springs, in the same order as the springs. */
-	std::vector<QGraphicsItem *> mItemsForSprings;
+	/** The selected items drawn over the net to highlight the objects under the mouse. Owned by mGraphicsScene. */
+	std::vector<QGraphicsItem *> mHighlightItems;
 
 	/** The object that is currently being manipulated. */
 	std::pair<SpringNet::ObjectType, size_t> mCurrentObject = {SpringNet::ObjectType::None, 0};
 
+	/** The neighborhood re-adjusted while dragging a point; prepared on the mouse-down, nullopt when not dragging. */
+	std::optional<SpringNet::DragRegion> mDragRegion;
+
+	/** Set once the point picked by the mouse-down has actually been moved; a mere click (or the first click of a
+	double-click) doesn't start the background adjustment on release. */
+	bool mHasDraggedPoint = false;
+
+	/** Finds the objects under the mouse while hovering and dragging, reusing its work between the mouse moves. */
+	HoverQuery mHoverQuery;
+
+	/** Polls the background adjustment once per frame, taking over the newest positions it has published. */
+	QTimer mBackgroundSolveTimer;
+
+	/** The worker thread running the background adjustment, nullptr if not running. */
+	std::unique_ptr<SolverThread> mBackgroundSolver;
+
+	/** Throttles the full scene updates while the net moves (dragging a point, polling the background adjustment):
+	each move only updates the renderer's positions and arms this, updateScene() runs once it times out. */
+	QTimer mSceneRefreshTimer;
+
+	/** Debounces the edits while auto-adjusting: each edit restarts it, the net is adjusted once it times out. */
+	QTimer mAutoAdjustTimer;
+
+	/** The points affected by the edits since the last auto-adjustment. */
+	std::vector<size_t> mAutoAdjustPoints;
+
+	/** The state of the paused background adjustment, nullopt if there's none. */
+	std::optional<Solver::Checkpoint> mPausedSolve;
+
+	/** The versions of the net when mPausedSolve was taken; the paused solve is dropped if the net differs. */
+	uint64_t mPausedSolveTopologyVersion = 0;
+	uint64_t mPausedSolveParamsVersion = 0;
+	uint64_t mPausedSolveGeometryVersion = 0;
+
+	/** The acceleration scheme that the user has chosen for the solver. */
+	Solver::Scheme mSolverScheme = Solver::Scheme::Anderson;
+
+	/** The rigidity analysis of the current net, nullptr if not analysed. */
+	std::unique_ptr<RigidityAnalysis> mRigidity;
+
+	/** The topology version of the net that mRigidity has been computed for. */
+	uint64_t mRigidityTopologyVersion = 0;
+
+	/** The least-squares view of the net, used for the direct and robust solves.
+	Keeps its factorization between uses, so that re-solving after editing a spring is fast. */
+	LeastSquares mLeastSquares;
+
+	/** The loss function that the user has chosen for the robust solve. */
+	LeastSquares::RobustLoss mRobustLoss = LeastSquares::RobustLoss::Huber;
+
+	/** The suspect springs found by the last robust solve, highlighted in the scene. */
+	std::vector<LeastSquares::Suspect> mSuspects;
+
+	/** The topology version of the net that mSuspects refer to; the suspects are dropped once the topology changes. */
+	uint64_t mSuspectsTopologyVersion = 0;
+
+	/** What the springs are colored by in the heat map, nullopt for plain springs. */
+	std::optional<StrainMap::Mode> mStrainMapMode;
+
+	/** The heat map colors of the springs, recomputed on each scene update while mStrainMapMode is set. */
+	StrainMap mStrainMap;
+
+	/** The Monte Carlo ensemble running in the background or finished, nullptr if none. */
+	std::unique_ptr<Ensemble> mEnsemble;
+
+	/** The topology and params versions of the net that mEnsemble has been started for; the ensemble is discarded
+	once either changes. */
+	uint64_t mEnsembleTopologyVersion = 0;
+	uint64_t mEnsembleParamsVersion = 0;
+
+	/** The settings that the user has last chosen for the ensemble. */
+	Ensemble::Settings mEnsembleSettings;
+
+	/** The options that the user has last chosen for exporting the net. */
+	NetExport::Options mNetExportOptions;
+
+	/** Periodically shows the progress of mEnsemble while it runs. */
+	QTimer mEnsembleTimer;
+
+	/** The performance HUD in the status bar, shown while Net / Show performance HUD is checked.
+	Owned by the status bar. */
+	QLabel * mPerformanceHud = nullptr;
+
+	/** The dockable table of the net's points or springs, shown by Net / Object table. Owned by this window. */
+	NetTableDock * mNetTableDock = nullptr;
+
+	/** Periodically refreshes mPerformanceHud while it is shown. */
+	QTimer mPerformanceHudTimer;
+
+	/** The recent durations of the hover queries and of updateScene(), for the performance HUD. */
+	RollingDuration mHoverQueryTimes;
+	RollingDuration mUpdateSceneTimes;
+
+	/** The background solver's iteration count at the last HUD refresh, and the time of that refresh, for showing the
+	iterations per second. */
+	size_t mPerformanceHudLastIterations = 0;
+	std::chrono::steady_clock::time_point mPerformanceHudLastRefresh;
+
+	/** The covariances of the points for the error ellipses, as computed by the covariance task, and the versions of
+	the net that they were computed for. */
+	struct Covariances
+	{
+		uint64_t mTopologyVersion;
+		uint64_t mParamsVersion;
+		uint64_t mGeometryVersion;
+		std::vector<LeastSquares::PointCovariance> mPointCovariances;
+
+		/** The reason why the covariances could not be computed (mPointCovariances is empty then); empty on success. */
+		QString mError;
+	};
+
+	/** The covariances that the error ellipses are drawn from; nullopt if none computed yet.
+	Kept until the covariances for the current net arrive, the ellipses stay shown meanwhile. */
+	std::optional<Covariances> mCovariances;
+
+	/** Set while the covariance task is running; at most one runs at a time. */
+	bool mIsComputingCovariances = false;
+
+	/** Computes the covariances in the covariance task, keeping its factorization between the tasks.
+	Only used by the task, never by the GUI thread. */
+	LeastSquares mCovarianceLeastSquares;
+
+	/** Protects mFinishedCovariances, shared with the covariance task. */
+	std::mutex mFinishedCovariancesMutex;
+
+	/** The covariances finished by the task and not yet taken over by the GUI thread. */
+	std::optional<Covariances> mFinishedCovariances;
+
+	/** The covariance task; declared last, so that it waits for the task before the members it uses are gone. */
+	TaskScheduler::TaskGroup mCovarianceTasks{TaskScheduler::Priority::Solve};
+
 
 	/** Connects the actions to their slots in this form. */
 	void connectActions();
 
+	/** Fills the Net / Solver scheme submenu with an exclusive action for each scheme. */
+	void createSolverSchemeActions();
+
+	/** Fills the Net / Robust loss submenu with an exclusive action for each loss function. */
+	void createRobustLossActions();
+
+	/** Fills the Net / Spring colors submenu with an exclusive action for the plain springs and for each strain map mode. */
+	void createSpringColorActions();
+
 
 public:
 
@@ -149,16 +377,43 @@ public:
 	void fileOpenByName(const QString & aFileName);
 	void fileSave();
 	void fileSaveAs();
+	void fileImportMeasurements();
+	void fileExportNet();
+	void fileExportSolverTrace();
+	void fileRecordInteractions(bool aShouldRecord);
 
 	void toolSelectObject();
 	void toolAddFixedPoint();
 	void toolAddSpring();
+	void toolAddAngle();
 	void toolRemoveObject();
 
 	void zoomIn();
 	void zoomOut();
 	void zoomAll();
 
+	void netSolve();
+	void netPauseResumeSolve();
+	void netLeastSquaresSolve();
+	void netRobustSolve();
+	void netHighlightUndetermined();
+	void netPinUndetermined();
+	void netShowErrorEllipses();
+	void netRunEnsemble();
+	void netClearEnsemble();
+	void netShowEnsembleScatter();
+	void netReorderRcm();
+	void netReorderHilbert();
+	void netShowMemoryUsage();
+	void netAutoAdjust(bool aIsEnabled);
+	void netShowPerformanceHud(bool aShouldShow);
+
+
+Q_SIGNALS:
+
+	/** Emitted by the covariance task when it has finished. Internal, connected to applyCovariances(). */
+	void covariancesFinished();
+
 
 private:
 
@@ -170,32 +425,108 @@ private:
 	void gvMouseReleasedSelectObject(QPointF aScenePos);
 	void gvMouseReleasedAddFixedPoint(QPointF aScenePos);
 	void gvMouseReleasedAddSpring(QPointF aScenePos);
+	void gvMouseReleasedAddAngle(QPointF aScenePos);
 	void gvMouseReleasedRemoveObject(QPointF aScenePos);
 
 	void doAdjust();
 
+	/** Starts (or restarts) the full adjustment running in the background on the event loop. */
+	void startBackgroundSolve();
+
+	/** Stops the background adjustment, if running. */
+	void stopBackgroundSolve();
+
+	/** Returns the paused solve, if it is still valid for the current net; drops it otherwise. */
+	std::optional<Solver::Checkpoint> pausedSolve();
+
+	/** Returns true if mPausedSolve is set and the net hasn't changed since it was taken. */
+	bool isPausedSolveValid() const;
+
+	/** Notes the current versions of the net as the ones that mPausedSolve is valid for. */
+	void updatePausedSolveVersions();
+
+	/** Shows the newest positions published by the background adjustment, and its result once finished;
+	called by mBackgroundSolveTimer. */
+	void backgroundSolveStep();
+
+	/** Notes that an edit has affected the specified points; if auto-adjusting, cancels any running adjustment and
+	(re)starts the debounce, so that a burst of edits is adjusted only once. */
+	void scheduleAutoAdjust(const std::vector<size_t> & aPtIndices);
+
+	/** Adjusts the neighborhood of the points affected by the edits, warm-started from the current positions; if the
+	edits reach further than the neighborhood, the background adjustment takes over. Called by mAutoAdjustTimer. */
+	void autoAdjust();
+
+	/** Shows the progress of mEnsemble; called by mEnsembleTimer. Discards the ensemble if the net has changed. */
+	void ensembleStep();
+
+	/** Shows the current performance counters in mPerformanceHud; called by mPerformanceHudTimer. */
+	void updatePerformanceHud();
+
+	/** Runs the hover query for the specified position, timing it for the performance HUD. */
+	HoverQuery::Result hoverQuery(QPointF aScenePos);
+
+	/** Reorders the document's net for cache locality and remaps the indices held by this window to the new order. */
+	void reorderNet(SpringNet::PointOrdering aOrdering);
+
 	/** Sets the current tool, updates the actions. */
 	void setCurrentTool(CurrentTool aNewTool);
 
-	/** Updates the mGraphicsScene from the current document. */
+	/** Updates mNetRenderer and the overlays in mGraphicsScene from the current document, and the views derived from
+	the net: the rigidity, the strain map and the object table. */
 	void updateScene();
 
+	/** Shows the net's new positions while it moves: only updates the positions in mNetRenderer, the rest of
+	updateScene() follows throttled by mSceneRefreshTimer. */
+	void updateNetPositions();
+
+	/** Re-runs the rigidity analysis if the net's topology has changed since the last one.
+	Does nothing if neither the highlighting nor the pinning of undetermined points is enabled. */
+	void updateRigidity();
+
+	/** Pins the undetermined points in the net, if enabled by the user; unpins all points otherwise. */
+	void applyRigidityPins();
+
+	/** Adds the error ellipses of the points to mGraphicsScene, if enabled by the user, from mCovariances.
+	Requests the covariances for the current net, if needed; until they arrive, the previous ones are shown, as long as
+	the topology is the same. */
+	void addErrorEllipseItems();
+
+	/** Starts the covariance task for a copy of the current net, unless mCovariances are already for the current net,
+	or the task is already running (applyCovariances() requests again once it finishes), or the net is still being
+	dragged or solved. */
+	void requestCovariances();
+
+	/** Takes over the covariances finished by the covariance task and updates the scene. Called in the GUI thread. */
+	void applyCovariances();
+
+	/** Adds the statistics of mEnsemble to mGraphicsScene: the empirical error ellipses, or the scattered sample
+	positions if enabled by the user. */
+	void addEnsembleItems();
+
+	/** Returns the factor to exaggerate the error ellipses with, so that the largest one (of aMaxSemiMajor) is well
+	visible relative to the average spring length. Returns 0 if there's nothing to show. */
+	double errorEllipseExaggeration(double aMaxSemiMajor) const;
+
 	/** Scales the specified threshold from screen coords to scene coords. */
 	double scaleThreshold(double aThreshold) const;
 
 	/** Returns the threshold to snap to objects in scene coord length, squared. */
 	double snapThresholdSquared() const;
 
-	/** Returns the graphics item representing the specified point visually, nullptr if not found. */
-	QGraphicsItem * itemForPoint(size_t aPointIdx);
+	/** Creates a new graphics item representing the specified object visually, same as drawn by mNetRenderer.
+	Returns nullptr if no such object. */
+	QGraphicsItem * createItemForObject(std::pair<SpringNet::ObjectType, size_t> aObjectDef);
 
-	/** Returns the graphics item representing the specified spring visually, nullptr if not found. */
-	QGraphicsItem * itemForSpring(size_t aSpringIdx);
+	/** Adds a selected item for the specified object over the net, to highlight it. */
+	void highlightObject(std::pair<SpringNet::ObjectType, size_t> aObjectDef);
 
-	/** Returns the graphics item representing the specified object visually.
-	Returns nullptr if no such item. */
-	QGraphicsItem * itemForObject(std::pair<SpringNet::ObjectType, size_t> aObjectDef);
+	/** Removes all the items added by highlightObject(). */
+	void clearHighlights();
 
 	/** Selects the nearest object, deselecting any previous selection. */
 	void selectNearestObject(QPointF aScenePos);
+
+	/** Highlights the object selected in the object table and scrolls the view to it. */
+	void netTableObjectSelected(std::pair<SpringNet::ObjectType, size_t> aObjectDef);
 };
@@ -0,0 +1,359 @@
+#include "MeasurementImport.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <unordered_map>
+#include <QFile>
+#include <QString>
+
+#include "Parallel.hpp"
+
+
+
+
+
+namespace {
+
+/** The smallest part of the text worth parsing on a separate thread. */
+static const size_t MIN_CHUNK_SIZE = 64 * 1024;
+
+/** The max number of fields in a record (an S record with all the optional fields). */
+static const size_t MAX_FIELDS = 6;
+
+/** The characters separating the fields of a record. */
+static const std::string_view FIELD_SEPARATORS = ",;\t";
+
+/** The UTF-8 byte order mark, written at the start of CSV files by some spreadsheets. */
+static const std::string_view UTF8_BOM = "\xef\xbb\xbf";
+
+
+
+
+
+/** Returns the string without the leading and trailing spaces (and CRs, for files with Windows line ends). */
+std::string_view trim(std::string_view aStr)
+{
+	static const std::string_view whitespace = " \t\r";
+	auto start = aStr.find_first_not_of(whitespace);
+	if (start == std::string_view::npos)
+	{
+		return {};
+	}
+	auto end = aStr.find_last_not_of(whitespace);
+	return aStr.substr(start, end - start + 1);
+}
+
+
+
+
+
+/** Returns the trimmed field without the enclosing double quotes, if any. */
+std::string_view unquote(std::string_view aField)
+{
+	aField = trim(aField);
+	if ((aField.size() >= 2) && (aField.front() == '"') && (aField.back() == '"'))
+	{
+		return trim(aField.substr(1, aField.size() - 2));
+	}
+	return aField;
+}
+
+
+
+
+
+/** Parses the field as a number, independent of the locale.
+Throws a std::runtime_error naming aWhat if the field is not a finite number. */
+double parseNumber(std::string_view aField, const char * aWhat)
+{
+	auto str = aField;
+	if (!str.empty() && (str.front() == '+'))
+	{
+		str.remove_prefix(1);
+	}
+	double res = 0;
+	auto [end, err] = std::from_chars(str.data(), str.data() + str.size(), res);
+	if ((err != std::errc()) || (end != str.data() + str.size()) || !std::isfinite(res))
+	{
+		throw std::runtime_error("Invalid " + std::string(aWhat) + " \"" + std::string(aField) + "\".");
+	}
+	return res;
+}
+
+
+
+
+
+/** Returns the error message prefixed by the (1-based) line number. */
+std::string lineError(size_t aLine, const std::string & aMessage)
+{
+	return "Line " + std::to_string(aLine) + ": " + aMessage;
+}
+
+}  // anonymous namespace
+
+
+
+
+
+SpringNet::Bulk MeasurementImport::parse(std::string_view aText)
+{
+	if (aText.substr(0, UTF8_BOM.size()) == UTF8_BOM)
+	{
+		aText.remove_prefix(UTF8_BOM.size());
+	}
+
+	// Split the text into chunks at line boundaries, one per scheduler thread:
+	auto numThreads = Parallel::numThreads();
+	auto numChunks = std::clamp<size_t>(aText.size() / MIN_CHUNK_SIZE, 1, numThreads);
+	std::vector<Chunk> chunks;
+	chunks.reserve(numChunks);
+	size_t start = 0;
+	for (size_t i = 0; (i < numChunks) && (start < aText.size()); ++i)
+	{
+		auto end = aText.size();
+		if (i + 1 < numChunks)
+		{
+			end = aText.find('\n', std::max(start, aText.size() * (i + 1) / numChunks));
+			end = (end == std::string_view::npos) ? aText.size() : end + 1;
+		}
+		chunks.emplace_back().mText = aText.substr(start, end - start);
+		start = end;
+	}
+
+	Parallel::runTasks(chunks.size(), [&](size_t aChunkIdx)
+		{
+			parseChunk(chunks[aChunkIdx]);
+		},
+		TaskScheduler::Priority::IO
+	);
+
+	// Report the first error in the text; make the line numbers global:
+	size_t firstLine = 1;
+	size_t numPoints = 0;
+	std::vector<size_t> springOffsets;
+	springOffsets.reserve(chunks.size() + 1);
+	springOffsets.push_back(0);
+	for (auto & chunk: chunks)
+	{
+		if (!chunk.mError.empty())
+		{
+			throw std::runtime_error(lineError(firstLine + chunk.mErrorLine, chunk.mError));
+		}
+		for (auto & pt: chunk.mPoints)
+		{
+			pt.mLine += firstLine;
+		}
+		for (auto & s: chunk.mSprings)
+		{
+			s.mLine += firstLine;
+		}
+		firstLine += chunk.mNumLines;
+		numPoints += chunk.mPoints.size();
+		springOffsets.push_back(springOffsets.back() + chunk.mSprings.size());
+	}
+	auto numSprings = springOffsets.back();
+
+	// Assign the point indices in the order of the P records:
+	SpringNet::Bulk res;
+	res.mPoints.reserve(numPoints);
+	res.mIsFixed.reserve(numPoints);
+	std::unordered_map<std::string_view, uint32_t> stations;
+	stations.reserve(numPoints);
+	std::vector<size_t> stationLines;
+	stationLines.reserve(numPoints);
+	for (const auto & chunk: chunks)
+	{
+		for (const auto & pt: chunk.mPoints)
+		{
+			auto [itr, isNew] = stations.emplace(pt.mName, static_cast<uint32_t>(res.mPoints.size()));
+			if (!isNew)
+			{
+				throw std::runtime_error(lineError(pt.mLine,
+					"Station \"" + std::string(pt.mName) + "\" is already defined on line " +
+					std::to_string(stationLines[itr->second]) + "."
+				));
+			}
+			res.mPoints.emplace_back(pt.mX, pt.mY);
+			res.mIsFixed.push_back(pt.mIsFixed);
+			stationLines.push_back(pt.mLine);
+		}
+	}
+
+	// Resolve the stations of the readings, each chunk into its own range of the arrays.
+	// The map is only read here, so the chunks can share it:
+	std::vector<uint32_t> pointIdx1(numSprings);
+	std::vector<uint32_t> pointIdx2(numSprings);
+	std::vector<double> lengths(numSprings);
+	std::vector<double> heightDifferences(numSprings);
+	std::vector<double> forces(numSprings);
+	auto findStation = [&stations](std::string_view aName, size_t aLine)
+	{
+		auto itr = stations.find(aName);
+		if (itr == stations.end())
+		{
+			throw std::runtime_error(lineError(aLine, "Unknown station \"" + std::string(aName) + "\"."));
+		}
+		return itr->second;
+	};
+	Parallel::runTasks(chunks.size(), [&](size_t aChunkIdx)
+		{
+			auto idx = springOffsets[aChunkIdx];
+			for (const auto & s: chunks[aChunkIdx].mSprings)
+			{
+				pointIdx1[idx] = findStation(s.mStation1, s.mLine);
+				pointIdx2[idx] = findStation(s.mStation2, s.mLine);
+				if (pointIdx1[idx] == pointIdx2[idx])
+				{
+					throw std::runtime_error(lineError(s.mLine, "The reading starts and ends at the same station."));
+				}
+				lengths[idx] = s.mLength;
+				heightDifferences[idx] = s.mHeightDifference;
+				forces[idx] = s.mForce;
+				++idx;
+			}
+		},
+		TaskScheduler::Priority::IO
+	);
+
+	Spring::projectLengthsToFloor(lengths, heightDifferences);
+
+	res.mSprings.reserve(numSprings);
+	for (size_t i = 0; i < numSprings; ++i)
+	{
+		res.mSprings.emplace_back(lengths[i], forces[i], pointIdx1[i], pointIdx2[i]);
+	}
+	return res;
+}
+
+
+
+
+
+SpringNet::Bulk MeasurementImport::parseFile(const QString & aFileName)
+{
+	QFile f(aFileName);
+	if (!f.open(QIODevice::ReadOnly))
+	{
+		throw std::runtime_error("Cannot open file for reading.");
+	}
+	auto contents = f.readAll();
+	return parse(std::string_view(contents.constData(), static_cast<size_t>(contents.size())));
+}
+
+
+
+
+
+void MeasurementImport::parseChunk(Chunk & aChunk)
+{
+	auto text = aChunk.mText;
+	size_t lineNum = 0;
+	size_t start = 0;
+	while (start < text.size())
+	{
+		auto end = text.find('\n', start);
+		if (end == std::string_view::npos)
+		{
+			end = text.size();
+		}
+		auto line = trim(text.substr(start, end - start));
+		if (!line.empty() && (line.front() != '#'))
+		{
+			try
+			{
+				parseLine(line, lineNum, aChunk);
+			}
+			catch (const std::exception & exc)
+			{
+				aChunk.mError = exc.what();
+				aChunk.mErrorLine = lineNum;
+				return;
+			}
+		}
+		lineNum += 1;
+		start = end + 1;
+	}
+	aChunk.mNumLines = lineNum;
+}
+
+
+
+
+
+void MeasurementImport::parseLine(std::string_view aLine, size_t aLineNum, Chunk & aChunk)
+{
+	// Split into fields:
+	std::string_view fields[MAX_FIELDS];
+	size_t numFields = 0;
+	size_t start = 0;
+	while (true)
+	{
+		auto end = aLine.find_first_of(FIELD_SEPARATORS, start);
+		if (numFields >= MAX_FIELDS)
+		{
+			throw std::runtime_error("Too many fields.");
+		}
+		fields[numFields++] = unquote(aLine.substr(start, end - start));
+		if (end == std::string_view::npos)
+		{
+			break;
+		}
+		start = end + 1;
+	}
+
+	auto type = fields[0];
+	if ((type == "P") || (type == "p"))
+	{
+		if ((numFields < 4) || (numFields > 5))
+		{
+			throw std::runtime_error("A point record needs 4 or 5 fields.");
+		}
+		if (fields[1].empty())
+		{
+			throw std::runtime_error("Missing station name.");
+		}
+		auto isFixed = (numFields > 4) && !fields[4].empty() && (parseNumber(fields[4], "fixed flag") != 0);
+		aChunk.mPoints.push_back({
+			fields[1],
+			parseNumber(fields[2], "X coord"),
+			parseNumber(fields[3], "Y coord"),
+			isFixed,
+			aLineNum
+		});
+	}
+	else if ((type == "S") || (type == "s"))
+	{
+		if (numFields < 4)
+		{
+			throw std::runtime_error("A tape reading record needs 4 to 6 fields.");
+		}
+		if (fields[1].empty() || fields[2].empty())
+		{
+			throw std::runtime_error("Missing station name.");
+		}
+		auto length = parseNumber(fields[3], "measured length");
+		auto heightDifference = ((numFields > 4) && !fields[4].empty()) ? parseNumber(fields[4], "height difference") : 0;
+		auto force = ((numFields > 5) && !fields[5].empty()) ? parseNumber(fields[5], "force") : 1;
+		if (length <= 0)
+		{
+			throw std::runtime_error("The measured length must be positive.");
+		}
+		if (std::abs(heightDifference) >= length)
+		{
+			throw std::runtime_error("The height difference must be shorter than the measured length.");
+		}
+		if (force <= 0)
+		{
+			throw std::runtime_error("The force must be positive.");
+		}
+		aChunk.mSprings.push_back({fields[1], fields[2], length, heightDifference, force, aLineNum});
+	}
+	else
+	{
+		throw std::runtime_error("Unknown record type \"" + std::string(type) + "\".");
+	}
+}
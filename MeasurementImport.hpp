@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "SpringNet.hpp"
+
+
+
+
+
+// fwd:
+class QString;
+
+
+
+
+
+/** Imports the measurements of a survey in bulk from a CSV / field-book text file, instead of entering each one through
+a dialog.
+Each line is one record, its fields separated by commas, semicolons or tabs. Empty lines and lines starting with '#' are
+skipped. The records are:
+	P, <station>, <x>, <y> [, <fixed>]
+	S, <station 1>, <station 2>, <measured length> [, <height difference> [, <force>]]
+A P record gives a station's approximate coords; a non-zero <fixed> makes it a fixed point. An S record is a tape
+reading between two stations, projected onto the floor by the height difference (0 by default) into the spring's ideal
+length; the force is the reading's weight (1 by default). The records may come in any order, the station names are
+case-sensitive.
+The text is parsed in parallel chunks; then the station names are resolved to point indices through a hash map, and the
+lengths are projected in a single batch. The result is added to the net by SpringNet::addBulk(), as a single change. */
+class MeasurementImport
+{
+public:
+
+	/** Parses the whole text into the points and springs to be added.
+	Throws a std::runtime_error naming the first offending line if anything is wrong. */
+	static SpringNet::Bulk parse(std::string_view aText);
+
+	/** Reads and parses the specified file, same as parse(). */
+	static SpringNet::Bulk parseFile(const QString & aFileName);
+
+
+protected:
+
+	/** A parsed P record. The name points into the parsed text. */
+	struct PointRecord
+	{
+		std::string_view mName;
+		double mX;
+		double mY;
+		bool mIsFixed;
+		size_t mLine;
+	};
+
+
+	/** A parsed S record. The names point into the parsed text. */
+	struct SpringRecord
+	{
+		std::string_view mStation1;
+		std::string_view mStation2;
+		double mLength;
+		double mHeightDifference;
+		double mForce;
+		size_t mLine;
+	};
+
+
+	/** A part of the text parsed by a single thread, starting at a line boundary. */
+	struct Chunk
+	{
+		std::string_view mText;
+
+		/** The number of lines in mText; the records' mLine are relative to the chunk until all chunks are parsed. */
+		size_t mNumLines = 0;
+
+		std::vector<PointRecord> mPoints;
+		std::vector<SpringRecord> mSprings;
+
+		/** The first error in the chunk, empty if none; mErrorLine is relative to the chunk. */
+		std::string mError;
+		size_t mErrorLine = 0;
+	};
+
+
+	/** Parses the chunk's lines into its records; stops at the first error, storing it in the chunk. */
+	static void parseChunk(Chunk & aChunk);
+
+	/** Parses a single non-empty line into a record of the chunk. Throws a std::runtime_error on error. */
+	static void parseLine(std::string_view aLine, size_t aLineNum, Chunk & aChunk);
+};
@@ -0,0 +1,471 @@
+#include "NetExport.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <numbers>
+#include <stdexcept>
+#include <utility>
+#include <QColor>
+#include <QFile>
+#include <QLineF>
+#include <QRectF>
+
+#include "SpringNet.hpp"
+
+
+
+
+
+namespace {
+
+/** The size of the output buffer; the text is written into the device in pieces of about this size. */
+static const size_t BUFFER_SIZE = 1024 * 1024;
+
+/** The most any single number takes in the output. */
+static const size_t MAX_NUMBER_LENGTH = 32;
+
+/** The half-size of a point marker, and the radius of a fixed point's marker (same as drawn in the view). */
+static const double POINT_MARKER_HALF_SIZE = 6.5;
+
+/** The height of the label text, in scene units; roughly the size of the labels in the view at 100 % zoom. */
+static const double LABEL_HEIGHT = 10;
+
+/** The margin around the net's points in the exported extent, so that the markers and labels are not cut off. */
+static const double EXTENT_MARGIN = 20;
+
+/** The hue of the residual colors for the most compressed and the most stretched springs, in degrees. */
+static const int RESIDUAL_HUE_SHORT = 240;
+static const int RESIDUAL_HUE_LONG = 0;
+
+/** The AutoCAD Color Index of each residual class; a hue ramp from blue to red, same as the SVG colors. */
+static const int RESIDUAL_ACI[] = {170, 150, 130, 110, 90, 70, 50, 30, 10};
+
+/** The names of the DXF layers and their AutoCAD Color Index. */
+static const char * DXF_LAYER_POINTS = "POINTS";
+static const char * DXF_LAYER_FIXED_POINTS = "FIXED_POINTS";
+static const char * DXF_LAYER_SPRINGS = "SPRINGS";
+static const char * DXF_LAYER_ANGLES = "ANGLES";
+static const char * DXF_LAYER_LABELS = "LABELS";
+static const std::pair<const char *, int> DXF_LAYERS[] =
+{
+	{DXF_LAYER_POINTS, 7},
+	{DXF_LAYER_FIXED_POINTS, 7},
+	{DXF_LAYER_SPRINGS, 7},
+	{DXF_LAYER_ANGLES, 7},
+	{DXF_LAYER_LABELS, 8},
+};
+
+
+
+
+
+/** Returns the bounds of the net's points, enlarged by EXTENT_MARGIN; a unit rect at the origin for an empty net. */
+QRectF extent(const SpringNet & aNet)
+{
+	const auto & points = aNet.points();
+	if (points.empty())
+	{
+		return QRectF(0, 0, 1, 1);
+	}
+	auto minX = points[0].x(), maxX = minX;
+	auto minY = points[0].y(), maxY = minY;
+	for (const auto & pt: points)
+	{
+		minX = std::min(minX, pt.x());
+		maxX = std::max(maxX, pt.x());
+		minY = std::min(minY, pt.y());
+		maxY = std::max(maxY, pt.y());
+	}
+	return QRectF(QPointF(minX, minY), QPointF(maxX, maxY))
+		.adjusted(-EXTENT_MARGIN, -EXTENT_MARGIN, EXTENT_MARGIN, EXTENT_MARGIN);
+}
+
+}  // anonymous namespace
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// NetExport::Writer:
+
+NetExport::Writer::Writer(QIODevice & aOut):
+	mOut(aOut)
+{
+	mBuffer.reserve(BUFFER_SIZE);
+}
+
+
+
+
+
+NetExport::Writer & NetExport::Writer::operator << (std::string_view aText)
+{
+	if (aText.size() > BUFFER_SIZE / 2)
+	{
+		flush();
+		if (mOut.write(aText.data(), static_cast<qint64>(aText.size())) != static_cast<qint64>(aText.size()))
+		{
+			throw std::runtime_error("Failed to write the output.");
+		}
+		return *this;
+	}
+	ensureSpace(aText.size());
+	mBuffer.append(aText);
+	return *this;
+}
+
+
+
+
+
+NetExport::Writer & NetExport::Writer::operator << (double aNumber)
+{
+	if (aNumber == 0)
+	{
+		// Write negative zeroes (such as from flipping the Y axis) as plain zeroes:
+		aNumber = 0;
+	}
+	ensureSpace(MAX_NUMBER_LENGTH);
+	char buf[MAX_NUMBER_LENGTH];
+	auto res = std::to_chars(buf, buf + sizeof(buf), aNumber);
+	mBuffer.append(buf, res.ptr);
+	return *this;
+}
+
+
+
+
+
+NetExport::Writer & NetExport::Writer::operator << (uint64_t aNumber)
+{
+	ensureSpace(MAX_NUMBER_LENGTH);
+	char buf[MAX_NUMBER_LENGTH];
+	auto res = std::to_chars(buf, buf + sizeof(buf), aNumber);
+	mBuffer.append(buf, res.ptr);
+	return *this;
+}
+
+
+
+
+
+NetExport::Writer & NetExport::Writer::writeLabelNumber(double aNumber)
+{
+	ensureSpace(MAX_NUMBER_LENGTH);
+	char buf[MAX_NUMBER_LENGTH];
+	auto res = std::to_chars(buf, buf + sizeof(buf), aNumber, std::chars_format::general, 6);
+	mBuffer.append(buf, res.ptr);
+	return *this;
+}
+
+
+
+
+
+void NetExport::Writer::flush()
+{
+	if (mBuffer.empty())
+	{
+		return;
+	}
+	if (mOut.write(mBuffer.data(), static_cast<qint64>(mBuffer.size())) != static_cast<qint64>(mBuffer.size()))
+	{
+		throw std::runtime_error("Failed to write the output.");
+	}
+	mBuffer.clear();
+}
+
+
+
+
+
+void NetExport::Writer::ensureSpace(size_t aSize)
+{
+	if (mBuffer.size() + aSize > BUFFER_SIZE)
+	{
+		flush();
+	}
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// NetExport::ResidualScale:
+
+size_t NetExport::ResidualScale::classOf(double aRelativeError) const
+{
+	if (mMaxAbsError <= 0)
+	{
+		return NUM_RESIDUAL_CLASSES / 2;
+	}
+	auto normalized = std::clamp(aRelativeError / mMaxAbsError, -1.0, 1.0);
+	return static_cast<size_t>(std::lround((normalized + 1) / 2 * (NUM_RESIDUAL_CLASSES - 1)));
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// NetExport:
+
+void NetExport::exportSvg(const SpringNet & aNet, QIODevice & aOut, const Options & aOptions)
+{
+	const auto & points = aNet.points();
+	auto bounds = extent(aNet);
+	Writer w(aOut);
+
+	// Header, with the styles shared by all the objects, so that the elements themselves stay short:
+	w << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\""
+		<< bounds.x() << " " << bounds.y() << " " << bounds.width() << " " << bounds.height() << "\">\n"
+		"<style>\n"
+		"rect,circle,line,path{fill:none;stroke:#000;stroke-width:1;vector-effect:non-scaling-stroke}\n"
+		"text{font-family:sans-serif;font-size:" << LABEL_HEIGHT << "px}\n";
+	if (aOptions.mShouldColorResiduals)
+	{
+		for (size_t i = 0; i < NUM_RESIDUAL_CLASSES; ++i)
+		{
+			auto hue = RESIDUAL_HUE_SHORT +
+				(RESIDUAL_HUE_LONG - RESIDUAL_HUE_SHORT) * static_cast<int>(i) / static_cast<int>(NUM_RESIDUAL_CLASSES - 1);
+			w << ".r" << static_cast<uint64_t>(i) << "{stroke:"
+				<< QColor::fromHsv(hue, 255, 224).name().toLatin1().constData() << "}\n";
+		}
+	}
+	w << "</style>\n";
+
+	// Points:
+	w << "<g id=\"points\">\n";
+	for (size_t idx = 0, numPoints = points.size(); idx < numPoints; ++idx)
+	{
+		const auto & pt = points[idx];
+		if (aNet.isPointFixed(idx))
+		{
+			w << "<circle cx=\"" << pt.x() << "\" cy=\"" << pt.y() << "\" r=\"" << POINT_MARKER_HALF_SIZE << "\"/>\n";
+		}
+		else
+		{
+			w << "<rect x=\"" << pt.x() - POINT_MARKER_HALF_SIZE << "\" y=\"" << pt.y() - POINT_MARKER_HALF_SIZE
+				<< "\" width=\"" << 2 * POINT_MARKER_HALF_SIZE << "\" height=\"" << 2 * POINT_MARKER_HALF_SIZE << "\"/>\n";
+		}
+	}
+	w << "</g>\n";
+
+	// Springs:
+	ResidualScale scale;
+	if (aOptions.mShouldColorResiduals)
+	{
+		scale = residualScale(aNet);
+	}
+	w << "<g id=\"springs\">\n";
+	for (size_t idx = 0, numSprings = aNet.numSprings(); idx < numSprings; ++idx)
+	{
+		const auto & s = aNet.spring(idx);
+		const auto & pt1 = points[s.pointIdx1()];
+		const auto & pt2 = points[s.pointIdx2()];
+		w << "<line";
+		if (aOptions.mShouldColorResiduals)
+		{
+			w << " class=\"r" << static_cast<uint64_t>(scale.classOf(relativeError(aNet, idx))) << "\"";
+		}
+		w << " x1=\"" << pt1.x() << "\" y1=\"" << pt1.y() << "\" x2=\"" << pt2.x() << "\" y2=\"" << pt2.y() << "\"/>\n";
+	}
+	w << "</g>\n";
+
+	// Angles, as arcs from the first spring's direction to the second one's (same direction as in the view):
+	w << "<g id=\"angles\">\n";
+	for (const auto & a: aNet.angles())
+	{
+		const auto & station = points[a.stationIdx()];
+		const auto & pt1 = points[a.pointIdx1()];
+		const auto & pt2 = points[a.pointIdx2()];
+		auto angle = Angle::currentAngle(station, pt1, pt2);
+		auto radius = QLineF(station, Angle::markerPos(station, pt1, pt2)).length();
+		auto diff1 = pt1 - station;
+		auto startDirection = std::atan2(diff1.y(), diff1.x());
+		auto endDirection = startDirection + angle;
+		w << "<path d=\"M" << station.x() + radius * std::cos(startDirection) << " " << station.y() + radius * std::sin(startDirection)
+			<< "A" << radius << " " << radius << " 0 " << ((angle > std::numbers::pi) ? "1" : "0") << " 1 "
+			<< station.x() + radius * std::cos(endDirection) << " " << station.y() + radius * std::sin(endDirection) << "\"/>\n";
+	}
+	w << "</g>\n";
+
+	// Labels:
+	if (aOptions.mShouldWriteLabels)
+	{
+		w << "<g id=\"labels\">\n";
+		for (const auto & s: aNet.springs())
+		{
+			auto center = (points[s.pointIdx1()] + points[s.pointIdx2()]) / 2;
+			w << "<text x=\"" << center.x() << "\" y=\"" << center.y() << "\">";
+			w.writeLabelNumber(s.currentLength(aNet)) << " / ";
+			w.writeLabelNumber(s.idealLength()) << "</text>\n";
+		}
+		for (const auto & a: aNet.angles())
+		{
+			auto marker = a.markerPos(aNet);
+			w << "<text x=\"" << marker.x() << "\" y=\"" << marker.y() << "\">";
+			w.writeLabelNumber(a.currentAngle(aNet) * 180 / std::numbers::pi) << "\xc2\xb0 / ";
+			w.writeLabelNumber(a.idealAngle() * 180 / std::numbers::pi) << "\xc2\xb0</text>\n";
+		}
+		w << "</g>\n";
+	}
+
+	w << "</svg>\n";
+	w.flush();
+}
+
+
+
+
+
+void NetExport::exportDxf(const SpringNet & aNet, QIODevice & aOut, const Options & aOptions)
+{
+	const auto & points = aNet.points();
+	auto bounds = extent(aNet);
+	Writer w(aOut);
+
+	// Header, with the extent (Y flipped):
+	w << "  0\nSECTION\n  2\nHEADER\n"
+		"  9\n$ACADVER\n  1\nAC1009\n"
+		"  9\n$EXTMIN\n 10\n" << bounds.left() << "\n 20\n" << -bounds.bottom() << "\n"
+		"  9\n$EXTMAX\n 10\n" << bounds.right() << "\n 20\n" << -bounds.top() << "\n"
+		"  0\nENDSEC\n";
+
+	// Tables, the line type and the layers:
+	w << "  0\nSECTION\n  2\nTABLES\n"
+		"  0\nTABLE\n  2\nLTYPE\n 70\n1\n"
+		"  0\nLTYPE\n  2\nCONTINUOUS\n 70\n0\n  3\nSolid line\n 72\n65\n 73\n0\n 40\n0.0\n"
+		"  0\nENDTAB\n"
+		"  0\nTABLE\n  2\nLAYER\n 70\n" << static_cast<uint64_t>(std::size(DXF_LAYERS)) << "\n";
+	for (const auto & [name, color]: DXF_LAYERS)
+	{
+		w << "  0\nLAYER\n  2\n" << name << "\n 70\n0\n 62\n" << static_cast<uint64_t>(color) << "\n  6\nCONTINUOUS\n";
+	}
+	w << "  0\nENDTAB\n  0\nENDSEC\n";
+
+	w << "  0\nSECTION\n  2\nENTITIES\n";
+
+	// Points:
+	for (size_t idx = 0, numPoints = points.size(); idx < numPoints; ++idx)
+	{
+		const auto & pt = points[idx];
+		w << "  0\nPOINT\n  8\n" << (aNet.isPointFixed(idx) ? DXF_LAYER_FIXED_POINTS : DXF_LAYER_POINTS)
+			<< "\n 10\n" << pt.x() << "\n 20\n" << -pt.y() << "\n 30\n0.0\n";
+	}
+
+	// Springs:
+	ResidualScale scale;
+	if (aOptions.mShouldColorResiduals)
+	{
+		scale = residualScale(aNet);
+	}
+	for (size_t idx = 0, numSprings = aNet.numSprings(); idx < numSprings; ++idx)
+	{
+		const auto & s = aNet.spring(idx);
+		const auto & pt1 = points[s.pointIdx1()];
+		const auto & pt2 = points[s.pointIdx2()];
+		w << "  0\nLINE\n  8\n" << DXF_LAYER_SPRINGS << "\n";
+		if (aOptions.mShouldColorResiduals)
+		{
+			auto color = RESIDUAL_ACI[scale.classOf(relativeError(aNet, idx))];
+			w << " 62\n" << static_cast<uint64_t>(color) << "\n";
+		}
+		w << " 10\n" << pt1.x() << "\n 20\n" << -pt1.y() << "\n 30\n0.0\n"
+			" 11\n" << pt2.x() << "\n 21\n" << -pt2.y() << "\n 31\n0.0\n";
+	}
+
+	// Angles; flipping the Y axis reverses the arc's direction, and DXF arcs always go counter-clockwise,
+	// so the arc is written from the second spring's direction to the first one's:
+	for (const auto & a: aNet.angles())
+	{
+		const auto & station = points[a.stationIdx()];
+		const auto & pt1 = points[a.pointIdx1()];
+		const auto & pt2 = points[a.pointIdx2()];
+		auto angle = Angle::currentAngle(station, pt1, pt2);
+		auto radius = QLineF(station, Angle::markerPos(station, pt1, pt2)).length();
+		auto diff1 = pt1 - station;
+		auto startDirection = -std::atan2(diff1.y(), diff1.x());
+		w << "  0\nARC\n  8\n" << DXF_LAYER_ANGLES
+			<< "\n 10\n" << station.x() << "\n 20\n" << -station.y() << "\n 30\n0.0\n 40\n" << radius
+			<< "\n 50\n" << (startDirection - angle) * 180 / std::numbers::pi
+			<< "\n 51\n" << startDirection * 180 / std::numbers::pi << "\n";
+	}
+
+	// Labels:
+	if (aOptions.mShouldWriteLabels)
+	{
+		for (const auto & s: aNet.springs())
+		{
+			auto center = (points[s.pointIdx1()] + points[s.pointIdx2()]) / 2;
+			w << "  0\nTEXT\n  8\n" << DXF_LAYER_LABELS
+				<< "\n 10\n" << center.x() << "\n 20\n" << -center.y() << "\n 30\n0.0\n 40\n" << LABEL_HEIGHT << "\n  1\n";
+			w.writeLabelNumber(s.currentLength(aNet)) << " / ";
+			w.writeLabelNumber(s.idealLength()) << "\n";
+		}
+		for (const auto & a: aNet.angles())
+		{
+			auto marker = a.markerPos(aNet);
+			w << "  0\nTEXT\n  8\n" << DXF_LAYER_LABELS
+				<< "\n 10\n" << marker.x() << "\n 20\n" << -marker.y() << "\n 30\n0.0\n 40\n" << LABEL_HEIGHT << "\n  1\n";
+			w.writeLabelNumber(a.currentAngle(aNet) * 180 / std::numbers::pi) << "%%d / ";
+			w.writeLabelNumber(a.idealAngle() * 180 / std::numbers::pi) << "%%d\n";
+		}
+	}
+
+	w << "  0\nENDSEC\n  0\nEOF\n";
+	w.flush();
+}
+
+
+
+
+
+void NetExport::exportToFile(const SpringNet & aNet, const QString & aFileName, const Options & aOptions)
+{
+	QFile f(aFileName);
+	if (!f.open(QIODevice::WriteOnly))
+	{
+		throw std::runtime_error("Cannot open file for writing.");
+	}
+	if (aFileName.endsWith(".dxf", Qt::CaseInsensitive))
+	{
+		exportDxf(aNet, f, aOptions);
+	}
+	else
+	{
+		exportSvg(aNet, f, aOptions);
+	}
+}
+
+
+
+
+
+double NetExport::relativeError(const SpringNet & aNet, size_t aSpringIdx)
+{
+	const auto & s = aNet.spring(aSpringIdx);
+	if (s.idealLength() <= 0)
+	{
+		return 0;
+	}
+	return (s.currentLength(aNet) - s.idealLength()) / s.idealLength();
+}
+
+
+
+
+
+NetExport::ResidualScale NetExport::residualScale(const SpringNet & aNet)
+{
+	ResidualScale res;
+	for (size_t idx = 0, numSprings = aNet.numSprings(); idx < numSprings; ++idx)
+	{
+		res.mMaxAbsError = std::max(res.mMaxAbsError, std::abs(relativeError(aNet, idx)));
+	}
+	return res;
+}
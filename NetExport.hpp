@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+
+
+
+
+// fwd:
+class QIODevice;
+class QString;
+class SpringNet;
+
+
+
+
+
+/** Exports the net's drawing into SVG or DXF, for use in other programs.
+The writers walk the net's arrays directly and stream the output through a fixed-size buffer, so the memory used
+doesn't grow with the size of the net, and no QGraphicsItem-s are created. The objects look the same as in the view:
+point markers, spring lines and angle arcs, with the same labels. */
+class NetExport
+{
+public:
+
+	/** What to include in the export, besides the objects themselves. */
+	struct Options
+	{
+		/** Write the "current / ideal" labels of the springs and angles. */
+		bool mShouldWriteLabels = false;
+
+		/** Color the springs by their relative length error, from blue (too short) through green to red (too long),
+		scaled to the largest error in the net. */
+		bool mShouldColorResiduals = false;
+	};
+
+
+	/** Writes the net as SVG into aOut. Throws a std::runtime_error if writing fails. */
+	static void exportSvg(const SpringNet & aNet, QIODevice & aOut, const Options & aOptions);
+
+	/** Writes the net as DXF (R12, ASCII) into aOut. The Y axis is flipped, DXF has it pointing up.
+	Throws a std::runtime_error if writing fails. */
+	static void exportDxf(const SpringNet & aNet, QIODevice & aOut, const Options & aOptions);
+
+	/** Writes the net into the specified file, as DXF if the file name ends with ".dxf", as SVG otherwise.
+	Throws a std::runtime_error on failure. */
+	static void exportToFile(const SpringNet & aNet, const QString & aFileName, const Options & aOptions);
+
+
+protected:
+
+	/** Collects the output text in a fixed-size buffer, writing it into the device whenever the buffer fills up.
+	The numbers are formatted without going through the locale or any temporary strings. */
+	class Writer
+	{
+	public:
+
+		explicit Writer(QIODevice & aOut);
+
+		Writer & operator << (std::string_view aText);
+		Writer & operator << (const char * aText) { return *this << std::string_view(aText); }
+		Writer & operator << (double aNumber);
+		Writer & operator << (uint64_t aNumber);
+
+		/** Writes a number the same way the labels in the view show it (6 significant digits). */
+		Writer & writeLabelNumber(double aNumber);
+
+		/** Writes out the buffered text. Throws a std::runtime_error if the device fails. */
+		void flush();
+
+
+	protected:
+
+		QIODevice & mOut;
+		std::string mBuffer;
+
+
+		/** Flushes the buffer if it is nearly full, so that a number (or short text) fits. */
+		void ensureSpace(size_t aSize);
+	};
+
+
+	/** The range of the springs' relative length errors, used for the residual colors. */
+	struct ResidualScale
+	{
+		/** The largest absolute relative error; 0 if all springs are exactly at their ideal length. */
+		double mMaxAbsError = 0;
+
+		/** Returns the color class (0 .. NUM_RESIDUAL_CLASSES - 1) of a spring with the specified relative error. */
+		size_t classOf(double aRelativeError) const;
+	};
+
+
+	/** The number of color steps between the most compressed and the most stretched spring. */
+	static constexpr size_t NUM_RESIDUAL_CLASSES = 9;
+
+
+	/** Returns the relative length error of the spring, (currentLength - idealLength) / idealLength. */
+	static double relativeError(const SpringNet & aNet, size_t aSpringIdx);
+
+	/** Returns the scale of the residual colors for the net. */
+	static ResidualScale residualScale(const SpringNet & aNet);
+};
@@ -0,0 +1,56 @@
+#include "NetExportDlg.hpp"
+#include "ui_NetExportDlg.h"
+
+
+
+
+
+std::optional<NetExport::Options> NetExportDlg::ask(
+	QWidget * aParent,
+	const NetExport::Options & aOptions
+)
+{
+	NetExportDlg dlg(aParent, aOptions);
+	if (dlg.exec() == QDialog::Rejected)
+	{
+		return std::nullopt;
+	}
+	else
+	{
+		return dlg.options();
+	}
+}
+
+
+
+
+
+NetExportDlg::NetExportDlg(QWidget * aParent, const NetExport::Options & aOptions):
+	Super(aParent),
+	mUI(new Ui::NetExportDlg)
+{
+	mUI->setupUi(this);
+	mUI->chbLabels->setChecked(aOptions.mShouldWriteLabels);
+	mUI->chbResidualColors->setChecked(aOptions.mShouldColorResiduals);
+}
+
+
+
+
+
+NetExportDlg::~NetExportDlg()
+{
+	// Nothing explicit needed yet
+}
+
+
+
+
+
+NetExport::Options NetExportDlg::options() const
+{
+	NetExport::Options res;
+	res.mShouldWriteLabels = mUI->chbLabels->isChecked();
+	res.mShouldColorResiduals = mUI->chbResidualColors->isChecked();
+	return res;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QDialog>
+
+#include "NetExport.hpp"
+
+
+
+
+
+// fwd:
+namespace Ui {
+class NetExportDlg;
+}
+
+
+
+
+
+/** Dialog for asking the user what to include in an SVG / DXF export of the net. */
+class NetExportDlg:
+	public QDialog
+{
+	Q_OBJECT
+
+	using Super = QDialog;
+
+
+public:
+
+	/** Shows the dialog with the specified options prefilled.
+	Returns the options the user chose, or nullopt if the user cancelled. */
+	static std::optional<NetExport::Options> ask(
+		QWidget * aParent,
+		const NetExport::Options & aOptions
+	);
+
+
+private:
+
+	/** The Qt-managed UI. */
+	std::unique_ptr<Ui::NetExportDlg> mUI;
+
+	explicit NetExportDlg(QWidget * aParent, const NetExport::Options & aOptions);
+	~NetExportDlg();
+
+	/** Returns the options currently chosen by the user. */
+	NetExport::Options options() const;
+};
@@ -0,0 +1,841 @@
+#include "NetHierarchy.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#include "SpringNet.hpp"
+#include "SolverTrace.hpp"
+
+
+
+
+
+namespace {
+
+/** Marks a node that hasn't been assigned to an aggregate yet. */
+static const size_t UNASSIGNED = std::numeric_limits<size_t>::max();
+
+/** The damping of the Jacobi step that smooths the prolongation, relative to the largest eigenvalue of D^-1 * K;
+4/3 is the usual choice for smoothed aggregation. */
+static const double PROLONGATION_SMOOTHING = 4.0 / 3.0;
+
+/** The number of power iterations that estimate the largest eigenvalue of D^-1 * K. A bound (such as Gershgorin's)
+isn't good enough, it overestimates a lot on the coarse levels, where the rotations and translations mix. */
+static const size_t SPECTRAL_RADIUS_ITERATIONS = 10;
+
+/** The coarsest level is solved directly if it has at most this many unknowns, otherwise only relaxed. */
+static const size_t COARSEST_DENSE_SIZE = 300;
+static const size_t COARSEST_NUM_SWEEPS = 20;
+
+/** In the direct solve, pivots smaller than this (relative to the largest diagonal entry) are taken as zero, and their
+unknowns are left at zero; the floppy parts of the net make K singular. */
+static const double SEMIDEFINITE_PIVOT = 1e-12;
+
+using Matrix = NetHierarchy::Matrix;
+
+
+
+
+
+/** Returns the product of the two sparse matrices. */
+Matrix multiply(const Matrix & aLeft, const Matrix & aRight)
+{
+	Matrix res;
+	res.mNumRows = aLeft.mNumRows;
+	res.mNumCols = aRight.mNumCols;
+	res.mOffsets.reserve(res.mNumRows + 1);
+	res.mOffsets.push_back(0);
+	std::vector<size_t> rowOfCol(aRight.mNumCols, UNASSIGNED);
+	std::vector<double> sums(aRight.mNumCols, 0);
+	for (size_t row = 0; row < aLeft.mNumRows; ++row)
+	{
+		auto rowStart = res.mCols.size();
+		for (auto i = aLeft.mOffsets[row]; i < aLeft.mOffsets[row + 1]; ++i)
+		{
+			auto mid = aLeft.mCols[i];
+			auto value = aLeft.mValues[i];
+			for (auto j = aRight.mOffsets[mid]; j < aRight.mOffsets[mid + 1]; ++j)
+			{
+				auto col = aRight.mCols[j];
+				if (rowOfCol[col] != row)
+				{
+					rowOfCol[col] = row;
+					sums[col] = 0;
+					res.mCols.push_back(col);
+				}
+				sums[col] += value * aRight.mValues[j];
+			}
+		}
+		std::sort(res.mCols.begin() + static_cast<ptrdiff_t>(rowStart), res.mCols.end());
+		for (auto i = rowStart; i < res.mCols.size(); ++i)
+		{
+			res.mValues.push_back(sums[res.mCols[i]]);
+		}
+		res.mOffsets.push_back(res.mCols.size());
+	}
+	return res;
+}
+
+
+
+
+
+/** Returns the transposed matrix. */
+Matrix transpose(const Matrix & aMatrix)
+{
+	Matrix res;
+	res.mNumRows = aMatrix.mNumCols;
+	res.mNumCols = aMatrix.mNumRows;
+	res.mOffsets.assign(res.mNumRows + 1, 0);
+	for (auto col: aMatrix.mCols)
+	{
+		res.mOffsets[col + 1] += 1;
+	}
+	for (size_t row = 0; row < res.mNumRows; ++row)
+	{
+		res.mOffsets[row + 1] += res.mOffsets[row];
+	}
+	res.mCols.resize(aMatrix.mCols.size());
+	res.mValues.resize(aMatrix.mValues.size());
+	auto fill = res.mOffsets;
+	for (size_t row = 0; row < aMatrix.mNumRows; ++row)
+	{
+		for (auto i = aMatrix.mOffsets[row]; i < aMatrix.mOffsets[row + 1]; ++i)
+		{
+			auto dst = fill[aMatrix.mCols[i]]++;
+			res.mCols[dst] = row;
+			res.mValues[dst] = aMatrix.mValues[i];
+		}
+	}
+	return res;
+}
+
+
+
+
+
+/** Returns the sum of the two sparse matrices of the same size. */
+Matrix add(const Matrix & aMatrix1, const Matrix & aMatrix2)
+{
+	Matrix res;
+	res.mNumRows = aMatrix1.mNumRows;
+	res.mNumCols = aMatrix1.mNumCols;
+	res.mOffsets.reserve(res.mNumRows + 1);
+	res.mOffsets.push_back(0);
+	for (size_t row = 0; row < res.mNumRows; ++row)
+	{
+		auto i1 = aMatrix1.mOffsets[row], end1 = aMatrix1.mOffsets[row + 1];
+		auto i2 = aMatrix2.mOffsets[row], end2 = aMatrix2.mOffsets[row + 1];
+		while ((i1 < end1) || (i2 < end2))
+		{
+			if ((i2 == end2) || ((i1 < end1) && (aMatrix1.mCols[i1] < aMatrix2.mCols[i2])))
+			{
+				res.mCols.push_back(aMatrix1.mCols[i1]);
+				res.mValues.push_back(aMatrix1.mValues[i1++]);
+			}
+			else if ((i1 == end1) || (aMatrix2.mCols[i2] < aMatrix1.mCols[i1]))
+			{
+				res.mCols.push_back(aMatrix2.mCols[i2]);
+				res.mValues.push_back(aMatrix2.mValues[i2++]);
+			}
+			else
+			{
+				res.mCols.push_back(aMatrix1.mCols[i1]);
+				res.mValues.push_back(aMatrix1.mValues[i1++] + aMatrix2.mValues[i2++]);
+			}
+		}
+		res.mOffsets.push_back(res.mCols.size());
+	}
+	return res;
+}
+
+
+
+
+
+/** Returns the inverses of the matrix's diagonal entries, zero for the non-positive ones (the unknowns without any
+stiffness, such as those of the immovable points). */
+std::vector<double> invertedDiagonal(const Matrix & aMatrix)
+{
+	std::vector<double> res(aMatrix.mNumRows, 0);
+	for (size_t row = 0; row < aMatrix.mNumRows; ++row)
+	{
+		for (auto i = aMatrix.mOffsets[row]; i < aMatrix.mOffsets[row + 1]; ++i)
+		{
+			if ((aMatrix.mCols[i] == row) && (aMatrix.mValues[i] > 0))
+			{
+				res[row] = 1 / aMatrix.mValues[i];
+			}
+		}
+	}
+	return res;
+}
+
+
+
+
+
+/** Estimates the largest eigenvalue of D^-1 * aMatrix by a few power iterations. */
+double estimateSpectralRadius(const Matrix & aMatrix, const std::vector<double> & aInverseDiagonal)
+{
+	auto num = aMatrix.mNumRows;
+	std::vector<double> vec(num), next(num);
+	for (size_t i = 0; i < num; ++i)
+	{
+		// A fixed pseudo-random start, so that the solve is deterministic:
+		vec[i] = (aInverseDiagonal[i] > 0) ? (1.0 + static_cast<double>((i * 7919) % 101) / 101.0) : 0;
+	}
+	double res = 0;
+	for (size_t iter = 0; iter < SPECTRAL_RADIUS_ITERATIONS; ++iter)
+	{
+		double norm = 0;
+		for (size_t row = 0; row < num; ++row)
+		{
+			double sum = 0;
+			for (auto i = aMatrix.mOffsets[row]; i < aMatrix.mOffsets[row + 1]; ++i)
+			{
+				sum += aMatrix.mValues[i] * vec[aMatrix.mCols[i]];
+			}
+			next[row] = sum * aInverseDiagonal[row];
+			norm += next[row] * next[row];
+		}
+		norm = std::sqrt(norm);
+		double prevNorm = 0;
+		for (auto v: vec)
+		{
+			prevNorm += v * v;
+		}
+		prevNorm = std::sqrt(prevNorm);
+		if ((norm <= 0) || (prevNorm <= 0))
+		{
+			return res;
+		}
+		res = norm / prevNorm;
+		for (size_t i = 0; i < num; ++i)
+		{
+			vec[i] = next[i] / norm;
+		}
+	}
+	return res;
+}
+
+
+
+
+
+/** Performs a single Gauss-Seidel sweep over the system, forward or backward. The unknowns without a positive
+diagonal entry are left as-is. */
+void gaussSeidel(const Matrix & aMatrix, const std::vector<double> & aRhs, std::vector<double> & aSolution, bool aIsForward)
+{
+	auto num = aMatrix.mNumRows;
+	for (size_t k = 0; k < num; ++k)
+	{
+		auto row = aIsForward ? k : (num - 1 - k);
+		auto sum = aRhs[row];
+		double diagonal = 0;
+		for (auto i = aMatrix.mOffsets[row]; i < aMatrix.mOffsets[row + 1]; ++i)
+		{
+			auto col = aMatrix.mCols[i];
+			if (col == row)
+			{
+				diagonal = aMatrix.mValues[i];
+			}
+			else
+			{
+				sum -= aMatrix.mValues[i] * aSolution[col];
+			}
+		}
+		if (diagonal > 0)
+		{
+			aSolution[row] = sum / diagonal;
+		}
+	}
+}
+
+
+
+
+
+/** Solves the (small) system directly, by a dense Cholesky factorization. The matrix may be singular (positive
+semi-definite); the unknowns of the zero pivots are then left at zero. */
+void solveDense(const Matrix & aMatrix, const std::vector<double> & aRhs, std::vector<double> & aSolution)
+{
+	auto num = aMatrix.mNumRows;
+	std::vector<double> factor(num * num, 0);
+	double maxDiagonal = 0;
+	for (size_t row = 0; row < num; ++row)
+	{
+		for (auto i = aMatrix.mOffsets[row]; i < aMatrix.mOffsets[row + 1]; ++i)
+		{
+			factor[row * num + aMatrix.mCols[i]] = aMatrix.mValues[i];
+			if (aMatrix.mCols[i] == row)
+			{
+				maxDiagonal = std::max(maxDiagonal, aMatrix.mValues[i]);
+			}
+		}
+	}
+
+	// Factorize into the lower triangle, L * L':
+	auto minPivot = SEMIDEFINITE_PIVOT * maxDiagonal;
+	for (size_t col = 0; col < num; ++col)
+	{
+		auto pivot = factor[col * num + col];
+		for (size_t k = 0; k < col; ++k)
+		{
+			pivot -= factor[col * num + k] * factor[col * num + k];
+		}
+		if (pivot <= minPivot)
+		{
+			for (size_t row = col; row < num; ++row)
+			{
+				factor[row * num + col] = 0;
+			}
+			continue;
+		}
+		pivot = std::sqrt(pivot);
+		factor[col * num + col] = pivot;
+		for (size_t row = col + 1; row < num; ++row)
+		{
+			auto value = factor[row * num + col];
+			for (size_t k = 0; k < col; ++k)
+			{
+				value -= factor[row * num + k] * factor[col * num + k];
+			}
+			factor[row * num + col] = value / pivot;
+		}
+	}
+
+	// Forward and back substitution:
+	aSolution = aRhs;
+	for (size_t row = 0; row < num; ++row)
+	{
+		auto pivot = factor[row * num + row];
+		if (pivot == 0)
+		{
+			aSolution[row] = 0;
+			continue;
+		}
+		for (size_t k = 0; k < row; ++k)
+		{
+			aSolution[row] -= factor[row * num + k] * aSolution[k];
+		}
+		aSolution[row] /= pivot;
+	}
+	for (size_t row = num; row-- > 0;)
+	{
+		auto pivot = factor[row * num + row];
+		if (pivot == 0)
+		{
+			aSolution[row] = 0;
+			continue;
+		}
+		for (size_t k = row + 1; k < num; ++k)
+		{
+			aSolution[row] -= factor[k * num + row] * aSolution[k];
+		}
+		aSolution[row] /= pivot;
+	}
+}
+
+}  // anonymous namespace
+
+
+
+
+
+const size_t NetHierarchy::NO_AGGREGATE = std::numeric_limits<size_t>::max();
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// NetHierarchy::Matrix:
+
+size_t NetHierarchy::Matrix::entryIndex(size_t aRow, size_t aCol) const
+{
+	auto begin = mCols.begin() + static_cast<ptrdiff_t>(mOffsets[aRow]);
+	auto end = mCols.begin() + static_cast<ptrdiff_t>(mOffsets[aRow + 1]);
+	auto itr = std::lower_bound(begin, end, aCol);
+	assert((itr != end) && (*itr == aCol));
+	return static_cast<size_t>(itr - mCols.begin());
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// NetHierarchy:
+
+
+
+
+
+NetHierarchy::NetHierarchy(const SpringNet & aNet, size_t aMinAggregates, size_t aMaxLevels)
+{
+	TRACE_SCOPE("hierarchyBuild");
+	auto numP = aNet.numPoints();
+	auto numS = aNet.numSprings();
+
+	// The nodes of the previous level that each point belongs to; for the net itself, the nodes are the movable points:
+	std::vector<size_t> prevNodeOfPoint(numP);
+	size_t prevNumNodes = 0;
+	for (size_t idx = 0; idx < numP; ++idx)
+	{
+		prevNodeOfPoint[idx] = aNet.isPointImmovable(idx) ? NO_AGGREGATE : prevNumNodes++;
+	}
+
+	while ((mLevels.size() < aMaxLevels) && (prevNumNodes > aMinAggregates))
+	{
+		// Build the node adjacency of the previous level, in a CSR layout:
+		std::vector<std::pair<size_t, size_t>> edges;
+		edges.reserve(2 * numS);
+		for (size_t idx = 0; idx < numS; ++idx)
+		{
+			const auto & spring = aNet.spring(idx);
+			auto node1 = prevNodeOfPoint[spring.pointIdx1()];
+			auto node2 = prevNodeOfPoint[spring.pointIdx2()];
+			if ((node1 != node2) && (node1 != NO_AGGREGATE) && (node2 != NO_AGGREGATE))
+			{
+				edges.emplace_back(node1, node2);
+				edges.emplace_back(node2, node1);
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+		std::vector<size_t> offsets(prevNumNodes + 1, 0);
+		for (const auto & e: edges)
+		{
+			offsets[e.first + 1] += 1;
+		}
+		for (size_t node = 0; node < prevNumNodes; ++node)
+		{
+			offsets[node + 1] += offsets[node];
+		}
+
+		// Aggregate: first take nodes whose whole neighborhood is free, together with the neighborhood:
+		std::vector<size_t> nodeToAggregate(prevNumNodes, UNASSIGNED);
+		size_t numAggregates = 0;
+		for (size_t node = 0; node < prevNumNodes; ++node)
+		{
+			if (nodeToAggregate[node] != UNASSIGNED)
+			{
+				continue;
+			}
+			auto isNeighborhoodFree = std::all_of(
+				edges.begin() + static_cast<ptrdiff_t>(offsets[node]),
+				edges.begin() + static_cast<ptrdiff_t>(offsets[node + 1]),
+				[&nodeToAggregate](const std::pair<size_t, size_t> & aEdge)
+				{
+					return (nodeToAggregate[aEdge.second] == UNASSIGNED);
+				}
+			);
+			if (!isNeighborhoodFree)
+			{
+				continue;
+			}
+			nodeToAggregate[node] = numAggregates;
+			for (auto i = offsets[node]; i < offsets[node + 1]; ++i)
+			{
+				nodeToAggregate[edges[i].second] = numAggregates;
+			}
+			numAggregates += 1;
+		}
+
+		// Then attach the leftover nodes to a neighboring aggregate, or make them singletons:
+		for (size_t node = 0; node < prevNumNodes; ++node)
+		{
+			if (nodeToAggregate[node] != UNASSIGNED)
+			{
+				continue;
+			}
+			for (auto i = offsets[node]; i < offsets[node + 1]; ++i)
+			{
+				auto neighborAggregate = nodeToAggregate[edges[i].second];
+				if (neighborAggregate != UNASSIGNED)
+				{
+					nodeToAggregate[node] = neighborAggregate;
+					break;
+				}
+			}
+			if (nodeToAggregate[node] == UNASSIGNED)
+			{
+				nodeToAggregate[node] = numAggregates;
+				numAggregates += 1;
+			}
+		}
+		if (numAggregates >= prevNumNodes)
+		{
+			// The level didn't shrink, no point in continuing
+			break;
+		}
+
+		// Build the level; the first level's nodes are the net's points:
+		Level level;
+		level.mNumAggregates = numAggregates;
+		if (mLevels.empty())
+		{
+			level.mNodeToAggregate.resize(numP);
+			for (size_t idx = 0; idx < numP; ++idx)
+			{
+				auto node = prevNodeOfPoint[idx];
+				level.mNodeToAggregate[idx] = (node == NO_AGGREGATE) ? NO_AGGREGATE : nodeToAggregate[node];
+			}
+		}
+		else
+		{
+			level.mNodeToAggregate = nodeToAggregate;
+		}
+		for (size_t idx = 0; idx < numP; ++idx)
+		{
+			auto node = prevNodeOfPoint[idx];
+			prevNodeOfPoint[idx] = (node == NO_AGGREGATE) ? NO_AGGREGATE : nodeToAggregate[node];
+		}
+		prevNumNodes = numAggregates;
+		mLevels.push_back(std::move(level));
+	}
+
+	// The pattern of the net's K, in 2x2 blocks: each point with itself, and the points of each spring and angle:
+	std::vector<std::pair<size_t, size_t>> blocks;
+	blocks.reserve(numP + 2 * numS + 6 * aNet.angles().size());
+	for (size_t idx = 0; idx < numP; ++idx)
+	{
+		blocks.emplace_back(idx, idx);
+	}
+	for (size_t idx = 0; idx < numS; ++idx)
+	{
+		const auto & spring = aNet.spring(idx);
+		blocks.emplace_back(spring.pointIdx1(), spring.pointIdx2());
+		blocks.emplace_back(spring.pointIdx2(), spring.pointIdx1());
+	}
+	for (const auto & angle: aNet.angles())
+	{
+		size_t indices[3] = {angle.stationIdx(), angle.pointIdx1(), angle.pointIdx2()};
+		for (size_t i = 0; i < 3; ++i)
+		{
+			for (size_t j = 0; j < 3; ++j)
+			{
+				if (i != j)
+				{
+					blocks.emplace_back(indices[i], indices[j]);
+				}
+			}
+		}
+	}
+	std::sort(blocks.begin(), blocks.end());
+	blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+	Matrix fine;
+	fine.mNumRows = 2 * numP;
+	fine.mNumCols = 2 * numP;
+	fine.mOffsets.assign(fine.mNumRows + 1, 0);
+	for (size_t b = 0; b < blocks.size();)
+	{
+		auto ptIdx = blocks[b].first;
+		auto end = b;
+		while ((end < blocks.size()) && (blocks[end].first == ptIdx))
+		{
+			end += 1;
+		}
+		for (size_t row = 2 * ptIdx; row < 2 * ptIdx + 2; ++row)
+		{
+			for (auto i = b; i < end; ++i)
+			{
+				fine.mCols.push_back(2 * blocks[i].second);
+				fine.mCols.push_back(2 * blocks[i].second + 1);
+			}
+			fine.mOffsets[row + 1] = fine.mCols.size();
+		}
+		b = end;
+	}
+	fine.mValues.assign(fine.mCols.size(), 0);
+	mOperators.resize(mLevels.size() + 1);
+	mOperators[0] = std::move(fine);
+	mRhs.resize(mOperators.size());
+	mSolutions.resize(mOperators.size());
+	mResiduals.resize(mOperators.size());
+}
+
+
+
+
+
+void NetHierarchy::applyVCycle(const SpringNet & aNet, std::vector<QPointF> & aPositions)
+{
+	TRACE_SCOPE("vCycle");
+	linearize(aNet, aPositions);
+	buildCoarseOperators(aPositions);
+	vCycle(0);
+	const auto & solution = mSolutions[0];
+	auto numP = aPositions.size();
+	for (size_t idx = 0; idx < numP; ++idx)
+	{
+		if (!aNet.isPointImmovable(idx))
+		{
+			aPositions[idx] += QPointF(solution[2 * idx], solution[2 * idx + 1]);
+		}
+	}
+}
+
+
+
+
+
+void NetHierarchy::linearize(const SpringNet & aNet, const std::vector<QPointF> & aPositions)
+{
+	auto & mtx = mOperators[0];
+	auto & rhs = mRhs[0];
+	std::fill(mtx.mValues.begin(), mtx.mValues.end(), 0.0);
+	rhs.assign(mtx.mNumRows, 0);
+	auto addBlock = [&mtx](size_t aPtIdx1, size_t aPtIdx2, QPointF aVec1, QPointF aVec2, double aWeight)
+	{
+		// Adds aWeight * aVec1 * aVec2' to the 2x2 block:
+		auto i0 = mtx.entryIndex(2 * aPtIdx1, 2 * aPtIdx2);
+		auto i1 = mtx.entryIndex(2 * aPtIdx1 + 1, 2 * aPtIdx2);
+		mtx.mValues[i0]     += aWeight * aVec1.x() * aVec2.x();
+		mtx.mValues[i0 + 1] += aWeight * aVec1.x() * aVec2.y();
+		mtx.mValues[i1]     += aWeight * aVec1.y() * aVec2.x();
+		mtx.mValues[i1 + 1] += aWeight * aVec1.y() * aVec2.y();
+	};
+	auto addRhs = [&rhs](size_t aPtIdx, QPointF aValue)
+	{
+		rhs[2 * aPtIdx] += aValue.x();
+		rhs[2 * aPtIdx + 1] += aValue.y();
+	};
+
+	// The springs, with the same weights as in computeDisplacements() (the move divided between two movable points):
+	for (const auto & s: aNet.springs())
+	{
+		auto idx1 = s.pointIdx1();
+		auto idx2 = s.pointIdx2();
+		auto isMovable1 = !aNet.isPointImmovable(idx1);
+		auto isMovable2 = !aNet.isPointImmovable(idx2);
+		auto diff = aPositions[idx1] - aPositions[idx2];
+		auto currentLength = std::sqrt(QPointF::dotProduct(diff, diff));
+		if ((!isMovable1 && !isMovable2) || (currentLength <= 0))
+		{
+			continue;
+		}
+		auto dir = diff / currentLength;
+		auto weight = s.force() * currentLength / s.idealLength();
+		if (isMovable1 && isMovable2)
+		{
+			weight /= 2;
+		}
+		auto move = dir * (weight * (s.idealLength() - currentLength));
+		if (isMovable1)
+		{
+			addRhs(idx1, move);
+			addBlock(idx1, idx1, dir, dir, weight);
+		}
+		if (isMovable2)
+		{
+			addRhs(idx2, -move);
+			addBlock(idx2, idx2, dir, dir, weight);
+		}
+		if (isMovable1 && isMovable2)
+		{
+			addBlock(idx1, idx2, dir, dir, -weight);
+			addBlock(idx2, idx1, dir, dir, -weight);
+		}
+	}
+
+	// The angles, as in computeDisplacements(), along their gradient:
+	for (const auto & a: aNet.angles())
+	{
+		size_t indices[3] = {a.stationIdx(), a.pointIdx1(), a.pointIdx2()};
+		double currentAngle;
+		QPointF gradients[3];
+		if (!Angle::evaluate(aPositions[indices[0]], aPositions[indices[1]], aPositions[indices[2]], currentAngle, gradients))
+		{
+			continue;
+		}
+		bool isMovable[3];
+		double gradientSq = 0;
+		for (size_t i = 0; i < 3; ++i)
+		{
+			isMovable[i] = !aNet.isPointImmovable(indices[i]);
+			if (isMovable[i])
+			{
+				gradientSq += QPointF::dotProduct(gradients[i], gradients[i]);
+			}
+		}
+		if (gradientSq <= 0)
+		{
+			continue;
+		}
+		auto weight = a.force() / gradientSq;
+		auto factor = Angle::angleError(a.idealAngle(), currentAngle) * weight;
+		for (size_t i = 0; i < 3; ++i)
+		{
+			if (!isMovable[i])
+			{
+				continue;
+			}
+			addRhs(indices[i], gradients[i] * factor);
+			for (size_t j = 0; j < 3; ++j)
+			{
+				if (isMovable[j])
+				{
+					addBlock(indices[i], indices[j], gradients[i], gradients[j], weight);
+				}
+			}
+		}
+	}
+}
+
+
+
+
+
+void NetHierarchy::buildCoarseOperators(const std::vector<QPointF> & aPositions)
+{
+	// The nodes of the previous level, and the number of unknowns per node (the points have no rotation):
+	const auto * nodePositions = &aPositions;
+	size_t numNodeUnknowns = 2;
+	auto numLevels = mLevels.size();
+	for (size_t lvl = 0; lvl < numLevels; ++lvl)
+	{
+		auto & level = mLevels[lvl];
+		auto numNodes = level.mNodeToAggregate.size();
+		auto numAggregates = level.mNumAggregates;
+
+		// The centroids, around which the aggregates rotate:
+		level.mCentroids.assign(numAggregates, QPointF(0, 0));
+		std::vector<size_t> sizes(numAggregates, 0);
+		for (size_t node = 0; node < numNodes; ++node)
+		{
+			auto aggregate = level.mNodeToAggregate[node];
+			if (aggregate != NO_AGGREGATE)
+			{
+				level.mCentroids[aggregate] += (*nodePositions)[node];
+				sizes[aggregate] += 1;
+			}
+		}
+		for (size_t aggregate = 0; aggregate < numAggregates; ++aggregate)
+		{
+			level.mCentroids[aggregate] /= static_cast<double>(sizes[aggregate]);
+		}
+
+		// The tentative prolongation, the rigid-body motions of each aggregate, in the units of the positions (so that the
+		// next level can build its own rigid-body motions from these):
+		Matrix tentative;
+		tentative.mNumRows = numNodes * numNodeUnknowns;
+		tentative.mNumCols = 3 * numAggregates;
+		tentative.mOffsets.reserve(tentative.mNumRows + 1);
+		tentative.mOffsets.push_back(0);
+		for (size_t node = 0; node < numNodes; ++node)
+		{
+			auto aggregate = level.mNodeToAggregate[node];
+			if (aggregate != NO_AGGREGATE)
+			{
+				auto arm = (*nodePositions)[node] - level.mCentroids[aggregate];
+				tentative.mCols.push_back(3 * aggregate);
+				tentative.mValues.push_back(1);
+				tentative.mCols.push_back(3 * aggregate + 2);
+				tentative.mValues.push_back(-arm.y());
+				tentative.mOffsets.push_back(tentative.mCols.size());
+				tentative.mCols.push_back(3 * aggregate + 1);
+				tentative.mValues.push_back(1);
+				tentative.mCols.push_back(3 * aggregate + 2);
+				tentative.mValues.push_back(arm.x());
+				tentative.mOffsets.push_back(tentative.mCols.size());
+				if (numNodeUnknowns == 3)
+				{
+					tentative.mCols.push_back(3 * aggregate + 2);
+					tentative.mValues.push_back(1);
+					tentative.mOffsets.push_back(tentative.mCols.size());
+				}
+			}
+			else
+			{
+				for (size_t i = 0; i < numNodeUnknowns; ++i)
+				{
+					tentative.mOffsets.push_back(tentative.mCols.size());
+				}
+			}
+		}
+
+		// Smooth the prolongation by a damped Jacobi step, P = (I - w * D^-1 * K) * tentative, and take the Galerkin product:
+		const auto & mtx = mOperators[lvl];
+		auto inverseDiagonal = invertedDiagonal(mtx);
+		auto spectralRadius = estimateSpectralRadius(mtx, inverseDiagonal);
+		auto jacobiWeight = (spectralRadius > 0) ? (PROLONGATION_SMOOTHING / spectralRadius) : 0;
+		auto smoothing = multiply(mtx, tentative);
+		for (size_t row = 0; row < smoothing.mNumRows; ++row)
+		{
+			for (auto i = smoothing.mOffsets[row]; i < smoothing.mOffsets[row + 1]; ++i)
+			{
+				smoothing.mValues[i] *= -jacobiWeight * inverseDiagonal[row];
+			}
+		}
+		level.mProlongation = add(tentative, smoothing);
+		mOperators[lvl + 1] = multiply(transpose(level.mProlongation), multiply(mtx, level.mProlongation));
+
+		nodePositions = &level.mCentroids;
+		numNodeUnknowns = 3;
+	}
+}
+
+
+
+
+
+void NetHierarchy::vCycle(size_t aLevel)
+{
+	const auto & mtx = mOperators[aLevel];
+	const auto & rhs = mRhs[aLevel];
+	auto & solution = mSolutions[aLevel];
+	solution.assign(mtx.mNumRows, 0);
+	if (aLevel + 1 == mOperators.size())
+	{
+		// The coarsest level, solve directly if small enough, otherwise just relax it well:
+		if (mtx.mNumRows <= COARSEST_DENSE_SIZE)
+		{
+			solveDense(mtx, rhs, solution);
+		}
+		else
+		{
+			for (size_t i = 0; i < COARSEST_NUM_SWEEPS; ++i)
+			{
+				gaussSeidel(mtx, rhs, solution, true);
+				gaussSeidel(mtx, rhs, solution, false);
+			}
+		}
+		return;
+	}
+
+	// Pre-smooth, restrict the residual, solve the coarse level, prolong its solution, post-smooth:
+	gaussSeidel(mtx, rhs, solution, true);
+	auto & residual = mResiduals[aLevel];
+	residual = rhs;
+	for (size_t row = 0; row < mtx.mNumRows; ++row)
+	{
+		for (auto i = mtx.mOffsets[row]; i < mtx.mOffsets[row + 1]; ++i)
+		{
+			residual[row] -= mtx.mValues[i] * solution[mtx.mCols[i]];
+		}
+	}
+	const auto & prolongation = mLevels[aLevel].mProlongation;
+	auto & coarseRhs = mRhs[aLevel + 1];
+	coarseRhs.assign(prolongation.mNumCols, 0);
+	for (size_t row = 0; row < prolongation.mNumRows; ++row)
+	{
+		for (auto i = prolongation.mOffsets[row]; i < prolongation.mOffsets[row + 1]; ++i)
+		{
+			coarseRhs[prolongation.mCols[i]] += prolongation.mValues[i] * residual[row];
+		}
+	}
+	vCycle(aLevel + 1);
+	const auto & coarseSolution = mSolutions[aLevel + 1];
+	for (size_t row = 0; row < prolongation.mNumRows; ++row)
+	{
+		for (auto i = prolongation.mOffsets[row]; i < prolongation.mOffsets[row + 1]; ++i)
+		{
+			solution[row] += prolongation.mValues[i] * coarseSolution[prolongation.mCols[i]];
+		}
+	}
+	gaussSeidel(mtx, rhs, solution, false);
+}
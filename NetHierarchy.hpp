@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <QPointF>
+
+
+
+
+
+// fwd:
+class SpringNet;
+
+
+
+
+
+/** A hierarchy of successively coarser versions of a SpringNet, used by the multigrid solver (smoothed aggregation).
+Each iteration of the solver linearizes the springs and angles at the current positions into the Gauss-Newton system
+K * d = F, where F is the sum of the corrections that SpringNet::computeDisplacements() averages and K is its
+(symmetrized) derivative, and solves it approximately by a single V-cycle over the hierarchy.
+Each coarse level is built by aggregating neighboring points (or aggregates of the previous level) together.
+Each aggregate has three unknowns, the rigid-body motions of its nodes (translation and rotation around its centroid);
+these are the smooth, large-scale errors that single-point relaxation is very slow to remove. The rigid-body motions are
+smoothed by a Jacobi step to get the prolongation, and the coarse operators are the Galerkin products P' * K * P.
+The aggregates only depend on the topology and are built once; the prolongations and the coarse operators depend on
+the positions and are rebuilt in each V-cycle.
+Immovable points are not a part of any aggregate.
+The hierarchy depends on the net's topology and on which points were immovable when it was built. */
+class NetHierarchy
+{
+public:
+
+	/** The aggregate index used for points that don't belong to any aggregate. */
+	static const size_t NO_AGGREGATE;
+
+
+	/** A sparse matrix in the CSR layout, the column indices ascending within each row. */
+	struct Matrix
+	{
+		size_t mNumRows = 0;
+		size_t mNumCols = 0;
+		std::vector<size_t> mOffsets;
+		std::vector<size_t> mCols;
+		std::vector<double> mValues;
+
+		/** Returns the index into mCols / mValues of the entry (aRow, aCol), which must be in the pattern. */
+		size_t entryIndex(size_t aRow, size_t aCol) const;
+	};
+
+
+	/** A single coarse level. */
+	struct Level
+	{
+		/** The aggregate of this level that each node of the previous level belongs to.
+		The nodes of the first coarse level are the points that were movable when the hierarchy was built. */
+		std::vector<size_t> mNodeToAggregate;
+
+		size_t mNumAggregates = 0;
+
+		/** The centroids of the aggregates, at the positions of the last V-cycle. */
+		std::vector<QPointF> mCentroids;
+
+		/** Maps the unknowns of this level to the unknowns of the previous level (rebuilt in each V-cycle). */
+		Matrix mProlongation;
+
+		size_t numAggregates() const { return mNumAggregates; }
+	};
+
+
+	/** Builds the hierarchy for the specified net.
+	Coarsening stops once a level has at most aMinAggregates aggregates, or no longer shrinks, or there are aMaxLevels levels. */
+	NetHierarchy(const SpringNet & aNet, size_t aMinAggregates, size_t aMaxLevels);
+
+	/** Returns the number of coarse levels (not counting the net itself). */
+	size_t numLevels() const { return mLevels.size(); }
+
+	const Level & level(size_t aLevelIdx) const { return mLevels[aLevelIdx]; }
+
+	/** Linearizes the net at aPositions, solves the Gauss-Newton system by a single V-cycle and adds the solution
+	to the movable points' positions. */
+	void applyVCycle(const SpringNet & aNet, std::vector<QPointF> & aPositions);
+
+
+protected:
+
+	/** The coarse levels, from the finest to the coarsest. */
+	std::vector<Level> mLevels;
+
+	/** The operator of each level, the net's own K first; the pattern of K is built once, its values in each V-cycle. */
+	std::vector<Matrix> mOperators;
+
+	/** The right-hand side, the solution and the residual on each level, the net's own first. */
+	std::vector<std::vector<double>> mRhs;
+	std::vector<std::vector<double>> mSolutions;
+	std::vector<std::vector<double>> mResiduals;
+
+
+	/** Fills in the values of mOperators[0] and mRhs[0] from the net's springs and angles at aPositions. */
+	void linearize(const SpringNet & aNet, const std::vector<QPointF> & aPositions);
+
+	/** Rebuilds the prolongation of each level and the coarse operators, from the positions and mOperators[0]. */
+	void buildCoarseOperators(const std::vector<QPointF> & aPositions);
+
+	/** Runs the V-cycle from the specified level down, solving mOperators[aLevel] * mSolutions[aLevel] = mRhs[aLevel],
+	starting from a zero solution. */
+	void vCycle(size_t aLevel);
+};
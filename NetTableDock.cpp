@@ -0,0 +1,166 @@
+#include "NetTableDock.hpp"
+#include "ui_NetTableDock.h"
+
+#include <algorithm>
+#include <QHeaderView>
+#include <QSignalBlocker>
+
+
+
+
+
+NetTableDock::NetTableDock(QWidget * aParent):
+	Super(aParent),
+	mUI(new Ui::NetTableDock)
+{
+	mUI->setupUi(this);
+	mUI->cbKind->addItem(tr("Springs"), static_cast<int>(NetTableModel::Kind::Springs));
+	mUI->cbKind->addItem(tr("Points"),  static_cast<int>(NetTableModel::Kind::Points));
+	mUI->cbKind->setCurrentIndex(mUI->cbKind->findData(static_cast<int>(mModel.kind())));
+	updateFilterColumns();
+
+	// All the rows have the same height, so the view never measures the rows that it doesn't show:
+	mUI->tvObjects->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+	mUI->tvObjects->verticalHeader()->hide();
+	mUI->tvObjects->setModel(&mModel);
+
+	// Start in the objects' order, rather than sorted by the first column; clicking a sorted column thrice unsorts:
+	mUI->tvObjects->horizontalHeader()->setSortIndicatorClearable(true);
+	mUI->tvObjects->horizontalHeader()->setSortIndicator(-1, Qt::AscendingOrder);
+	mUI->tvObjects->setSortingEnabled(true);
+
+	connect(mUI->cbKind,         &QComboBox::currentIndexChanged, this, &NetTableDock::kindChanged);
+	connect(mUI->chbFilter,      &QCheckBox::toggled,             this, &NetTableDock::filterChanged);
+	connect(mUI->eFilterMin,     &QLineEdit::editingFinished,     this, &NetTableDock::filterChanged);
+	connect(mUI->cbFilterColumn, &QComboBox::currentIndexChanged, this, &NetTableDock::filterChanged);
+	connect(mUI->tvObjects->selectionModel(), &QItemSelectionModel::currentRowChanged, this, &NetTableDock::currentRowChanged);
+	connect(this, &QDockWidget::visibilityChanged, this, [this](bool aIsVisible)
+		{
+			if (aIsVisible)
+			{
+				mModel.netChanged();
+			}
+		}
+	);
+}
+
+
+
+
+
+NetTableDock::~NetTableDock()
+{
+	// Nothing explicit needed yet
+}
+
+
+
+
+
+void NetTableDock::setNet(const SpringNet * aNet)
+{
+	mSelectedObject = {SpringNet::ObjectType::None, 0};
+	mModel.setNet(aNet);
+}
+
+
+
+
+
+void NetTableDock::netChanged()
+{
+	if (isVisible())
+	{
+		mModel.netChanged();
+	}
+}
+
+
+
+
+
+void NetTableDock::selectObject(std::pair<SpringNet::ObjectType, size_t> aObject)
+{
+	if (!isVisible() || (aObject.first != mModel.objectType()))
+	{
+		return;
+	}
+	auto row = mModel.objectRow(aObject.second);
+	if (row < 0)
+	{
+		return;
+	}
+	mIsSelectingObject = true;
+	mSelectedObject = aObject;
+	auto idx = mModel.index(row, 0);
+	mUI->tvObjects->setCurrentIndex(idx);
+	mUI->tvObjects->scrollTo(idx);
+	mIsSelectingObject = false;
+}
+
+
+
+
+
+void NetTableDock::kindChanged()
+{
+	auto kind = static_cast<NetTableModel::Kind>(mUI->cbKind->currentData().toInt());
+	mSelectedObject = {SpringNet::ObjectType::None, 0};
+	mModel.setKind(kind);
+	mUI->tvObjects->horizontalHeader()->setSortIndicator(-1, Qt::AscendingOrder);
+	updateFilterColumns();
+	filterChanged();
+}
+
+
+
+
+
+void NetTableDock::updateFilterColumns()
+{
+	QSignalBlocker blocker(mUI->cbFilterColumn);
+	auto prevColumn = mUI->cbFilterColumn->currentIndex();
+	mUI->cbFilterColumn->clear();
+	mUI->cbFilterColumn->addItems(NetTableModel::columnTitles(mModel.kind()));
+	mUI->cbFilterColumn->setCurrentIndex(std::clamp(prevColumn, 0, mUI->cbFilterColumn->count() - 1));
+}
+
+
+
+
+
+void NetTableDock::filterChanged()
+{
+	if (!mUI->chbFilter->isChecked())
+	{
+		mModel.setFilter(std::nullopt);
+		return;
+	}
+	bool isOK = false;
+	auto minAbsValue = mUI->eFilterMin->text().toDouble(&isOK);
+	if (!isOK)
+	{
+		// Keep the previous filter until the user enters a number:
+		return;
+	}
+	mModel.setFilter(NetTableModel::Filter{mUI->cbFilterColumn->currentIndex(), minAbsValue});
+}
+
+
+
+
+
+void NetTableDock::currentRowChanged(const QModelIndex & aCurrent)
+{
+	if (mIsSelectingObject || !aCurrent.isValid())
+	{
+		return;
+	}
+	std::pair object{mModel.objectType(), mModel.objectIdx(aCurrent.row())};
+	if (object == mSelectedObject)
+	{
+		return;
+	}
+	mSelectedObject = object;
+	Q_EMIT objectSelected(object);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <memory>
+#include <QDockWidget>
+
+#include "NetTableModel.hpp"
+
+
+
+
+
+// fwd:
+namespace Ui {
+class NetTableDock;
+}
+
+
+
+
+
+/** Dockable table of the net's points or springs, with sorting and filtering (see NetTableModel).
+The current row is synced with the scene: selecting a row emits objectSelected(), and the object clicked in the scene
+is selected in the table through selectObject(). */
+class NetTableDock:
+	public QDockWidget
+{
+	Q_OBJECT
+
+	using Super = QDockWidget;
+
+
+public:
+
+	explicit NetTableDock(QWidget * aParent);
+	~NetTableDock();
+
+	/** Sets the net to list, nullptr for none. The net must outlive the dock, or be reset before being destroyed. */
+	void setNet(const SpringNet * aNet);
+
+	/** To be called whenever the net has changed. Does nothing while the dock is hidden, it refreshes when shown. */
+	void netChanged();
+
+	/** Makes the object's row current and scrolls to it, if the table lists that type of objects and the object isn't
+	filtered out. Doesn't emit objectSelected(). */
+	void selectObject(std::pair<SpringNet::ObjectType, size_t> aObject);
+
+
+Q_SIGNALS:
+
+	/** Emitted when the user selects an object's row in the table. */
+	void objectSelected(std::pair<SpringNet::ObjectType, size_t> aObject);
+
+
+private:
+
+	/** The Qt-managed UI. */
+	std::unique_ptr<Ui::NetTableDock> mUI;
+
+	NetTableModel mModel;
+
+	/** Set while selectObject() changes the current row, so that it isn't reported back by objectSelected(). */
+	bool mIsSelectingObject = false;
+
+	/** The object last reported by objectSelected(); re-ordering the rows moves the current row without changing it. */
+	std::pair<SpringNet::ObjectType, size_t> mSelectedObject = {SpringNet::ObjectType::None, 0};
+
+
+	/** Switches the table to the kind of objects selected in the UI. */
+	void kindChanged();
+
+	/** Refills the filter column choice for the current kind of objects. */
+	void updateFilterColumns();
+
+	/** Sets the model's filter from the UI. */
+	void filterChanged();
+
+	/** Reports the newly current row's object through objectSelected(). */
+	void currentRowChanged(const QModelIndex & aCurrent);
+};
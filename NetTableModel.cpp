@@ -0,0 +1,560 @@
+#include "NetTableModel.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <numeric>
+#include <QtGlobal>
+
+
+
+
+
+namespace {
+
+/** How the values of a column are shown. */
+enum class Format
+{
+	Index,
+	Real,
+	Bool,
+};
+
+
+/** A single column of the table: its title (untranslated, translated by tr() when shown), and its value for the
+object at the specified index. */
+struct ColumnDef
+{
+	const char * mTitle;
+	Format mFormat;
+	double (* mValue)(const SpringNet & aNet, size_t aIdx);
+};
+
+
+static const ColumnDef POINT_COLUMNS[] =
+{
+	{QT_TRANSLATE_NOOP("NetTableModel", "#"),     Format::Index, [](const SpringNet &, size_t aIdx) { return static_cast<double>(aIdx); }},
+	{QT_TRANSLATE_NOOP("NetTableModel", "X"),     Format::Real,  [](const SpringNet & aNet, size_t aIdx) { return aNet.point(aIdx).x(); }},
+	{QT_TRANSLATE_NOOP("NetTableModel", "Y"),     Format::Real,  [](const SpringNet & aNet, size_t aIdx) { return aNet.point(aIdx).y(); }},
+	{QT_TRANSLATE_NOOP("NetTableModel", "Fixed"), Format::Bool,  [](const SpringNet & aNet, size_t aIdx) { return aNet.isPointFixed(aIdx) ? 1.0 : 0.0; }},
+};
+
+
+/** The strain and residual are the same values as the strain map colors the springs by (StrainMap::Mode). */
+static const ColumnDef SPRING_COLUMNS[] =
+{
+	{QT_TRANSLATE_NOOP("NetTableModel", "#"),            Format::Index, [](const SpringNet &, size_t aIdx) { return static_cast<double>(aIdx); }},
+	{QT_TRANSLATE_NOOP("NetTableModel", "Point 1"),      Format::Index, [](const SpringNet & aNet, size_t aIdx) { return static_cast<double>(aNet.spring(aIdx).pointIdx1()); }},
+	{QT_TRANSLATE_NOOP("NetTableModel", "Point 2"),      Format::Index, [](const SpringNet & aNet, size_t aIdx) { return static_cast<double>(aNet.spring(aIdx).pointIdx2()); }},
+	{QT_TRANSLATE_NOOP("NetTableModel", "Ideal length"), Format::Real,  [](const SpringNet & aNet, size_t aIdx) { return aNet.spring(aIdx).idealLength(); }},
+	{QT_TRANSLATE_NOOP("NetTableModel", "Length"),       Format::Real,  [](const SpringNet & aNet, size_t aIdx) { return aNet.spring(aIdx).currentLength(aNet); }},
+	{QT_TRANSLATE_NOOP("NetTableModel", "Strain"),       Format::Real,  [](const SpringNet & aNet, size_t aIdx)
+		{
+			const auto & s = aNet.spring(aIdx);
+			auto ideal = s.idealLength();
+			return (ideal > 0) ? (s.currentLength(aNet) - ideal) / ideal : 0.0;
+		}
+	},
+	{QT_TRANSLATE_NOOP("NetTableModel", "Residual"),     Format::Real,  [](const SpringNet & aNet, size_t aIdx)
+		{
+			const auto & s = aNet.spring(aIdx);
+			return (s.currentLength(aNet) - s.idealLength()) * std::sqrt(s.force());
+		}
+	},
+	{QT_TRANSLATE_NOOP("NetTableModel", "Force"),        Format::Real,  [](const SpringNet & aNet, size_t aIdx) { return aNet.spring(aIdx).force(); }},
+};
+
+
+/** Returns the columns of the table for the specified kind of objects. */
+static std::pair<const ColumnDef *, int> columnDefs(NetTableModel::Kind aKind)
+{
+	switch (aKind)
+	{
+		case NetTableModel::Kind::Points:  return {POINT_COLUMNS, static_cast<int>(std::size(POINT_COLUMNS))};
+		case NetTableModel::Kind::Springs: return {SPRING_COLUMNS, static_cast<int>(std::size(SPRING_COLUMNS))};
+	}
+	return {nullptr, 0};
+}
+
+}  // anonymous namespace
+
+
+
+
+
+NetTableModel::NetTableModel(QObject * aParent):
+	Super(aParent)
+{
+	// The ordering task emits from a worker thread, the order is applied in the GUI thread:
+	connect(this, &NetTableModel::orderFinished, this, &NetTableModel::applyOrder, Qt::QueuedConnection);
+}
+
+
+
+
+
+NetTableModel::~NetTableModel()
+{
+	mOrderTasks.cancelAndWait();
+}
+
+
+
+
+
+void NetTableModel::setNet(const SpringNet * aNet)
+{
+	mNet = aNet;
+	resetRows();
+}
+
+
+
+
+
+void NetTableModel::netChanged()
+{
+	if (mNet == nullptr)
+	{
+		return;
+	}
+	if (mNet->topologyVersion() != mTopologyVersion)
+	{
+		resetRows();
+		return;
+	}
+	if ((mNet->paramsVersion() == mParamsVersion) && (mNet->geometryVersion() == mGeometryVersion))
+	{
+		return;
+	}
+	mParamsVersion = mNet->paramsVersion();
+	mGeometryVersion = mNet->geometryVersion();
+
+	// The view only re-reads the cells that it shows:
+	auto numRows = rowCount();
+	if (numRows > 0)
+	{
+		Q_EMIT dataChanged(index(0, 0), index(numRows - 1, columnCount() - 1), {Qt::DisplayRole});
+	}
+
+	// Re-order, unless the previous change is still being ordered; then re-order once it finishes:
+	if ((mSortColumn >= 0) || mFilter.has_value())
+	{
+		if (mIsOrdering)
+		{
+			mIsOrderStale = true;
+		}
+		else
+		{
+			requestOrder();
+		}
+	}
+}
+
+
+
+
+
+void NetTableModel::setKind(Kind aKind)
+{
+	if (aKind == mKind)
+	{
+		return;
+	}
+	mKind = aKind;
+	mSortColumn = -1;
+	mFilter.reset();
+	resetRows();
+}
+
+
+
+
+
+void NetTableModel::setFilter(std::optional<Filter> aFilter)
+{
+	mFilter = aFilter;
+	requestOrder();
+}
+
+
+
+
+
+SpringNet::ObjectType NetTableModel::objectType() const
+{
+	switch (mKind)
+	{
+		case Kind::Points:  return SpringNet::ObjectType::Point;
+		case Kind::Springs: return SpringNet::ObjectType::Spring;
+	}
+	return SpringNet::ObjectType::None;
+}
+
+
+
+
+
+size_t NetTableModel::objectIdx(int aRow) const
+{
+	if (mRowObjects.has_value())
+	{
+		return (*mRowObjects)[static_cast<size_t>(aRow)];
+	}
+	return static_cast<size_t>(aRow);
+}
+
+
+
+
+
+int NetTableModel::objectRow(size_t aObjectIdx) const
+{
+	if (!mRowObjects.has_value())
+	{
+		return (aObjectIdx < static_cast<size_t>(rowCount())) ? static_cast<int>(aObjectIdx) : -1;
+	}
+	auto itr = std::find(mRowObjects->begin(), mRowObjects->end(), static_cast<uint32_t>(aObjectIdx));
+	if (itr == mRowObjects->end())
+	{
+		return -1;
+	}
+	return static_cast<int>(itr - mRowObjects->begin());
+}
+
+
+
+
+
+QStringList NetTableModel::columnTitles(Kind aKind)
+{
+	QStringList res;
+	auto [defs, numColumns] = columnDefs(aKind);
+	for (int col = 0; col < numColumns; ++col)
+	{
+		res.append(tr(defs[col].mTitle));
+	}
+	return res;
+}
+
+
+
+
+
+int NetTableModel::rowCount(const QModelIndex & aParent) const
+{
+	if (aParent.isValid())
+	{
+		return 0;
+	}
+	auto numRows = mRowObjects.has_value() ? mRowObjects->size() : numObjects();
+	return static_cast<int>(std::min<size_t>(numRows, INT_MAX));
+}
+
+
+
+
+
+int NetTableModel::columnCount(const QModelIndex & aParent) const
+{
+	if (aParent.isValid())
+	{
+		return 0;
+	}
+	return columnDefs(mKind).second;
+}
+
+
+
+
+
+QVariant NetTableModel::data(const QModelIndex & aIndex, int aRole) const
+{
+	if (!aIndex.isValid() || (mNet == nullptr))
+	{
+		return {};
+	}
+	const auto & def = columnDefs(mKind).first[aIndex.column()];
+	switch (aRole)
+	{
+		case Qt::DisplayRole:
+		{
+			auto value = def.mValue(*mNet, objectIdx(aIndex.row()));
+			switch (def.mFormat)
+			{
+				case Format::Index: return QString::number(static_cast<qulonglong>(value));
+				case Format::Real:  return QString::number(value, 'g', 10);
+				case Format::Bool:  return (value != 0) ? tr("yes") : QString();
+			}
+			return {};
+		}
+		case Qt::TextAlignmentRole:
+		{
+			if (def.mFormat == Format::Bool)
+			{
+				return static_cast<int>(Qt::AlignCenter);
+			}
+			return static_cast<int>(Qt::AlignRight | Qt::AlignVCenter);
+		}
+		default: return {};
+	}
+}
+
+
+
+
+
+QVariant NetTableModel::headerData(int aSection, Qt::Orientation aOrientation, int aRole) const
+{
+	if ((aOrientation != Qt::Horizontal) || (aRole != Qt::DisplayRole))
+	{
+		return Super::headerData(aSection, aOrientation, aRole);
+	}
+	auto [defs, numColumns] = columnDefs(mKind);
+	if ((aSection < 0) || (aSection >= numColumns))
+	{
+		return {};
+	}
+	return tr(defs[aSection].mTitle);
+}
+
+
+
+
+
+void NetTableModel::sort(int aColumn, Qt::SortOrder aOrder)
+{
+	mSortColumn = aColumn;
+	mSortOrder = aOrder;
+	requestOrder();
+}
+
+
+
+
+
+size_t NetTableModel::numObjects() const
+{
+	if (mNet == nullptr)
+	{
+		return 0;
+	}
+	switch (mKind)
+	{
+		case Kind::Points:  return mNet->numPoints();
+		case Kind::Springs: return mNet->numSprings();
+	}
+	return 0;
+}
+
+
+
+
+
+double NetTableModel::value(size_t aObjectIdx, int aColumn) const
+{
+	return columnDefs(mKind).first[aColumn].mValue(*mNet, aObjectIdx);
+}
+
+
+
+
+
+void NetTableModel::requestOrder()
+{
+	mIsOrderStale = false;
+	mOrderGeneration += 1;
+	if ((mNet == nullptr) || ((mSortColumn < 0) && !mFilter.has_value()))
+	{
+		// Nothing to compute, show the objects in their order; any result still being ordered gets dropped:
+		mIsOrdering = false;
+		if (mRowObjects.has_value())
+		{
+			beginResetModel();
+			mRowObjects.reset();
+			endResetModel();
+		}
+		return;
+	}
+
+	// Gather the values of the columns, in a single pass each; the ordering task does the rest:
+	auto numObjs = numObjects();
+	OrderRequest request{mOrderGeneration, numObjs, {}, (mSortOrder == Qt::DescendingOrder), {}, 0};
+	if (mSortColumn >= 0)
+	{
+		request.mSortValues.resize(numObjs);
+		for (size_t idx = 0; idx < numObjs; ++idx)
+		{
+			request.mSortValues[idx] = value(idx, mSortColumn);
+		}
+	}
+	if (mFilter.has_value())
+	{
+		request.mMinAbsValue = mFilter->mMinAbsValue;
+		request.mFilterValues.resize(numObjs);
+		for (size_t idx = 0; idx < numObjs; ++idx)
+		{
+			request.mFilterValues[idx] = value(idx, mFilter->mColumn);
+		}
+	}
+	{
+		std::lock_guard lock(mMutex);
+		mPendingRequest = std::move(request);
+	}
+	mOrderTasks.run([this]() { orderPendingRequest(); });
+	mIsOrdering = true;
+}
+
+
+
+
+
+void NetTableModel::applyOrder()
+{
+	std::optional<OrderResult> result;
+	{
+		std::lock_guard lock(mMutex);
+		std::swap(result, mPendingResult);
+	}
+	if (!result.has_value() || (result->mGeneration != mOrderGeneration))
+	{
+		// A newer request is being ordered, its result will follow:
+		return;
+	}
+	mIsOrdering = false;
+
+	auto & rows = result->mRowObjects;
+	if (rows.size() != static_cast<size_t>(rowCount()))
+	{
+		// The filter has changed the number of rows:
+		beginResetModel();
+		mRowObjects = std::move(rows);
+		endResetModel();
+	}
+	else
+	{
+		// Only reordered, keep the selection and the current row on their objects:
+		Q_EMIT layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+		auto oldIndices = persistentIndexList();
+		std::vector<size_t> oldObjects;
+		oldObjects.reserve(static_cast<size_t>(oldIndices.size()));
+		for (const auto & idx: oldIndices)
+		{
+			oldObjects.push_back(objectIdx(idx.row()));
+		}
+		std::vector<int> newRowOfObject;
+		if (!oldIndices.isEmpty())
+		{
+			newRowOfObject.assign(numObjects(), -1);
+			for (size_t row = 0; row < rows.size(); ++row)
+			{
+				newRowOfObject[rows[row]] = static_cast<int>(row);
+			}
+		}
+		mRowObjects = std::move(rows);
+		QModelIndexList newIndices;
+		newIndices.reserve(oldIndices.size());
+		for (qsizetype i = 0; i < oldIndices.size(); ++i)
+		{
+			auto newRow = (oldObjects[i] < newRowOfObject.size()) ? newRowOfObject[oldObjects[i]] : -1;
+			newIndices.append((newRow < 0) ? QModelIndex() : index(newRow, oldIndices[i].column()));
+		}
+		changePersistentIndexList(oldIndices, newIndices);
+		Q_EMIT layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+	}
+
+	if (mIsOrderStale)
+	{
+		requestOrder();
+	}
+}
+
+
+
+
+
+void NetTableModel::resetRows()
+{
+	beginResetModel();
+	if (mNet != nullptr)
+	{
+		mTopologyVersion = mNet->topologyVersion();
+		mParamsVersion = mNet->paramsVersion();
+		mGeometryVersion = mNet->geometryVersion();
+	}
+	mRowObjects.reset();
+	endResetModel();
+	requestOrder();
+}
+
+
+
+
+
+void NetTableModel::orderPendingRequest()
+{
+	std::unique_lock lock(mMutex);
+	if (!mPendingRequest.has_value())
+	{
+		// Taken by the task of a newer request
+		return;
+	}
+	auto request = std::move(*mPendingRequest);
+	mPendingRequest.reset();
+	lock.unlock();
+
+	auto rows = computeOrder(request);
+
+	// Tasks of successive requests may finish out of order, keep the newest result:
+	lock.lock();
+	if (mPendingResult.has_value() && (mPendingResult->mGeneration > request.mGeneration))
+	{
+		return;
+	}
+	mPendingResult = OrderResult{request.mGeneration, std::move(rows)};
+	Q_EMIT orderFinished();
+}
+
+
+
+
+
+std::vector<uint32_t> NetTableModel::computeOrder(const OrderRequest & aRequest)
+{
+	std::vector<uint32_t> rows;
+	if (aRequest.mFilterValues.empty())
+	{
+		rows.resize(aRequest.mNumObjects);
+		std::iota(rows.begin(), rows.end(), 0);
+	}
+	else
+	{
+		for (size_t idx = 0; idx < aRequest.mNumObjects; ++idx)
+		{
+			if (std::abs(aRequest.mFilterValues[idx]) >= aRequest.mMinAbsValue)
+			{
+				rows.push_back(static_cast<uint32_t>(idx));
+			}
+		}
+	}
+	if (aRequest.mSortValues.empty())
+	{
+		return rows;
+	}
+
+	// NaNs (from a diverged solve) don't compare, keep them at the end in their order; the rest is sorted stably, so
+	// that the equal values stay in the objects' order:
+	const auto & values = aRequest.mSortValues;
+	auto nans = std::stable_partition(rows.begin(), rows.end(),
+		[&values](uint32_t aIdx) { return !std::isnan(values[aIdx]); }
+	);
+	if (aRequest.mIsDescending)
+	{
+		std::stable_sort(rows.begin(), nans, [&values](uint32_t aIdx1, uint32_t aIdx2) { return values[aIdx1] > values[aIdx2]; });
+	}
+	else
+	{
+		std::stable_sort(rows.begin(), nans, [&values](uint32_t aIdx1, uint32_t aIdx2) { return values[aIdx1] < values[aIdx2]; });
+	}
+	return rows;
+}
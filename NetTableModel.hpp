@@ -0,0 +1,180 @@
+#pragma once
+
+#include <mutex>
+#include <optional>
+#include <vector>
+#include <QAbstractTableModel>
+
+#include "SpringNet.hpp"
+#include "TaskScheduler.hpp"
+
+
+
+
+
+/** A table of either the points or the springs of a SpringNet, for the object table dock.
+The cells are read straight from the net whenever the view asks for them, so only the rows that are visible are ever
+formatted, and the model doesn't copy the net; it stays usable with millions of rows.
+The rows can be sorted by any column and filtered by the absolute value in a column. The sort / filter order is
+computed by a task on the shared TaskScheduler, at the Interactive priority: the GUI thread only gathers the column's
+values into an array, the task sorts the indices and hands the row order back. Until then the previous order stays
+shown. */
+class NetTableModel:
+	public QAbstractTableModel
+{
+	Q_OBJECT
+
+	using Super = QAbstractTableModel;
+
+
+public:
+
+	/** Which objects the table lists. */
+	enum class Kind
+	{
+		Points,
+		Springs,
+	};
+
+
+	/** Only the rows whose absolute value in mColumn is at least mMinAbsValue are shown. */
+	struct Filter
+	{
+		int mColumn;
+		double mMinAbsValue;
+	};
+
+
+	NetTableModel(QObject * aParent = nullptr);
+
+	/** Cancels the ordering task, if any, and waits for it. */
+	virtual ~NetTableModel() override;
+
+	/** Sets the net to list, nullptr for none. The net must outlive the model, or be reset before being destroyed. */
+	void setNet(const SpringNet * aNet);
+
+	/** To be called whenever the net has changed. Refreshes the shown values; if the rows are sorted or filtered,
+	recomputes their order (at most one recompute runs at a time, changes in the meantime are coalesced). */
+	void netChanged();
+
+	Kind kind() const { return mKind; }
+	void setKind(Kind aKind);
+
+	/** Sets the filter, nullopt to show all the rows. */
+	void setFilter(std::optional<Filter> aFilter);
+
+	/** Returns the type of the objects listed, as used by SpringNet::nearestObject(). */
+	SpringNet::ObjectType objectType() const;
+
+	/** Returns the index of the object (point or spring) shown in the specified row. */
+	size_t objectIdx(int aRow) const;
+
+	/** Returns the row that shows the specified object, or -1 if it is filtered out. */
+	int objectRow(size_t aObjectIdx) const;
+
+	/** Returns the titles of the columns for the specified kind of objects. */
+	static QStringList columnTitles(Kind aKind);
+
+	// QAbstractTableModel overrides:
+	virtual int rowCount(const QModelIndex & aParent = QModelIndex()) const override;
+	virtual int columnCount(const QModelIndex & aParent = QModelIndex()) const override;
+	virtual QVariant data(const QModelIndex & aIndex, int aRole = Qt::DisplayRole) const override;
+	virtual QVariant headerData(int aSection, Qt::Orientation aOrientation, int aRole = Qt::DisplayRole) const override;
+	virtual void sort(int aColumn, Qt::SortOrder aOrder = Qt::AscendingOrder) override;
+
+
+Q_SIGNALS:
+
+	/** Emitted by the ordering task when it has finished an order. Internal, connected to applyOrder(). */
+	void orderFinished();
+
+
+protected:
+
+	/** The job for the ordering task: the values to filter and sort the objects by. */
+	struct OrderRequest
+	{
+		uint64_t mGeneration;
+		size_t mNumObjects;
+
+		/** The value of each object in the sort column; empty if not sorting. */
+		std::vector<double> mSortValues;
+		bool mIsDescending;
+
+		/** The value of each object in the filter column; empty if not filtering. */
+		std::vector<double> mFilterValues;
+		double mMinAbsValue;
+	};
+
+
+	/** The ordering task's answer to an OrderRequest. */
+	struct OrderResult
+	{
+		uint64_t mGeneration;
+		std::vector<uint32_t> mRowObjects;
+	};
+
+
+	const SpringNet * mNet = nullptr;
+
+	Kind mKind = Kind::Springs;
+
+	/** The versions of the net when the model last refreshed; a topology change resets the model. */
+	uint64_t mTopologyVersion = 0;
+	uint64_t mParamsVersion = 0;
+	uint64_t mGeometryVersion = 0;
+
+	/** The column sorted by, -1 for the objects' order. */
+	int mSortColumn = -1;
+	Qt::SortOrder mSortOrder = Qt::AscendingOrder;
+
+	std::optional<Filter> mFilter;
+
+	/** The object shown in each row; nullopt when the rows are the objects in their order (not sorted nor filtered). */
+	std::optional<std::vector<uint32_t>> mRowObjects;
+
+	/** The generation of the last requested order; results of older requests are dropped. */
+	uint64_t mOrderGeneration = 0;
+
+	/** Set while a request is being ordered. */
+	bool mIsOrdering = false;
+
+	/** Set when the net has changed while a request was being ordered; the order is requested again once done. */
+	bool mIsOrderStale = false;
+
+	/** Protects the members below, shared with the ordering tasks. */
+	std::mutex mMutex;
+
+	/** The newest request not yet taken by an ordering task. */
+	std::optional<OrderRequest> mPendingRequest;
+
+	/** The newest result not yet applied by the GUI thread. */
+	std::optional<OrderResult> mPendingResult;
+
+	/** The ordering tasks; declared last, so that it waits for the tasks before the members they use are gone. */
+	TaskScheduler::TaskGroup mOrderTasks{TaskScheduler::Priority::Interactive};
+
+
+	/** Returns the number of the objects of mKind in the net. */
+	size_t numObjects() const;
+
+	/** Returns the value of the specified object in the specified column, as used for sorting and filtering. */
+	double value(size_t aObjectIdx, int aColumn) const;
+
+	/** Gathers the values of the sort and filter columns and queues an ordering task for them, replacing any request
+	that no task has taken yet. If not sorting nor filtering, shows the objects in their order right away. */
+	void requestOrder();
+
+	/** Shows the result of the ordering task, if it is the result of the newest request. Called in the GUI thread. */
+	void applyOrder();
+
+	/** Drops the rows' order and refreshes the whole model; used when the objects themselves have changed. */
+	void resetRows();
+
+	/** The body of an ordering task: takes the newest request, if no other task has taken it yet, and computes its row
+	order. */
+	void orderPendingRequest();
+
+	/** Computes the row order for the request. */
+	static std::vector<uint32_t> computeOrder(const OrderRequest & aRequest);
+};
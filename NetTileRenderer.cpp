@@ -0,0 +1,843 @@
+#include "NetTileRenderer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <QFontMetricsF>
+#include <QPainter>
+#include <QtMath>
+
+#include "SolverTrace.hpp"
+#include "StrainMap.hpp"
+
+
+
+
+
+namespace {
+
+/** The range of the zoom levels; level 0 draws one scene unit as one pixel, each level up doubles that. */
+static const int MIN_LEVEL = -40;
+static const int MAX_LEVEL = 30;
+
+/** The max number of tiles kept in the cache, across all levels (each takes TILE_SIZE^2 * 4 bytes, 256 KiB). */
+static const size_t MAX_CACHED_TILES = 256;
+
+/** If moving the points changes more areas than this, all tiles are invalidated instead. */
+static const size_t MAX_CHANGED_AREAS = 1024;
+
+/** How many levels up paint() looks for a coarser tile to draw in place of a missing one. */
+static const int MAX_FALLBACK_LEVELS = 4;
+
+/** How many pixels the pens may draw outside of the objects' geometric bounds. */
+static const double PEN_MARGIN_PIXELS = 2;
+
+/** The labels are not drawn if they would be smaller than this, in pixels; they would be unreadable anyway. */
+static const double MIN_LABEL_PIXEL_HEIGHT = 5;
+
+/** The number of line segments that approximate the arc of an angle. */
+static const int ANGLE_ARC_SEGMENTS = 16;
+
+/** The average number of objects per cell of a Grid, and the max number of cells in either direction. */
+static const size_t GRID_OBJECTS_PER_CELL = 4;
+static const size_t GRID_MAX_CELLS_PER_SIDE = 4096;
+
+/** The widest label expected, used for the labels' bounds. */
+static const char * WIDEST_LABEL = "-8.88888e+08 / -8.88888e+08";
+
+
+
+
+
+/** Returns the marker drawn for a point, same as the one drawn by GraphicsPointItem. */
+static QRectF pointMarker(QPointF aPos)
+{
+	return QRectF(aPos.x() - 6, aPos.y() - 6, 13, 13);
+}
+
+}  // anonymous namespace
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// NetTileRenderer::Grid:
+
+template <typename BoundsFn>
+void NetTileRenderer::Grid::build(size_t aNumObjects, BoundsFn && aBoundsFn)
+{
+	mCellStarts.clear();
+	mObjects.clear();
+	mMaxHalfWidth = 0;
+	mMaxHalfHeight = 0;
+	mNumCellsX = 0;
+	mNumCellsY = 0;
+	if (aNumObjects == 0)
+	{
+		return;
+	}
+
+	// The extent of the centers and the largest half-extents:
+	auto minX = std::numeric_limits<double>::max();
+	auto minY = std::numeric_limits<double>::max();
+	auto maxX = std::numeric_limits<double>::lowest();
+	auto maxY = std::numeric_limits<double>::lowest();
+	for (size_t idx = 0; idx < aNumObjects; ++idx)
+	{
+		auto bounds = aBoundsFn(idx);
+		auto center = bounds.center();
+		minX = std::min(minX, center.x());
+		minY = std::min(minY, center.y());
+		maxX = std::max(maxX, center.x());
+		maxY = std::max(maxY, center.y());
+		mMaxHalfWidth = std::max(mMaxHalfWidth, bounds.width() / 2);
+		mMaxHalfHeight = std::max(mMaxHalfHeight, bounds.height() / 2);
+	}
+	mExtent = QRectF(QPointF(minX, minY), QPointF(maxX, maxY));
+
+	// Square cells, about GRID_OBJECTS_PER_CELL objects per cell if the objects were spread evenly:
+	auto width = maxX - minX;
+	auto height = maxY - minY;
+	auto numCells = static_cast<double>(std::max<size_t>(1, aNumObjects / GRID_OBJECTS_PER_CELL));
+	mCellSize = std::max(std::sqrt(width * height / numCells), std::max(width, height) / numCells);
+	if (mCellSize <= 0)
+	{
+		mCellSize = 1;
+	}
+	mNumCellsX = std::min(GRID_MAX_CELLS_PER_SIDE, static_cast<size_t>(width / mCellSize) + 1);
+	mNumCellsY = std::min(GRID_MAX_CELLS_PER_SIDE, static_cast<size_t>(height / mCellSize) + 1);
+	mCellSize = std::max({mCellSize, width / mNumCellsX, height / mNumCellsY});
+
+	// Counting sort of the objects by their cell:
+	std::vector<uint32_t> objectCells(aNumObjects);
+	mCellStarts.assign(mNumCellsX * mNumCellsY + 1, 0);
+	for (size_t idx = 0; idx < aNumObjects; ++idx)
+	{
+		auto center = aBoundsFn(idx).center();
+		objectCells[idx] = static_cast<uint32_t>(cellY(center.y()) * mNumCellsX + cellX(center.x()));
+		mCellStarts[objectCells[idx] + 1] += 1;
+	}
+	for (size_t cell = 1; cell < mCellStarts.size(); ++cell)
+	{
+		mCellStarts[cell] += mCellStarts[cell - 1];
+	}
+	auto cursors = mCellStarts;
+	mObjects.resize(aNumObjects);
+	for (size_t idx = 0; idx < aNumObjects; ++idx)
+	{
+		mObjects[cursors[objectCells[idx]]++] = static_cast<uint32_t>(idx);
+	}
+}
+
+
+
+
+
+template <typename Fn>
+void NetTileRenderer::Grid::forEachCandidate(const QRectF & aRect, Fn && aFn) const
+{
+	if (mObjects.empty())
+	{
+		return;
+	}
+	auto query = aRect.adjusted(-mMaxHalfWidth, -mMaxHalfHeight, mMaxHalfWidth, mMaxHalfHeight);
+	if (
+		(query.right() < mExtent.left()) || (query.left() > mExtent.right()) ||
+		(query.bottom() < mExtent.top()) || (query.top() > mExtent.bottom())
+	)
+	{
+		return;
+	}
+	auto x0 = cellX(query.left());
+	auto x1 = cellX(query.right());
+	auto y0 = cellY(query.top());
+	auto y1 = cellY(query.bottom());
+	for (auto y = y0; y <= y1; ++y)
+	{
+		for (auto x = x0; x <= x1; ++x)
+		{
+			auto cell = y * mNumCellsX + x;
+			for (auto idx = mCellStarts[cell]; idx < mCellStarts[cell + 1]; ++idx)
+			{
+				aFn(mObjects[idx]);
+			}
+		}
+	}
+}
+
+
+
+
+
+size_t NetTileRenderer::Grid::cellX(double aX) const
+{
+	auto cell = std::floor((aX - mExtent.left()) / mCellSize);
+	return static_cast<size_t>(std::clamp(cell, 0.0, static_cast<double>(mNumCellsX - 1)));
+}
+
+
+
+
+
+size_t NetTileRenderer::Grid::cellY(double aY) const
+{
+	auto cell = std::floor((aY - mExtent.top()) / mCellSize);
+	return static_cast<size_t>(std::clamp(cell, 0.0, static_cast<double>(mNumCellsY - 1)));
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// NetTileRenderer::TileKeyHash:
+
+size_t NetTileRenderer::TileKeyHash::operator () (const TileKey & aKey) const
+{
+	auto hash = std::hash<int64_t>()(aKey.mX);
+	hash = hash * 31 + std::hash<int64_t>()(aKey.mY);
+	hash = hash * 31 + std::hash<int>()(aKey.mLevel);
+	return hash;
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// NetTileRenderer:
+
+NetTileRenderer::NetTileRenderer(QObject * aParent):
+	Super(aParent)
+{
+	QFontMetricsF metrics(mFont);
+	mLabelSize = QSizeF(metrics.horizontalAdvance(QString::fromUtf8(WIDEST_LABEL)), metrics.height());
+	mLabelAscent = metrics.ascent();
+}
+
+
+
+
+
+NetTileRenderer::~NetTileRenderer()
+{
+	mRenderTasks.cancelAndWait();
+}
+
+
+
+
+
+void NetTileRenderer::setNet(const SpringNet & aNet, Highlights aHighlights, std::vector<uint8_t> aSpringColors)
+{
+	TRACE_SCOPE("tileSnapshot");
+
+	// Share the topology with the previous snapshot, if it hasn't changed:
+	auto topology = (mSnapshot == nullptr) ? nullptr : mSnapshot->mTopology;
+	auto isSameTopology = (
+		(topology != nullptr) &&
+		(topology->mTopologyVersion == aNet.topologyVersion()) &&
+		(topology->mParamsVersion == aNet.paramsVersion()) &&
+		(topology->mHighlights == aHighlights)
+	);
+	if (!isSameTopology)
+	{
+		auto newTopology = std::make_shared<Topology>();
+		newTopology->mTopologyVersion = aNet.topologyVersion();
+		newTopology->mParamsVersion = aNet.paramsVersion();
+		newTopology->mSprings = aNet.springs();
+		newTopology->mAngles = aNet.angles();
+		auto numPoints = aNet.numPoints();
+		newTopology->mIsFixed.resize(numPoints);
+		for (size_t idx = 0; idx < numPoints; ++idx)
+		{
+			newTopology->mIsFixed[idx] = aNet.isPointFixed(idx);
+		}
+		newTopology->mHighlights = std::move(aHighlights);
+		topology = std::move(newTopology);
+	}
+
+	auto snapshot = std::make_shared<Snapshot>();
+	snapshot->mGeneration = ++mGeneration;
+	snapshot->mTopology = std::move(topology);
+	snapshot->mPositions = aNet.positions();
+	snapshot->mSpringColors = std::move(aSpringColors);
+
+	std::optional<std::vector<QRectF>> changed;
+	if (isSameTopology && (mSnapshot->mSpringColors.size() == snapshot->mSpringColors.size()))
+	{
+		changed = changedAreas(*mSnapshot, *snapshot);
+	}
+	publish(std::move(snapshot), changed);
+}
+
+
+
+
+
+void NetTileRenderer::setPositions(const SpringNet & aNet)
+{
+	if (
+		(mSnapshot == nullptr) ||
+		(mSnapshot->mTopology->mTopologyVersion != aNet.topologyVersion()) ||
+		(mSnapshot->mTopology->mParamsVersion != aNet.paramsVersion())
+	)
+	{
+		// The highlights and colors are per object, they no longer fit:
+		setNet(aNet, {});
+		return;
+	}
+	TRACE_SCOPE("tileSnapshot");
+	auto snapshot = std::make_shared<Snapshot>();
+	snapshot->mGeneration = ++mGeneration;
+	snapshot->mTopology = mSnapshot->mTopology;
+	snapshot->mPositions = aNet.positions();
+	snapshot->mSpringColors = mSnapshot->mSpringColors;
+	auto changed = changedAreas(*mSnapshot, *snapshot);
+	publish(std::move(snapshot), changed);
+}
+
+
+
+
+
+void NetTileRenderer::publish(std::shared_ptr<const Snapshot> aSnapshot, const std::optional<std::vector<QRectF>> & aChanged)
+{
+	{
+		std::lock_guard lock(mMutex);
+		auto generation = aSnapshot->mGeneration;
+		mSnapshot = std::move(aSnapshot);
+		if (aChanged)
+		{
+			for (const auto & area: *aChanged)
+			{
+				invalidate(area, generation);
+			}
+		}
+		else
+		{
+			mAllDirtyGeneration = generation;
+		}
+	}
+	Q_EMIT updated();
+}
+
+
+
+
+
+void NetTileRenderer::paint(QPainter & aPainter, const QRectF & aSceneRect, double aPixelScale)
+{
+	mHasPendingUpdate = false;
+	if ((mSnapshot == nullptr) || (aPixelScale <= 0) || aSceneRect.isEmpty())
+	{
+		return;
+	}
+
+	// Render at the nearest level at least as fine as the view, the tiles are only ever scaled down:
+	auto level = std::clamp(static_cast<int>(std::ceil(std::log2(aPixelScale))), MIN_LEVEL, MAX_LEVEL);
+	auto size = tileSceneSize(level);
+	auto minX = static_cast<int64_t>(std::floor(aSceneRect.left() / size));
+	auto maxX = static_cast<int64_t>(std::floor(aSceneRect.right() / size));
+	auto minY = static_cast<int64_t>(std::floor(aSceneRect.top() / size));
+	auto maxY = static_cast<int64_t>(std::floor(aSceneRect.bottom() / size));
+
+	// Collect the images under the lock, blit them after releasing it (QImage copies are shallow):
+	struct Blit
+	{
+		QRectF mTarget;
+		QImage mImage;
+		QRectF mSource;
+	};
+	std::vector<Blit> blits;
+	size_t numQueued = 0;
+	{
+		std::lock_guard lock(mMutex);
+		++mFrame;
+		for (auto y = minY; y <= maxY; ++y)
+		{
+			for (auto x = minX; x <= maxX; ++x)
+			{
+				TileKey key{level, x, y};
+				auto & tile = mTiles[key];
+				tile.mLastUsedFrame = mFrame;
+				auto target = tileRect(key);
+				if (!tile.mImage.isNull())
+				{
+					blits.push_back({target, tile.mImage, QRectF(0, 0, TILE_SIZE, TILE_SIZE)});
+				}
+				else
+				{
+					// Draw the covering part of a coarser tile until this one is rendered (such as right after zooming in):
+					for (int up = 1; up <= MAX_FALLBACK_LEVELS; ++up)
+					{
+						auto itr = mTiles.find({level - up, x >> up, y >> up});
+						if ((itr == mTiles.end()) || itr->second.mImage.isNull())
+						{
+							continue;
+						}
+						itr->second.mLastUsedFrame = mFrame;
+						auto coarseRect = tileRect(itr->first);
+						auto factor = TILE_SIZE / coarseRect.width();
+						QRectF source(
+							(target.left() - coarseRect.left()) * factor,
+							(target.top() - coarseRect.top()) * factor,
+							target.width() * factor,
+							target.height() * factor
+						);
+						blits.push_back({target, itr->second.mImage, source});
+						break;
+					}
+				}
+				if (!tile.mIsQueued && !isTileCurrent(tile))
+				{
+					tile.mIsQueued = true;
+					mQueue.push_front(key);
+					numQueued += 1;
+				}
+			}
+		}
+		dropOldTiles();
+	}
+	for (size_t i = 0; i < numQueued; ++i)
+	{
+		mRenderTasks.run([this]() { renderQueuedTile(); });
+	}
+
+	aPainter.save();
+	aPainter.setRenderHint(QPainter::SmoothPixmapTransform);
+	for (const auto & blit: blits)
+	{
+		aPainter.drawImage(blit.mTarget, blit.mImage, blit.mSource);
+	}
+	aPainter.restore();
+}
+
+
+
+
+
+bool NetTileRenderer::hasPendingTiles() const
+{
+	std::lock_guard lock(mMutex);
+	if (!mQueue.empty())
+	{
+		return true;
+	}
+	// A tile being rendered has already left the queue, but stays marked until its image is stored:
+	return std::any_of(mTiles.begin(), mTiles.end(),
+		[](const auto & aKeyAndTile)
+		{
+			return aKeyAndTile.second.mIsQueued;
+		}
+	);
+}
+
+
+
+
+
+QPainterPath NetTileRenderer::angleArc(QPointF aStation, QPointF aPt1, double aAngle, double aRadius)
+{
+	// Approximate the arc by line segments, from the first spring's direction counter-clockwise to the second one's:
+	auto diff1 = aPt1 - aStation;
+	auto startDirection = std::atan2(diff1.y(), diff1.x());
+	QPainterPath path;
+	for (int i = 0; i <= ANGLE_ARC_SEGMENTS; ++i)
+	{
+		auto direction = startDirection + aAngle * i / ANGLE_ARC_SEGMENTS;
+		QPointF pt(aStation.x() + aRadius * std::cos(direction), aStation.y() + aRadius * std::sin(direction));
+		if (i == 0)
+		{
+			path.moveTo(pt);
+		}
+		else
+		{
+			path.lineTo(pt);
+		}
+	}
+	return path;
+}
+
+
+
+
+
+std::optional<std::vector<QRectF>> NetTileRenderer::changedAreas(const Snapshot & aOld, const Snapshot & aNew) const
+{
+	const auto & oldPositions = aOld.mPositions;
+	const auto & newPositions = aNew.mPositions;
+	auto numPoints = newPositions.size();
+	if (oldPositions.size() != numPoints)
+	{
+		return std::nullopt;
+	}
+	std::vector<bool> hasMoved(numPoints);
+	size_t numMoved = 0;
+	for (size_t idx = 0; idx < numPoints; ++idx)
+	{
+		if (oldPositions[idx] != newPositions[idx])
+		{
+			hasMoved[idx] = true;
+			numMoved += 1;
+		}
+	}
+	if (numMoved * 2 > numPoints)
+	{
+		return std::nullopt;
+	}
+
+	// Both the area that the object has left and the one it has moved into:
+	std::vector<QRectF> res;
+	for (size_t idx = 0; idx < numPoints; ++idx)
+	{
+		if (hasMoved[idx])
+		{
+			res.push_back(pointBounds(aOld, idx).united(pointBounds(aNew, idx)));
+		}
+	}
+	// The springs that have moved, or changed their heat-map color (even when only the far end of the net has moved):
+	const auto & topology = *aNew.mTopology;
+	auto numSprings = topology.mSprings.size();
+	const auto & oldColors = aOld.mSpringColors;
+	const auto & newColors = aNew.mSpringColors;
+	for (size_t idx = 0; (idx < numSprings) && (res.size() <= MAX_CHANGED_AREAS); ++idx)
+	{
+		const auto & s = topology.mSprings[idx];
+		if (hasMoved[s.pointIdx1()] || hasMoved[s.pointIdx2()] || (!newColors.empty() && (oldColors[idx] != newColors[idx])))
+		{
+			res.push_back(springBounds(aOld, idx).united(springBounds(aNew, idx)));
+		}
+	}
+	auto numAngles = topology.mAngles.size();
+	for (size_t idx = 0; (idx < numAngles) && (res.size() <= MAX_CHANGED_AREAS); ++idx)
+	{
+		const auto & a = topology.mAngles[idx];
+		if (hasMoved[a.stationIdx()] || hasMoved[a.pointIdx1()] || hasMoved[a.pointIdx2()])
+		{
+			res.push_back(angleBounds(aOld, idx).united(angleBounds(aNew, idx)));
+		}
+	}
+	if (res.size() > MAX_CHANGED_AREAS)
+	{
+		return std::nullopt;
+	}
+	return res;
+}
+
+
+
+
+
+void NetTileRenderer::invalidate(const QRectF & aSceneRect, uint64_t aGeneration)
+{
+	for (auto & [key, tile]: mTiles)
+	{
+		auto margin = PEN_MARGIN_PIXELS * tileSceneSize(key.mLevel) / TILE_SIZE;
+		if (tileRect(key).adjusted(-margin, -margin, margin, margin).intersects(aSceneRect))
+		{
+			tile.mDirtyGeneration = aGeneration;
+		}
+	}
+}
+
+
+
+
+
+void NetTileRenderer::dropOldTiles()
+{
+	if (mTiles.size() <= MAX_CACHED_TILES)
+	{
+		return;
+	}
+	std::vector<std::pair<uint64_t, TileKey>> candidates;
+	for (const auto & [key, tile]: mTiles)
+	{
+		if (tile.mLastUsedFrame < mFrame)
+		{
+			candidates.emplace_back(tile.mLastUsedFrame, key);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(),
+		[](const auto & aCand1, const auto & aCand2)
+		{
+			return aCand1.first < aCand2.first;
+		}
+	);
+	auto numToDrop = std::min(mTiles.size() - MAX_CACHED_TILES, candidates.size());
+	for (size_t i = 0; i < numToDrop; ++i)
+	{
+		// A worker rendering the tile just finds it gone and discards the image
+		mTiles.erase(candidates[i].second);
+	}
+}
+
+
+
+
+
+bool NetTileRenderer::isTileCurrent(const Tile & aTile) const
+{
+	return (
+		(aTile.mImageGeneration > 0) &&
+		(aTile.mImageGeneration >= aTile.mDirtyGeneration) &&
+		(aTile.mImageGeneration >= mAllDirtyGeneration)
+	);
+}
+
+
+
+
+
+QRectF NetTileRenderer::pointBounds(const Snapshot & aSnapshot, size_t aPointIdx) const
+{
+	return pointMarker(aSnapshot.mPositions[aPointIdx]).adjusted(-1, -1, 1, 1);
+}
+
+
+
+
+
+QRectF NetTileRenderer::springBounds(const Snapshot & aSnapshot, size_t aSpringIdx) const
+{
+	const auto & s = aSnapshot.mTopology->mSprings[aSpringIdx];
+	const auto & pt1 = aSnapshot.mPositions[s.pointIdx1()];
+	const auto & pt2 = aSnapshot.mPositions[s.pointIdx2()];
+	auto center = (pt1 + pt2) / 2;
+	QRectF label(center.x(), center.y() - mLabelAscent, mLabelSize.width(), mLabelSize.height());
+	return QRectF(pt1, pt2).normalized().adjusted(-2, -2, 2, 2).united(label);
+}
+
+
+
+
+
+QRectF NetTileRenderer::angleBounds(const Snapshot & aSnapshot, size_t aAngleIdx) const
+{
+	const auto & a = aSnapshot.mTopology->mAngles[aAngleIdx];
+	const auto & station = aSnapshot.mPositions[a.stationIdx()];
+	auto marker = Angle::markerPos(station, aSnapshot.mPositions[a.pointIdx1()], aSnapshot.mPositions[a.pointIdx2()]);
+	auto radius = QLineF(station, marker).length() + 1;
+	QRectF label(marker.x(), marker.y() - mLabelAscent, mLabelSize.width(), mLabelSize.height());
+	return QRectF(station.x() - radius, station.y() - radius, 2 * radius, 2 * radius).united(label);
+}
+
+
+
+
+
+void NetTileRenderer::ensureGrids(const Snapshot & aSnapshot) const
+{
+	std::call_once(aSnapshot.mGridsBuilt,
+		[this, &aSnapshot]()
+		{
+			TRACE_SCOPE("tileGrids");
+			const auto & topology = *aSnapshot.mTopology;
+			aSnapshot.mPointGrid.build(aSnapshot.mPositions.size(),
+				[this, &aSnapshot](size_t aIdx) { return pointBounds(aSnapshot, aIdx); }
+			);
+			aSnapshot.mSpringGrid.build(topology.mSprings.size(),
+				[this, &aSnapshot](size_t aIdx) { return springBounds(aSnapshot, aIdx); }
+			);
+			aSnapshot.mAngleGrid.build(topology.mAngles.size(),
+				[this, &aSnapshot](size_t aIdx) { return angleBounds(aSnapshot, aIdx); }
+			);
+		}
+	);
+}
+
+
+
+
+
+QImage NetTileRenderer::renderTile(const Snapshot & aSnapshot, const TileKey & aKey) const
+{
+	ensureGrids(aSnapshot);
+	TRACE_SCOPE("tileRender");
+
+	auto rect = tileRect(aKey);
+	auto scale = TILE_SIZE / rect.width();
+	auto margin = PEN_MARGIN_PIXELS / scale;
+	auto query = rect.adjusted(-margin, -margin, margin, margin);
+	auto shouldDrawLabels = (mLabelSize.height() * scale >= MIN_LABEL_PIXEL_HEIGHT);
+	const auto & topology = *aSnapshot.mTopology;
+	const auto & positions = aSnapshot.mPositions;
+	const auto & undetermined = topology.mHighlights.mUndeterminedPoints;
+	const auto & suspects = topology.mHighlights.mSuspectSprings;
+
+	QImage image(TILE_SIZE, TILE_SIZE, QImage::Format_ARGB32_Premultiplied);
+	image.fill(Qt::transparent);
+	QPainter painter(&image);
+	painter.setFont(mFont);
+	painter.scale(scale, scale);
+	painter.translate(-rect.topLeft());
+	QPen normalPen;
+	QPen highlightPen(QColor::fromRgb(0xff, 0, 0));
+
+	// The points first, the springs and angles are drawn over them (same as the stacking order of the scene items).
+	// The markers are batched by their look, indexed by [isUndetermined][isFixed]:
+	std::vector<QRectF> markers[2][2];
+	aSnapshot.mPointGrid.forEachCandidate(query,
+		[&](size_t aIdx)
+		{
+			if (pointBounds(aSnapshot, aIdx).intersects(query))
+			{
+				auto isUndetermined = (aIdx < undetermined.size()) && undetermined[aIdx];
+				markers[isUndetermined][topology.mIsFixed[aIdx]].push_back(pointMarker(positions[aIdx]));
+			}
+		}
+	);
+	for (int isUndetermined = 0; isUndetermined < 2; ++isUndetermined)
+	{
+		painter.setPen(isUndetermined ? highlightPen : normalPen);
+		painter.drawRects(markers[isUndetermined][0].data(), static_cast<int>(markers[isUndetermined][0].size()));
+		for (const auto & marker: markers[isUndetermined][1])
+		{
+			painter.drawEllipse(marker);
+		}
+	}
+
+	// Springs, batched by whether they're suspect; in the heat map the non-suspect ones are further batched by their color:
+	const auto & springColors = aSnapshot.mSpringColors;
+	std::vector<QLineF> lines[2];
+	std::vector<std::vector<QLineF>> colorLines(springColors.empty() ? 0 : StrainMap::NUM_COLORS);
+	std::vector<size_t> labelledSprings;
+	aSnapshot.mSpringGrid.forEachCandidate(query,
+		[&](size_t aIdx)
+		{
+			if (springBounds(aSnapshot, aIdx).intersects(query))
+			{
+				const auto & s = topology.mSprings[aIdx];
+				auto isSuspect = (aIdx < suspects.size()) && suspects[aIdx];
+				auto & batch = (isSuspect || springColors.empty()) ? lines[isSuspect] : colorLines[springColors[aIdx]];
+				batch.emplace_back(positions[s.pointIdx1()], positions[s.pointIdx2()]);
+				labelledSprings.push_back(aIdx);
+			}
+		}
+	);
+	painter.setPen(normalPen);
+	painter.drawLines(lines[0].data(), static_cast<int>(lines[0].size()));
+	if (!colorLines.empty())
+	{
+		const auto & palette = StrainMap::palette();
+		auto colorPen = normalPen;
+		for (size_t color = 0; color < colorLines.size(); ++color)
+		{
+			if (colorLines[color].empty())
+			{
+				continue;
+			}
+			colorPen.setColor(QColor::fromRgb(palette[color]));
+			painter.setPen(colorPen);
+			painter.drawLines(colorLines[color].data(), static_cast<int>(colorLines[color].size()));
+		}
+	}
+	auto suspectPen = highlightPen;
+	suspectPen.setWidth(normalPen.width() + 1);
+	painter.setPen(suspectPen);
+	painter.drawLines(lines[1].data(), static_cast<int>(lines[1].size()));
+	painter.setPen(normalPen);
+	if (shouldDrawLabels)
+	{
+		for (auto idx: labelledSprings)
+		{
+			const auto & s = topology.mSprings[idx];
+			QLineF line(positions[s.pointIdx1()], positions[s.pointIdx2()]);
+			painter.drawText(line.center(), QString("%1 / %2").arg(line.length()).arg(s.idealLength()));
+		}
+	}
+
+	// Angles:
+	aSnapshot.mAngleGrid.forEachCandidate(query,
+		[&](size_t aIdx)
+		{
+			if (!angleBounds(aSnapshot, aIdx).intersects(query))
+			{
+				return;
+			}
+			const auto & a = topology.mAngles[aIdx];
+			const auto & station = positions[a.stationIdx()];
+			const auto & pt1 = positions[a.pointIdx1()];
+			const auto & pt2 = positions[a.pointIdx2()];
+			auto currentAngle = Angle::currentAngle(station, pt1, pt2);
+			auto marker = Angle::markerPos(station, pt1, pt2);
+			painter.drawPath(angleArc(station, pt1, currentAngle, QLineF(station, marker).length()));
+			if (shouldDrawLabels)
+			{
+				painter.drawText(marker, QString("%1\u00b0 / %2\u00b0")
+					.arg(qRadiansToDegrees(currentAngle))
+					.arg(qRadiansToDegrees(a.idealAngle()))
+				);
+			}
+		}
+	);
+	return image;
+}
+
+
+
+
+
+void NetTileRenderer::renderQueuedTile()
+{
+	std::unique_lock lock(mMutex);
+	if (mQueue.empty())
+	{
+		return;
+	}
+	auto key = mQueue.front();
+	mQueue.pop_front();
+	auto itr = mTiles.find(key);
+	if (itr == mTiles.end())
+	{
+		return;
+	}
+	if ((itr->second.mLastUsedFrame < mFrame) || isTileCurrent(itr->second))
+	{
+		// Scrolled out of the view before its turn, or already rendered through a duplicate request:
+		itr->second.mIsQueued = false;
+		return;
+	}
+	auto snapshot = mSnapshot;
+	lock.unlock();
+
+	auto image = renderTile(*snapshot, key);
+
+	lock.lock();
+	itr = mTiles.find(key);
+	if (itr == mTiles.end())
+	{
+		return;
+	}
+	itr->second.mIsQueued = false;
+	if (snapshot->mGeneration > itr->second.mImageGeneration)
+	{
+		itr->second.mImage = std::move(image);
+		itr->second.mImageGeneration = snapshot->mGeneration;
+	}
+	if (!mHasPendingUpdate.exchange(true))
+	{
+		Q_EMIT updated();
+	}
+}
+
+
+
+
+
+QRectF NetTileRenderer::tileRect(const TileKey & aKey)
+{
+	auto size = tileSceneSize(aKey.mLevel);
+	return QRectF(static_cast<double>(aKey.mX) * size, static_cast<double>(aKey.mY) * size, size, size);
+}
+
+
+
+
+
+double NetTileRenderer::tileSceneSize(int aLevel)
+{
+	return std::ldexp(static_cast<double>(TILE_SIZE), -aLevel);
+}
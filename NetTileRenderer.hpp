@@ -0,0 +1,281 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include <QObject>
+#include <QImage>
+#include <QFont>
+#include <QPainterPath>
+
+#include "SpringNet.hpp"
+#include "TaskScheduler.hpp"
+
+
+
+
+
+// fwd:
+class QPainter;
+
+
+
+
+
+/** Draws a SpringNet through a cache of raster tiles, so that panning and zooming only blit images, regardless of
+the size of the net.
+The scene is divided into square tiles of TILE_SIZE pixels at discrete zoom levels, each level doubling the scale;
+the tiles are rendered by the tasks of the shared TaskScheduler, at the Interactive priority, from a snapshot of the net,
+taken by setNet(). A new snapshot only
+invalidates the tiles where something has moved, unless the topology, params or highlights have changed.
+Until an invalidated or missing tile is re-rendered, paint() draws its outdated image, or the covering part of a
+coarser level's tile, so the view never stalls waiting for the workers.
+The objects are drawn the same way as the QGraphicsItem-s in MainWindow draw them, apart from the selection. */
+class NetTileRenderer:
+	public QObject
+{
+	Q_OBJECT
+
+	using Super = QObject;
+
+
+public:
+
+	/** The extra highlighting of the net's objects. Either vector may be empty, meaning nothing is highlighted. */
+	struct Highlights
+	{
+		/** Points not rigidly connected to the fixed points (RigidityAnalysis), drawn in red. */
+		std::vector<bool> mUndeterminedPoints;
+
+		/** Springs suspected of a gross error (the robust solve), drawn thick red. */
+		std::vector<bool> mSuspectSprings;
+
+		bool operator == (const Highlights & aOther) const = default;
+	};
+
+
+	/** The size of a tile, in pixels. */
+	static constexpr int TILE_SIZE = 256;
+
+
+	/** Creates the renderer with no net. */
+	explicit NetTileRenderer(QObject * aParent = nullptr);
+
+	/** Cancels the queued tiles and waits for the ones being rendered. */
+	virtual ~NetTileRenderer() override;
+
+	/** Takes a snapshot of the net to be drawn from now on, and invalidates the tiles that it changes.
+	aSpringColors are the indices into StrainMap::palette() to draw each spring with, for the strain heat map;
+	empty to draw the springs plain.
+	To be called from the GUI thread whenever the net changes. */
+	void setNet(const SpringNet & aNet, Highlights aHighlights, std::vector<uint8_t> aSpringColors = {});
+
+	/** Takes a snapshot of the net's new positions, keeping the highlights and spring colors of the last setNet(), and
+	invalidates the tiles where something has moved. Much cheaper than setNet(), for following the net while it moves.
+	If the topology or params have changed since the last setNet(), the net is drawn without the highlights and colors
+	until the next setNet(). To be called from the GUI thread. */
+	void setPositions(const SpringNet & aNet);
+
+	/** Draws the tiles covering aSceneRect (in scene coords) through aPainter, which is set up with the view transform.
+	aPixelScale is the number of device pixels per scene unit, it selects the zoom level.
+	Queues the rendering of the missing and outdated tiles. To be called from the GUI thread. */
+	void paint(QPainter & aPainter, const QRectF & aSceneRect, double aPixelScale);
+
+	/** Returns true while any tile requested by paint() is waiting to be rendered, or being rendered.
+	Once it returns false, the next paint() of the same area draws the net complete and up to date. */
+	bool hasPendingTiles() const;
+
+	/** Returns the arc of an angle at aStation, starting in the direction of aPt1 and spanning aAngle radians
+	counter-clockwise, at aRadius from the station. */
+	static QPainterPath angleArc(QPointF aStation, QPointF aPt1, double aAngle, double aRadius);
+
+
+Q_SIGNALS:
+
+	/** Emitted when the drawing has changed: by setNet(), and whenever tiles have been rendered. The latter is emitted
+	from the worker threads, so it must be connected through a queued connection (the default across threads). */
+	void updated();
+
+
+protected:
+
+	/** The part of the snapshot that only changes with the topology, params or highlights; shared by snapshots. */
+	struct Topology
+	{
+		uint64_t mTopologyVersion;
+		uint64_t mParamsVersion;
+		std::vector<Spring> mSprings;
+		std::vector<Angle> mAngles;
+		std::vector<bool> mIsFixed;
+		Highlights mHighlights;
+	};
+
+
+	/** A uniform grid over the objects of one kind, each object registered in the cell of its bounds' center.
+	Queries expand the query rect by the largest half-extent of the objects, so that no object is missed. */
+	class Grid
+	{
+	public:
+
+		/** Builds the grid over aNumObjects objects, whose bounds are returned by aBoundsFn(objectIdx). */
+		template <typename BoundsFn>
+		void build(size_t aNumObjects, BoundsFn && aBoundsFn);
+
+		/** Calls aFn(objectIdx) for each object whose bounds' center lies in a cell that the query can reach.
+		The caller is expected to test the object's bounds against aRect. */
+		template <typename Fn>
+		void forEachCandidate(const QRectF & aRect, Fn && aFn) const;
+
+
+	protected:
+
+		QRectF mExtent;
+		double mCellSize = 1;
+		size_t mNumCellsX = 0;
+		size_t mNumCellsY = 0;
+
+		/** The objects in each cell: the indices in mObjects[mCellStarts[cell] .. mCellStarts[cell + 1]). */
+		std::vector<uint32_t> mCellStarts;
+		std::vector<uint32_t> mObjects;
+
+		double mMaxHalfWidth = 0;
+		double mMaxHalfHeight = 0;
+
+
+		size_t cellX(double aX) const;
+		size_t cellY(double aY) const;
+	};
+
+
+	/** The complete state of the net to be drawn. Immutable once published; the grids are built lazily, by the first
+	worker that renders from the snapshot. */
+	struct Snapshot
+	{
+		/** Increases with each snapshot; the tiles record which snapshot they have been rendered from. */
+		uint64_t mGeneration;
+
+		std::shared_ptr<const Topology> mTopology;
+		std::vector<QPointF> mPositions;
+
+		/** The color index of each spring in StrainMap::palette(), empty if the springs are drawn plain. */
+		std::vector<uint8_t> mSpringColors;
+
+		mutable std::once_flag mGridsBuilt;
+		mutable Grid mPointGrid;
+		mutable Grid mSpringGrid;
+		mutable Grid mAngleGrid;
+	};
+
+
+	/** Identifies a tile: the zoom level and the tile coords within the level. */
+	struct TileKey
+	{
+		int mLevel;
+		int64_t mX;
+		int64_t mY;
+
+		bool operator == (const TileKey & aOther) const = default;
+	};
+
+
+	struct TileKeyHash
+	{
+		size_t operator () (const TileKey & aKey) const;
+	};
+
+
+	struct Tile
+	{
+		/** The rendered image, null if not rendered yet. */
+		QImage mImage;
+
+		/** The generation of the snapshot mImage has been rendered from, 0 if none. */
+		uint64_t mImageGeneration = 0;
+
+		/** The generation of the snapshot that has last invalidated this tile. */
+		uint64_t mDirtyGeneration = 0;
+
+		/** The paint() frame in which the tile has last been drawn; used for dropping the least recently used ones. */
+		uint64_t mLastUsedFrame = 0;
+
+		/** Set while the tile waits in mQueue or is being rendered. */
+		bool mIsQueued = false;
+	};
+
+
+	/** The font of the labels, and its metrics measured in the GUI thread. */
+	QFont mFont;
+	QSizeF mLabelSize;
+	double mLabelAscent;
+
+	/** The current snapshot; replaced only by the GUI thread, read by the workers under mMutex. */
+	std::shared_ptr<const Snapshot> mSnapshot;
+
+	/** The generation assigned to the last snapshot. */
+	uint64_t mGeneration = 0;
+
+	/** Protects mSnapshot (for the workers), mTiles, mQueue, mFrame and mAllDirtyGeneration. */
+	mutable std::mutex mMutex;
+
+	std::unordered_map<TileKey, Tile, TileKeyHash> mTiles;
+
+	/** The tiles waiting to be rendered, the most recently requested first. Each has a task queued in mRenderTasks,
+	the tasks take the tiles from the front, regardless of which tile queued them. */
+	std::deque<TileKey> mQueue;
+
+	/** The number of paint() calls so far. */
+	uint64_t mFrame = 0;
+
+	/** The generation of the snapshot that has last invalidated all the tiles. */
+	uint64_t mAllDirtyGeneration = 0;
+
+	/** Set when updated() has been emitted by a worker and no paint() has happened since; limits the signals to one
+	per frame. */
+	std::atomic<bool> mHasPendingUpdate = false;
+
+	/** The tile rendering tasks; declared last, so that it waits for the tasks before the members they use are gone. */
+	TaskScheduler::TaskGroup mRenderTasks{TaskScheduler::Priority::Interactive};
+
+
+	/** Makes the snapshot the current one, invalidating the specified areas of the tiles, all of them if nullopt. */
+	void publish(std::shared_ptr<const Snapshot> aSnapshot, const std::optional<std::vector<QRectF>> & aChanged);
+
+	/** Returns the areas of aNew that have changed since aOld, in scene coords; nullopt if nearly everything has. */
+	std::optional<std::vector<QRectF>> changedAreas(const Snapshot & aOld, const Snapshot & aNew) const;
+
+	/** Invalidates the cached tiles intersecting aSceneRect (including the few pixels drawn outside of the objects'
+	bounds). Expects mMutex to be locked. */
+	void invalidate(const QRectF & aSceneRect, uint64_t aGeneration);
+
+	/** Drops the least recently drawn tiles not used in the current frame, down to MAX_CACHED_TILES.
+	Expects mMutex to be locked. */
+	void dropOldTiles();
+
+	/** Returns true if the tile has been rendered from a snapshot newer than its invalidation.
+	Expects mMutex to be locked. */
+	bool isTileCurrent(const Tile & aTile) const;
+
+	/** The bounds of the objects as drawn, including their labels, in scene coords. */
+	QRectF pointBounds(const Snapshot & aSnapshot, size_t aPointIdx) const;
+	QRectF springBounds(const Snapshot & aSnapshot, size_t aSpringIdx) const;
+	QRectF angleBounds(const Snapshot & aSnapshot, size_t aAngleIdx) const;
+
+	/** Builds the grids of the snapshot, if not built yet. Thread-safe. */
+	void ensureGrids(const Snapshot & aSnapshot) const;
+
+	/** Renders the specified tile from the snapshot. Called from the worker threads. */
+	QImage renderTile(const Snapshot & aSnapshot, const TileKey & aKey) const;
+
+	/** A single rendering task: renders the tile at the front of mQueue, if it is still needed. */
+	void renderQueuedTile();
+
+	/** Returns the scene rect covered by the specified tile. */
+	static QRectF tileRect(const TileKey & aKey);
+
+	/** Returns the size of a tile at the specified zoom level, in scene units. */
+	static double tileSceneSize(int aLevel);
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <exception>
+#include <vector>
+
+#include "TaskScheduler.hpp"
+
+
+
+
+
+namespace Parallel
+{
+
+
+
+
+
+/** Returns the number of tasks worth running in parallel: the number of the shared scheduler's workers. */
+inline size_t numThreads()
+{
+	return TaskScheduler::instance().numThreads();
+}
+
+
+
+
+
+/** Calls aFn(taskIdx) for each of the aNumTasks tasks, on the shared TaskScheduler at the specified priority;
+task 0 runs on the calling thread, which then helps with the rest.
+Returns once all the tasks have finished. If any task throws, rethrows the exception of the first such task. */
+template <typename Fn>
+void runTasks(size_t aNumTasks, Fn && aFn, TaskScheduler::Priority aPriority = TaskScheduler::Priority::Interactive)
+{
+	std::vector<std::exception_ptr> errors(aNumTasks);
+	auto runTask = [&](size_t aTaskIdx)
+	{
+		try
+		{
+			aFn(aTaskIdx);
+		}
+		catch (...)
+		{
+			errors[aTaskIdx] = std::current_exception();
+		}
+	};
+	TaskScheduler::TaskGroup group(aPriority);
+	for (size_t i = 1; i < aNumTasks; ++i)
+	{
+		group.run([&runTask, i]() { runTask(i); });
+	}
+	if (aNumTasks > 0)
+	{
+		runTask(0);
+	}
+	group.wait();
+	for (const auto & err: errors)
+	{
+		if (err != nullptr)
+		{
+			std::rethrow_exception(err);
+		}
+	}
+}
+
+
+
+
+
+}  // namespace Parallel
@@ -0,0 +1,60 @@
+#include "PositionBuffer.hpp"
+
+
+
+
+
+namespace {
+
+/** Marks mMiddle as holding published positions that the reader hasn't taken yet. */
+static const unsigned FRESH_FLAG = 4;
+
+/** The bits of mMiddle holding the buffer index. */
+static const unsigned INDEX_MASK = 3;
+
+}  // anonymous namespace
+
+
+
+
+
+PositionBuffer::PositionBuffer():
+	mEpochs{0, 0, 0},
+	mMiddle(1),
+	mBackIdx(0),
+	mFrontIdx(2),
+	mPublishedEpoch(0)
+{
+}
+
+
+
+
+
+void PositionBuffer::publish()
+{
+	auto epoch = mPublishedEpoch.load(std::memory_order_relaxed) + 1;
+	mEpochs[mBackIdx] = epoch;
+
+	// Release the filled buffer to the reader, acquire the buffer that the reader has last released:
+	auto prevMiddle = mMiddle.exchange(mBackIdx | FRESH_FLAG, std::memory_order_acq_rel);
+	mBackIdx = prevMiddle & INDEX_MASK;
+	mPublishedEpoch.store(epoch, std::memory_order_release);
+}
+
+
+
+
+
+bool PositionBuffer::update()
+{
+	if ((mMiddle.load(std::memory_order_relaxed) & FRESH_FLAG) == 0)
+	{
+		return false;
+	}
+
+	// Only the reader clears the flag, so it is still set; swap in the fresh buffer, giving up the front one:
+	auto prevMiddle = mMiddle.exchange(mFrontIdx, std::memory_order_acq_rel);
+	mFrontIdx = prevMiddle & INDEX_MASK;
+	return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <QPointF>
+
+
+
+
+
+/** Hands the point positions over from a single writer thread (the solver) to a single reader thread (the UI),
+without either of them ever waiting for the other: a lock-free triple buffer.
+The writer fills its back buffer and publishes it; the reader takes the most recently published buffer as its front
+buffer. The third buffer is the one in between, swapped atomically by both sides, together with a flag telling
+whether it holds positions not yet taken by the reader. Each buffer is only ever accessed by one side at a time and
+each published buffer is complete, so the reader never sees torn coords, nor a mix of two iterations.
+Each published buffer is tagged by an epoch, which increases with each publish(). */
+class PositionBuffer
+{
+public:
+
+	PositionBuffer();
+
+	/** Writer: returns the back buffer, to be filled with the positions before publish(). */
+	std::vector<QPointF> & back() { return mBuffers[mBackIdx]; }
+
+	/** Writer: publishes the back buffer and takes over a buffer that the reader doesn't use. */
+	void publish();
+
+	/** Reader: if positions have been published since the last call, makes the newest of them the front buffer and
+	returns true. Returns false if there's nothing new, the front buffer is left as it is. */
+	bool update();
+
+	/** Reader: returns the front buffer. Empty until the first update() that returns true. */
+	const std::vector<QPointF> & front() const { return mBuffers[mFrontIdx]; }
+
+	/** Reader: returns the epoch of the front buffer, 0 if nothing has been taken yet. */
+	uint64_t frontEpoch() const { return mEpochs[mFrontIdx]; }
+
+	/** Returns the epoch of the last published buffer, 0 if none yet. Can be called from any thread. */
+	uint64_t publishedEpoch() const { return mPublishedEpoch.load(std::memory_order_acquire); }
+
+
+protected:
+
+	std::array<std::vector<QPointF>, 3> mBuffers;
+
+	/** The epoch of the positions in each buffer. Written only by the side that owns the buffer. */
+	std::array<uint64_t, 3> mEpochs;
+
+	/** The index of the middle buffer (the lowest bits) and the FRESH_FLAG if it has been published but not taken
+	by the reader yet. */
+	std::atomic<unsigned> mMiddle;
+
+	/** The index of the buffer owned by the writer. Only accessed by the writer. */
+	unsigned mBackIdx;
+
+	/** The index of the buffer owned by the reader. Only accessed by the reader. */
+	unsigned mFrontIdx;
+
+	/** The epoch of the last published buffer. */
+	std::atomic<uint64_t> mPublishedEpoch;
+};
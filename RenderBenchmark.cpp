@@ -0,0 +1,613 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <numbers>
+#include <random>
+#include <thread>
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QGraphicsScene>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLineF>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QWheelEvent>
+
+#include "CadGraphicsView.hpp"
+#include "LatencyStats.hpp"
+#include "MainWindow.hpp"
+#include "NetTileRenderer.hpp"
+#include "SpringNet.hpp"
+
+
+
+
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/** The nets rendered by default, by their number of points. */
+static const char * DEFAULT_NET_SIZES = "1000,10000,100000,1000000";
+
+/** The viewports rendered into by default. */
+static const char * DEFAULT_VIEWPORT_SIZES = "800x600,1920x1080,3840x2160";
+
+/** The zoom levels rendered at, relative to the whole net fitting into the viewport. */
+static const double ZOOM_LEVELS[] = {1, 8, 64};
+
+/** The default number of frames measured for each operation. */
+static const int DEFAULT_NUM_FRAMES = 100;
+
+/** The longest time spent measuring a single operation; fewer frames are measured if they are this slow. */
+static const std::chrono::seconds MAX_MEASUREMENT_TIME(10);
+
+/** The longest time to wait for the tiles to be rendered before giving up on the frame. */
+static const std::chrono::seconds MAX_SETTLE_TIME(30);
+
+/** The distance of the points in the generated nets, and the max random offset of each point from its grid node. */
+static const double GRID_SPACING = 10;
+static const double GRID_JITTER = 2;
+
+/** Every how manyth point of the generated nets is the station of an angle. */
+static const size_t ANGLE_STATION_STEP = 16;
+
+/** The scene with an item per object is only measured for nets up to this many objects, larger ones take too long. */
+static const size_t MAX_ITEM_SCENE_OBJECTS = 300000;
+
+/** How far the view is panned per frame, and the direction of the pan is reversed after this many frames. */
+static const int PAN_STEP_PIXELS = 20;
+static const int PAN_STEPS_PER_DIRECTION = 10;
+
+
+
+
+
+/** Generates a net of about aNumPoints points: a jittered square grid with the horizontal, vertical and diagonal
+springs at their ideal lengths, an angle at every ANGLE_STATION_STEP-th point and the corner points fixed. */
+SpringNet generateNet(size_t aNumPoints)
+{
+	auto side = std::max<size_t>(static_cast<size_t>(std::sqrt(static_cast<double>(aNumPoints))), 2);
+	std::mt19937_64 rng(side);
+	std::uniform_real_distribution<double> jitter(-GRID_JITTER, GRID_JITTER);
+	SpringNet::Bulk bulk;
+	bulk.mPoints.reserve(side * side);
+	bulk.mIsFixed.reserve(side * side);
+	for (size_t y = 0; y < side; ++y)
+	{
+		for (size_t x = 0; x < side; ++x)
+		{
+			bulk.mPoints.emplace_back(x * GRID_SPACING + jitter(rng), y * GRID_SPACING + jitter(rng));
+			bulk.mIsFixed.push_back(((x == 0) || (x + 1 == side)) && ((y == 0) || (y + 1 == side)));
+		}
+	}
+	auto addSpring = [&bulk](size_t aPointIdx1, size_t aPointIdx2)
+	{
+		auto length = QLineF(bulk.mPoints[aPointIdx1], bulk.mPoints[aPointIdx2]).length();
+		bulk.mSprings.emplace_back(length, 1, aPointIdx1, aPointIdx2);
+	};
+
+	// The horizontal and vertical springs of each point come right after each other, so that they make the angles:
+	std::vector<size_t> angleSprings;
+	for (size_t y = 0; y < side; ++y)
+	{
+		for (size_t x = 0; x < side; ++x)
+		{
+			auto idx = y * side + x;
+			if ((x + 1 < side) && (y + 1 < side))
+			{
+				if (idx % ANGLE_STATION_STEP == 0)
+				{
+					angleSprings.push_back(bulk.mSprings.size());
+				}
+				addSpring(idx, idx + 1);
+				addSpring(idx, idx + side);
+				addSpring(idx, idx + side + 1);
+			}
+		}
+	}
+
+	SpringNet res;
+	res.addBulk(bulk);
+	res.reserveAngles(angleSprings.size());
+	for (auto springIdx: angleSprings)
+	{
+		res.addAngle(std::numbers::pi / 2, 1, springIdx, springIdx + 1);
+	}
+	return res;
+}
+
+
+
+
+
+/** Parses a comma-separated list of numbers. Returns an empty list on error. */
+std::vector<size_t> parseSizes(const QString & aText)
+{
+	std::vector<size_t> res;
+	for (const auto & part: aText.split(',', Qt::SkipEmptyParts))
+	{
+		bool isOK = false;
+		auto value = part.trimmed().toULongLong(&isOK);
+		if (!isOK || (value == 0))
+		{
+			return {};
+		}
+		res.push_back(value);
+	}
+	return res;
+}
+
+
+
+
+
+/** Parses a comma-separated list of WxH viewport sizes. Returns an empty list on error. */
+std::vector<QSize> parseViewports(const QString & aText)
+{
+	std::vector<QSize> res;
+	for (const auto & part: aText.split(',', Qt::SkipEmptyParts))
+	{
+		auto dims = part.trimmed().split('x');
+		bool isOK1 = false, isOK2 = false;
+		auto width = (dims.size() == 2) ? dims[0].toInt(&isOK1) : 0;
+		auto height = (dims.size() == 2) ? dims[1].toInt(&isOK2) : 0;
+		if (!isOK1 || !isOK2 || (width <= 0) || (height <= 0))
+		{
+			return {};
+		}
+		res.emplace_back(width, height);
+	}
+	return res;
+}
+
+
+
+
+
+/** Renders the net of a single size into a single viewport, the same way MainWindow shows it, and measures the
+frame times of the various operations. */
+class Benchmark
+{
+public:
+
+	Benchmark(const SpringNet & aNet, QSize aViewportSize, int aNumFrames):
+		mNet(aNet),
+		mView(nullptr),
+		mImage(aViewportSize, QImage::Format_ARGB32_Premultiplied),
+		mNumFrames(aNumFrames),
+		mRng(aNet.numPoints())
+	{
+		mScene.setItemIndexMethod(QGraphicsScene::NoIndex);
+		mView.setScene(&mScene);
+		mView.setNetRenderer(&mRenderer);
+		mView.resize(aViewportSize);
+		mView.show();
+		QApplication::processEvents();
+		mRenderer.setNet(mNet, {});
+	}
+
+
+	~Benchmark()
+	{
+		clearSelection();
+		mView.setNetRenderer(nullptr);
+	}
+
+
+	/** Runs all the measurements at the specified zoom level (relative to the whole net). */
+	QJsonObject run(double aZoom)
+	{
+		QJsonObject res;
+		res["viewport"] = QJsonArray{mImage.width(), mImage.height()};
+		res["zoom"] = aZoom;
+		res["setNet"] = measureSetNet().toJson();
+		zoomTo(aZoom);
+		res["fullRepaintCold"] = measureColdRepaint().toJson();
+		res["fullRepaintWarm"] = measureWarmRepaint().toJson();
+		auto [panFrames, panSettle] = measurePan();
+		res["panFrame"] = panFrames.toJson();
+		res["panSettle"] = panSettle.toJson();
+		zoomTo(aZoom);
+		auto [zoomFrames, zoomSettle] = measureWheelZoom();
+		res["wheelZoomFrame"] = zoomFrames.toJson();
+		res["wheelZoomSettle"] = zoomSettle.toJson();
+		zoomTo(aZoom);
+		res["selection"] = measureSelection().toJson();
+		auto numObjects = mNet.numPoints() + mNet.numSprings() + mNet.numAngles();
+		if (numObjects <= MAX_ITEM_SCENE_OBJECTS)
+		{
+			res["itemSceneRepaint"] = measureItemScene().toJson();
+		}
+		return res;
+	}
+
+
+protected:
+
+	SpringNet mNet;
+	QGraphicsScene mScene;
+	NetTileRenderer mRenderer;
+	CadGraphicsView mView;
+
+	/** The image that the frames are rendered into, the size of the viewport. */
+	QImage mImage;
+
+	int mNumFrames;
+
+	std::mt19937_64 mRng;
+
+	/** The items added by selectRandomObject(), owned by mScene. */
+	std::vector<QGraphicsItem *> mSelectionItems;
+
+
+	/** Renders a single frame of the viewport into mImage, the same way it's painted on screen. */
+	Clock::duration renderFrame()
+	{
+		auto start = Clock::now();
+		{
+			QPainter painter(&mImage);
+			mView.viewport()->render(&painter);
+		}
+		return Clock::now() - start;
+	}
+
+
+	/** Renders frames until the renderer has no more tiles to render, so that the last frame shows the complete net.
+	Returns the time until then. */
+	Clock::duration settle()
+	{
+		auto start = Clock::now();
+		while (true)
+		{
+			renderFrame();
+			QApplication::processEvents();
+			if (!mRenderer.hasPendingTiles())
+			{
+				renderFrame();
+				return Clock::now() - start;
+			}
+			if (Clock::now() - start > MAX_SETTLE_TIME)
+			{
+				std::cerr << "Timed out waiting for the tiles to render." << std::endl;
+				return Clock::now() - start;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+
+	/** Returns true if the measurement should go on after aNumDone frames started at aStart. */
+	bool shouldContinue(int aNumDone, Clock::time_point aStart) const
+	{
+		return (aNumDone < mNumFrames) && ((aNumDone == 0) || (Clock::now() - aStart < MAX_MEASUREMENT_TIME));
+	}
+
+
+	/** Zooms the view so that the whole net fits in, then zooms in by aZoom around the net's center. */
+	void zoomTo(double aZoom)
+	{
+		const auto & points = mNet.points();
+		auto minX = points[0].x(), maxX = minX;
+		auto minY = points[0].y(), maxY = minY;
+		for (const auto & pt: points)
+		{
+			minX = std::min(minX, pt.x());
+			maxX = std::max(maxX, pt.x());
+			minY = std::min(minY, pt.y());
+			maxY = std::max(maxY, pt.y());
+		}
+		QRectF all(QPointF(minX, minY), QPointF(maxX, maxY));
+		auto center = all.center();
+		QRectF zoomed(0, 0, all.width() / aZoom, all.height() / aZoom);
+		zoomed.moveCenter(center);
+		mView.zoomTo(zoomed);
+		mView.centerOn(center);
+		settle();
+	}
+
+
+	/** Measures taking the snapshot of the net after the points have moved, the net-size dependent part of
+	MainWindow::updateScene(). */
+	LatencyStats measureSetNet()
+	{
+		LatencyStats res;
+		auto positions = mNet.positions();
+		std::uniform_real_distribution<double> offset(-GRID_JITTER, GRID_JITTER);
+		auto start = Clock::now();
+		for (int i = 0; shouldContinue(i, start); ++i)
+		{
+			// Move a few points, as the solver or dragging does:
+			for (int j = 0; j < 10; ++j)
+			{
+				auto idx = mRng() % positions.size();
+				positions[idx] += QPointF(offset(mRng), offset(mRng));
+			}
+			mNet.setPositions(positions);
+			auto frameStart = Clock::now();
+			mRenderer.setNet(mNet, {});
+			res.add(Clock::now() - frameStart);
+		}
+		settle();
+		return res;
+	}
+
+
+	/** Measures the time to render the whole viewport from scratch, after the net's topology changes. */
+	LatencyStats measureColdRepaint()
+	{
+		LatencyStats res;
+		auto start = Clock::now();
+		for (int i = 0; shouldContinue(i, start); ++i)
+		{
+			// Alternating the highlights invalidates all the tiles, same as a topology change:
+			NetTileRenderer::Highlights highlights;
+			if (i % 2 == 0)
+			{
+				highlights.mUndeterminedPoints.assign(mNet.numPoints(), false);
+			}
+			auto frameStart = Clock::now();
+			mRenderer.setNet(mNet, std::move(highlights));
+			settle();
+			res.add(Clock::now() - frameStart);
+		}
+		return res;
+	}
+
+
+	/** Measures repainting the viewport with all the tiles rendered already. */
+	LatencyStats measureWarmRepaint()
+	{
+		LatencyStats res;
+		settle();
+		auto start = Clock::now();
+		for (int i = 0; shouldContinue(i, start); ++i)
+		{
+			res.add(renderFrame());
+		}
+		return res;
+	}
+
+
+	/** Measures panning the view by the middle mouse button: the frame right after each pan step, and the time until
+	the newly uncovered tiles are rendered. */
+	std::pair<LatencyStats, LatencyStats> measurePan()
+	{
+		LatencyStats frames, settles;
+		auto viewport = mView.viewport();
+		QPointF pos(viewport->width() / 2, viewport->height() / 2);
+		QMouseEvent press(QEvent::MouseButtonPress, pos, viewport->mapToGlobal(pos), Qt::MiddleButton, Qt::MiddleButton, Qt::NoModifier);
+		QApplication::sendEvent(viewport, &press);
+		auto start = Clock::now();
+		for (int i = 0; shouldContinue(i, start); ++i)
+		{
+			auto direction = ((i / PAN_STEPS_PER_DIRECTION) % 2 == 0) ? 1 : -1;
+			pos += QPointF(direction * PAN_STEP_PIXELS, direction * PAN_STEP_PIXELS / 2);
+			auto frameStart = Clock::now();
+			QMouseEvent move(QEvent::MouseMove, pos, viewport->mapToGlobal(pos), Qt::NoButton, Qt::MiddleButton, Qt::NoModifier);
+			QApplication::sendEvent(viewport, &move);
+			renderFrame();
+			frames.add(Clock::now() - frameStart);
+			settles.add(settle());
+		}
+		QMouseEvent release(QEvent::MouseButtonRelease, pos, viewport->mapToGlobal(pos), Qt::MiddleButton, Qt::NoButton, Qt::NoModifier);
+		QApplication::sendEvent(viewport, &release);
+		return {frames, settles};
+	}
+
+
+	/** Measures zooming the view by the mouse wheel, alternately in and out: the frame right after each wheel step,
+	and the time until the tiles of the new zoom level are rendered. */
+	std::pair<LatencyStats, LatencyStats> measureWheelZoom()
+	{
+		LatencyStats frames, settles;
+		auto viewport = mView.viewport();
+		QPointF pos(viewport->width() / 2, viewport->height() / 2);
+		auto start = Clock::now();
+		for (int i = 0; shouldContinue(i, start); ++i)
+		{
+			auto delta = (i % 2 == 0) ? 120 : -120;
+			auto frameStart = Clock::now();
+			QWheelEvent wheel(
+				pos, viewport->mapToGlobal(pos), QPoint(), QPoint(0, delta),
+				Qt::NoButton, Qt::NoModifier, Qt::NoScrollPhase, false
+			);
+			QApplication::sendEvent(viewport, &wheel);
+			renderFrame();
+			frames.add(Clock::now() - frameStart);
+			settles.add(settle());
+		}
+		return {frames, settles};
+	}
+
+
+	/** Removes the items added by selectRandomObject(). */
+	void clearSelection()
+	{
+		for (auto item: mSelectionItems)
+		{
+			mScene.removeItem(item);
+			delete item;
+		}
+		mSelectionItems.clear();
+	}
+
+
+	/** Selects a random object the same way MainWindow highlights the object under the mouse: by a selected item over
+	the net. */
+	void selectRandomObject()
+	{
+		clearSelection();
+		QGraphicsItem * item = nullptr;
+		switch (mRng() % 3)
+		{
+			case 0:
+			{
+				auto idx = mRng() % mNet.numPoints();
+				item = new GraphicsPointItem(mNet.point(idx), mNet.isPointFixed(idx));
+				break;
+			}
+			case 1:
+			{
+				const auto & s = mNet.spring(mRng() % mNet.numSprings());
+				const auto & pt1 = s.point1(mNet);
+				const auto & pt2 = s.point2(mNet);
+				item = new GraphicsSpringItem(pt1.x(), pt1.y(), pt2.x(), pt2.y(), s.idealLength());
+				break;
+			}
+			default:
+			{
+				if (mNet.numAngles() == 0)
+				{
+					return;
+				}
+				item = new GraphicsAngleItem(mNet, mNet.angle(mRng() % mNet.numAngles()));
+				break;
+			}
+		}
+		item->setFlag(QGraphicsItem::ItemIsSelectable);
+		mScene.addItem(item);
+		item->setSelected(true);
+		mSelectionItems.push_back(item);
+	}
+
+
+	/** Measures changing the selection: replacing the selected item and repainting. */
+	LatencyStats measureSelection()
+	{
+		LatencyStats res;
+		auto start = Clock::now();
+		for (int i = 0; shouldContinue(i, start); ++i)
+		{
+			auto frameStart = Clock::now();
+			selectRandomObject();
+			renderFrame();
+			res.add(Clock::now() - frameStart);
+		}
+		clearSelection();
+		return res;
+	}
+
+
+	/** Measures repainting a scene with a QGraphicsItem for each object (GraphicsPointItem, GraphicsSpringItem,
+	GraphicsAngleItem), without the tile renderer; this is the cost of drawing the items over the net. */
+	LatencyStats measureItemScene()
+	{
+		QGraphicsScene scene;
+		scene.setItemIndexMethod(QGraphicsScene::NoIndex);
+		for (size_t idx = 0, numPoints = mNet.numPoints(); idx < numPoints; ++idx)
+		{
+			scene.addItem(new GraphicsPointItem(mNet.point(idx), mNet.isPointFixed(idx)));
+		}
+		for (const auto & s: mNet.springs())
+		{
+			const auto & pt1 = s.point1(mNet);
+			const auto & pt2 = s.point2(mNet);
+			scene.addItem(new GraphicsSpringItem(pt1.x(), pt1.y(), pt2.x(), pt2.y(), s.idealLength()));
+		}
+		for (const auto & a: mNet.angles())
+		{
+			scene.addItem(new GraphicsAngleItem(mNet, a));
+		}
+		mView.setNetRenderer(nullptr);
+		mView.setScene(&scene);
+
+		LatencyStats res;
+		auto start = Clock::now();
+		for (int i = 0; shouldContinue(i, start); ++i)
+		{
+			res.add(renderFrame());
+		}
+
+		mView.setScene(&mScene);
+		mView.setNetRenderer(&mRenderer);
+		return res;
+	}
+};
+
+}  // anonymous namespace
+
+
+
+
+
+/** The SpringAnglesRenderBenchmark executable: renders generated nets through the same graphics pipeline as the app
+(CadGraphicsView with NetTileRenderer, and the QGraphicsItem-s drawn over the net), on the offscreen platform,
+and writes the statistics of the frame times as JSON, so that rendering regressions can be caught without a display. */
+int main(int argc, char * argv[])
+{
+	// Render without a display, unless the user asks for a specific platform:
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+	{
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	}
+	QApplication app(argc, argv);
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription(
+		"Measures the rendering of generated nets through the SpringAngles graphics pipeline, "
+		"and writes the frame time statistics as JSON."
+	);
+	parser.addHelpOption();
+	QCommandLineOption pointsOption("points", "The comma-separated sizes of the nets to render, in points.", "list", DEFAULT_NET_SIZES);
+	QCommandLineOption viewportsOption("viewports", "The comma-separated viewport sizes to render into, as WxH.", "list", DEFAULT_VIEWPORT_SIZES);
+	QCommandLineOption framesOption("frames", "The number of frames to measure for each operation.", "count", QString::number(DEFAULT_NUM_FRAMES));
+	QCommandLineOption outputOption("output", "Write the JSON into this file instead of the standard output.", "file");
+	parser.addOptions({pointsOption, viewportsOption, framesOption, outputOption});
+	parser.process(app);
+
+	auto netSizes = parseSizes(parser.value(pointsOption));
+	auto viewports = parseViewports(parser.value(viewportsOption));
+	auto numFrames = parser.value(framesOption).toInt();
+	if (netSizes.empty() || viewports.empty() || (numFrames <= 0))
+	{
+		std::cerr << "Invalid commandline, see --help." << std::endl;
+		return 1;
+	}
+
+	QJsonArray results;
+	for (auto netSize: netSizes)
+	{
+		auto net = generateNet(netSize);
+		for (const auto & viewport: viewports)
+		{
+			Benchmark benchmark(net, viewport, numFrames);
+			for (auto zoom: ZOOM_LEVELS)
+			{
+				std::cerr << net.numPoints() << " points, " << viewport.width() << "x" << viewport.height()
+					<< ", zoom " << zoom << "..." << std::endl;
+				auto res = benchmark.run(zoom);
+				res["numPoints"] = static_cast<qint64>(net.numPoints());
+				res["numSprings"] = static_cast<qint64>(net.numSprings());
+				res["numAngles"] = static_cast<qint64>(net.numAngles());
+				results.append(res);
+			}
+		}
+	}
+
+	QJsonObject root;
+	root["qtVersion"] = QString::fromUtf8(qVersion());
+	root["platform"] = QApplication::platformName();
+	root["numCores"] = static_cast<int>(std::thread::hardware_concurrency());
+	root["results"] = results;
+	auto json = QJsonDocument(root).toJson();
+	if (parser.isSet(outputOption))
+	{
+		QFile f(parser.value(outputOption));
+		if (!f.open(QIODevice::WriteOnly) || (f.write(json) != json.size()))
+		{
+			std::cerr << "Cannot write the output file." << std::endl;
+			return 1;
+		}
+	}
+	else
+	{
+		std::cout << json.toStdString();
+	}
+	return 0;
+}
@@ -0,0 +1,370 @@
+#include "RigidityAnalysis.hpp"
+
+#include <array>
+#include <cstdint>
+
+#include "SpringNet.hpp"
+
+
+
+
+
+namespace {
+
+
+
+
+
+/** The (2, 3) pebble game on a graph with a fixed number of vertices.
+Each vertex has two pebbles; an accepted (independent) edge is covered by a pebble from one of its endpoints and
+is directed out of that endpoint. Hence each vertex has at most two out-edges and the game state is O(n).
+An edge is independent iff four pebbles can be gathered on its endpoints. */
+class PebbleGame
+{
+	/** The number of free pebbles on each vertex. */
+	std::vector<uint8_t> mNumPebbles;
+
+	/** The number of out-edges of each vertex (always 2 - mNumPebbles). */
+	std::vector<uint8_t> mNumOut;
+
+	/** The heads of the out-edges of each vertex. */
+	std::vector<std::array<size_t, 2>> mOut;
+
+	/** Per-vertex search marks; a vertex is visited in the current search if its mark equals mCurrentMark. */
+	std::vector<uint32_t> mMarks;
+	uint32_t mCurrentMark = 0;
+
+	/** The vertex from which each visited vertex has been reached, for reversing the path. */
+	std::vector<size_t> mParents;
+
+	/** The DFS stack, kept here to avoid reallocating in each search. */
+	std::vector<size_t> mStack;
+
+
+public:
+
+	explicit PebbleGame(size_t aNumVertices):
+		mNumPebbles(aNumVertices, 2),
+		mNumOut(aNumVertices, 0),
+		mOut(aNumVertices),
+		mMarks(aNumVertices, 0),
+		mParents(aNumVertices, 0)
+	{
+	}
+
+
+	/** Inserts the edge, if it is independent. Returns true if inserted, false if redundant. */
+	bool insertEdge(size_t aV1, size_t aV2)
+	{
+		if (!gatherFourPebbles(aV1, aV2))
+		{
+			return false;
+		}
+		mNumPebbles[aV1] -= 1;
+		mOut[aV1][mNumOut[aV1]] = aV2;
+		mNumOut[aV1] += 1;
+		return true;
+	}
+
+
+	/** Returns the marks of the vertices that are in the same rigid component as the two vertices.
+	Three pebbles are gathered on the pair (four, if they aren't rigid together, and then the component is only the
+	pair itself); a vertex is then rigid with the pair iff it can't reach a free pebble without passing through the pair.
+	The vertices that can reach one are found in a single backward search from all the free pebbles, so the whole
+	component is labelled in linear time. */
+	std::vector<bool> rigidComponent(size_t aV1, size_t aV2)
+	{
+		auto numV = mNumPebbles.size();
+		std::vector<bool> isInComponent(numV, false);
+		isInComponent[aV1] = true;
+		isInComponent[aV2] = true;
+		if (gatherFourPebbles(aV1, aV2))
+		{
+			return isInComponent;
+		}
+
+		// Build the in-edges of each vertex (CSR), for searching backwards:
+		std::vector<size_t> inStart(numV + 1, 0);
+		for (size_t v = 0; v < numV; ++v)
+		{
+			for (uint8_t i = 0; i < mNumOut[v]; ++i)
+			{
+				inStart[mOut[v][i] + 1] += 1;
+			}
+		}
+		for (size_t v = 0; v < numV; ++v)
+		{
+			inStart[v + 1] += inStart[v];
+		}
+		std::vector<size_t> inTails(inStart[numV]);
+		auto inFill = inStart;
+		for (size_t v = 0; v < numV; ++v)
+		{
+			for (uint8_t i = 0; i < mNumOut[v]; ++i)
+			{
+				inTails[inFill[mOut[v][i]]++] = v;
+			}
+		}
+
+		// Mark everything that can reach a free pebble outside the pair:
+		nextMark();
+		mMarks[aV1] = mCurrentMark;
+		mMarks[aV2] = mCurrentMark;
+		mStack.clear();
+		for (size_t v = 0; v < numV; ++v)
+		{
+			if ((mNumPebbles[v] > 0) && (mMarks[v] != mCurrentMark))
+			{
+				mMarks[v] = mCurrentMark;
+				mStack.push_back(v);
+			}
+		}
+		while (!mStack.empty())
+		{
+			auto v = mStack.back();
+			mStack.pop_back();
+			for (auto i = inStart[v]; i < inStart[v + 1]; ++i)
+			{
+				auto w = inTails[i];
+				if (mMarks[w] != mCurrentMark)
+				{
+					mMarks[w] = mCurrentMark;
+					mStack.push_back(w);
+				}
+			}
+		}
+		for (size_t v = 0; v < numV; ++v)
+		{
+			if (mMarks[v] != mCurrentMark)
+			{
+				isInComponent[v] = true;
+			}
+		}
+		return isInComponent;
+	}
+
+
+protected:
+
+	/** Moves as many pebbles as possible onto the two vertices, up to two on each.
+	Returns true if all four have been gathered. */
+	bool gatherFourPebbles(size_t aV1, size_t aV2)
+	{
+		while ((mNumPebbles[aV1] < 2) && fetchPebble(aV1, aV2))
+		{
+		}
+		while ((mNumPebbles[aV2] < 2) && fetchPebble(aV2, aV1))
+		{
+		}
+		return (mNumPebbles[aV1] + mNumPebbles[aV2] == 4);
+	}
+
+
+	/** Searches along the out-edges of aTarget for a free pebble (not on aBlocked) and moves it to aTarget,
+	reversing the edges along the path. Returns true if a pebble has been moved. */
+	bool fetchPebble(size_t aTarget, size_t aBlocked)
+	{
+		nextMark();
+		mMarks[aTarget] = mCurrentMark;
+		mMarks[aBlocked] = mCurrentMark;
+		mStack.clear();
+		mStack.push_back(aTarget);
+		while (!mStack.empty())
+		{
+			auto v = mStack.back();
+			mStack.pop_back();
+			for (uint8_t i = 0; i < mNumOut[v]; ++i)
+			{
+				auto w = mOut[v][i];
+				if (mMarks[w] == mCurrentMark)
+				{
+					continue;
+				}
+				mMarks[w] = mCurrentMark;
+				mParents[w] = v;
+				if (mNumPebbles[w] > 0)
+				{
+					// Found a free pebble, reverse the path back to aTarget:
+					mNumPebbles[w] -= 1;
+					while (w != aTarget)
+					{
+						auto parent = mParents[w];
+						reverseEdge(parent, w);
+						w = parent;
+					}
+					mNumPebbles[aTarget] += 1;
+					return true;
+				}
+				mStack.push_back(w);
+			}
+		}
+		return false;
+	}
+
+
+	/** Turns the edge aFrom -> aTo into aTo -> aFrom. */
+	void reverseEdge(size_t aFrom, size_t aTo)
+	{
+		auto & out = mOut[aFrom];
+		if (out[0] == aTo)
+		{
+			out[0] = out[1];
+		}
+		mNumOut[aFrom] -= 1;
+		mOut[aTo][mNumOut[aTo]] = aFrom;
+		mNumOut[aTo] += 1;
+	}
+
+
+	/** Starts a new search, so that all vertices are unvisited. */
+	void nextMark()
+	{
+		mCurrentMark += 1;
+		if (mCurrentMark == 0)
+		{
+			// Wrapped around, reset all marks:
+			std::fill(mMarks.begin(), mMarks.end(), 0);
+			mCurrentMark = 1;
+		}
+	}
+};
+
+}  // anonymous namespace
+
+
+
+
+
+RigidityAnalysis::RigidityAnalysis(const SpringNet & aNet)
+{
+	auto numP = aNet.numPoints();
+	mIsDetermined.assign(numP, false);
+	if (numP == 0)
+	{
+		return;
+	}
+	PebbleGame game(numP);
+	size_t numIndependent = 0;
+
+	// Tie all the fixed points together into a single rigid body, using a fan of edges from the first two:
+	std::vector<size_t> fixedPoints;
+	for (size_t idx = 0; idx < numP; ++idx)
+	{
+		if (aNet.isPointFixed(idx))
+		{
+			fixedPoints.push_back(idx);
+		}
+	}
+	mIsAnchored = (fixedPoints.size() >= 2);
+	if (mIsAnchored)
+	{
+		game.insertEdge(fixedPoints[0], fixedPoints[1]);
+		numIndependent += 1;
+		for (size_t i = 2; i < fixedPoints.size(); ++i)
+		{
+			game.insertEdge(fixedPoints[0], fixedPoints[i]);
+			game.insertEdge(fixedPoints[1], fixedPoints[i]);
+			numIndependent += 2;
+		}
+	}
+
+	// Insert all the springs:
+	auto numS = aNet.numSprings();
+	for (size_t idx = 0; idx < numS; ++idx)
+	{
+		const auto & spring = aNet.spring(idx);
+		if (game.insertEdge(spring.pointIdx1(), spring.pointIdx2()))
+		{
+			numIndependent += 1;
+		}
+		else
+		{
+			mRedundantSprings.push_back(idx);
+		}
+	}
+
+	// Insert all the angles, as the distances between their arms' ends:
+	for (const auto & angle: aNet.angles())
+	{
+		if (game.insertEdge(angle.pointIdx1(), angle.pointIdx2()))
+		{
+			numIndependent += 1;
+		}
+	}
+	auto numTotalDofs = 2 * numP;
+	mNumDegreesOfFreedom = (numTotalDofs > numIndependent + 3) ? (numTotalDofs - numIndependent - 3) : 0;
+
+	// Pick the reference pair of points that the rest is judged against:
+	size_t ref1, ref2;
+	if (mIsAnchored)
+	{
+		ref1 = fixedPoints[0];
+		ref2 = fixedPoints[1];
+	}
+	else if (numS > 0)
+	{
+		// Prefer a spring at the single fixed point, if there is one:
+		size_t refSpringIdx = 0;
+		for (size_t idx = 0; idx < numS; ++idx)
+		{
+			const auto & spring = aNet.spring(idx);
+			if (aNet.isPointFixed(spring.pointIdx1()) || aNet.isPointFixed(spring.pointIdx2()))
+			{
+				refSpringIdx = idx;
+				break;
+			}
+		}
+		ref1 = aNet.spring(refSpringIdx).pointIdx1();
+		ref2 = aNet.spring(refSpringIdx).pointIdx2();
+	}
+	else
+	{
+		// No springs at all, only fixed points are determined:
+		for (size_t idx = 0; idx < numP; ++idx)
+		{
+			mIsDetermined[idx] = aNet.isPointFixed(idx);
+			if (!mIsDetermined[idx])
+			{
+				mUndeterminedPoints.push_back(idx);
+				mFlexibleGroups.push_back({idx});
+			}
+		}
+		return;
+	}
+
+	// A point is determined if it is in the rigid component of the reference pair:
+	mIsDetermined = game.rigidComponent(ref1, ref2);
+	auto adjacency = aNet.buildAdjacency();
+
+	// Collect the undetermined points and group them by the springs connecting them:
+	std::vector<bool> isGrouped(numP, false);
+	for (size_t idx = 0; idx < numP; ++idx)
+	{
+		if (mIsDetermined[idx])
+		{
+			continue;
+		}
+		mUndeterminedPoints.push_back(idx);
+		if (isGrouped[idx])
+		{
+			continue;
+		}
+		std::vector<size_t> group{idx};
+		isGrouped[idx] = true;
+		for (size_t i = 0; i < group.size(); ++i)
+		{
+			auto ptIdx = group[i];
+			for (auto itr = adjacency.springsBegin(ptIdx), end = adjacency.springsEnd(ptIdx); itr != end; ++itr)
+			{
+				const auto & spring = aNet.spring(*itr);
+				auto otherIdx = (spring.pointIdx1() == ptIdx) ? spring.pointIdx2() : spring.pointIdx1();
+				if (!mIsDetermined[otherIdx] && !isGrouped[otherIdx])
+				{
+					isGrouped[otherIdx] = true;
+					group.push_back(otherIdx);
+				}
+			}
+		}
+		mFlexibleGroups.push_back(std::move(group));
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+
+
+
+
+// fwd:
+class SpringNet;
+
+
+
+
+
+/** Combinatorial (Laman) rigidity analysis of a SpringNet, using the (2, 3) pebble game.
+Only the topology of the net is considered, not the actual positions or lengths.
+An angle is considered as a distance between the other points of its two springs: with the springs' lengths given,
+the angle determines that distance, and vice versa.
+All fixed points are considered to be a single rigid body (the ground); a point is determined if it is rigidly
+connected to the ground. If the net has fewer than two fixed points, the points are judged relative to
+a reference spring instead, and the net is reported as not anchored. */
+class RigidityAnalysis
+{
+public:
+
+	/** Analyses the specified net. */
+	explicit RigidityAnalysis(const SpringNet & aNet);
+
+	/** Returns true if the specified point is rigidly connected to the ground. */
+	bool isPointDetermined(size_t aPtIdx) const { return mIsDetermined[aPtIdx]; }
+
+	/** Returns the indices of all points that are not rigidly connected to the ground. */
+	const std::vector<size_t> & undeterminedPoints() const { return mUndeterminedPoints; }
+
+	/** Returns the undetermined points, grouped by the springs connecting them into flexible sub-structures. */
+	const std::vector<std::vector<size_t>> & flexibleGroups() const { return mFlexibleGroups; }
+
+	/** Returns the indices of springs that are redundant (over-constrain an already rigid part of the net). */
+	const std::vector<size_t> & redundantSprings() const { return mRedundantSprings; }
+
+	/** Returns the number of internal degrees of freedom (flexes) of the net, after removing the rigid-body motions. */
+	size_t numDegreesOfFreedom() const { return mNumDegreesOfFreedom; }
+
+	/** Returns true if the net has at least two fixed points, so that it cannot move as a whole. */
+	bool isAnchored() const { return mIsAnchored; }
+
+
+protected:
+
+	std::vector<bool> mIsDetermined;
+	std::vector<size_t> mUndeterminedPoints;
+	std::vector<std::vector<size_t>> mFlexibleGroups;
+	std::vector<size_t> mRedundantSprings;
+	size_t mNumDegreesOfFreedom = 0;
+	bool mIsAnchored = false;
+};
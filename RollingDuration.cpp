@@ -0,0 +1,41 @@
+#include "RollingDuration.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+
+
+
+
+void RollingDuration::add(std::chrono::steady_clock::duration aDuration)
+{
+	mMs[mNext] = std::chrono::duration<double, std::milli>(aDuration).count();
+	mNext = (mNext + 1) % WINDOW_SIZE;
+	mCount = std::min(mCount + 1, WINDOW_SIZE);
+}
+
+
+
+
+
+double RollingDuration::meanMs() const
+{
+	if (mCount == 0)
+	{
+		return 0;
+	}
+	return std::accumulate(mMs.begin(), mMs.begin() + mCount, 0.0) / mCount;
+}
+
+
+
+
+
+double RollingDuration::maxMs() const
+{
+	if (mCount == 0)
+	{
+		return 0;
+	}
+	return *std::max_element(mMs.begin(), mMs.begin() + mCount);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+
+
+
+
+/** Keeps the durations of the last few runs of a repeated operation (a paint, a mouse-move handler), for showing
+their rolling mean and max. Adding a duration is just a store into a fixed ring, cheap enough for the hot paths. */
+class RollingDuration
+{
+public:
+
+	/** The number of the most recent durations kept. */
+	static constexpr size_t WINDOW_SIZE = 64;
+
+
+	/** Adds the duration of a single run, dropping the oldest one if the window is full. */
+	void add(std::chrono::steady_clock::duration aDuration);
+
+	/** Returns the number of durations in the window. */
+	size_t count() const { return mCount; }
+
+	/** Returns the mean of the durations in the window, in milliseconds; 0 if none. */
+	double meanMs() const;
+
+	/** Returns the longest duration in the window, in milliseconds; 0 if none. */
+	double maxMs() const;
+
+
+protected:
+
+	/** The durations, in milliseconds; the first mCount are valid. */
+	std::array<double, WINDOW_SIZE> mMs{};
+
+	/** Where the next duration is written. */
+	size_t mNext = 0;
+
+	size_t mCount = 0;
+};
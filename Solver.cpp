@@ -0,0 +1,642 @@
+#include "Solver.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <QtGlobal>
+
+#include "SpringNet.hpp"
+#include "NetHierarchy.hpp"
+#include "SolverTrace.hpp"
+
+
+
+
+
+namespace {
+
+/** An accelerated iteration falls back to a plain one when the residual grows by more than this factor.
+Only a guard against the acceleration blowing up; the momentum schemes are not monotone, and on the normal
+overshoots they restart their momentum themselves (see restartMomentumIfUphill()). */
+static const double FALLBACK_RESIDUAL_GROWTH = 2.0;
+
+/** FIRE parameters (Bitzek et al., 2006), the time step is relative to a single plain iteration. */
+static const double FIRE_INITIAL_TIME_STEP = 0.5;
+static const double FIRE_MAX_TIME_STEP = 1.5;
+static const double FIRE_TIME_STEP_INCREASE = 1.1;
+static const double FIRE_TIME_STEP_DECREASE = 0.5;
+static const double FIRE_INITIAL_ALPHA = 0.1;
+static const double FIRE_ALPHA_DECREASE = 0.99;
+static const size_t FIRE_MIN_POSITIVE_STEPS = 5;
+
+/** Relative Tikhonov regularization of the Anderson least-squares problem. */
+static const double ANDERSON_REGULARIZATION = 1e-10;
+
+/** Multigrid: coarsening stops at this many aggregates, or this many levels. */
+static const size_t MULTIGRID_MIN_AGGREGATES = 4;
+static const size_t MULTIGRID_MAX_LEVELS = 32;
+
+/** Multigrid: the Gauss-Newton step is halved at most this many times when it makes the residual grow. */
+static const size_t MULTIGRID_MAX_STEP_HALVINGS = 10;
+
+/** Multigrid: the relative growth of the residual that the Gauss-Newton step is still allowed.
+The residual isn't exactly the quantity that Gauss-Newton minimizes, so near the solution it may grow by rounding-sized
+amounts; halving such steps would only slow down the final convergence. */
+static const double MULTIGRID_STEP_RESIDUAL_TOLERANCE = 1e-6;
+
+
+
+
+
+/** Returns the dot product of the two vectors of points, as if they were flat vectors of coords. */
+double dot(const std::vector<QPointF> & aV1, const std::vector<QPointF> & aV2)
+{
+	double res = 0;
+	auto num = aV1.size();
+	for (size_t i = 0; i < num; ++i)
+	{
+		res += QPointF::dotProduct(aV1[i], aV2[i]);
+	}
+	return res;
+}
+
+
+
+
+
+/** Solves the dense linear system aMatrix * x = aRhs (aMatrix is aSize x aSize, row-major) in-place,
+using Gaussian elimination with partial pivoting. The result is stored in aRhs.
+Returns false if the matrix is singular. */
+bool solveDense(std::vector<double> & aMatrix, std::vector<double> & aRhs, size_t aSize)
+{
+	for (size_t col = 0; col < aSize; ++col)
+	{
+		auto pivot = col;
+		for (size_t row = col + 1; row < aSize; ++row)
+		{
+			if (std::abs(aMatrix[row * aSize + col]) > std::abs(aMatrix[pivot * aSize + col]))
+			{
+				pivot = row;
+			}
+		}
+		if (aMatrix[pivot * aSize + col] == 0)
+		{
+			return false;
+		}
+		if (pivot != col)
+		{
+			for (size_t i = 0; i < aSize; ++i)
+			{
+				std::swap(aMatrix[col * aSize + i], aMatrix[pivot * aSize + i]);
+			}
+			std::swap(aRhs[col], aRhs[pivot]);
+		}
+		for (size_t row = col + 1; row < aSize; ++row)
+		{
+			auto factor = aMatrix[row * aSize + col] / aMatrix[col * aSize + col];
+			for (size_t i = col; i < aSize; ++i)
+			{
+				aMatrix[row * aSize + i] -= factor * aMatrix[col * aSize + i];
+			}
+			aRhs[row] -= factor * aRhs[col];
+		}
+	}
+	for (size_t col = aSize; col-- > 0;)
+	{
+		for (size_t i = col + 1; i < aSize; ++i)
+		{
+			aRhs[col] -= aMatrix[col * aSize + i] * aRhs[i];
+		}
+		aRhs[col] /= aMatrix[col * aSize + col];
+	}
+	return true;
+}
+
+
+
+
+
+/** Reorders the vector of points into the specified new order. Empty vectors (unused by the scheme) are left as-is. */
+void permute(std::vector<QPointF> & aPoints, const std::vector<size_t> & aNewToOld)
+{
+	if (aPoints.size() != aNewToOld.size())
+	{
+		return;
+	}
+	std::vector<QPointF> res;
+	res.reserve(aPoints.size());
+	for (auto oldIdx: aNewToOld)
+	{
+		res.push_back(aPoints[oldIdx]);
+	}
+	aPoints.swap(res);
+}
+
+}  // anonymous namespace
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Solver::Checkpoint:
+
+void Solver::Checkpoint::permutePoints(const std::vector<size_t> & aNewToOld, const SpringNet & aReorderedNet)
+{
+	permute(mPositions, aNewToOld);
+	permute(mVelocities, aNewToOld);
+	for (auto & v: mAndersonPosDiffs)
+	{
+		permute(v, aNewToOld);
+	}
+	for (auto & v: mAndersonDispDiffs)
+	{
+		permute(v, aNewToOld);
+	}
+	permute(mAndersonLastPositions, aNewToOld);
+	permute(mAndersonLastDisplacements, aNewToOld);
+	if (mTopologyHash != 0)
+	{
+		mTopologyHash = aReorderedNet.topologyHash();
+	}
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Solver:
+
+Solver::Solver(SpringNet & aNet, const Settings & aSettings):
+	mNet(aNet),
+	mSettings(aSettings),
+	mPositions(aNet.positions())
+{
+	resetAcceleration();
+	if (mSettings.mScheme == Scheme::Multigrid)
+	{
+		mHierarchy = std::make_unique<NetHierarchy>(aNet, MULTIGRID_MIN_AGGREGATES, MULTIGRID_MAX_LEVELS);
+	}
+	mResult.mResidual = mNet.residual(mPositions);
+}
+
+
+
+
+
+Solver::Solver(SpringNet & aNet, const Checkpoint & aCheckpoint):
+	mNet(aNet),
+	mSettings(aCheckpoint.mSettings),
+	mResult(aCheckpoint.mResult),
+	mPositions(aCheckpoint.mPositions),
+	mVelocities(aCheckpoint.mVelocities),
+	mFireTimeStep(aCheckpoint.mFireTimeStep),
+	mFireAlpha(aCheckpoint.mFireAlpha),
+	mFireNumPositiveSteps(aCheckpoint.mFireNumPositiveSteps),
+	mAndersonPosDiffs(aCheckpoint.mAndersonPosDiffs.begin(), aCheckpoint.mAndersonPosDiffs.end()),
+	mAndersonDispDiffs(aCheckpoint.mAndersonDispDiffs.begin(), aCheckpoint.mAndersonDispDiffs.end()),
+	mAndersonLastPositions(aCheckpoint.mAndersonLastPositions),
+	mAndersonLastDisplacements(aCheckpoint.mAndersonLastDisplacements)
+{
+	// Check that all the per-point vectors match the net:
+	auto numP = aNet.numPoints();
+	auto isValidSize = [numP](const std::vector<QPointF> & aVector, bool aMayBeEmpty)
+	{
+		return (aVector.size() == numP) || (aMayBeEmpty && aVector.empty());
+	};
+	auto isValid = (
+		isValidSize(mPositions, false) &&
+		isValidSize(mVelocities, false) &&
+		isValidSize(mAndersonLastPositions, true) &&
+		isValidSize(mAndersonLastDisplacements, true) &&
+		(mAndersonLastPositions.size() == mAndersonLastDisplacements.size()) &&
+		(mAndersonPosDiffs.size() == mAndersonDispDiffs.size())
+	);
+	for (size_t i = 0; isValid && (i < mAndersonPosDiffs.size()); ++i)
+	{
+		isValid = isValidSize(mAndersonPosDiffs[i], false) && isValidSize(mAndersonDispDiffs[i], false);
+	}
+	if ((aCheckpoint.mTopologyHash != 0) && (aCheckpoint.mTopologyHash != aNet.topologyHash()))
+	{
+		// Same number of points, but different springs or angles
+		isValid = false;
+	}
+	if (!isValid)
+	{
+		throw std::runtime_error("The solver checkpoint doesn't match the net.");
+	}
+	if (mSettings.mScheme == Scheme::Multigrid)
+	{
+		mHierarchy = std::make_unique<NetHierarchy>(aNet, MULTIGRID_MIN_AGGREGATES, MULTIGRID_MAX_LEVELS);
+	}
+}
+
+
+
+
+
+Solver::~Solver()
+{
+	// Nothing explicit needed, but NetHierarchy needs to be a complete type here
+}
+
+
+
+
+
+bool Solver::iterate()
+{
+	if (mResult.mHasConverged || mResult.mHasDiverged)
+	{
+		return mResult.mHasConverged;
+	}
+	TRACE_SCOPE("solverIteration");
+	TRACE_COUNTER("pointsTouched", mPositions.size());
+	mPrevPositions = mPositions;
+	switch (mSettings.mScheme)
+	{
+		case Scheme::Plain:     stepPlain();     break;
+		case Scheme::HeavyBall: stepHeavyBall(); break;
+		case Scheme::Nesterov:  stepNesterov();  break;
+		case Scheme::Fire:      stepFire();      break;
+		case Scheme::Anderson:  stepAnderson();  break;
+		case Scheme::Multigrid: stepMultigrid(); break;
+	}
+	mResult.mNumIterations += 1;
+
+	auto residual = mNet.residual(mPositions);
+	if ((mSettings.mScheme != Scheme::Plain) && !(residual <= mResult.mResidual * FALLBACK_RESIDUAL_GROWTH))
+	{
+		// The acceleration made things worse (or non-finite), undo it and do a plain step instead:
+		mPositions.swap(mPrevPositions);
+		resetAcceleration();
+		stepPlain();
+		residual = mNet.residual(mPositions);
+		mResult.mNumFallbacks += 1;
+	}
+	mResult.mResidual = residual;
+	TRACE_COUNTER("residual", residual);
+	TRACE_MEMORY();
+	if (!std::isfinite(residual))
+	{
+		mResult.mHasDiverged = true;
+		return false;
+	}
+	mResult.mHasConverged = (mResult.mMaxDisplacement < mSettings.mTolerance);
+	return mResult.mHasConverged;
+}
+
+
+
+
+
+const Solver::Result & Solver::solve()
+{
+	while (!hasFinished())
+	{
+		iterate();
+	}
+	writePositions();
+	return mResult;
+}
+
+
+
+
+
+size_t Solver::step(std::chrono::microseconds aTimeBudget, size_t aMaxIterations)
+{
+	auto startTime = std::chrono::steady_clock::now();
+	size_t numIterations = 0;
+	while (!hasFinished() && (numIterations < aMaxIterations))
+	{
+		iterate();
+		numIterations += 1;
+		if (std::chrono::steady_clock::now() - startTime >= aTimeBudget)
+		{
+			break;
+		}
+	}
+	return numIterations;
+}
+
+
+
+
+
+Solver::Checkpoint Solver::checkpoint() const
+{
+	Checkpoint res;
+	res.mSettings = mSettings;
+	res.mResult = mResult;
+	res.mPositions = mPositions;
+	res.mVelocities = mVelocities;
+	res.mFireTimeStep = mFireTimeStep;
+	res.mFireAlpha = mFireAlpha;
+	res.mFireNumPositiveSteps = mFireNumPositiveSteps;
+	res.mAndersonPosDiffs.assign(mAndersonPosDiffs.begin(), mAndersonPosDiffs.end());
+	res.mAndersonDispDiffs.assign(mAndersonDispDiffs.begin(), mAndersonDispDiffs.end());
+	res.mAndersonLastPositions = mAndersonLastPositions;
+	res.mAndersonLastDisplacements = mAndersonLastDisplacements;
+	res.mTopologyHash = mNet.topologyHash();
+	return res;
+}
+
+
+
+
+
+bool Solver::hasFinished() const
+{
+	return (
+		mResult.mHasConverged ||
+		mResult.mHasDiverged ||
+		(mResult.mNumIterations >= mSettings.mMaxIterations)
+	);
+}
+
+
+
+
+
+void Solver::writePositions()
+{
+	mNet.setPositions(mPositions);
+}
+
+
+
+
+
+const char * Solver::schemeName(Scheme aScheme)
+{
+	switch (aScheme)
+	{
+		case Scheme::Plain:     return QT_TRANSLATE_NOOP("Solver", "Plain");
+		case Scheme::HeavyBall: return QT_TRANSLATE_NOOP("Solver", "Heavy-ball momentum");
+		case Scheme::Nesterov:  return QT_TRANSLATE_NOOP("Solver", "Nesterov momentum");
+		case Scheme::Fire:      return QT_TRANSLATE_NOOP("Solver", "FIRE");
+		case Scheme::Anderson:  return QT_TRANSLATE_NOOP("Solver", "Anderson mixing");
+		case Scheme::Multigrid: return QT_TRANSLATE_NOOP("Solver", "Multigrid");
+	}
+	return "Unknown";
+}
+
+
+
+
+
+const std::vector<Solver::Scheme> & Solver::allSchemes()
+{
+	static const std::vector<Scheme> schemes =
+	{
+		Scheme::Plain,
+		Scheme::HeavyBall,
+		Scheme::Nesterov,
+		Scheme::Fire,
+		Scheme::Anderson,
+		Scheme::Multigrid,
+	};
+	return schemes;
+}
+
+
+
+
+
+void Solver::stepPlain()
+{
+	mNet.computeDisplacements(mPositions, mDisplacements);
+	updateMaxDisplacement();
+	TRACE_SCOPE("positionUpdate");
+	auto num = mPositions.size();
+	for (size_t i = 0; i < num; ++i)
+	{
+		mPositions[i] += mDisplacements[i];
+	}
+}
+
+
+
+
+
+void Solver::stepHeavyBall()
+{
+	mNet.computeDisplacements(mPositions, mDisplacements);
+	updateMaxDisplacement();
+	restartMomentumIfUphill();
+	TRACE_SCOPE("positionUpdate");
+	auto num = mPositions.size();
+	for (size_t i = 0; i < num; ++i)
+	{
+		mVelocities[i] = mVelocities[i] * mSettings.mMomentum + mDisplacements[i];
+		mPositions[i] += mVelocities[i];
+	}
+}
+
+
+
+
+
+void Solver::stepNesterov()
+{
+	// Evaluate the displacements at the look-ahead positions:
+	auto num = mPositions.size();
+	auto lookAhead = mPositions;
+	for (size_t i = 0; i < num; ++i)
+	{
+		lookAhead[i] += mVelocities[i] * mSettings.mMomentum;
+	}
+	mNet.computeDisplacements(lookAhead, mDisplacements);
+	updateMaxDisplacement();
+	restartMomentumIfUphill();
+	TRACE_SCOPE("positionUpdate");
+	for (size_t i = 0; i < num; ++i)
+	{
+		mVelocities[i] = mVelocities[i] * mSettings.mMomentum + mDisplacements[i];
+		mPositions[i] += mVelocities[i];
+	}
+}
+
+
+
+
+
+void Solver::stepFire()
+{
+	mNet.computeDisplacements(mPositions, mDisplacements);
+	updateMaxDisplacement();
+	TRACE_SCOPE("positionUpdate");
+	auto num = mPositions.size();
+
+	// Adapt the time step based on whether the velocity is going downhill:
+	auto power = dot(mDisplacements, mVelocities);
+	if (power >= 0)
+	{
+		mFireNumPositiveSteps += 1;
+		if (mFireNumPositiveSteps > FIRE_MIN_POSITIVE_STEPS)
+		{
+			mFireTimeStep = std::min(mFireTimeStep * FIRE_TIME_STEP_INCREASE, FIRE_MAX_TIME_STEP);
+			mFireAlpha *= FIRE_ALPHA_DECREASE;
+		}
+	}
+	else
+	{
+		mFireNumPositiveSteps = 0;
+		mFireTimeStep *= FIRE_TIME_STEP_DECREASE;
+		mFireAlpha = FIRE_INITIAL_ALPHA;
+		std::fill(mVelocities.begin(), mVelocities.end(), QPointF(0, 0));
+	}
+
+	// Integrate the velocity, then mix it towards the direction of the displacement:
+	for (size_t i = 0; i < num; ++i)
+	{
+		mVelocities[i] += mDisplacements[i] * mFireTimeStep;
+	}
+	auto velNorm = std::sqrt(dot(mVelocities, mVelocities));
+	auto dispNorm = std::sqrt(dot(mDisplacements, mDisplacements));
+	auto mix = (dispNorm > 0) ? (mFireAlpha * velNorm / dispNorm) : 0;
+	for (size_t i = 0; i < num; ++i)
+	{
+		mVelocities[i] = mVelocities[i] * (1 - mFireAlpha) + mDisplacements[i] * mix;
+		mPositions[i] += mVelocities[i] * mFireTimeStep;
+	}
+}
+
+
+
+
+
+void Solver::stepAnderson()
+{
+	mNet.computeDisplacements(mPositions, mDisplacements);
+	updateMaxDisplacement();
+	TRACE_SCOPE("positionUpdate");
+	auto num = mPositions.size();
+
+	// Update the history with the differences from the previous iteration:
+	if (!mAndersonLastPositions.empty())
+	{
+		std::vector<QPointF> posDiff(num), dispDiff(num);
+		for (size_t i = 0; i < num; ++i)
+		{
+			posDiff[i] = mPositions[i] - mAndersonLastPositions[i];
+			dispDiff[i] = mDisplacements[i] - mAndersonLastDisplacements[i];
+		}
+		mAndersonPosDiffs.push_back(std::move(posDiff));
+		mAndersonDispDiffs.push_back(std::move(dispDiff));
+		if (mAndersonPosDiffs.size() > mSettings.mAndersonDepth)
+		{
+			mAndersonPosDiffs.pop_front();
+			mAndersonDispDiffs.pop_front();
+		}
+	}
+	mAndersonLastPositions = mPositions;
+	mAndersonLastDisplacements = mDisplacements;
+
+	// Find the combination of the history that minimizes the linearized displacement:
+	auto depth = mAndersonDispDiffs.size();
+	std::vector<double> gamma(depth, 0);
+	if (depth > 0)
+	{
+		std::vector<double> matrix(depth * depth);
+		double trace = 0;
+		for (size_t r = 0; r < depth; ++r)
+		{
+			for (size_t c = r; c < depth; ++c)
+			{
+				auto v = dot(mAndersonDispDiffs[r], mAndersonDispDiffs[c]);
+				matrix[r * depth + c] = v;
+				matrix[c * depth + r] = v;
+			}
+			trace += matrix[r * depth + r];
+			gamma[r] = dot(mAndersonDispDiffs[r], mDisplacements);
+		}
+		for (size_t r = 0; r < depth; ++r)
+		{
+			matrix[r * depth + r] += ANDERSON_REGULARIZATION * trace;
+		}
+		if (!solveDense(matrix, gamma, depth))
+		{
+			std::fill(gamma.begin(), gamma.end(), 0);
+		}
+	}
+
+	for (size_t i = 0; i < num; ++i)
+	{
+		auto newPos = mPositions[i] + mDisplacements[i];
+		for (size_t h = 0; h < depth; ++h)
+		{
+			newPos -= (mAndersonPosDiffs[h][i] + mAndersonDispDiffs[h][i]) * gamma[h];
+		}
+		mPositions[i] = newPos;
+	}
+}
+
+
+
+
+
+void Solver::stepMultigrid()
+{
+	// The plain displacement decides the convergence, same as for the other schemes:
+	mNet.computeDisplacements(mPositions, mDisplacements);
+	updateMaxDisplacement();
+	mHierarchy->applyVCycle(mNet, mPositions);
+
+	// Far from the solution (or with inconsistent constraints) the linearization may be poor and the full step may
+	// overshoot; halve it until it doesn't make the residual grow:
+	auto maxResidual = mResult.mResidual * (1 + MULTIGRID_STEP_RESIDUAL_TOLERANCE);
+	auto num = mPositions.size();
+	for (size_t i = 0; (i < MULTIGRID_MAX_STEP_HALVINGS) && !(mNet.residual(mPositions) <= maxResidual); ++i)
+	{
+		for (size_t j = 0; j < num; ++j)
+		{
+			mPositions[j] = (mPositions[j] + mPrevPositions[j]) / 2;
+		}
+	}
+}
+
+
+
+
+
+void Solver::resetAcceleration()
+{
+	mVelocities.assign(mPositions.size(), QPointF(0, 0));
+	mFireTimeStep = FIRE_INITIAL_TIME_STEP;
+	mFireAlpha = FIRE_INITIAL_ALPHA;
+	mFireNumPositiveSteps = 0;
+	mAndersonPosDiffs.clear();
+	mAndersonDispDiffs.clear();
+	mAndersonLastPositions.clear();
+	mAndersonLastDisplacements.clear();
+}
+
+
+
+
+
+void Solver::restartMomentumIfUphill()
+{
+	// The displacement points downhill, so a velocity against it means the momentum has carried the points past the
+	// minimum along its direction (O'Donoghue and Candes, 2015, the gradient restart):
+	if (dot(mDisplacements, mVelocities) < 0)
+	{
+		std::fill(mVelocities.begin(), mVelocities.end(), QPointF(0, 0));
+	}
+}
+
+
+
+
+
+void Solver::updateMaxDisplacement()
+{
+	double maxDistSq = 0;
+	for (const auto & d: mDisplacements)
+	{
+		maxDistSq = std::max(maxDistSq, QPointF::dotProduct(d, d));
+	}
+	mResult.mMaxDisplacement = std::sqrt(maxDistSq);
+}
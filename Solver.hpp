@@ -0,0 +1,229 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <limits>
+#include <QPointF>
+
+
+
+
+
+// fwd:
+class SpringNet;
+class NetHierarchy;
+
+
+
+
+
+/** Iterative relaxation of a SpringNet towards the spring lengths, with selectable acceleration of the convergence.
+The solver works on its own copy of the point positions, call writePositions() to store them back into the net.
+The topology of the net must not change while the solver is in use; pinning points is allowed.
+The solver never reads the net's point positions after its creation, and only writes them in writePositions(), so it
+can run on another thread than the one drawing the net (SolverThread).
+If an accelerated iteration makes the residual blow up, it is undone, replaced by a plain iteration, and the
+acceleration state is reset (a fallback). The momentum schemes additionally restart their momentum whenever it points
+uphill, which is what keeps them from oscillating around the solution.
+The solve can be driven cooperatively by step(), in time-budgeted slices; its whole state can be taken as a Checkpoint
+and a new solver created from it later (even after saving and loading the document), continuing where it left off. */
+class Solver
+{
+public:
+
+	/** The acceleration scheme applied on top of the basic relaxation. */
+	enum class Scheme
+	{
+		/** Each iteration moves all the points by their displacements, all computed from the same positions (Jacobi).
+		Unlike SpringNet::adjust(), which moves each point right away, so that the next points already see it (Gauss-Seidel). */
+		Plain,
+
+		/** Polyak's heavy-ball momentum. */
+		HeavyBall,
+
+		/** Nesterov's momentum, the displacement is evaluated at the look-ahead positions. */
+		Nesterov,
+
+		/** Fast Inertial Relaxation Engine: momentum with an adaptive time step and velocity mixing. */
+		Fire,
+
+		/** Anderson mixing over the last few iterates. */
+		Anderson,
+
+		/** Gauss-Newton steps, each solved approximately by a single smoothed-aggregation V-cycle (NetHierarchy). */
+		Multigrid,
+	};
+
+
+	/** The parameters of the solver. */
+	struct Settings
+	{
+		Scheme mScheme = Scheme::Anderson;
+
+		/** The momentum coefficient, used by HeavyBall and Nesterov. */
+		double mMomentum = 0.9;
+
+		/** The number of previous iterates that Anderson mixing uses. */
+		size_t mAndersonDepth = 5;
+
+		/** The solve is considered converged once no point is displaced more than this in an iteration. */
+		double mTolerance = 1e-6;
+
+		/** The solve is stopped after this many iterations, even if not converged. */
+		size_t mMaxIterations = 100000;
+	};
+
+
+	/** The statistics of the solve so far. */
+	struct Result
+	{
+		size_t mNumIterations = 0;
+
+		/** The number of iterations where the acceleration made the residual blow up and a plain step was used instead. */
+		size_t mNumFallbacks = 0;
+
+		/** The residual (RMS of the force-weighted length errors) after the last iteration. */
+		double mResidual = 0;
+
+		/** The largest point displacement in the last iteration. */
+		double mMaxDisplacement = 0;
+
+		bool mHasConverged = false;
+
+		/** Set when the positions have become non-finite; the solve is stopped. */
+		bool mHasDiverged = false;
+	};
+
+
+	/** The complete state of a solve, from which it can be resumed. */
+	struct Checkpoint
+	{
+		Settings mSettings;
+		Result mResult;
+		std::vector<QPointF> mPositions;
+		std::vector<QPointF> mVelocities;
+		double mFireTimeStep = 0;
+		double mFireAlpha = 0;
+		size_t mFireNumPositiveSteps = 0;
+		std::vector<std::vector<QPointF>> mAndersonPosDiffs;
+		std::vector<std::vector<QPointF>> mAndersonDispDiffs;
+		std::vector<QPointF> mAndersonLastPositions;
+		std::vector<QPointF> mAndersonLastDisplacements;
+
+		/** The SpringNet::topologyHash() of the net that the checkpoint was taken for; 0 if not known (the checkpoints
+		saved by the older versions of the document). */
+		uint64_t mTopologyHash = 0;
+
+		/** Reorders all the per-point vectors after the net's points have been reordered;
+		aNewToOld is the new order of the points (SpringNet::Reordering::mPointNewToOld).
+		aReorderedNet is the net after the reordering, its topology hash is taken over. */
+		void permutePoints(const std::vector<size_t> & aNewToOld, const SpringNet & aReorderedNet);
+	};
+
+
+	/** Creates a new solver for the specified net, starting at the net's current point positions. */
+	Solver(SpringNet & aNet, const Settings & aSettings);
+
+	/** Creates a solver for the specified net that resumes the solve from the checkpoint.
+	The multigrid hierarchy, if used, is rebuilt from the net.
+	Throws a std::runtime_error if the checkpoint doesn't match the net (a different topology or number of points). */
+	Solver(SpringNet & aNet, const Checkpoint & aCheckpoint);
+
+	~Solver();
+
+	/** Performs a single iteration. Returns true if the solve has converged. */
+	bool iterate();
+
+	/** Iterates until converged, or until the max number of iterations is reached.
+	Writes the positions back into the net. */
+	const Result & solve();
+
+	/** Iterates until either the time budget or the specified number of iterations is used up, or the solve finishes.
+	At least one iteration is performed unless the solve has already finished, so that it always progresses.
+	The positions are not written back into the net. Returns the number of iterations performed. */
+	size_t step(
+		std::chrono::microseconds aTimeBudget,
+		size_t aMaxIterations = std::numeric_limits<size_t>::max()
+	);
+
+	/** Returns the complete current state of the solve. */
+	Checkpoint checkpoint() const;
+
+	/** Returns true if the solve has either converged or run out of iterations. */
+	bool hasFinished() const;
+
+	const Result & result() const { return mResult; }
+	const Settings & settings() const { return mSettings; }
+
+	/** Returns the solver's current point positions, in the same order as the net's points. */
+	const std::vector<QPointF> & positions() const { return mPositions; }
+
+	/** Stores the solver's current point positions into the net. */
+	void writePositions();
+
+	/** Returns the user-visible name of the specified scheme, untranslated (the CLI matches it as-is);
+	the GUI translates it in the "Solver" context. */
+	static const char * schemeName(Scheme aScheme);
+
+	/** Returns all the available schemes, in the order they should be presented to the user. */
+	static const std::vector<Scheme> & allSchemes();
+
+
+protected:
+
+	/** The net being solved. */
+	SpringNet & mNet;
+
+	Settings mSettings;
+
+	Result mResult;
+
+	/** The current point positions. */
+	std::vector<QPointF> mPositions;
+
+	/** The positions before the current iteration, for undoing the iteration on fallback. */
+	std::vector<QPointF> mPrevPositions;
+
+	/** The displacements computed in the current iteration. */
+	std::vector<QPointF> mDisplacements;
+
+	/** The point velocities, used by the momentum-based schemes. */
+	std::vector<QPointF> mVelocities;
+
+	/** FIRE: the current time step, mixing coefficient and the number of consecutive downhill steps. */
+	double mFireTimeStep;
+	double mFireAlpha;
+	size_t mFireNumPositiveSteps = 0;
+
+	/** Anderson: the differences between consecutive iterates (positions and displacements), newest last. */
+	std::deque<std::vector<QPointF>> mAndersonPosDiffs;
+	std::deque<std::vector<QPointF>> mAndersonDispDiffs;
+
+	/** Anderson: the positions and displacements of the previous iteration; empty if there's none. */
+	std::vector<QPointF> mAndersonLastPositions;
+	std::vector<QPointF> mAndersonLastDisplacements;
+
+	/** Multigrid: the hierarchy of coarse nets, nullptr for other schemes. */
+	std::unique_ptr<NetHierarchy> mHierarchy;
+
+
+	/** Performs a single iteration of the respective scheme, updating mPositions, mDisplacements and
+	mResult.mMaxDisplacement. */
+	void stepPlain();
+	void stepHeavyBall();
+	void stepNesterov();
+	void stepFire();
+	void stepAnderson();
+	void stepMultigrid();
+
+	/** Resets the momentum, time step and history of the accelerated schemes. */
+	void resetAcceleration();
+
+	/** HeavyBall, Nesterov: zeroes the velocities if they point against mDisplacements. */
+	void restartMomentumIfUphill();
+
+	/** Sets mResult.mMaxDisplacement from mDisplacements. */
+	void updateMaxDisplacement();
+};
@@ -0,0 +1,114 @@
+#include "SolverThread.hpp"
+
+#include "SpringNet.hpp"
+
+
+
+
+
+namespace {
+
+/** The solving time between publishing the positions; the length of a single task. Also bounds how long stop() waits
+for the worker, and how long the interactive tasks may wait for one. */
+static const std::chrono::microseconds PUBLISH_INTERVAL(10000);
+
+}  // anonymous namespace
+
+
+
+
+
+SolverThread::SolverThread(SpringNet & aNet, const Solver::Settings & aSettings):
+	mNet(aNet),
+	mSolver(aNet, aSettings)
+{
+	mHasFinished = mSolver.hasFinished();
+	mNumIterations = mSolver.result().mNumIterations;
+	mResidual = mSolver.result().mResidual;
+}
+
+
+
+
+
+SolverThread::SolverThread(SpringNet & aNet, const Solver::Checkpoint & aCheckpoint):
+	mNet(aNet),
+	mSolver(aNet, aCheckpoint)
+{
+	mHasFinished = mSolver.hasFinished();
+	mNumIterations = mSolver.result().mNumIterations;
+	mResidual = mSolver.result().mResidual;
+}
+
+
+
+
+
+SolverThread::~SolverThread()
+{
+	stop();
+}
+
+
+
+
+
+void SolverThread::start()
+{
+	stop();
+	if (mHasFinished)
+	{
+		return;
+	}
+	mSlices.run([this]() { solveSlice(); });
+}
+
+
+
+
+
+void SolverThread::stop()
+{
+	mSlices.cancelAndWait();
+}
+
+
+
+
+
+bool SolverThread::applyPositions()
+{
+	if (!mPositions.update())
+	{
+		return false;
+	}
+	mNet.setPositions(mPositions.front());
+	return true;
+}
+
+
+
+
+
+void SolverThread::solveSlice()
+{
+	if (mSlices.isCancelled())
+	{
+		return;
+	}
+	mSolver.step(PUBLISH_INTERVAL);
+
+	// Assigning into the back buffer reuses its memory, so publishing doesn't allocate once all three are filled:
+	mPositions.back() = mSolver.positions();
+	mPositions.publish();
+	mNumIterations.store(mSolver.result().mNumIterations, std::memory_order_relaxed);
+	mResidual.store(mSolver.result().mResidual, std::memory_order_relaxed);
+	if (mSolver.hasFinished())
+	{
+		mHasFinished = true;
+		return;
+	}
+
+	// Queue the next slice rather than looping, so that the more urgent tasks get the worker in between:
+	mSlices.run([this]() { solveSlice(); });
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+
+#include "Solver.hpp"
+#include "PositionBuffer.hpp"
+#include "TaskScheduler.hpp"
+
+
+
+
+
+/** Runs a Solver in the background, so that the UI stays responsive however long the iterations take.
+The solve runs on the shared TaskScheduler at the Solve priority, as a chain of time slices, each slice a task that
+queues the next one; so the interactive tasks get a worker at the end of the current slice.
+After each time slice the worker publishes the positions through a PositionBuffer; the UI thread takes the newest
+published positions into the net by applyPositions(), whenever it is ready to draw them. Neither thread ever waits
+for the other, and the UI always draws (and hit-tests) a complete set of positions from a single iteration.
+While the worker runs, the solver only reads the net's topology, params and pins, and never writes into the net;
+so the topology, params and pins must not change until stop() returns. */
+class SolverThread
+{
+public:
+
+	/** Creates a solver for the net, starting at the net's current point positions. Call start() to run it. */
+	SolverThread(SpringNet & aNet, const Solver::Settings & aSettings);
+
+	/** Creates a solver for the net, resuming from the checkpoint. Call start() to run it.
+	Throws a std::runtime_error if the checkpoint doesn't match the net. */
+	SolverThread(SpringNet & aNet, const Solver::Checkpoint & aCheckpoint);
+
+	/** Stops the solve, if running. */
+	~SolverThread();
+
+	/** Starts (or continues) the solve in the background. Does nothing if it has already finished. */
+	void start();
+
+	/** Stops the solve and waits for the running time slice to finish, the solve can be continued by start(). */
+	void stop();
+
+	/** Returns true once the solve has finished; no more time slices are queued then. */
+	bool hasFinished() const { return mHasFinished.load(); }
+
+	/** Writes the newest published positions into the net. Returns false if there have been no new positions since
+	the last call. To be called from the UI thread. */
+	bool applyPositions();
+
+	/** Returns the complete state of the solve. Only valid while the worker is stopped or finished. */
+	Solver::Checkpoint checkpoint() const { return mSolver.checkpoint(); }
+
+	/** Returns the result of the solve. Only valid while the worker is stopped or finished. */
+	const Solver::Result & result() const { return mSolver.result(); }
+
+	const Solver::Settings & settings() const { return mSolver.settings(); }
+
+	/** Returns the number of iterations done so far, as of the last published positions. Can be called any time. */
+	size_t numIterations() const { return mNumIterations.load(std::memory_order_relaxed); }
+
+	/** Returns the residual after the last published iteration. Can be called any time. */
+	double residual() const { return mResidual.load(std::memory_order_relaxed); }
+
+
+protected:
+
+	SpringNet & mNet;
+
+	Solver mSolver;
+
+	/** The positions published by the worker after each time slice. */
+	PositionBuffer mPositions;
+
+	/** The time slices; cancelled to stop the solve. */
+	TaskScheduler::TaskGroup mSlices{TaskScheduler::Priority::Solve};
+
+	/** Set by the worker once the solve has finished. */
+	std::atomic<bool> mHasFinished = false;
+
+	/** The progress of the solve, published by the worker together with the positions, for displaying while running. */
+	std::atomic<size_t> mNumIterations = 0;
+	std::atomic<double> mResidual = 0;
+
+
+	/** A single time slice: solves for PUBLISH_INTERVAL, publishes the positions, and queues the next slice,
+	unless finished or stopped. */
+	void solveSlice();
+};
@@ -0,0 +1,225 @@
+#include "SolverTrace.hpp"
+
+#include <thread>
+#include <functional>
+#include <stdexcept>
+#include <QIODevice>
+#include <QByteArray>
+#include <QFile>
+
+#if defined(Q_OS_WIN) || defined(_WIN32)
+	#define NOMINMAX
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+#endif
+
+
+
+
+
+/** About 32 MiB each; a solve adds a few events and samples per iteration. */
+const size_t SolverTrace::MAX_EVENTS = 1 << 20;
+const size_t SolverTrace::MAX_SAMPLES = 1 << 20;
+
+
+
+
+
+SolverTrace::SolverTrace():
+	mStartTime(std::chrono::steady_clock::now())
+{
+}
+
+
+
+
+
+SolverTrace & SolverTrace::get()
+{
+	static SolverTrace instance;
+	return instance;
+}
+
+
+
+
+
+int64_t SolverTrace::nowUs() const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mStartTime).count();
+}
+
+
+
+
+
+void SolverTrace::addEvent(const char * aName, int64_t aStartUs, int64_t aDurationUs)
+{
+	auto threadId = static_cast<uint64_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+	std::scoped_lock lock(mMtx);
+	if (mEvents.size() >= MAX_EVENTS)
+	{
+		mEvents.pop_front();
+		mNumDroppedEvents += 1;
+	}
+	mEvents.push_back({aName, aStartUs, aDurationUs, threadId});
+}
+
+
+
+
+
+void SolverTrace::addSample(const char * aName, double aValue)
+{
+	auto timeUs = nowUs();
+	std::scoped_lock lock(mMtx);
+	if (mSamples.size() >= MAX_SAMPLES)
+	{
+		mSamples.pop_front();
+		mNumDroppedSamples += 1;
+	}
+	mSamples.push_back({aName, timeUs, aValue});
+}
+
+
+
+
+
+void SolverTrace::sampleMemory()
+{
+	addSample("peakMemory", static_cast<double>(peakMemoryUsage()));
+}
+
+
+
+
+
+void SolverTrace::clear()
+{
+	std::scoped_lock lock(mMtx);
+	mEvents.clear();
+	mSamples.clear();
+	mNumDroppedEvents = 0;
+	mNumDroppedSamples = 0;
+}
+
+
+
+
+
+void SolverTrace::exportChromeTrace(QIODevice & aOut) const
+{
+	std::scoped_lock lock(mMtx);
+	aOut.write("{\"traceEvents\":[\n");
+	bool isFirst = true;
+	for (const auto & e: mEvents)
+	{
+		if (!isFirst)
+		{
+			aOut.write(",\n");
+		}
+		isFirst = false;
+		aOut.write(
+			QByteArray("{\"name\":\"") + e.mName +
+			"\",\"ph\":\"X\",\"pid\":1,\"tid\":" + QByteArray::number(static_cast<qulonglong>(e.mThreadId % 1000000)) +
+			",\"ts\":" + QByteArray::number(static_cast<qlonglong>(e.mStartUs)) +
+			",\"dur\":" + QByteArray::number(static_cast<qlonglong>(e.mDurationUs)) + "}"
+		);
+	}
+	for (const auto & s: mSamples)
+	{
+		if (!isFirst)
+		{
+			aOut.write(",\n");
+		}
+		isFirst = false;
+		aOut.write(
+			QByteArray("{\"name\":\"") + s.mName +
+			"\",\"ph\":\"C\",\"pid\":1,\"ts\":" + QByteArray::number(static_cast<qlonglong>(s.mTimeUs)) +
+			",\"args\":{\"value\":" + QByteArray::number(s.mValue, 'g', 17) + "}}"
+		);
+	}
+	aOut.write(
+		"\n],\"otherData\":{\"droppedEvents\":" + QByteArray::number(static_cast<qulonglong>(mNumDroppedEvents)) +
+		",\"droppedSamples\":" + QByteArray::number(static_cast<qulonglong>(mNumDroppedSamples)) + "}}\n"
+	);
+}
+
+
+
+
+
+void SolverTrace::exportCsv(QIODevice & aOut) const
+{
+	std::scoped_lock lock(mMtx);
+	aOut.write("kind,name,timeUs,durationUs,value,thread\n");
+	aOut.write("dropped,events,,," + QByteArray::number(static_cast<qulonglong>(mNumDroppedEvents)) + ",\n");
+	aOut.write("dropped,counters,,," + QByteArray::number(static_cast<qulonglong>(mNumDroppedSamples)) + ",\n");
+	for (const auto & e: mEvents)
+	{
+		aOut.write(
+			QByteArray("event,") + e.mName + "," +
+			QByteArray::number(static_cast<qlonglong>(e.mStartUs)) + "," +
+			QByteArray::number(static_cast<qlonglong>(e.mDurationUs)) + ",," +
+			QByteArray::number(static_cast<qulonglong>(e.mThreadId)) + "\n"
+		);
+	}
+	for (const auto & s: mSamples)
+	{
+		aOut.write(
+			QByteArray("counter,") + s.mName + "," +
+			QByteArray::number(static_cast<qlonglong>(s.mTimeUs)) + ",," +
+			QByteArray::number(s.mValue, 'g', 17) + ",\n"
+		);
+	}
+}
+
+
+
+
+
+void SolverTrace::exportToFile(const QString & aFileName) const
+{
+	QFile f(aFileName);
+	if (!f.open(QIODevice::WriteOnly))
+	{
+		throw std::runtime_error("Cannot open file for writing.");
+	}
+	if (aFileName.endsWith(".csv", Qt::CaseInsensitive))
+	{
+		exportCsv(f);
+	}
+	else
+	{
+		exportChromeTrace(f);
+	}
+}
+
+
+
+
+
+uint64_t SolverTrace::peakMemoryUsage()
+{
+	#if defined(Q_OS_WIN) || defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS pmc;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		{
+			return pmc.PeakWorkingSetSize;
+		}
+		return 0;
+	#else
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+		{
+			return 0;
+		}
+		#ifdef __APPLE__
+			return static_cast<uint64_t>(usage.ru_maxrss);  // bytes on macOS
+		#else
+			return static_cast<uint64_t>(usage.ru_maxrss) * 1024;  // kilobytes elsewhere
+		#endif
+	#endif
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+
+
+
+
+// fwd:
+class QIODevice;
+class QString;
+
+
+
+
+
+/** Collects the timing of the solver phases and the values of solver counters (residual, numbers of points and
+springs touched, memory high-water mark), for exporting as a Chrome trace-event JSON or CSV.
+Only the latest MAX_EVENTS events and MAX_SAMPLES samples are kept, so that a long interactive session doesn't run out
+of memory; the older ones are dropped and their number is reported in the export.
+The collection is only compiled in when SPRINGANGLES_TRACE is defined (the SPRINGANGLES_ENABLE_TRACE CMake option);
+otherwise the TRACE_ macros expand to nothing and the trace stays empty. */
+class SolverTrace
+{
+public:
+
+	/** A single timed phase. */
+	struct Event
+	{
+		const char * mName;
+		int64_t mStartUs;
+		int64_t mDurationUs;
+		uint64_t mThreadId;
+	};
+
+	/** A single sample of a counter. */
+	struct Sample
+	{
+		const char * mName;
+		int64_t mTimeUs;
+		double mValue;
+	};
+
+
+	/** The maximum number of events and samples kept; the oldest ones are dropped beyond that. */
+	static const size_t MAX_EVENTS;
+	static const size_t MAX_SAMPLES;
+
+
+	/** Returns the single instance of the trace. */
+	static SolverTrace & get();
+
+	/** Returns true if the trace collection has been compiled in. */
+	static constexpr bool isEnabled()
+	{
+		#ifdef SPRINGANGLES_TRACE
+			return true;
+		#else
+			return false;
+		#endif
+	}
+
+	/** Returns the number of microseconds since the trace has been created. */
+	int64_t nowUs() const;
+
+	/** Adds a timed phase. */
+	void addEvent(const char * aName, int64_t aStartUs, int64_t aDurationUs);
+
+	/** Adds a sample of the specified counter, timestamped now. */
+	void addSample(const char * aName, double aValue);
+
+	/** Adds a sample of the process' memory high-water mark, in bytes. */
+	void sampleMemory();
+
+	/** Removes all the collected data, including the counts of the dropped events and samples. */
+	void clear();
+
+	/** Writes the collected data as Chrome trace-event JSON (chrome://tracing, Perfetto). */
+	void exportChromeTrace(QIODevice & aOut) const;
+
+	/** Writes the collected data as CSV, one row per event or sample. */
+	void exportCsv(QIODevice & aOut) const;
+
+	/** Writes the collected data into the specified file, as CSV if the file name ends with ".csv", as Chrome
+	trace-event JSON otherwise. Throws a std::runtime_error if the file cannot be written. */
+	void exportToFile(const QString & aFileName) const;
+
+	/** Returns the process' peak resident memory, in bytes; 0 if not available on this platform. */
+	static uint64_t peakMemoryUsage();
+
+
+protected:
+
+	/** The time that all timestamps are relative to. */
+	std::chrono::steady_clock::time_point mStartTime;
+
+	/** Protects the members below, solves may run in parallel. */
+	mutable std::mutex mMtx;
+
+	/** The latest events and samples, the oldest first. */
+	std::deque<Event> mEvents;
+	std::deque<Sample> mSamples;
+
+	/** The number of the events and samples dropped because of MAX_EVENTS and MAX_SAMPLES, since the last clear(). */
+	uint64_t mNumDroppedEvents = 0;
+	uint64_t mNumDroppedSamples = 0;
+
+
+	SolverTrace();
+};
+
+
+
+
+
+/** Times the enclosing scope and adds it as an event to SolverTrace. Use through the TRACE_SCOPE macro. */
+class SolverTraceScope
+{
+	const char * mName;
+	int64_t mStartUs;
+
+public:
+
+	explicit SolverTraceScope(const char * aName):
+		mName(aName),
+		mStartUs(SolverTrace::get().nowUs())
+	{
+	}
+
+	~SolverTraceScope()
+	{
+		auto & trace = SolverTrace::get();
+		trace.addEvent(mName, mStartUs, trace.nowUs() - mStartUs);
+	}
+};
+
+
+
+
+
+#ifdef SPRINGANGLES_TRACE
+	#define TRACE_CONCAT_INNER(a, b) a##b
+	#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+	/** Times the rest of the enclosing scope as the specified phase. */
+	#define TRACE_SCOPE(aName) SolverTraceScope TRACE_CONCAT(traceScope, __LINE__)(aName)
+
+	/** Records a sample of the specified counter. */
+	#define TRACE_COUNTER(aName, aValue) SolverTrace::get().addSample(aName, static_cast<double>(aValue))
+
+	/** Records a sample of the memory high-water mark. */
+	#define TRACE_MEMORY() SolverTrace::get().sampleMemory()
+#else
+	#define TRACE_SCOPE(aName)
+	#define TRACE_COUNTER(aName, aValue)
+	#define TRACE_MEMORY()
+#endif
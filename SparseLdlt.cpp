@@ -0,0 +1,370 @@
+#include "SparseLdlt.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "SolverTrace.hpp"
+
+
+
+
+
+namespace {
+
+/** Marks a root of the elimination tree, and an entry not found in the pattern. */
+static const size_t NONE = std::numeric_limits<size_t>::max();
+
+}  // anonymous namespace
+
+
+
+
+
+void SparseLdlt::analyse(size_t aSize, std::vector<std::vector<size_t>> aUpperPattern)
+{
+	TRACE_SCOPE("symbolicFactorization");
+	mSize = aSize;
+	mIsAnalysed = true;
+	mZd.clear();
+	mZx.clear();
+
+	// Store the pattern of the upper triangle in CSC:
+	mAp.assign(aSize + 1, 0);
+	mAi.clear();
+	for (size_t col = 0; col < aSize; ++col)
+	{
+		auto & rows = aUpperPattern[col];
+		std::sort(rows.begin(), rows.end());
+		rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+		mAi.insert(mAi.end(), rows.begin(), rows.end());
+		mAp[col + 1] = mAi.size();
+		std::vector<size_t>().swap(rows);
+	}
+	mAd.assign(aSize, 0);
+	mAx.assign(mAi.size(), 0);
+
+	// Compute the elimination tree and the number of entries in each column of L:
+	mParent.assign(aSize, NONE);
+	std::vector<size_t> flag(aSize);
+	std::vector<size_t> lnz(aSize, 0);
+	for (size_t k = 0; k < aSize; ++k)
+	{
+		flag[k] = k;
+		for (auto p = mAp[k]; p < mAp[k + 1]; ++p)
+		{
+			// Walk up the tree from each entry of row k, up to a node already visited for this row:
+			for (auto i = mAi[p]; flag[i] != k; i = mParent[i])
+			{
+				if (mParent[i] == NONE)
+				{
+					mParent[i] = k;
+				}
+				lnz[i] += 1;
+				flag[i] = k;
+			}
+		}
+	}
+	mLp.assign(aSize + 1, 0);
+	for (size_t k = 0; k < aSize; ++k)
+	{
+		mLp[k + 1] = mLp[k] + lnz[k];
+	}
+	mLi.assign(mLp[aSize], 0);
+	mLx.assign(mLp[aSize], 0);
+	mD.assign(aSize, 0);
+	TRACE_COUNTER("factorNonZeros", mLp[aSize]);
+}
+
+
+
+
+
+void SparseLdlt::setZero()
+{
+	std::fill(mAd.begin(), mAd.end(), 0);
+	std::fill(mAx.begin(), mAx.end(), 0);
+}
+
+
+
+
+
+void SparseLdlt::copyNumericFrom(const SparseLdlt & aOther)
+{
+	if ((aOther.mSize != mSize) || (aOther.mLx.size() != mLx.size()) || (aOther.mAx.size() != mAx.size()))
+	{
+		throw std::logic_error("Copying the numeric factorization between different patterns");
+	}
+	std::copy(aOther.mAd.begin(), aOther.mAd.end(), mAd.begin());
+	std::copy(aOther.mAx.begin(), aOther.mAx.end(), mAx.begin());
+	std::copy(aOther.mLx.begin(), aOther.mLx.end(), mLx.begin());
+	std::copy(aOther.mD.begin(), aOther.mD.end(), mD.begin());
+}
+
+
+
+
+
+void SparseLdlt::add(size_t aRow, size_t aCol, double aValue)
+{
+	if (aRow == aCol)
+	{
+		mAd[aRow] += aValue;
+		return;
+	}
+	if (aRow > aCol)
+	{
+		std::swap(aRow, aCol);
+	}
+	auto begin = mAi.begin() + static_cast<ptrdiff_t>(mAp[aCol]);
+	auto end = mAi.begin() + static_cast<ptrdiff_t>(mAp[aCol + 1]);
+	auto itr = std::lower_bound(begin, end, aRow);
+	if ((itr == end) || (*itr != aRow))
+	{
+		throw std::runtime_error("The matrix entry is not a part of the analysed pattern.");
+	}
+	mAx[static_cast<size_t>(itr - mAi.begin())] += aValue;
+}
+
+
+
+
+
+bool SparseLdlt::factorize(double aMinPivot)
+{
+	TRACE_SCOPE("numericFactorization");
+	if (!mIsAnalysed)
+	{
+		throw std::runtime_error("The matrix pattern has not been analysed.");
+	}
+	mZd.clear();
+	mZx.clear();
+
+	// Up-looking: row k of L is computed by a sparse triangular solve with the already computed rows,
+	// its non-zero pattern is given by the reach of row k of A in the elimination tree.
+	auto n = mSize;
+	std::vector<double> y(n, 0);
+	std::vector<size_t> flag(n);
+	std::vector<size_t> pattern(n);
+	std::vector<size_t> lnz(n, 0);
+	for (size_t k = 0; k < n; ++k)
+	{
+		y[k] = mAd[k];
+		auto top = n;
+		flag[k] = k;
+		for (auto p = mAp[k]; p < mAp[k + 1]; ++p)
+		{
+			auto i = mAi[p];
+			y[i] += mAx[p];
+			size_t len = 0;
+			for (; flag[i] != k; i = mParent[i])
+			{
+				pattern[len++] = i;
+				flag[i] = k;
+			}
+			while (len > 0)
+			{
+				pattern[--top] = pattern[--len];
+			}
+		}
+		auto d = y[k];
+		y[k] = 0;
+		for (; top < n; ++top)
+		{
+			auto i = pattern[top];
+			auto yi = y[i];
+			y[i] = 0;
+			auto pEnd = mLp[i] + lnz[i];
+			for (auto p = mLp[i]; p < pEnd; ++p)
+			{
+				y[mLi[p]] -= mLx[p] * yi;
+			}
+			auto lki = yi / mD[i];
+			d -= lki * yi;
+			mLi[pEnd] = k;
+			mLx[pEnd] = lki;
+			lnz[i] += 1;
+		}
+		if (!(d > aMinPivot))
+		{
+			return false;
+		}
+		mD[k] = d;
+	}
+	return true;
+}
+
+
+
+
+
+void SparseLdlt::solve(std::vector<double> & aRhs) const
+{
+	auto n = mSize;
+	for (size_t j = 0; j < n; ++j)
+	{
+		auto xj = aRhs[j];
+		for (auto p = mLp[j]; p < mLp[j + 1]; ++p)
+		{
+			aRhs[mLi[p]] -= mLx[p] * xj;
+		}
+	}
+	for (size_t j = 0; j < n; ++j)
+	{
+		aRhs[j] /= mD[j];
+	}
+	for (size_t j = n; j-- > 0;)
+	{
+		auto xj = aRhs[j];
+		for (auto p = mLp[j]; p < mLp[j + 1]; ++p)
+		{
+			xj -= mLx[p] * aRhs[mLi[p]];
+		}
+		aRhs[j] = xj;
+	}
+}
+
+
+
+
+
+bool SparseLdlt::rankOneUpdate(const std::vector<size_t> & aIndices, const std::vector<double> & aValues, double aSigma)
+{
+	TRACE_SCOPE("rankOneUpdate");
+	mZd.clear();
+	mZx.clear();
+	if (aIndices.empty())
+	{
+		return true;
+	}
+
+	// Scatter w, the modification only reaches the columns on the path from its first index to the root:
+	mUpdateWork.resize(mSize, 0);
+	for (size_t i = 0; i < aIndices.size(); ++i)
+	{
+		mUpdateWork[aIndices[i]] += aValues[i];
+	}
+
+	// Method C1 of Gill, Golub, Murray and Saunders, restricted to the path:
+	auto alpha = aSigma;
+	auto isValid = true;
+	for (auto j = *std::min_element(aIndices.begin(), aIndices.end()); j != NONE; j = mParent[j])
+	{
+		auto p = mUpdateWork[j];
+		mUpdateWork[j] = 0;
+		if (!isValid || (p == 0))
+		{
+			// Nothing to update in this column, but the rest of the path still needs its scattered values cleared
+			continue;
+		}
+		auto d = mD[j];
+		auto dBar = d + alpha * p * p;
+		if (!(dBar > 0))
+		{
+			isValid = false;
+			continue;
+		}
+		auto beta = p * alpha / dBar;
+		alpha = d * alpha / dBar;
+		mD[j] = dBar;
+		for (auto q = mLp[j]; q < mLp[j + 1]; ++q)
+		{
+			auto i = mLi[q];
+			mUpdateWork[i] -= p * mLx[q];
+			mLx[q] += beta * mUpdateWork[i];
+		}
+	}
+	return isValid;
+}
+
+
+
+
+
+void SparseLdlt::computeSelectedInverse()
+{
+	TRACE_SCOPE("selectedInversion");
+
+	// Takahashi equations, from the last column backwards:
+	//   Z(i, j) = -sum_k L(k, j) * Z(i, k)    for i in the pattern of L(:, j)
+	//   Z(j, j) = 1 / D(j) - sum_k L(k, j) * Z(k, j)
+	// all the Z(i, k) needed are within the pattern of L, and have already been computed.
+	// For each k in the pattern of column j, the pattern of column k contains all the rows of column j below k,
+	// so the column k is walked and its rows are matched against column j's through a scattered index.
+	auto n = mSize;
+	mZd.assign(n, 0);
+	mZx.assign(mLx.size(), 0);
+	std::vector<size_t> posInColumn(n, NONE);
+	for (size_t j = n; j-- > 0;)
+	{
+		auto pBegin = mLp[j];
+		auto pEnd = mLp[j + 1];
+		for (auto p = pBegin; p < pEnd; ++p)
+		{
+			posInColumn[mLi[p]] = p;
+		}
+		for (auto q = pBegin; q < pEnd; ++q)
+		{
+			auto k = mLi[q];
+			auto lkj = mLx[q];
+			mZx[q] -= lkj * mZd[k];
+			for (auto t = mLp[k]; t < mLp[k + 1]; ++t)
+			{
+				auto p = posInColumn[mLi[t]];
+				if (p == NONE)
+				{
+					continue;
+				}
+				// Z(i, k) with i = mLi[t] > k contributes to both Z(i, j) and Z(k, j):
+				mZx[p] -= lkj * mZx[t];
+				mZx[q] -= mLx[p] * mZx[t];
+			}
+		}
+		auto zjj = 1 / mD[j];
+		for (auto p = pBegin; p < pEnd; ++p)
+		{
+			zjj -= mLx[p] * mZx[p];
+			posInColumn[mLi[p]] = NONE;
+		}
+		mZd[j] = zjj;
+	}
+}
+
+
+
+
+
+double SparseLdlt::inverseEntry(size_t aRow, size_t aCol) const
+{
+	if (mZd.empty() && (mSize > 0))
+	{
+		throw std::runtime_error("The selected inverse has not been computed.");
+	}
+	if (aRow == aCol)
+	{
+		return mZd[aRow];
+	}
+	auto idx = (aRow > aCol) ? factorEntryIndex(aRow, aCol) : factorEntryIndex(aCol, aRow);
+	if (idx == NONE)
+	{
+		throw std::runtime_error("The inverse entry is not within the pattern of the factor.");
+	}
+	return mZx[idx];
+}
+
+
+
+
+
+size_t SparseLdlt::factorEntryIndex(size_t aRow, size_t aCol) const
+{
+	auto begin = mLi.begin() + static_cast<ptrdiff_t>(mLp[aCol]);
+	auto end = mLi.begin() + static_cast<ptrdiff_t>(mLp[aCol + 1]);
+	auto itr = std::lower_bound(begin, end, aRow);
+	if ((itr == end) || (*itr != aRow))
+	{
+		return NONE;
+	}
+	return static_cast<size_t>(itr - mLi.begin());
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+
+
+
+
+/** Sparse LDL' factorization of a symmetric positive definite matrix (up-looking, after T. A. Davis' LDL).
+The work is split into the symbolic analysis of the sparsity pattern (analyse()), which only needs to be redone
+when the pattern changes, and the numeric factorization (factorize()), which can be repeated for new values.
+The matrix is expected to be already permuted into a fill-reducing order.
+After factorizing, the entries of the inverse within the pattern of L (which includes the pattern of the matrix
+and thus all the diagonal blocks) can be computed by selected inversion, without forming the dense inverse. */
+class SparseLdlt
+{
+public:
+
+	SparseLdlt() = default;
+
+	/** Analyses the sparsity pattern of the matrix of the specified size.
+	aUpperPattern[k] are the row indices i < k of the structurally non-zero entries in the upper triangle of column k.
+	The diagonal is always assumed to be present. Discards any previous factorization. */
+	void analyse(size_t aSize, std::vector<std::vector<size_t>> aUpperPattern);
+
+	/** Returns true if analyse() has been called. */
+	bool isAnalysed() const { return mIsAnalysed; }
+
+	/** Sets all the matrix values to zero, keeping the pattern. */
+	void setZero();
+
+	/** Adds the value to the matrix entry (aRow, aCol) and its symmetric counterpart.
+	The entry must be a part of the analysed pattern. */
+	void add(size_t aRow, size_t aCol, double aValue);
+
+	/** Returns the diagonal entry of the matrix (not of the factorization). */
+	double diagonal(size_t aIdx) const { return mAd[aIdx]; }
+
+	/** Computes the numeric factorization of the current matrix values.
+	Returns false if the matrix is not positive definite (a pivot is not larger than aMinPivot). */
+	bool factorize(double aMinPivot = 0);
+
+	/** Solves the system in-place, using the current factorization. */
+	void solve(std::vector<double> & aRhs) const;
+
+	/** Computes the entries of the inverse within the pattern of L (Takahashi equations), using the current
+	factorization. Afterwards, inverseEntry() may be queried. */
+	void computeSelectedInverse();
+
+	/** Returns the entry of the inverse computed by computeSelectedInverse().
+	The entry must be within the pattern of L (or its transpose). */
+	double inverseEntry(size_t aRow, size_t aCol) const;
+
+	/** Applies the rank-one modification L D L' + aSigma * w w' to the current factorization, where w is a sparse
+	vector given by its indices and values. All the indices must be within a single column's pattern of the matrix
+	(such as the unknowns of a single observation), so that the pattern of L doesn't change.
+	Only the columns along the path in the elimination tree are touched.
+	Returns false if the result is not positive definite; the factorization is then invalid. */
+	bool rankOneUpdate(const std::vector<size_t> & aIndices, const std::vector<double> & aValues, double aSigma);
+
+	/** Copies the matrix values and the numeric factorization from aOther, which must have been analysed for the
+	same pattern, into the already allocated storage. The symbolic analysis is kept, the selected inverse is not
+	copied (it is stale afterwards). */
+	void copyNumericFrom(const SparseLdlt & aOther);
+
+	size_t size() const { return mSize; }
+
+	/** Returns the number of off-diagonal non-zeros in L. */
+	size_t numFactorNonZeros() const { return mLp.empty() ? 0 : mLp.back(); }
+
+
+protected:
+
+	size_t mSize = 0;
+	bool mIsAnalysed = false;
+
+	/** The matrix: its diagonal, and its strictly upper triangle in CSC (row indices ascending within a column). */
+	std::vector<double> mAd;
+	std::vector<size_t> mAp;
+	std::vector<size_t> mAi;
+	std::vector<double> mAx;
+
+	/** The elimination tree (SIZE_MAX for roots). */
+	std::vector<size_t> mParent;
+
+	/** The factor L (strictly lower triangle, CSC, unit diagonal implied) and D. */
+	std::vector<size_t> mLp;
+	std::vector<size_t> mLi;
+	std::vector<double> mLx;
+	std::vector<double> mD;
+
+	/** The selected inverse: its diagonal and the entries in the pattern of L. */
+	std::vector<double> mZd;
+	std::vector<double> mZx;
+
+	/** Scratch space for rankOneUpdate(), kept all-zero between the calls. */
+	std::vector<double> mUpdateWork;
+
+
+	/** Returns the index into mLi / mLx of the entry (aRow, aCol), aRow > aCol, or SIZE_MAX if not in the pattern. */
+	size_t factorEntryIndex(size_t aRow, size_t aCol) const;
+};
@@ -1,59 +1,111 @@
 #include "SpringNet.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <limits>
+#include <numbers>
+#include <numeric>
 #include <stdexcept>
-#include <map>
 
 #include "Geometry.hpp"
+#include "SolverTrace.hpp"
 
 
 
 
 
-///////////////////////////////////////////////////////////////////////////////
-// Spring:
+namespace {
+
+/** The max number of points, and of springs, in a net; the indices referring to them are 32-bit. */
+static const size_t MAX_OBJECTS = std::numeric_limits<uint32_t>::max();
+
+/** The new index of a removed spring, while renumbering the springs. */
+static const size_t REMOVED_SPRING = std::numeric_limits<size_t>::max();
+
+/** The number of cells along each side of the grid that the Hilbert curve passes through. A power of two. */
+static const uint32_t HILBERT_GRID_SIZE = 1u << 16;
+
+/** The Reverse Cuthill-McKee ordering looks for the starting point of each component by this many breadth-first
+searches at most, each one starting from the farthest point of the previous one. */
+static const size_t MAX_PERIPHERAL_SEARCHES = 4;
 
-const Point & Spring::point1() const
+
+
+
+
+/** Returns the distance along the Hilbert curve of the cell at the specified coords of the HILBERT_GRID_SIZE grid. */
+uint64_t hilbertDistance(uint32_t aX, uint32_t aY)
 {
-	return mParentNet.point(mPointIdx1);
+	uint64_t res = 0;
+	for (uint32_t s = HILBERT_GRID_SIZE / 2; s > 0; s /= 2)
+	{
+		uint32_t rx = ((aX & s) != 0) ? 1 : 0;
+		uint32_t ry = ((aY & s) != 0) ? 1 : 0;
+		res += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+
+		// Rotate the quadrant, so that the curve within it has the base orientation:
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				aX = HILBERT_GRID_SIZE - 1 - aX;
+				aY = HILBERT_GRID_SIZE - 1 - aY;
+			}
+			std::swap(aX, aY);
+		}
+	}
+	return res;
 }
 
 
 
 
 
-const Point & Spring::point2() const
+/** Returns the inverse of the specified permutation. */
+std::vector<size_t> invertPermutation(const std::vector<size_t> & aPermutation)
 {
-	return mParentNet.point(mPointIdx2);
+	std::vector<size_t> res(aPermutation.size());
+	auto num = aPermutation.size();
+	for (size_t i = 0; i < num; ++i)
+	{
+		res[aPermutation[i]] = i;
+	}
+	return res;
 }
 
+}  // anonymous namespace
 
 
 
 
-Point & Spring::point1()
+
+///////////////////////////////////////////////////////////////////////////////
+// Spring:
+
+const Point & Spring::point1(const SpringNet & aNet) const
 {
-	return mParentNet.point(mPointIdx1);
+	return aNet.point(mPointIdx1);
 }
 
 
 
 
 
-Point & Spring::point2()
+const Point & Spring::point2(const SpringNet & aNet) const
 {
-	return mParentNet.point(mPointIdx2);
+	return aNet.point(mPointIdx2);
 }
 
 
 
 
 
-double Spring::currentLength() const
+double Spring::currentLength(const SpringNet & aNet) const
 {
-	auto pt1 = point1();
-	auto pt2 = point2();
+	auto pt1 = point1(aNet);
+	auto pt2 = point2(aNet);
 	auto dx = pt1.x() - pt2.x();
 	auto dy = pt1.y() - pt2.y();
 	return std::sqrt(dx * dx + dy * dy);
@@ -63,107 +115,816 @@ double Spring::currentLength() const
 
 
 
-double Spring::diffX() const
+double Spring::diffX(const SpringNet & aNet) const
+{
+	return point1(aNet).x() - point2(aNet).x();
+}
+
+
+
+
+
+double Spring::diffY(const SpringNet & aNet) const
+{
+	return point1(aNet).y() - point2(aNet).y();
+}
+
+
+
+
+
+const Point & Spring::otherPoint(const SpringNet & aNet, size_t aPointIdx) const
+{
+	if (aPointIdx == mPointIdx1)
+	{
+		return point1(aNet);
+	}
+	else
+	{
+		return point2(aNet);
+	}
+}
+
+
+
+
+
+double Spring::projectLengthToFloor(double aLength, double aHeightDifference)
+{
+	assert(aLength > aHeightDifference);
+
+	return std::sqrt(aLength * aLength - aHeightDifference * aHeightDifference);
+}
+
+
+
+
+
+void Spring::projectLengthsToFloor(std::vector<double> & aLengths, const std::vector<double> & aHeightDifferences)
+{
+	assert(aLengths.size() == aHeightDifferences.size());
+
+	auto num = aLengths.size();
+	auto lengths = aLengths.data();
+	auto heightDifferences = aHeightDifferences.data();
+	for (size_t i = 0; i < num; ++i)
+	{
+		lengths[i] = std::sqrt(lengths[i] * lengths[i] - heightDifferences[i] * heightDifferences[i]);
+	}
+}
+
+
+
+
+
+double Spring::distanceSquared(const SpringNet & aNet, QPointF aPt) const
+{
+	return Geometry::distanceSquared(aPt, point1(aNet), point2(aNet));
+}
+
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Angle:
+
+Angle::Angle(const SpringNet & aNet, double aIdealAngle, double aForce, size_t aSpringIdx1, size_t aSpringIdx2):
+	mIdealAngle(aIdealAngle),
+	mForce(aForce),
+	mSpringIdx1(static_cast<uint32_t>(aSpringIdx1)),
+	mSpringIdx2(static_cast<uint32_t>(aSpringIdx2))
+{
+	updatePointIndices(aNet);
+}
+
+
+
+
+
+void Angle::setSpringIndices(const SpringNet & aNet, size_t aSpringIdx1, size_t aSpringIdx2)
+{
+	mSpringIdx1 = static_cast<uint32_t>(aSpringIdx1);
+	mSpringIdx2 = static_cast<uint32_t>(aSpringIdx2);
+	updatePointIndices(aNet);
+}
+
+
+
+
+
+void Angle::updatePointIndices(const SpringNet & aNet)
+{
+	const auto & spring1 = aNet.spring(mSpringIdx1);
+	const auto & spring2 = aNet.spring(mSpringIdx2);
+	uint32_t ends1[2] = {static_cast<uint32_t>(spring1.pointIdx1()), static_cast<uint32_t>(spring1.pointIdx2())};
+	uint32_t ends2[2] = {static_cast<uint32_t>(spring2.pointIdx1()), static_cast<uint32_t>(spring2.pointIdx2())};
+	size_t numShared = 0;
+	for (size_t i = 0; i < 2; ++i)
+	{
+		for (size_t j = 0; j < 2; ++j)
+		{
+			if (ends1[i] == ends2[j])
+			{
+				mStationIdx = ends1[i];
+				mPointIdx1 = ends1[1 - i];
+				mPointIdx2 = ends2[1 - j];
+				numShared += 1;
+			}
+		}
+	}
+	if (numShared != 1)
+	{
+		throw std::runtime_error("The springs of an angle must share exactly one point.");
+	}
+}
+
+
+
+
+
+double Angle::currentAngle(const SpringNet & aNet) const
+{
+	return currentAngle(aNet.point(mStationIdx), aNet.point(mPointIdx1), aNet.point(mPointIdx2));
+}
+
+
+
+
+
+double Angle::currentAngle(QPointF aStation, QPointF aPt1, QPointF aPt2)
+{
+	double angle;
+	QPointF gradients[3];
+	if (!evaluate(aStation, aPt1, aPt2, angle, gradients))
+	{
+		return 0;
+	}
+	return (angle < 0) ? (angle + 2 * std::numbers::pi) : angle;
+}
+
+
+
+
+
+double Angle::armLength(const SpringNet & aNet) const
+{
+	return (aNet.spring(mSpringIdx1).idealLength() + aNet.spring(mSpringIdx2).idealLength()) / 2;
+}
+
+
+
+
+
+QPointF Angle::markerPos(const SpringNet & aNet) const
+{
+	return markerPos(aNet.point(mStationIdx), aNet.point(mPointIdx1), aNet.point(mPointIdx2));
+}
+
+
+
+
+
+QPointF Angle::markerPos(QPointF aStation, QPointF aPt1, QPointF aPt2)
+{
+	auto diff1 = aPt1 - aStation;
+	auto diff2 = aPt2 - aStation;
+	auto radius = std::sqrt(std::min(QPointF::dotProduct(diff1, diff1), QPointF::dotProduct(diff2, diff2))) / 3;
+	auto direction = std::atan2(diff1.y(), diff1.x()) + currentAngle(aStation, aPt1, aPt2) / 2;
+	return aStation + QPointF(std::cos(direction), std::sin(direction)) * radius;
+}
+
+
+
+
+
+bool Angle::evaluate(QPointF aStation, QPointF aPt1, QPointF aPt2, double & aAngle, QPointF (& aGradients)[3])
+{
+	auto diff1 = aPt1 - aStation;
+	auto diff2 = aPt2 - aStation;
+	auto lenSq1 = QPointF::dotProduct(diff1, diff1);
+	auto lenSq2 = QPointF::dotProduct(diff2, diff2);
+	if ((lenSq1 <= 0) || (lenSq2 <= 0))
+	{
+		return false;
+	}
+	aAngle = std::atan2(diff1.x() * diff2.y() - diff1.y() * diff2.x(), QPointF::dotProduct(diff1, diff2));
+
+	// The angle is the difference of the arms' directions; a direction changes by perp(diff) / |diff|^2:
+	aGradients[1] = QPointF(diff1.y(), -diff1.x()) / lenSq1;
+	aGradients[2] = QPointF(-diff2.y(), diff2.x()) / lenSq2;
+	aGradients[0] = -(aGradients[1] + aGradients[2]);
+	return true;
+}
+
+
+
+
+
+double Angle::angleError(double aIdealAngle, double aCurrentAngle)
+{
+	auto res = std::remainder(aIdealAngle - aCurrentAngle, 2 * std::numbers::pi);
+	return (res <= -std::numbers::pi) ? (res + 2 * std::numbers::pi) : res;
+}
+
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SpringNet:
+
+SpringNet::SpringNet():
+	mParamsVersion(nextVersion()),
+	mGeometryVersion(nextVersion())
+{
+	topologyChanged();
+}
+
+
+
+
+
+SpringNet::MemoryUsage SpringNet::memoryUsage() const
+{
+	MemoryUsage res;
+	res.mPoints = (
+		mPoints.capacity() * sizeof(Point) +
+		(mIsFixed.capacity() + 7) / 8 +
+		(mIsPinned.capacity() + 7) / 8
+	);
+	res.mSprings = mSprings.capacity() * sizeof(Spring);
+	res.mAngles = mAngles.capacity() * sizeof(Angle);
+	return res;
+}
+
+
+
+
+
+void SpringNet::reservePoints(size_t aNumPoints)
+{
+	mPoints.reserve(aNumPoints);
+	mIsFixed.reserve(aNumPoints);
+	mIsPinned.reserve(aNumPoints);
+}
+
+
+
+
+
+void SpringNet::reserveSprings(size_t aNumSprings)
+{
+	mSprings.reserve(aNumSprings);
+}
+
+
+
+
+
+void SpringNet::reserveAngles(size_t aNumAngles)
+{
+	mAngles.reserve(aNumAngles);
+}
+
+
+
+
+
+void SpringNet::addPoint(QPointF aPos, bool aIsFixed)
+{
+	if (mPoints.size() >= MAX_OBJECTS)
+	{
+		throw std::runtime_error("Too many points.");
+	}
+	mPoints.emplace_back(aPos);
+	mIsFixed.push_back(aIsFixed);
+	mIsPinned.push_back(false);
+	topologyChanged();
+}
+
+
+
+
+
+void SpringNet::addSpring(double aIdealLength, double aForce, size_t aPointIdx1, size_t aPointIdx2)
+{
+	if ((aPointIdx1 >= mPoints.size()) || (aPointIdx2 >= mPoints.size()))
+	{
+		throw std::runtime_error("Point index out of bounds.");
+	}
+	if (mSprings.size() >= MAX_OBJECTS)
+	{
+		throw std::runtime_error("Too many springs.");
+	}
+	mSprings.emplace_back(aIdealLength, aForce, aPointIdx1, aPointIdx2);
+	topologyChanged();
+}
+
+
+
+
+
+void SpringNet::addBulk(const Bulk & aBulk)
+{
+	auto numNewPoints = aBulk.mPoints.size();
+	if (aBulk.mIsFixed.size() != numNewPoints)
+	{
+		throw std::runtime_error("The bulk's points and fixed flags differ in count.");
+	}
+	if (numNewPoints > MAX_OBJECTS - mPoints.size())
+	{
+		throw std::runtime_error("Too many points.");
+	}
+	if (aBulk.mSprings.size() > MAX_OBJECTS - mSprings.size())
+	{
+		throw std::runtime_error("Too many springs.");
+	}
+	for (const auto & s: aBulk.mSprings)
+	{
+		if ((s.pointIdx1() >= numNewPoints) || (s.pointIdx2() >= numNewPoints))
+		{
+			throw std::runtime_error("Point index out of bounds.");
+		}
+	}
+
+	auto firstNewPointIdx = mPoints.size();
+	mPoints.insert(mPoints.end(), aBulk.mPoints.begin(), aBulk.mPoints.end());
+	mIsFixed.insert(mIsFixed.end(), aBulk.mIsFixed.begin(), aBulk.mIsFixed.end());
+	mIsPinned.resize(mPoints.size(), false);
+	mSprings.reserve(mSprings.size() + aBulk.mSprings.size());
+	for (const auto & s: aBulk.mSprings)
+	{
+		mSprings.emplace_back(
+			s.idealLength(), s.force(),
+			firstNewPointIdx + s.pointIdx1(),
+			firstNewPointIdx + s.pointIdx2()
+		);
+	}
+	topologyChanged();
+}
+
+
+
+
+
+void SpringNet::addAngle(double aIdealAngle, double aForce, size_t aSpringIdx1, size_t aSpringIdx2)
+{
+	if ((aSpringIdx1 >= mSprings.size()) || (aSpringIdx2 >= mSprings.size()))
+	{
+		throw std::runtime_error("Spring index out of bounds.");
+	}
+	mAngles.emplace_back(*this, aIdealAngle, aForce, aSpringIdx1, aSpringIdx2);
+	topologyChanged();
+}
+
+
+
+
+
+void SpringNet::setPointPos(size_t aIdx, QPointF aPos)
+{
+	mPoints[aIdx].set(aPos);
+	mGeometryVersion = nextVersion();
+}
+
+
+
+
+
+void SpringNet::setSpringParams(size_t aIdx, double aIdealLength, double aForce)
+{
+	auto & spring = mSprings[aIdx];
+	spring.setIdealLength(aIdealLength);
+	spring.setForce(aForce);
+	mParamsVersion = nextVersion();
+}
+
+
+
+
+
+void SpringNet::setAngleParams(size_t aIdx, double aIdealAngle, double aForce)
+{
+	auto & angle = mAngles[aIdx];
+	angle.setIdealAngle(aIdealAngle);
+	angle.setForce(aForce);
+	mParamsVersion = nextVersion();
+}
+
+
+
+
+
+size_t SpringNet::nearestPointIdx(QPointF aQueryPt)
+{
+	if (mPoints.empty())
+	{
+		throw std::runtime_error("No points to query");
+	}
+	auto num = mPoints.size();
+	auto res = 0;
+	auto minDist = Geometry::distanceSquared(mPoints[0], aQueryPt);
+	for (size_t idx = 1; idx < num; ++idx)
+	{
+		auto dist = Geometry::distanceSquared(mPoints[idx], aQueryPt);
+		if (dist < minDist)
+		{
+			minDist = dist;
+			res = idx;
+		}
+	}
+	return res;
+}
+
+
+
+
+
+size_t SpringNet::nearestSpringIdx(QPointF aQueryPt)
+{
+	if (mSprings.empty())
+	{
+		throw std::runtime_error("No springs to query");
+	}
+	auto num = mSprings.size();
+	auto res = 0;
+	auto minDist = mSprings[0].distanceSquared(*this, aQueryPt);
+	for (size_t idx = 1; idx < num; ++idx)
+	{
+		auto dist = mSprings[idx].distanceSquared(*this, aQueryPt);
+		if (dist < minDist)
+		{
+			minDist = dist;
+			res = idx;
+		}
+	}
+	return res;
+}
+
+
+
+
+
+void SpringNet::clear()
+{
+	mAngles.clear();
+	mSprings.clear();
+	mPoints.clear();
+	mIsFixed.clear();
+	mIsPinned.clear();
+	topologyChanged();
+}
+
+
+
+
+
+double SpringNet::adjust()
+{
+	auto adjacency = buildAdjacency();
+	std::vector<size_t> ptIndices;
+	auto numP = mPoints.size();
+	ptIndices.reserve(numP);
+	for (size_t idx = 0; idx < numP; ++idx)
+	{
+		if (adjacency.numSpringsAt(idx) > 0)
+		{
+			ptIndices.push_back(idx);
+		}
+	}
+	return adjustPoints(ptIndices, adjacency);
+}
+
+
+
+
+
+double SpringNet::adjustPoints(const std::vector<size_t> & aPtIndices, const Adjacency & aAdjacency)
+{
+	TRACE_SCOPE("adjustPoints");
+	TRACE_COUNTER("pointsTouched", aPtIndices.size());
+	mGeometryVersion = nextVersion();
+	double maxDistSq = 0;
+	for (const auto ptIdx: aPtIndices)
+	{
+		if (isPointImmovable(ptIdx))
+		{
+			continue;
+		}
+		auto & pt = mPoints[ptIdx];
+		auto newPos = adjustedPosition(ptIdx, aAdjacency);
+		maxDistSq = std::max(maxDistSq, Geometry::distanceSquared(pt, newPos));
+		pt.set(newPos);
+	}
+	return std::sqrt(maxDistSq);
+}
+
+
+
+
+
+SpringNet::DragRegion SpringNet::dragRegion(size_t aCenterPtIdx, size_t aRingSize) const
 {
-	return point1().x() - point2().x();
+	DragRegion res;
+	res.mCenterPtIdx = aCenterPtIdx;
+	res.mAdjacency = buildAdjacency();
+	res.mPtIndices = pointsWithinRing(aCenterPtIdx, aRingSize, res.mAdjacency);
+	std::erase(res.mPtIndices, aCenterPtIdx);
+	return res;
 }
 
 
 
 
 
-double Spring::diffY() const
+size_t SpringNet::adjustLocal(const DragRegion & aRegion, double aTolerance, std::chrono::microseconds aBudget)
 {
-	return point1().y() - point2().y();
+	auto startTime = std::chrono::steady_clock::now();
+
+	// Hold the center point in place, so that its neighbors treat it as fixed:
+	auto wasPinned = mIsPinned[aRegion.mCenterPtIdx];
+	mIsPinned[aRegion.mCenterPtIdx] = true;
+	size_t numRounds = 0;
+	double lastMove;
+	do
+	{
+		lastMove = adjustPoints(aRegion.mPtIndices, aRegion.mAdjacency);
+		numRounds += 1;
+	} while ((lastMove > aTolerance) && (std::chrono::steady_clock::now() - startTime < aBudget));
+	mIsPinned[aRegion.mCenterPtIdx] = wasPinned;
+	return numRounds;
 }
 
 
 
 
 
-const Point & Spring::otherPoint(size_t aPointIdx) const
+SpringNet::LocalAdjustment SpringNet::adjustAround(
+	const std::vector<size_t> & aPtIndices,
+	size_t aRingSize,
+	double aTolerance,
+	std::chrono::microseconds aBudget
+)
 {
-	if (aPointIdx == mPointIdx1)
+	auto startTime = std::chrono::steady_clock::now();
+	auto adjacency = buildAdjacency();
+	auto ptIndices = pointsWithinRing(aPtIndices, aRingSize, adjacency);
+
+	// Remember where the region's edge points started:
+	std::vector<bool> isInRegion(mPoints.size(), false);
+	for (auto ptIdx: ptIndices)
 	{
-		return point1();
+		isInRegion[ptIdx] = true;
 	}
-	else
+	std::vector<std::pair<size_t, QPointF>> edgeStarts;
+	for (auto ptIdx: ptIndices)
+	{
+		for (auto itr = adjacency.springsBegin(ptIdx), end = adjacency.springsEnd(ptIdx); itr != end; ++itr)
+		{
+			const auto & spring = mSprings[*itr];
+			auto otherIdx = (spring.pointIdx1() == ptIdx) ? spring.pointIdx2() : spring.pointIdx1();
+			if (!isInRegion[otherIdx])
+			{
+				edgeStarts.emplace_back(ptIdx, mPoints[ptIdx]);
+				break;
+			}
+		}
+	}
+
+	LocalAdjustment res;
+	do
 	{
-		return point2();
+		res.mLastMove = adjustPoints(ptIndices, adjacency);
+	} while ((res.mLastMove > aTolerance) && (std::chrono::steady_clock::now() - startTime < aBudget));
+	for (const auto & [ptIdx, startPos]: edgeStarts)
+	{
+		res.mEdgeMove = std::max(res.mEdgeMove, std::sqrt(Geometry::distanceSquared(mPoints[ptIdx], startPos)));
 	}
+	return res;
 }
 
 
 
 
 
-double Spring::projectLengthToFloor(double aLength, double aHeightDifference)
+std::vector<QPointF> SpringNet::positions() const
 {
-	assert(aLength > aHeightDifference);
-
-	return std::sqrt(aLength * aLength - aHeightDifference * aHeightDifference);
+	std::vector<QPointF> res;
+	res.reserve(mPoints.size());
+	for (const auto & p: mPoints)
+	{
+		res.emplace_back(p.x(), p.y());
+	}
+	return res;
 }
 
 
 
 
 
-double Spring::distanceSquared(QPointF aPt)
+void SpringNet::setPositions(const std::vector<QPointF> & aPositions)
 {
-	return Geometry::distanceSquared(aPt, point1(), point2());
+	TRACE_SCOPE("positionWriteBack");
+	assert(aPositions.size() == mPoints.size());
+	auto numP = mPoints.size();
+	for (size_t idx = 0; idx < numP; ++idx)
+	{
+		mPoints[idx].set(aPositions[idx]);
+	}
+	mGeometryVersion = nextVersion();
 }
 
 
 
 
 
-///////////////////////////////////////////////////////////////////////////////
-// SpringNet:
-
-SpringNet::SpringNet()
+void SpringNet::computeDisplacements(const std::vector<QPointF> & aPositions, std::vector<QPointF> & aDisplacements) const
 {
+	TRACE_SCOPE("forceEvaluation");
+	TRACE_COUNTER("springsTouched", mSprings.size());
+	assert(aPositions.size() == mPoints.size());
+	auto numP = mPoints.size();
+	aDisplacements.assign(numP, QPointF(0, 0));
+	std::vector<unsigned> numConstraints(numP, 0);
+	for (const auto & s: mSprings)
+	{
+		auto idx1 = s.pointIdx1();
+		auto idx2 = s.pointIdx2();
+		auto diff = aPositions[idx1] - aPositions[idx2];
+		auto currentLength = std::sqrt(QPointF::dotProduct(diff, diff));
+		auto move = diff * ((s.idealLength() - currentLength) * s.force() / s.idealLength());
+		auto isMovable1 = !isPointImmovable(idx1);
+		auto isMovable2 = !isPointImmovable(idx2);
+
+		// For movable points divide the difference between the two points:
+		if (isMovable1 && isMovable2)
+		{
+			move /= 2;
+		}
+		aDisplacements[idx1] += move;
+		aDisplacements[idx2] -= move;
+		numConstraints[idx1] += 1;
+		numConstraints[idx2] += 1;
+	}
+
+	// Each angle moves its movable points along the angle's gradient, by the smallest move that corrects
+	// the (linearized) angle error; same as a spring divides its correction between its points:
+	for (const auto & a: mAngles)
+	{
+		size_t indices[3] = {a.stationIdx(), a.pointIdx1(), a.pointIdx2()};
+		double currentAngle;
+		QPointF gradients[3];
+		if (!Angle::evaluate(aPositions[indices[0]], aPositions[indices[1]], aPositions[indices[2]], currentAngle, gradients))
+		{
+			continue;
+		}
+		double gradientSq = 0;
+		for (size_t i = 0; i < 3; ++i)
+		{
+			if (!isPointImmovable(indices[i]))
+			{
+				gradientSq += QPointF::dotProduct(gradients[i], gradients[i]);
+			}
+		}
+		if (gradientSq <= 0)
+		{
+			continue;
+		}
+		auto factor = Angle::angleError(a.idealAngle(), currentAngle) * a.force() / gradientSq;
+		for (size_t i = 0; i < 3; ++i)
+		{
+			aDisplacements[indices[i]] += gradients[i] * factor;
+			numConstraints[indices[i]] += 1;
+		}
+	}
 
+	// All springs and angles are applied simultaneously, so average them to avoid overshooting:
+	for (size_t idx = 0; idx < numP; ++idx)
+	{
+		if (isPointImmovable(idx) || (numConstraints[idx] == 0))
+		{
+			aDisplacements[idx] = QPointF(0, 0);
+		}
+		else
+		{
+			aDisplacements[idx] /= numConstraints[idx];
+		}
+	}
 }
 
 
 
 
 
-void SpringNet::addPoint(QPointF aPos, bool aIsFixed)
+double SpringNet::residual(const std::vector<QPointF> & aPositions) const
 {
-	mPoints.push_back(std::make_shared<Point>(aPos, aIsFixed));
+	if (mSprings.empty())
+	{
+		return 0;
+	}
+	double sum = 0;
+	for (const auto & s: mSprings)
+	{
+		auto diff = aPositions[s.pointIdx1()] - aPositions[s.pointIdx2()];
+		auto lenDif = std::sqrt(QPointF::dotProduct(diff, diff)) - s.idealLength();
+		sum += s.force() * lenDif * lenDif;
+	}
+	for (const auto & a: mAngles)
+	{
+		double currentAngle;
+		QPointF gradients[3];
+		if (!Angle::evaluate(aPositions[a.stationIdx()], aPositions[a.pointIdx1()], aPositions[a.pointIdx2()], currentAngle, gradients))
+		{
+			continue;
+		}
+		auto arcDif = Angle::angleError(a.idealAngle(), currentAngle) * a.armLength(*this);
+		sum += a.force() * arcDif * arcDif;
+	}
+	return std::sqrt(sum / static_cast<double>(mSprings.size() + mAngles.size()));
 }
 
 
 
 
 
-void SpringNet::addSpring(double aIdealLength, double aForce, size_t aPointIdx1, size_t aPointIdx2)
+uint64_t SpringNet::topologyHash() const
 {
-	mSprings.push_back(std::make_shared<Spring>(*this, aIdealLength, aForce, aPointIdx1, aPointIdx2));
+	// 64-bit FNV-1a over the indices:
+	uint64_t hash = 0xcbf29ce484222325ull;
+	auto add = [&hash](uint64_t aValue)
+	{
+		for (int i = 0; i < 8; ++i)
+		{
+			hash = (hash ^ ((aValue >> (8 * i)) & 0xff)) * 0x100000001b3ull;
+		}
+	};
+	add(mPoints.size());
+	add(mSprings.size());
+	for (const auto & s: mSprings)
+	{
+		add(s.pointIdx1());
+		add(s.pointIdx2());
+	}
+	add(mAngles.size());
+	for (const auto & a: mAngles)
+	{
+		add(a.springIdx1());
+		add(a.springIdx2());
+	}
+	return hash;
 }
 
 
 
 
 
-size_t SpringNet::nearestPointIdx(QPointF aQueryPt)
+SpringNet::Adjacency SpringNet::buildAdjacency() const
 {
-	if (mPoints.empty())
+	TRACE_SCOPE("adjacencyBuild");
+	Adjacency res;
+	auto numP = mPoints.size();
+	res.mOffsets.assign(numP + 1, 0);
+	for (const auto & s: mSprings)
 	{
-		throw std::runtime_error("No points to query");
+		res.mOffsets[s.pointIdx1() + 1] += 1;
+		res.mOffsets[s.pointIdx2() + 1] += 1;
 	}
-	auto num = mPoints.size();
-	auto res = 0;
-	auto minDist = Geometry::distanceSquared(*mPoints[0], aQueryPt);
-	for (size_t idx = 1; idx < num; ++idx)
+	for (size_t idx = 0; idx < numP; ++idx)
 	{
-		auto dist = Geometry::distanceSquared(*mPoints[idx], aQueryPt);
-		if (dist < minDist)
-		{
-			minDist = dist;
-			res = idx;
-		}
+		res.mOffsets[idx + 1] += res.mOffsets[idx];
+	}
+	res.mSpringIndices.resize(res.mOffsets[numP]);
+	auto fill = res.mOffsets;
+	auto numS = mSprings.size();
+	for (size_t idx = 0; idx < numS; ++idx)
+	{
+		const auto & s = mSprings[idx];
+		res.mSpringIndices[fill[s.pointIdx1()]++] = idx;
+		res.mSpringIndices[fill[s.pointIdx2()]++] = idx;
+	}
+
+	// The angles, the same way:
+	res.mAngleOffsets.assign(numP + 1, 0);
+	for (const auto & a: mAngles)
+	{
+		res.mAngleOffsets[a.stationIdx() + 1] += 1;
+		res.mAngleOffsets[a.pointIdx1() + 1] += 1;
+		res.mAngleOffsets[a.pointIdx2() + 1] += 1;
+	}
+	for (size_t idx = 0; idx < numP; ++idx)
+	{
+		res.mAngleOffsets[idx + 1] += res.mAngleOffsets[idx];
+	}
+	res.mAngleIndices.resize(res.mAngleOffsets[numP]);
+	fill = res.mAngleOffsets;
+	auto numA = mAngles.size();
+	for (size_t idx = 0; idx < numA; ++idx)
+	{
+		const auto & a = mAngles[idx];
+		res.mAngleIndices[fill[a.stationIdx()]++] = idx;
+		res.mAngleIndices[fill[a.pointIdx1()]++] = idx;
+		res.mAngleIndices[fill[a.pointIdx2()]++] = idx;
 	}
 	return res;
 }
@@ -172,23 +933,56 @@ size_t SpringNet::nearestPointIdx(QPointF aQueryPt)
 
 
 
-size_t SpringNet::nearestSpringIdx(QPointF aQueryPt)
+std::vector<size_t> SpringNet::pointsWithinRing(size_t aPtIdx, size_t aRingSize, const Adjacency & aAdjacency) const
 {
-	if (mSprings.empty())
+	return pointsWithinRing(std::vector<size_t>{aPtIdx}, aRingSize, aAdjacency);
+}
+
+
+
+
+
+std::vector<size_t> SpringNet::pointsWithinRing(
+	const std::vector<size_t> & aPtIndices,
+	size_t aRingSize,
+	const Adjacency & aAdjacency
+) const
+{
+	// Breadth-first search from all the points at once, one ring at a time:
+	std::vector<bool> isVisited(mPoints.size(), false);
+	std::vector<size_t> res;
+	for (auto ptIdx: aPtIndices)
 	{
-		throw std::runtime_error("No springs to query");
+		if (!isVisited[ptIdx])
+		{
+			isVisited[ptIdx] = true;
+			res.push_back(ptIdx);
+		}
 	}
-	auto num = mSprings.size();
-	auto res = 0;
-	auto minDist = mSprings[0]->distanceSquared(aQueryPt);
-	for (size_t idx = 1; idx < num; ++idx)
+	size_t ringStart = 0;
+	for (size_t ring = 0; ring < aRingSize; ++ring)
 	{
-		auto dist = mSprings[idx]->distanceSquared(aQueryPt);
-		if (dist < minDist)
+		auto ringEnd = res.size();
+		for (size_t i = ringStart; i < ringEnd; ++i)
 		{
-			minDist = dist;
-			res = idx;
+			auto ptIdx = res[i];
+			for (auto itr = aAdjacency.springsBegin(ptIdx), end = aAdjacency.springsEnd(ptIdx); itr != end; ++itr)
+			{
+				const auto & spring = mSprings[*itr];
+				auto otherIdx = (spring.pointIdx1() == ptIdx) ? spring.pointIdx2() : spring.pointIdx1();
+				if (!isVisited[otherIdx])
+				{
+					isVisited[otherIdx] = true;
+					res.push_back(otherIdx);
+				}
+			}
+		}
+		if (ringEnd == res.size())
+		{
+			// No new points, the whole component has been reached
+			break;
 		}
+		ringStart = ringEnd;
 	}
 	return res;
 }
@@ -197,63 +991,105 @@ size_t SpringNet::nearestSpringIdx(QPointF aQueryPt)
 
 
 
-void SpringNet::clear()
+void SpringNet::unpinAllPoints()
 {
-	mSprings.clear();
-	mPoints.clear();
+	std::fill(mIsPinned.begin(), mIsPinned.end(), false);
 }
 
 
 
 
 
-void SpringNet::adjust()
+uint64_t SpringNet::nextVersion()
 {
-	std::map<size_t, std::vector<size_t>> springsAtPoints;  // ptIDx -> [springIdx, ...]
-	auto numS = mSprings.size();
-	for (size_t idx = 0; idx < numS; ++idx)
+	static std::atomic<uint64_t> lastVersion(0);
+	return ++lastVersion;
+}
+
+
+
+
+
+void SpringNet::topologyChanged()
+{
+	mTopologyVersion = nextVersion();
+}
+
+
+
+
+
+QPointF SpringNet::adjustedPosition(size_t aPtIdx, const Adjacency & aAdjacency) const
+{
+	const auto & pt = mPoints[aPtIdx];
+	double nx = pt.x(), ny = pt.y();
+	for (auto itr = aAdjacency.springsBegin(aPtIdx), end = aAdjacency.springsEnd(aPtIdx); itr != end; ++itr)
 	{
-		const auto & s = mSprings[idx];
-		springsAtPoints[s->pointIdx1()].push_back(idx);
-		springsAtPoints[s->pointIdx2()].push_back(idx);
+		const auto & spring = mSprings[*itr];
+		auto lenDif = spring.idealLength() - spring.currentLength(*this);
+		// For movable points divide the difference between the two points:
+		auto otherIdx = (spring.pointIdx1() == aPtIdx) ? spring.pointIdx2() : spring.pointIdx1();
+		if (!isPointImmovable(otherIdx))
+		{
+			lenDif = lenDif / 2;
+		}
+
+		if (spring.pointIdx1() != aPtIdx)
+		{
+			lenDif = -lenDif;
+		}
+		nx += spring.diffX(*this) * lenDif * spring.force() / spring.idealLength();
+		ny += spring.diffY(*this) * lenDif * spring.force() / spring.idealLength();
 	}
 
-	auto newPoints = mPoints;
-	for (const auto & s: springsAtPoints)
+	// The angles move the point by its share of the angle's correction, same as in computeDisplacements():
+	for (auto itr = aAdjacency.anglesBegin(aPtIdx), end = aAdjacency.anglesEnd(aPtIdx); itr != end; ++itr)
 	{
-		auto ptIdx = s.first;
-		const auto & pt = mPoints[ptIdx];
-		if (pt->isFixed())
+		const auto & angle = mAngles[*itr];
+		size_t indices[3] = {angle.stationIdx(), angle.pointIdx1(), angle.pointIdx2()};
+		double currentAngle;
+		QPointF gradients[3];
+		if (!Angle::evaluate(mPoints[indices[0]], mPoints[indices[1]], mPoints[indices[2]], currentAngle, gradients))
 		{
 			continue;
 		}
-
-		double nx = pt->x(), ny = pt->y();
-		for (const auto sIdx: s.second)
+		double gradientSq = 0;
+		QPointF gradient;
+		for (size_t i = 0; i < 3; ++i)
 		{
-			const auto & spring = mSprings[sIdx];
-			auto lenDif = spring->idealLength() - spring->currentLength();
-			// For movable points divide the difference between the two points:
-			if (!spring->otherPoint(ptIdx).isFixed())
+			if (indices[i] == aPtIdx)
 			{
-				lenDif = lenDif / 2;
+				gradient = gradients[i];
 			}
-
-			if (spring->pointIdx1() != ptIdx)
+			if (!isPointImmovable(indices[i]) || (indices[i] == aPtIdx))
 			{
-				lenDif = -lenDif;
+				gradientSq += QPointF::dotProduct(gradients[i], gradients[i]);
 			}
-			nx += spring->diffX() * lenDif * spring->force() / spring->idealLength();
-			ny += spring->diffY() * lenDif * spring->force() / spring->idealLength();
 		}
-		newPoints[ptIdx]->set(nx, ny);
+		if (gradientSq <= 0)
+		{
+			continue;
+		}
+		auto move = gradient * (Angle::angleError(angle.idealAngle(), currentAngle) * angle.force() / gradientSq);
+		nx += move.x();
+		ny += move.y();
+	}
+
+	// Average the corrections, same as computeDisplacements() does; their plain sum overshoots, and whether the sweep
+	// diverges then depends on the order of the points:
+	auto numConstraints = aAdjacency.numSpringsAt(aPtIdx) + aAdjacency.numAnglesAt(aPtIdx);
+	if (numConstraints > 1)
+	{
+		nx = pt.x() + (nx - pt.x()) / static_cast<double>(numConstraints);
+		ny = pt.y() + (ny - pt.y()) / static_cast<double>(numConstraints);
 	}
-	mPoints = newPoints;
+	return {nx, ny};
 }
 
 
 
 
+
 std::pair<bool, size_t> SpringNet::snapToPoint(QPointF aQueryPt, double aPointSnapDistSq)
 {
 	if (mPoints.empty())
@@ -281,13 +1117,23 @@ std::pair<SpringNet::ObjectType, size_t> SpringNet::nearestObject(QPointF aScene
 	{
 		return {ObjectType::Point, ptIdx};
 	}
-	auto ptDistSq = Geometry::distanceSquared(aScenePos, *mPoints[ptIdx]);
+	auto ptDistSq = Geometry::distanceSquared(aScenePos, mPoints[ptIdx]);
 	auto springIdx = nearestSpringIdx(aScenePos);
-	auto springDistSq = Geometry::distanceSquared(aScenePos, mSprings[springIdx]->point1(), mSprings[springIdx]->point2());
+	auto springDistSq = Geometry::distanceSquared(aScenePos, mSprings[springIdx].point1(*this), mSprings[springIdx].point2(*this));
 	if (ptDistSq < aSnapDistSq)
 	{
 		return {ObjectType::Point, ptIdx};
 	}
+
+	// The angles can only be picked by their marker:
+	auto numA = mAngles.size();
+	for (size_t idx = 0; idx < numA; ++idx)
+	{
+		if (Geometry::distanceSquared(aScenePos, mAngles[idx].markerPos(*this)) < aSnapDistSq)
+		{
+			return {ObjectType::Angle, idx};
+		}
+	}
 	if (springDistSq < aSnapDistSq)
 	{
 		return {ObjectType::Spring, springIdx};
@@ -315,27 +1161,35 @@ void SpringNet::removePoint(size_t aIdx)
 	}
 
 	// Remove all springs connected to the point:
-	std::erase_if(mSprings, [aIdx](const SpringPtr & aSpring)
+	removeSpringsIf([this, aIdx](size_t aSpringIdx)
 		{
-			return ((aSpring->pointIdx1() == aIdx) || (aSpring->pointIdx2() == aIdx));
+			const auto & spring = mSprings[aSpringIdx];
+			return ((spring.pointIdx1() == aIdx) || (spring.pointIdx2() == aIdx));
 		}
 	);
 
 	// Shift down all point indices within springs:
 	for (auto & spring: mSprings)
 	{
-		if (spring->pointIdx1() > aIdx)
+		if (spring.pointIdx1() > aIdx)
 		{
-			spring->setPointIdx1(spring->pointIdx1() - 1);
+			spring.setPointIdx1(spring.pointIdx1() - 1);
 		}
-		if (spring->pointIdx2() > aIdx)
+		if (spring.pointIdx2() > aIdx)
 		{
-			spring->setPointIdx2(spring->pointIdx2() - 1);
+			spring.setPointIdx2(spring.pointIdx2() - 1);
 		}
 	}
+	for (auto & angle: mAngles)
+	{
+		angle.updatePointIndices(*this);
+	}
 
 	// Remove the point:
 	mPoints.erase(mPoints.begin() + aIdx);
+	mIsFixed.erase(mIsFixed.begin() + aIdx);
+	mIsPinned.erase(mIsPinned.begin() + aIdx);
+	topologyChanged();
 }
 
 
@@ -348,5 +1202,271 @@ void SpringNet::removeSpring(size_t aIdx)
 	{
 		throw std::runtime_error("Spring index out of bounds.");
 	}
-	mSprings.erase(mSprings.begin() + aIdx);
+	removeSpringsIf([aIdx](size_t aSpringIdx)
+		{
+			return (aSpringIdx == aIdx);
+		}
+	);
+	topologyChanged();
+}
+
+
+
+
+
+void SpringNet::removeAngle(size_t aIdx)
+{
+	if (aIdx >= mAngles.size())
+	{
+		throw std::runtime_error("Angle index out of bounds.");
+	}
+	mAngles.erase(mAngles.begin() + static_cast<ptrdiff_t>(aIdx));
+	topologyChanged();
+}
+
+
+
+
+
+SpringNet::Reordering SpringNet::reorder(PointOrdering aOrdering)
+{
+	TRACE_SCOPE("reorder");
+	Reordering res;
+	switch (aOrdering)
+	{
+		case PointOrdering::ReverseCuthillMcKee: res.mPointNewToOld = reverseCuthillMcKeeOrder(); break;
+		case PointOrdering::Hilbert:             res.mPointNewToOld = hilbertOrder(); break;
+	}
+	res.mPointOldToNew = invertPermutation(res.mPointNewToOld);
+
+	// Points:
+	auto numP = mPoints.size();
+	std::vector<Point> points;
+	points.reserve(numP);
+	std::vector<bool> isFixed(numP);
+	std::vector<bool> isPinned(numP);
+	for (size_t idx = 0; idx < numP; ++idx)
+	{
+		auto oldIdx = res.mPointNewToOld[idx];
+		points.push_back(mPoints[oldIdx]);
+		isFixed[idx] = mIsFixed[oldIdx];
+		isPinned[idx] = mIsPinned[oldIdx];
+	}
+	mPoints.swap(points);
+	mIsFixed.swap(isFixed);
+	mIsPinned.swap(isPinned);
+
+	// Springs, by their (new) lower point index, then the higher one:
+	auto numS = mSprings.size();
+	std::vector<std::pair<std::pair<size_t, size_t>, size_t>> springKeys;
+	springKeys.reserve(numS);
+	for (size_t idx = 0; idx < numS; ++idx)
+	{
+		auto ptIdx1 = res.mPointOldToNew[mSprings[idx].pointIdx1()];
+		auto ptIdx2 = res.mPointOldToNew[mSprings[idx].pointIdx2()];
+		springKeys.push_back({{std::min(ptIdx1, ptIdx2), std::max(ptIdx1, ptIdx2)}, idx});
+	}
+	std::sort(springKeys.begin(), springKeys.end());
+	std::vector<Spring> springs;
+	springs.reserve(numS);
+	res.mSpringNewToOld.reserve(numS);
+	for (const auto & key: springKeys)
+	{
+		auto & s = springs.emplace_back(mSprings[key.second]);
+		s.setPointIdx1(res.mPointOldToNew[s.pointIdx1()]);
+		s.setPointIdx2(res.mPointOldToNew[s.pointIdx2()]);
+		res.mSpringNewToOld.push_back(key.second);
+	}
+	res.mSpringOldToNew = invertPermutation(res.mSpringNewToOld);
+	mSprings.swap(springs);
+
+	// Angles, by their (new) station:
+	auto numA = mAngles.size();
+	std::vector<std::pair<size_t, size_t>> angleKeys;
+	angleKeys.reserve(numA);
+	for (size_t idx = 0; idx < numA; ++idx)
+	{
+		angleKeys.emplace_back(res.mPointOldToNew[mAngles[idx].stationIdx()], idx);
+	}
+	std::sort(angleKeys.begin(), angleKeys.end());
+	std::vector<Angle> angles;
+	angles.reserve(numA);
+	res.mAngleNewToOld.reserve(numA);
+	for (const auto & key: angleKeys)
+	{
+		auto & a = angles.emplace_back(mAngles[key.second]);
+		a.setSpringIndices(*this, res.mSpringOldToNew[a.springIdx1()], res.mSpringOldToNew[a.springIdx2()]);
+		res.mAngleNewToOld.push_back(key.second);
+	}
+	res.mAngleOldToNew = invertPermutation(res.mAngleNewToOld);
+	mAngles.swap(angles);
+
+	// Both the indices and the order of the positions have changed:
+	topologyChanged();
+	mGeometryVersion = nextVersion();
+	return res;
+}
+
+
+
+
+
+std::vector<size_t> SpringNet::reverseCuthillMcKeeOrder() const
+{
+	auto adjacency = buildAdjacency();
+	auto numP = mPoints.size();
+	auto otherPoint = [this](size_t aPtIdx, size_t aSpringIdx)
+	{
+		const auto & spring = mSprings[aSpringIdx];
+		return (spring.pointIdx1() == aPtIdx) ? spring.pointIdx2() : spring.pointIdx1();
+	};
+
+	// Appends the points of aStart's component that are not yet visited to aOrder, breadth-first, the neighbors of
+	// each point by increasing degree (Cuthill-McKee).
+	// Each search marks the points it visits with its own mark; mark 1 is reserved for the points already in the result.
+	std::vector<size_t> visitMark(numP, 0);
+	size_t lastMark = 1;
+	std::vector<size_t> neighbors;
+	auto breadthFirst = [&](size_t aStart, std::vector<size_t> & aOrder)
+	{
+		auto mark = ++lastMark;
+		auto begin = aOrder.size();
+		aOrder.push_back(aStart);
+		visitMark[aStart] = mark;
+		for (auto i = begin; i < aOrder.size(); ++i)
+		{
+			auto ptIdx = aOrder[i];
+			neighbors.clear();
+			for (auto itr = adjacency.springsBegin(ptIdx), end = adjacency.springsEnd(ptIdx); itr != end; ++itr)
+			{
+				auto otherIdx = otherPoint(ptIdx, *itr);
+				if ((visitMark[otherIdx] != mark) && (visitMark[otherIdx] != 1))
+				{
+					visitMark[otherIdx] = mark;
+					neighbors.push_back(otherIdx);
+				}
+			}
+			std::sort(neighbors.begin(), neighbors.end(),
+				[&adjacency](size_t aPtIdx1, size_t aPtIdx2)
+				{
+					return (adjacency.numSpringsAt(aPtIdx1) < adjacency.numSpringsAt(aPtIdx2));
+				}
+			);
+			aOrder.insert(aOrder.end(), neighbors.begin(), neighbors.end());
+		}
+	};
+
+	std::vector<size_t> res;
+	res.reserve(numP);
+	std::vector<size_t> byDegree(numP);
+	std::iota(byDegree.begin(), byDegree.end(), 0);
+	std::stable_sort(byDegree.begin(), byDegree.end(),
+		[&adjacency](size_t aPtIdx1, size_t aPtIdx2)
+		{
+			return (adjacency.numSpringsAt(aPtIdx1) < adjacency.numSpringsAt(aPtIdx2));
+		}
+	);
+	std::vector<size_t> search;
+	for (auto start: byDegree)
+	{
+		if (visitMark[start] == 1)
+		{
+			continue;
+		}
+
+		// Start from a pseudo-peripheral point, the one farthest from the previous candidate:
+		for (size_t i = 0; i < MAX_PERIPHERAL_SEARCHES; ++i)
+		{
+			search.clear();
+			breadthFirst(start, search);
+			if (search.back() == start)
+			{
+				break;
+			}
+			start = search.back();
+		}
+		auto begin = res.size();
+		breadthFirst(start, res);
+		for (auto i = begin; i < res.size(); ++i)
+		{
+			visitMark[res[i]] = 1;
+		}
+	}
+
+	// Reversing the order reduces the profile of the matrix further:
+	std::reverse(res.begin(), res.end());
+	return res;
+}
+
+
+
+
+
+std::vector<size_t> SpringNet::hilbertOrder() const
+{
+	auto numP = mPoints.size();
+	auto minX = std::numeric_limits<double>::max(), maxX = std::numeric_limits<double>::lowest();
+	auto minY = minX, maxY = maxX;
+	for (const auto & p: mPoints)
+	{
+		minX = std::min(minX, p.x());
+		maxX = std::max(maxX, p.x());
+		minY = std::min(minY, p.y());
+		maxY = std::max(maxY, p.y());
+	}
+
+	// Scale the bounding box uniformly onto the grid, so that the curve doesn't get stretched:
+	auto extent = std::max(maxX - minX, maxY - minY);
+	auto scale = (extent > 0) ? ((HILBERT_GRID_SIZE - 1) / extent) : 0.0;
+	std::vector<std::pair<uint64_t, size_t>> keys;
+	keys.reserve(numP);
+	for (size_t idx = 0; idx < numP; ++idx)
+	{
+		auto x = static_cast<uint32_t>((mPoints[idx].x() - minX) * scale);
+		auto y = static_cast<uint32_t>((mPoints[idx].y() - minY) * scale);
+		keys.emplace_back(hilbertDistance(x, y), idx);
+	}
+	std::sort(keys.begin(), keys.end());
+	std::vector<size_t> res;
+	res.reserve(numP);
+	for (const auto & key: keys)
+	{
+		res.push_back(key.second);
+	}
+	return res;
+}
+
+
+
+
+
+template <typename Predicate>
+void SpringNet::removeSpringsIf(Predicate aShouldRemove)
+{
+	auto numS = mSprings.size();
+	std::vector<size_t> newIndices(numS, REMOVED_SPRING);
+	size_t numKept = 0;
+	for (size_t idx = 0; idx < numS; ++idx)
+	{
+		if (!aShouldRemove(idx))
+		{
+			newIndices[idx] = numKept;
+			mSprings[numKept++] = std::move(mSprings[idx]);
+		}
+	}
+	mSprings.erase(mSprings.begin() + static_cast<ptrdiff_t>(numKept), mSprings.end());
+
+	// Drop the angles that have lost a spring, renumber the rest:
+	std::erase_if(mAngles, [&newIndices](const Angle & aAngle)
+		{
+			return (
+				(newIndices[aAngle.springIdx1()] == REMOVED_SPRING) ||
+				(newIndices[aAngle.springIdx2()] == REMOVED_SPRING)
+			);
+		}
+	);
+	for (auto & angle: mAngles)
+	{
+		angle.setSpringIndices(*this, newIndices[angle.springIdx1()], newIndices[angle.springIdx2()]);
+	}
 }
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
 #include <memory>
+#include <chrono>
 #include <QPointF>
 
 
@@ -15,32 +17,26 @@ class SpringNet;
 
 
 
-/** Represents a single point, either a fixed one or a moving one, that can define a spring endpoint. */
+/** Represents a single point that can define a spring endpoint.
+Whether the point is fixed is kept by SpringNet in a bitset, so that a point is nothing more than its coords. */
 class Point:
 	public QPointF
 {
 	using Super = QPointF;
 
-	/** A fixed point cannot be moved at all. */
-	bool mIsFixed;
-
 
 public:
 
-	Point(double aX, double aY, bool aIsFixed = false):
-		Super(aX, aY),
-		mIsFixed(aIsFixed)
+	Point(double aX, double aY):
+		Super(aX, aY)
 	{
 	}
 
-	Point(const QPointF & aPos, bool aIsFixed = false):
-		Super(aPos),
-		mIsFixed(aIsFixed)
+	Point(const QPointF & aPos):
+		Super(aPos)
 	{
 	}
 
-	bool isFixed() const { return mIsFixed; }
-
 	void set(double aX, double aY)
 	{
 		setX(aX);
@@ -54,100 +50,319 @@ public:
 	}
 };
 
-using PointPtr = std::shared_ptr<Point>;
 
 
 
 
-
-/** A spring between two points (specified as indices into the point array in SpringNet). */
+/** A spring between two points (specified as indices into the point array in SpringNet).
+The springs are stored by value and kept compact (32-bit point indices, no reference to the parent net),
+so the functions that need the points' coords take the net as a parameter. */
 class Spring
 {
-	SpringNet & mParentNet;
 	double mIdealLength;
 	double mForce;
-	size_t mPointIdx1;
-	size_t mPointIdx2;
+	uint32_t mPointIdx1;
+	uint32_t mPointIdx2;
 
 public:
-	Spring(SpringNet & aParentNet, double aIdealLength, double aForce, size_t aPointIdx1, size_t aPointIdx2):
-		mParentNet(aParentNet),
+	Spring(double aIdealLength, double aForce, size_t aPointIdx1, size_t aPointIdx2):
 		mIdealLength(aIdealLength),
 		mForce(aForce),
-		mPointIdx1(aPointIdx1),
-		mPointIdx2(aPointIdx2)
+		mPointIdx1(static_cast<uint32_t>(aPointIdx1)),
+		mPointIdx2(static_cast<uint32_t>(aPointIdx2))
 	{
 	}
 
 	size_t pointIdx1() const { return mPointIdx1; }
 	size_t pointIdx2() const { return mPointIdx2; }
-	void setPointIdx1(size_t aPointIdx1) { mPointIdx1 = aPointIdx1; }
-	void setPointIdx2(size_t aPointIdx2) { mPointIdx2 = aPointIdx2; }
-	const Point & point1() const;
-	const Point & point2() const;
-	Point & point1();
-	Point & point2();
+	void setPointIdx1(size_t aPointIdx1) { mPointIdx1 = static_cast<uint32_t>(aPointIdx1); }
+	void setPointIdx2(size_t aPointIdx2) { mPointIdx2 = static_cast<uint32_t>(aPointIdx2); }
+	const Point & point1(const SpringNet & aNet) const;
+	const Point & point2(const SpringNet & aNet) const;
 	double idealLength() const { return mIdealLength; }
 	double force() const { return mForce; }
-	double currentLength() const;
+	double currentLength(const SpringNet & aNet) const;
 	void setIdealLength(double aIdealLength) { mIdealLength = aIdealLength; }
 	void setForce(double aForce) { mForce = aForce; }
-	double diffX() const;
-	double diffY() const;
+	double diffX(const SpringNet & aNet) const;
+	double diffY(const SpringNet & aNet) const;
 
 	/** Returns the other point than the specified one.
 	UB if aPointIdx is neither mPointIdx1 nor mPointIdx2. */
-	const Point & otherPoint(size_t aPointIdx) const;
+	const Point & otherPoint(const SpringNet & aNet, size_t aPointIdx) const;
 
 	/** Returns the length, projected from a sloped measurement onto a flat floor. */
 	static double projectLengthToFloor(double aLength, double aHeightDifference);
 
+	/** Projects all the lengths onto a flat floor in place, same as projectLengthToFloor() for each of them.
+	A plain loop over contiguous arrays, so that the compiler can vectorise it for large imports.
+	The arrays must be of the same size, and each length longer than its height difference. */
+	static void projectLengthsToFloor(std::vector<double> & aLengths, const std::vector<double> & aHeightDifferences);
+
 	/** Returns the square of the distance between the specified point and the spring. */
-	double distanceSquared(QPointF aPt);
+	double distanceSquared(const SpringNet & aNet, QPointF aPt) const;
 };
 
-using SpringPtr = std::shared_ptr<Spring>;
 
 
 
 
+/** An angle constraint between two springs that share a point (the station), such as measured by a theodolite.
+The angle is measured at the station, counter-clockwise from the direction to the first spring's other point to the
+direction to the second spring's other point, in radians.
+The point indices are derived from the springs; SpringNet keeps them up to date when the indices shift.
+Stored by value and compact, same as Spring. */
+class Angle
+{
+	double mIdealAngle;
+	double mForce;
+	uint32_t mSpringIdx1;
+	uint32_t mSpringIdx2;
+
+	/** The shared point and the other points of the two springs, cached for the solver's inner loop. */
+	uint32_t mStationIdx;
+	uint32_t mPointIdx1;
+	uint32_t mPointIdx2;
 
+
+public:
+
+	/** Creates the angle between the two specified springs of aNet.
+	Throws a std::runtime_error if the springs don't share exactly one point. */
+	Angle(const SpringNet & aNet, double aIdealAngle, double aForce, size_t aSpringIdx1, size_t aSpringIdx2);
+
+	size_t springIdx1() const { return mSpringIdx1; }
+	size_t springIdx2() const { return mSpringIdx2; }
+	size_t stationIdx() const { return mStationIdx; }
+	size_t pointIdx1() const { return mPointIdx1; }
+	size_t pointIdx2() const { return mPointIdx2; }
+	double idealAngle() const { return mIdealAngle; }
+	double force() const { return mForce; }
+	void setIdealAngle(double aIdealAngle) { mIdealAngle = aIdealAngle; }
+	void setForce(double aForce) { mForce = aForce; }
+
+	/** Sets new spring indices (after the springs have been renumbered) and re-derives the point indices from them. */
+	void setSpringIndices(const SpringNet & aNet, size_t aSpringIdx1, size_t aSpringIdx2);
+
+	/** Re-derives the point indices from the springs (after the points have been renumbered). */
+	void updatePointIndices(const SpringNet & aNet);
+
+	/** Returns the current angle, in the range [0, 2 * pi). */
+	double currentAngle(const SpringNet & aNet) const;
+
+	/** Returns the angle at aStation from aPt1 to aPt2, in the range [0, 2 * pi); 0 if undefined. */
+	static double currentAngle(QPointF aStation, QPointF aPt1, QPointF aPt2);
+
+	/** Returns the average ideal length of the two springs.
+	An angle error times the arm length is the perpendicular displacement of the arms' ends, which makes the angle
+	errors comparable to the length errors; the residual and the least-squares weight of the angle use it. */
+	double armLength(const SpringNet & aNet) const;
+
+	/** Returns the position where the angle is displayed (and picked in the UI): on the bisector of the angle,
+	at a third of the shorter arm's current length. */
+	QPointF markerPos(const SpringNet & aNet) const;
+
+	/** Returns the marker position of the angle at aStation from aPt1 to aPt2, same as the member markerPos(). */
+	static QPointF markerPos(QPointF aStation, QPointF aPt1, QPointF aPt2);
+
+	/** Evaluates the angle at aStation from aPt1 to aPt2 (counter-clockwise, in (-pi, pi]), and its gradients with
+	respect to the positions of aStation, aPt1 and aPt2, in this order.
+	Returns false if either arm has a zero length, the angle is undefined then. */
+	static bool evaluate(QPointF aStation, QPointF aPt1, QPointF aPt2, double & aAngle, QPointF (& aGradients)[3]);
+
+	/** Returns aIdealAngle - aCurrentAngle, wrapped into (-pi, pi]. */
+	static double angleError(double aIdealAngle, double aCurrentAngle);
+};
+
+
+
+
+
+/** The network of points, springs and angles.
+The objects are stored by value in contiguous arrays, and refer to each other by 32-bit indices, so that huge nets
+(tens of millions of springs) fit in memory; the number of points and springs is limited to 2^32 - 1 each. */
 class SpringNet
 {
-	std::vector<PointPtr> mPoints;
-	std::vector<SpringPtr> mSprings;
+	std::vector<Point> mPoints;
+	std::vector<Spring> mSprings;
+	std::vector<Angle> mAngles;
+
+	/** Per-point flag, a fixed point cannot be moved at all. Same order as mPoints. */
+	std::vector<bool> mIsFixed;
+
+	/** Per-point flag, a pinned point is temporarily held in place by the solver (such as while being dragged).
+	Unlike the fixed flag, pinning is not a part of the document. Same order as mPoints. */
+	std::vector<bool> mIsPinned;
+
+	/** A number that changes whenever points, springs or angles are added or removed.
+	Unique across all SpringNet instances, so that it can be used as a cache key. */
+	uint64_t mTopologyVersion;
+
+	/** A number that changes whenever the parameters of a spring or an angle are changed through setSpringParams()
+	or setAngleParams(). */
+	uint64_t mParamsVersion;
+
+	/** A number that changes whenever the points are moved through SpringNet (setPointPos(), setPositions(), adjusting). */
+	uint64_t mGeometryVersion;
 
 
 public:
 
+	/** The springs connected to each point, in a compressed (CSR) layout:
+	springs at point P are mSpringIndices[mOffsets[P]] .. mSpringIndices[mOffsets[P + 1] - 1].
+	The angles involving each point (as the station or as an arm's end) are in the same layout,
+	in mAngleOffsets and mAngleIndices. */
+	struct Adjacency
+	{
+		std::vector<size_t> mOffsets;
+		std::vector<uint32_t> mSpringIndices;
+		std::vector<size_t> mAngleOffsets;
+		std::vector<uint32_t> mAngleIndices;
+
+		size_t numSpringsAt(size_t aPtIdx) const { return mOffsets[aPtIdx + 1] - mOffsets[aPtIdx]; }
+		const uint32_t * springsBegin(size_t aPtIdx) const { return mSpringIndices.data() + mOffsets[aPtIdx]; }
+		const uint32_t * springsEnd(size_t aPtIdx) const { return mSpringIndices.data() + mOffsets[aPtIdx + 1]; }
+		size_t numAnglesAt(size_t aPtIdx) const { return mAngleOffsets[aPtIdx + 1] - mAngleOffsets[aPtIdx]; }
+		const uint32_t * anglesBegin(size_t aPtIdx) const { return mAngleIndices.data() + mAngleOffsets[aPtIdx]; }
+		const uint32_t * anglesEnd(size_t aPtIdx) const { return mAngleIndices.data() + mAngleOffsets[aPtIdx + 1]; }
+	};
+
+	/** The memory used by the net, in bytes, by the kind of the objects. Includes the unused reserved capacity. */
+	struct MemoryUsage
+	{
+		/** The points' coords and their fixed and pinned flags. */
+		size_t mPoints = 0;
+		size_t mSprings = 0;
+		size_t mAngles = 0;
+
+		size_t total() const { return mPoints + mSprings + mAngles; }
+	};
+
+	/** The orderings of the points that reorder() can apply. */
+	enum class PointOrdering
+	{
+		/** Reverse Cuthill-McKee: breadth-first through the springs, so that the points connected by a spring get
+		close indices. */
+		ReverseCuthillMcKee,
+
+		/** Along a Hilbert curve through the bounding box, so that the points close to each other get close indices. */
+		Hilbert,
+	};
+
+	/** The permutations applied by reorder(): the old index of each object in the new order, and vice versa. */
+	struct Reordering
+	{
+		std::vector<size_t> mPointNewToOld;
+		std::vector<size_t> mPointOldToNew;
+		std::vector<size_t> mSpringNewToOld;
+		std::vector<size_t> mSpringOldToNew;
+		std::vector<size_t> mAngleNewToOld;
+		std::vector<size_t> mAngleOldToNew;
+	};
+
+	/** How far adjustAround() has got with settling the net. */
+	struct LocalAdjustment
+	{
+		/** The largest distance that any point has moved in the last round; above the tolerance if the time budget
+		has run out before the region settled. */
+		double mLastMove = 0;
+
+		/** The largest distance that any point on the region's edge (with a spring to a point outside the region) has
+		moved in total; a move that isn't negligible has strained the springs leading out of the region. */
+		double mEdgeMove = 0;
+	};
+
+	/** The neighborhood of a dragged point, prepared by dragRegion() once when the drag starts and re-adjusted by
+	adjustLocal() on each mouse move. Only valid until the net's topology changes. */
+	struct DragRegion
+	{
+		size_t mCenterPtIdx = 0;
+		Adjacency mAdjacency;
+
+		/** The points within the ring around the center point, without the center point itself. */
+		std::vector<size_t> mPtIndices;
+	};
+
+	/** The points and springs to be added to the net at once by addBulk(), such as when importing measurements.
+	The springs' point indices refer to mPoints here, not to the net's points. */
+	struct Bulk
+	{
+		std::vector<QPointF> mPoints;
+		std::vector<bool> mIsFixed;
+		std::vector<Spring> mSprings;
+	};
+
 	/** Object type, for functions handling multiple object types. */
 	enum class ObjectType
 	{
 		None,
 		Point,
 		Spring,
+		Angle,
 	};
 
 
 	SpringNet();
 
-	const std::vector<PointPtr> & points() const { return mPoints; }
-	const std::vector<SpringPtr> & springs() const { return mSprings; }
+	/** Creates a copy of the net.
+	The copy keeps the version numbers of the original, since it has the same contents; either net gets new versions
+	as soon as it is changed, so the caches keyed by the versions stay valid for both. */
+	SpringNet(const SpringNet & aOther) = default;
+
+	const std::vector<Point> & points() const { return mPoints; }
+	const std::vector<Spring> & springs() const { return mSprings; }
+	const std::vector<Angle> & angles() const { return mAngles; }
+
+	uint64_t topologyVersion() const { return mTopologyVersion; }
+	uint64_t paramsVersion() const { return mParamsVersion; }
+	uint64_t geometryVersion() const { return mGeometryVersion; }
 
 	size_t numPoints() const { return mPoints.size(); }
 	size_t numSprings() const { return mSprings.size(); }
+	size_t numAngles() const { return mAngles.size(); }
+
+	const Point & point(size_t aIdx) const { return mPoints[aIdx]; }
+	Point & point(size_t aIdx) { return mPoints[aIdx]; }
+	const Spring & spring(size_t aIdx) const { return mSprings[aIdx]; }
+	Spring & spring(size_t aIdx) { return mSprings[aIdx]; }
+	const Angle & angle(size_t aIdx) const { return mAngles[aIdx]; }
+
+	/** Returns the memory used by the net. */
+	MemoryUsage memoryUsage() const;
 
-	const Point & point(size_t aIdx) const { return *mPoints[aIdx]; }
-	Point & point(size_t aIdx) { return *mPoints[aIdx]; }
-	const Spring & spring(size_t aIdx) const { return *mSprings[aIdx]; }
-	Spring & spring(size_t aIdx) { return *mSprings[aIdx]; }
+	/** Reserves the memory for the specified total number of points, springs and angles, so that adding them one by
+	one (such as when loading a file) doesn't need to re-allocate and copy the arrays as they grow. */
+	void reservePoints(size_t aNumPoints);
+	void reserveSprings(size_t aNumSprings);
+	void reserveAngles(size_t aNumAngles);
 
-	/** Adds a new point with the specified properties. */
+	/** Adds a new point with the specified properties.
+	Throws a std::runtime_error if the net already has the max number of points. */
 	void addPoint(QPointF aPos, bool aIsFixed);
 
-	/** Adds a new spring with the specified properties. */
+	/** Adds a new spring with the specified properties.
+	Throws a std::runtime_error if either point index is out of bounds, or the net already has the max number of
+	springs. */
 	void addSpring(double aIdealLength, double aForce, size_t aPointIdx1, size_t aPointIdx2);
 
+	/** Appends all the points and springs of aBulk after the existing objects, as a single topology change.
+	Everything is validated first; throws a std::runtime_error, leaving the net unchanged, if a spring's point index is
+	out of aBulk's points, or the net would have more than the max number of points or springs. */
+	void addBulk(const Bulk & aBulk);
+
+	/** Adds a new angle between the two specified springs.
+	Throws a std::runtime_error if the springs don't share exactly one point. */
+	void addAngle(double aIdealAngle, double aForce, size_t aSpringIdx1, size_t aSpringIdx2);
+
+	/** Moves the specified point to the specified position. */
+	void setPointPos(size_t aIdx, QPointF aPos);
+
+	/** Sets the ideal length and force of the specified spring. */
+	void setSpringParams(size_t aIdx, double aIdealLength, double aForce);
+
+	/** Sets the ideal angle and force of the specified angle. */
+	void setAngleParams(size_t aIdx, double aIdealAngle, double aForce);
+
 	/** Returns the index of the point nearest to the specified coords.
 	Throws a std::runtime_error if there are no points in the network. */
 	size_t nearestPointIdx(QPointF aQueryPt);
@@ -159,8 +374,85 @@ public:
 	/** Removes everything from the containers. */
 	void clear();
 
-	/** Performs one round of spring-based point position adjustment. */
-	void adjust();
+	/** Performs one round of spring-based point position adjustment.
+	Returns the largest distance that any point has moved in this round. */
+	double adjust();
+
+	/** Performs one round of adjustment limited to the specified points.
+	Returns the largest distance that any of the points has moved. */
+	double adjustPoints(const std::vector<size_t> & aPtIndices, const Adjacency & aAdjacency);
+
+	/** Prepares the re-adjustment of the points within aRingSize springs of the specified point, for adjustLocal(). */
+	DragRegion dragRegion(size_t aCenterPtIdx, size_t aRingSize) const;
+
+	/** Repeatedly adjusts the points of the region, until no point moves more than aTolerance in a round, or the time
+	budget runs out. The center point itself is not moved. At least one round is always performed.
+	Returns the number of rounds performed. */
+	size_t adjustLocal(const DragRegion & aRegion, double aTolerance, std::chrono::microseconds aBudget);
+
+	/** Repeatedly adjusts the points within aRingSize springs of any of the specified points (including them), until
+	no point moves more than aTolerance in a round, or the time budget runs out. At least one round is always performed. */
+	LocalAdjustment adjustAround(
+		const std::vector<size_t> & aPtIndices,
+		size_t aRingSize,
+		double aTolerance,
+		std::chrono::microseconds aBudget
+	);
+
+	/** Returns the positions of all the points, in the same order as the points. */
+	std::vector<QPointF> positions() const;
+
+	/** Moves all the points to the specified positions (in the same order as the points). */
+	void setPositions(const std::vector<QPointF> & aPositions);
+
+	/** Computes, for the specified point positions, how much each point should move in a single Jacobi-style
+	(simultaneous) round of adjustment. The springs and the angles are evaluated in the same pass; since they are all
+	applied at once, the displacement is averaged over the springs and angles at each point.
+	Immovable points get a zero displacement. */
+	void computeDisplacements(const std::vector<QPointF> & aPositions, std::vector<QPointF> & aDisplacements) const;
+
+	/** Returns the root-mean-square of the force-weighted spring length errors and angle errors (scaled to lengths by
+	the arm length), for the specified point positions. */
+	double residual(const std::vector<QPointF> & aPositions) const;
+
+	/** Returns the root-mean-square of the force-weighted spring length errors and angle errors, for the current
+	point positions. */
+	double residual() const { return residual(positions()); }
+
+	/** Returns a fingerprint of the topology: the number of points, and the points of the springs and the springs of
+	the angles, in their order. Unlike topologyVersion(), it is the same for the same topology in any session, so that
+	it can be saved along with the data that is only valid for the topology (the solver checkpoint). */
+	uint64_t topologyHash() const;
+
+	/** Builds the point-to-springs and point-to-angles adjacency for the current network. */
+	Adjacency buildAdjacency() const;
+
+	/** Returns the indices of all points that are at most aRingSize springs away from the specified point
+	(including the point itself). */
+	std::vector<size_t> pointsWithinRing(size_t aPtIdx, size_t aRingSize, const Adjacency & aAdjacency) const;
+
+	/** Returns the indices of all points that are at most aRingSize springs away from any of the specified points
+	(including the points themselves), each only once. */
+	std::vector<size_t> pointsWithinRing(
+		const std::vector<size_t> & aPtIndices,
+		size_t aRingSize,
+		const Adjacency & aAdjacency
+	) const;
+
+	/** Pins or unpins the specified point; a pinned point is not moved by the solver. */
+	void setPointPinned(size_t aIdx, bool aIsPinned) { mIsPinned[aIdx] = aIsPinned; }
+
+	/** Returns true if the specified point is pinned. */
+	bool isPointPinned(size_t aIdx) const { return mIsPinned[aIdx]; }
+
+	/** Returns true if the specified point is fixed. */
+	bool isPointFixed(size_t aIdx) const { return mIsFixed[aIdx]; }
+
+	/** Returns true if the solver may not move the specified point (it is either fixed or pinned). */
+	bool isPointImmovable(size_t aIdx) const { return mIsFixed[aIdx] || mIsPinned[aIdx]; }
+
+	/** Unpins all points. */
+	void unpinAllPoints();
 
 	/** Returns {true, ptIdx} when the query position is within snap distance of a point,
 	{false, ?} if too far or no points. */
@@ -169,10 +461,43 @@ public:
 	/** Returns the object nearest to the specified position. */
 	std::pair<ObjectType, size_t> nearestObject(QPointF aScenePos, double aSnapDistSq);
 
-	/** Removes the point at the specified index, and all its connecting springs.
-	Updates all springs' point indices after the index shift in mPoints. */
+	/** Removes the point at the specified index, and all its connecting springs (and their angles).
+	Updates all springs' and angles' indices after the index shifts. */
 	void removePoint(size_t aIdx);
 
-	/** Removes the spring at the specified index. */
+	/** Removes the spring at the specified index, and all the angles using it. */
 	void removeSpring(size_t aIdx);
+
+	/** Removes the angle at the specified index. */
+	void removeAngle(size_t aIdx);
+
+	/** Renumbers the points in the specified order, then the springs by their lower point index and the angles by
+	their station, so that the objects near each other in the net are near each other in memory as well; the solvers'
+	sweeps over the points and springs then mostly hit the cache.
+	Returns the permutations applied, for updating any indices kept outside of the net. */
+	Reordering reorder(PointOrdering aOrdering);
+
+
+private:
+
+	/** Returns a new value for the version numbers, unique across all SpringNet instances. */
+	static uint64_t nextVersion();
+
+	/** Assigns a new unique value to mTopologyVersion. */
+	void topologyChanged();
+
+	/** Returns the points' indices in the Reverse Cuthill-McKee order. */
+	std::vector<size_t> reverseCuthillMcKeeOrder() const;
+
+	/** Returns the points' indices in the order along a Hilbert curve through the points' bounding box. */
+	std::vector<size_t> hilbertOrder() const;
+
+	/** Returns the new position for the specified point: the average of the corrections required by the springs and
+	angles connected to it. */
+	QPointF adjustedPosition(size_t aPtIdx, const Adjacency & aAdjacency) const;
+
+	/** Removes the springs for whose index aShouldRemove returns true, together with the angles using them,
+	and renumbers the springs in the remaining angles. */
+	template <typename Predicate>
+	void removeSpringsIf(Predicate aShouldRemove);
 };
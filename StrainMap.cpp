@@ -0,0 +1,196 @@
+#include "StrainMap.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <QColor>
+#include <QtGlobal>
+
+#include "Parallel.hpp"
+#include "SpringNet.hpp"
+
+
+
+
+
+namespace {
+
+/** The hues of the palette's ends, same as the residual colors of NetExport: blue for compressed, red for stretched. */
+static const int PALETTE_HUE_SHORT = 240;
+static const int PALETTE_HUE_LONG = 0;
+
+/** The smallest number of springs worth processing on a separate thread. */
+static const size_t MIN_CHUNK_SPRINGS = 256 * 1024;
+
+}  // anonymous namespace
+
+
+
+
+
+void StrainMap::compute(const SpringNet & aNet, Mode aMode)
+{
+	mMode = aMode;
+	const auto * springs = aNet.springs().data();
+	const auto * points = aNet.points().data();
+	auto numSprings = aNet.numSprings();
+	mValues.resize(numSprings);
+	mColorIndices.resize(numSprings);
+	auto * values = mValues.data();
+	auto * colorIndices = mColorIndices.data();
+
+	// The springs are split into contiguous chunks, one per thread; each pass sums up its chunks afterwards:
+	struct Chunk
+	{
+		size_t mBegin;
+		size_t mEnd;
+		double mMaxAbs = 0;
+		double mSumSq = 0;
+		std::array<size_t, NUM_HISTOGRAM_BINS> mHistogram{};
+	};
+	auto numChunks = std::clamp<size_t>(numSprings / MIN_CHUNK_SPRINGS, 1, Parallel::numThreads());
+	std::vector<Chunk> chunks;
+	chunks.reserve(numChunks);
+	for (size_t i = 0; i < numChunks; ++i)
+	{
+		chunks.push_back({numSprings * i / numChunks, numSprings * (i + 1) / numChunks});
+	}
+
+	// The first pass computes the values, in a branch-free loop specialized for the mode (only the coords are
+	// gathered, the arithmetic vectorizes):
+	auto computeValues = [&](Chunk & aChunk, auto aValueFn)
+	{
+		double maxAbs = 0;
+		double sumSq = 0;
+		for (auto idx = aChunk.mBegin; idx < aChunk.mEnd; ++idx)
+		{
+			const auto & s = springs[idx];
+			const auto & pt1 = points[s.pointIdx1()];
+			const auto & pt2 = points[s.pointIdx2()];
+			auto dx = pt2.x() - pt1.x();
+			auto dy = pt2.y() - pt1.y();
+			auto value = aValueFn(std::sqrt(dx * dx + dy * dy), s);
+			values[idx] = static_cast<float>(value);
+			maxAbs = std::max(maxAbs, std::abs(value));
+			sumSq += value * value;
+		}
+		aChunk.mMaxAbs = maxAbs;
+		aChunk.mSumSq = sumSq;
+	};
+	Parallel::runTasks(numChunks, [&](size_t aChunkIdx)
+		{
+			switch (aMode)
+			{
+				case Mode::RelativeStrain:
+				{
+					computeValues(chunks[aChunkIdx], [](double aLength, const Spring & aSpring)
+						{
+							auto ideal = aSpring.idealLength();
+							return (ideal > 0) ? (aLength - ideal) / ideal : 0.0;
+						}
+					);
+					break;
+				}
+				case Mode::NormalizedResidual:
+				{
+					computeValues(chunks[aChunkIdx], [](double aLength, const Spring & aSpring)
+						{
+							return (aLength - aSpring.idealLength()) * std::sqrt(aSpring.force());
+						}
+					);
+					break;
+				}
+			}
+		}
+	);
+	double maxAbs = 0;
+	double sumSq = 0;
+	for (const auto & chunk: chunks)
+	{
+		maxAbs = std::max(maxAbs, chunk.mMaxAbs);
+		sumSq += chunk.mSumSq;
+	}
+
+	// The palette spans [-maxAbs, +maxAbs]; the residuals are normalized by their RMS only for the legend, their colors
+	// don't change by the normalization:
+	mMaxAbsValue = maxAbs;
+	if ((aMode == Mode::NormalizedResidual) && (numSprings > 0))
+	{
+		auto rms = std::sqrt(sumSq / numSprings);
+		mMaxAbsValue = (std::isfinite(rms) && (rms > 0)) ? (maxAbs / rms) : 0;
+	}
+
+	// The second pass quantizes the values into the color indices through the scale (NaNs from a diverged solve end
+	// up as the first color), and counts them into the histogram bins, which are groups of adjacent colors:
+	auto scale = (maxAbs > 0) ? static_cast<float>((NUM_COLORS / 2) / maxAbs) : 0.0f;
+	auto offset = static_cast<float>(NUM_COLORS / 2);
+	Parallel::runTasks(numChunks, [&](size_t aChunkIdx)
+		{
+			auto & chunk = chunks[aChunkIdx];
+			for (auto idx = chunk.mBegin; idx < chunk.mEnd; ++idx)
+			{
+				auto color = std::min(static_cast<float>(NUM_COLORS - 1), std::max(0.0f, values[idx] * scale + offset));
+				colorIndices[idx] = static_cast<uint8_t>(color);
+			}
+			for (auto idx = chunk.mBegin; idx < chunk.mEnd; ++idx)
+			{
+				chunk.mHistogram[colorIndices[idx] * NUM_HISTOGRAM_BINS / NUM_COLORS] += 1;
+			}
+		}
+	);
+	mHistogram.fill(0);
+	for (const auto & chunk: chunks)
+	{
+		for (size_t bin = 0; bin < NUM_HISTOGRAM_BINS; ++bin)
+		{
+			mHistogram[bin] += chunk.mHistogram[bin];
+		}
+	}
+}
+
+
+
+
+
+const std::array<QRgb, StrainMap::NUM_COLORS> & StrainMap::palette()
+{
+	static const auto res = []()
+	{
+		std::array<QRgb, NUM_COLORS> colors;
+		for (size_t idx = 0; idx < NUM_COLORS; ++idx)
+		{
+			auto hue = PALETTE_HUE_SHORT +
+				(PALETTE_HUE_LONG - PALETTE_HUE_SHORT) * static_cast<int>(idx) / static_cast<int>(NUM_COLORS - 1);
+			colors[idx] = QColor::fromHsv(hue, 255, 224).rgb();
+		}
+		return colors;
+	}();
+	return res;
+}
+
+
+
+
+
+const char * StrainMap::modeName(Mode aMode)
+{
+	switch (aMode)
+	{
+		case Mode::RelativeStrain:     return QT_TRANSLATE_NOOP("StrainMap", "Relative strain");
+		case Mode::NormalizedResidual: return QT_TRANSLATE_NOOP("StrainMap", "Normalized residual");
+	}
+	return "";
+}
+
+
+
+
+
+const std::vector<StrainMap::Mode> & StrainMap::allModes()
+{
+	static const std::vector<Mode> modes =
+	{
+		Mode::RelativeStrain,
+		Mode::NormalizedResidual,
+	};
+	return modes;
+}
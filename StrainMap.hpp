@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <QRgb>
+
+
+
+
+
+// fwd:
+class SpringNet;
+
+
+
+
+
+/** Colors the springs of a net by how much they are stretched or compressed, for the heat-map view.
+The values of all the springs are computed in a single tight pass over the springs' arrays, then quantized into
+indices to a fixed palette, from blue (the most compressed) through green to red (the most stretched), symmetric
+around zero. The renderer draws the springs batched by their color index, so recoloring never creates any per-spring
+objects. */
+class StrainMap
+{
+public:
+
+	/** What value the springs are colored by. */
+	enum class Mode
+	{
+		/** (currentLength - idealLength) / idealLength. */
+		RelativeStrain,
+
+		/** The length error weighted by the square root of the force (the spring's weight in the least squares), relative
+		to the RMS of all the springs' weighted length errors. */
+		NormalizedResidual,
+	};
+
+
+	/** The number of colors in the palette. */
+	static constexpr size_t NUM_COLORS = 256;
+
+	/** The number of bins of the histogram, evenly spanning the palette. */
+	static constexpr size_t NUM_HISTOGRAM_BINS = 32;
+
+
+	/** Computes the values, the color indices and the histogram for all the springs of aNet, at its current positions. */
+	void compute(const SpringNet & aNet, Mode aMode);
+
+	Mode mode() const { return mMode; }
+
+	/** The index into palette() of each spring's color, in the same order as the springs. */
+	const std::vector<uint8_t> & colorIndices() const { return mColorIndices; }
+
+	/** The palette spans the values from -maxAbsValue() (the first color) to +maxAbsValue() (the last color).
+	0 if all the springs are exactly at their ideal length. */
+	double maxAbsValue() const { return mMaxAbsValue; }
+
+	/** The number of springs in each bin; the bins evenly span the values from -maxAbsValue() to +maxAbsValue(). */
+	const std::array<size_t, NUM_HISTOGRAM_BINS> & histogram() const { return mHistogram; }
+
+	/** Returns the colors, indexed by colorIndices(). */
+	static const std::array<QRgb, NUM_COLORS> & palette();
+
+	/** Returns the user-visible name of the mode, untranslated; translate it in the "StrainMap" context. */
+	static const char * modeName(Mode aMode);
+
+	/** Returns all the modes, in the order they should be presented to the user. */
+	static const std::vector<Mode> & allModes();
+
+
+protected:
+
+	Mode mMode = Mode::RelativeStrain;
+
+	/** The value of each spring, per mMode. Kept between computes, so that recomputing doesn't allocate. */
+	std::vector<float> mValues;
+
+	std::vector<uint8_t> mColorIndices;
+
+	double mMaxAbsValue = 0;
+
+	std::array<size_t, NUM_HISTOGRAM_BINS> mHistogram{};
+};
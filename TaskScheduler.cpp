@@ -0,0 +1,370 @@
+#include "TaskScheduler.hpp"
+
+#include <algorithm>
+
+
+
+
+
+namespace {
+
+/** How long a thread waiting in TaskGroup::wait() sleeps before looking for the group's queued tasks again.
+The tasks of the group are normally taken by the workers and the waiter is woken up by the last one finishing;
+this only bounds the wait when a task is queued to a busy worker and no other worker steals it. */
+static const std::chrono::milliseconds WAIT_RECHECK_INTERVAL(1);
+
+/** The scheduler whose worker the current thread is, and the worker's index; nullptr if not a worker. */
+static thread_local const TaskScheduler * gCurrentScheduler = nullptr;
+static thread_local size_t gCurrentWorkerIdx = 0;
+
+
+
+
+
+/** Removes and returns a task of the group (any group if nullptr) from the queue, from its back or front. */
+template <typename Task, typename Group>
+static std::optional<Task> takeFromQueue(std::deque<Task> & aQueue, const Group * aGroup, bool aFromBack)
+{
+	if (aQueue.empty())
+	{
+		return std::nullopt;
+	}
+	auto matches = [aGroup](const Task & aTask)
+	{
+		return (aGroup == nullptr) || (aTask.mGroup == aGroup);
+	};
+	if (aFromBack)
+	{
+		auto itr = std::find_if(aQueue.rbegin(), aQueue.rend(), matches);
+		if (itr == aQueue.rend())
+		{
+			return std::nullopt;
+		}
+		auto res = std::move(*itr);
+		aQueue.erase(std::next(itr).base());
+		return res;
+	}
+	auto itr = std::find_if(aQueue.begin(), aQueue.end(), matches);
+	if (itr == aQueue.end())
+	{
+		return std::nullopt;
+	}
+	auto res = std::move(*itr);
+	aQueue.erase(itr);
+	return res;
+}
+
+}  // anonymous namespace
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// TaskScheduler::CancellationToken:
+
+TaskScheduler::CancellationToken::CancellationToken():
+	mIsCancelled(std::make_shared<std::atomic<bool>>(false))
+{
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// TaskScheduler::TaskGroup:
+
+TaskScheduler::TaskGroup::TaskGroup(Priority aPriority, TaskScheduler & aScheduler):
+	mScheduler(aScheduler),
+	mPriority(aPriority)
+{
+}
+
+
+
+
+
+TaskScheduler::TaskGroup::~TaskGroup()
+{
+	try
+	{
+		wait();
+	}
+	catch (...)
+	{
+		// Nobody to report to any more
+	}
+}
+
+
+
+
+
+void TaskScheduler::TaskGroup::run(std::function<void()> aTask)
+{
+	CancellationToken token;
+	{
+		std::lock_guard lock(mMutex);
+		mNumPending += 1;
+		token = mToken;
+	}
+	mScheduler.submit(mPriority,
+		[this, token, task = std::move(aTask)]()
+		{
+			if (!token.isCancelled())
+			{
+				try
+				{
+					task();
+				}
+				catch (...)
+				{
+					std::lock_guard lock(mMutex);
+					if (mError == nullptr)
+					{
+						mError = std::current_exception();
+					}
+				}
+			}
+			taskDone();
+		},
+		this
+	);
+}
+
+
+
+
+
+void TaskScheduler::TaskGroup::wait()
+{
+	std::unique_lock lock(mMutex);
+	while (mNumPending > 0)
+	{
+		lock.unlock();
+		auto hasRun = mScheduler.runPendingTask(this);
+		lock.lock();
+		if (!hasRun && (mNumPending > 0))
+		{
+			// The remaining tasks are running elsewhere (or are queued to a busy worker):
+			mCondition.wait_for(lock, WAIT_RECHECK_INTERVAL);
+		}
+	}
+	if (mError != nullptr)
+	{
+		auto err = mError;
+		mError = nullptr;
+		std::rethrow_exception(err);
+	}
+}
+
+
+
+
+
+void TaskScheduler::TaskGroup::cancelAndWait()
+{
+	cancel();
+	try
+	{
+		wait();
+	}
+	catch (...)
+	{
+		// Cancelled, the result isn't wanted
+	}
+	std::lock_guard lock(mMutex);
+	mToken = CancellationToken();
+}
+
+
+
+
+
+TaskScheduler::CancellationToken TaskScheduler::TaskGroup::token() const
+{
+	std::lock_guard lock(mMutex);
+	return mToken;
+}
+
+
+
+
+
+void TaskScheduler::TaskGroup::taskDone()
+{
+	// Notify under the lock, the waiter may destroy the group as soon as it can lock the mutex:
+	std::lock_guard lock(mMutex);
+	mNumPending -= 1;
+	if (mNumPending == 0)
+	{
+		mCondition.notify_all();
+	}
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// TaskScheduler:
+
+TaskScheduler::TaskScheduler(size_t aNumThreads)
+{
+	auto numThreads = std::max<size_t>(aNumThreads, 1);
+	for (size_t i = 0; i < numThreads; ++i)
+	{
+		mWorkers.push_back(std::make_unique<Worker>());
+	}
+	// Only start the threads once all the workers exist, they steal from each other:
+	for (size_t i = 0; i < numThreads; ++i)
+	{
+		mWorkers[i]->mThread = std::thread(&TaskScheduler::workerThread, this, i);
+	}
+}
+
+
+
+
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard lock(mMutex);
+		mShouldStop = true;
+	}
+	mCondition.notify_all();
+	for (auto & worker: mWorkers)
+	{
+		worker->mThread.join();
+	}
+}
+
+
+
+
+
+TaskScheduler & TaskScheduler::instance()
+{
+	static TaskScheduler scheduler(std::thread::hardware_concurrency());
+	return scheduler;
+}
+
+
+
+
+
+void TaskScheduler::submit(Priority aPriority, std::function<void()> aTask, const TaskGroup * aGroup)
+{
+	// Count the task before it becomes visible, so that the count never drops below zero when it is taken right away:
+	mNumQueued += 1;
+	auto priority = static_cast<size_t>(aPriority);
+	if (isWorkerThread())
+	{
+		auto & worker = *mWorkers[gCurrentWorkerIdx];
+		std::lock_guard lock(worker.mMutex);
+		worker.mQueues[priority].push_back({std::move(aTask), aGroup});
+	}
+	else
+	{
+		std::lock_guard lock(mMutex);
+		mSharedQueues[priority].push_back({std::move(aTask), aGroup});
+	}
+
+	// Lock the mutex before notifying, so that the notification isn't lost by a worker just about to sleep:
+	{
+		std::lock_guard lock(mMutex);
+	}
+	mCondition.notify_one();
+}
+
+
+
+
+
+bool TaskScheduler::isWorkerThread() const
+{
+	return (gCurrentScheduler == this);
+}
+
+
+
+
+
+bool TaskScheduler::runPendingTask(const TaskGroup * aGroup)
+{
+	auto task = takeTask(isWorkerThread() ? std::optional<size_t>(gCurrentWorkerIdx) : std::nullopt, aGroup);
+	if (!task.has_value())
+	{
+		return false;
+	}
+	task->mFn();
+	return true;
+}
+
+
+
+
+
+std::optional<TaskScheduler::Task> TaskScheduler::takeTask(std::optional<size_t> aWorkerIdx, const TaskGroup * aGroup)
+{
+	auto numWorkers = mWorkers.size();
+	auto firstVictim = aWorkerIdx.has_value() ? (*aWorkerIdx + 1) : 0;
+	for (size_t priority = 0; priority < NUM_PRIORITIES; ++priority)
+	{
+		std::optional<Task> task;
+		if (aWorkerIdx.has_value())
+		{
+			auto & own = *mWorkers[*aWorkerIdx];
+			std::lock_guard lock(own.mMutex);
+			task = takeFromQueue(own.mQueues[priority], aGroup, true);
+		}
+		if (!task.has_value())
+		{
+			std::lock_guard lock(mMutex);
+			task = takeFromQueue(mSharedQueues[priority], aGroup, false);
+		}
+		for (size_t i = 0; (i < numWorkers) && !task.has_value(); ++i)
+		{
+			auto victimIdx = (firstVictim + i) % numWorkers;
+			if (victimIdx == aWorkerIdx)
+			{
+				continue;
+			}
+			auto & victim = *mWorkers[victimIdx];
+			std::lock_guard lock(victim.mMutex);
+			task = takeFromQueue(victim.mQueues[priority], aGroup, false);
+		}
+		if (task.has_value())
+		{
+			mNumQueued -= 1;
+			return task;
+		}
+	}
+	return std::nullopt;
+}
+
+
+
+
+
+void TaskScheduler::workerThread(size_t aWorkerIdx)
+{
+	gCurrentScheduler = this;
+	gCurrentWorkerIdx = aWorkerIdx;
+	while (true)
+	{
+		if (auto task = takeTask(aWorkerIdx, nullptr))
+		{
+			task->mFn();
+			continue;
+		}
+		std::unique_lock lock(mMutex);
+		mCondition.wait(lock, [this]() { return mShouldStop || (mNumQueued.load() > 0); });
+		if (mShouldStop)
+		{
+			return;
+		}
+	}
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+
+
+
+
+/** The pool of worker threads shared by all the background work of the app: the tile rendering, the solvers, the
+ensemble, the object table and the file I/O. A single pool sized to the cores, instead of each subsystem starting its
+own threads, so that the subsystems don't oversubscribe the cores and fight over them.
+Each task has a Priority; an idle worker always takes the most urgent task queued anywhere, so the interactive work
+(such as the tiles of the view being dragged) overtakes the running solve and the I/O at the next task boundary.
+The long-running jobs are therefore split into short tasks (such as the solver's time slices).
+Each worker has its own queues; a task submitted from a worker goes to that worker's queue, where the worker takes
+the newest one first (it's the warmest in its cache), and the idle workers steal the oldest ones from the others.
+Tasks submitted from other threads go to a shared queue.
+The tasks are usually run through a TaskGroup, which tracks their completion, exceptions and cancellation. */
+class TaskScheduler
+{
+public:
+
+	/** How urgent a task is; the lower values are taken first. */
+	enum class Priority
+	{
+		/** The work that the user is waiting for to see the view respond, such as the tiles, the heat map or the table. */
+		Interactive,
+
+		/** The background solves: the solver's time slices and the ensemble's blocks. */
+		Solve,
+
+		/** Loading and saving the files. */
+		IO,
+	};
+
+	static constexpr size_t NUM_PRIORITIES = 3;
+
+
+	/** A cancellation flag that can be shared by any number of tasks. Cancelling is only a request: the tasks not yet
+	started are skipped, and the running ones may poll isCancelled() to finish early. */
+	class CancellationToken
+	{
+	public:
+
+		CancellationToken();
+
+		void cancel() { mIsCancelled->store(true); }
+		bool isCancelled() const { return mIsCancelled->load(std::memory_order_relaxed); }
+
+
+	protected:
+
+		std::shared_ptr<std::atomic<bool>> mIsCancelled;
+	};
+
+
+	/** A set of tasks at a single priority, that can be waited for and cancelled together.
+	The first exception thrown by a task is kept and rethrown by wait(). The group must outlive its tasks, the destructor
+	waits for them. */
+	class TaskGroup
+	{
+	public:
+
+		explicit TaskGroup(Priority aPriority, TaskScheduler & aScheduler = TaskScheduler::instance());
+
+		/** Waits for the tasks, dropping any exception. */
+		~TaskGroup();
+
+		TaskGroup(const TaskGroup &) = delete;
+		TaskGroup & operator = (const TaskGroup &) = delete;
+
+		/** Queues the task; it is skipped if the group is cancelled before the task starts.
+		Can be called from any thread, including from the group's own tasks. */
+		void run(std::function<void()> aTask);
+
+		/** Waits until all the tasks run so far have finished. Meanwhile the calling thread runs the group's own queued
+		tasks, so that the wait doesn't depend on the workers being free (nor deadlocks when called from a worker).
+		Rethrows the first exception thrown by the tasks, and then forgets it. */
+		void wait();
+
+		/** Cancels the tasks run so far; doesn't wait for the running ones. */
+		void cancel() { token().cancel(); }
+
+		/** Cancels the tasks, waits for the running ones, and then renews the token, so that the group can be reused.
+		Drops any exception thrown by the tasks. */
+		void cancelAndWait();
+
+		/** Returns true if the group has been cancelled; for the long tasks to poll. */
+		bool isCancelled() const { return token().isCancelled(); }
+
+		/** Returns the token that cancel() cancels, for passing to the code that the tasks call. */
+		CancellationToken token() const;
+
+		Priority priority() const { return mPriority; }
+
+
+	protected:
+
+		TaskScheduler & mScheduler;
+
+		Priority mPriority;
+
+		/** Protects the members below. */
+		mutable std::mutex mMutex;
+
+		/** Signalled when the last task has finished. */
+		std::condition_variable mCondition;
+
+		CancellationToken mToken;
+
+		/** The number of tasks run and not yet finished. */
+		size_t mNumPending = 0;
+
+		/** The first exception thrown by a task since the last wait(). */
+		std::exception_ptr mError;
+
+
+		/** Called by each task after it has finished (or been skipped). */
+		void taskDone();
+	};
+
+
+	/** Starts the specified number of worker threads (at least 1). */
+	explicit TaskScheduler(size_t aNumThreads);
+
+	/** Stops the worker threads. The tasks still queued are dropped; their groups should have been waited for. */
+	~TaskScheduler();
+
+	/** Returns the scheduler shared by the whole app, with a worker per hardware thread. */
+	static TaskScheduler & instance();
+
+	size_t numThreads() const { return mWorkers.size(); }
+
+	/** Queues the task. aGroup only identifies the task's group for runPendingTask(), it may be nullptr. */
+	void submit(Priority aPriority, std::function<void()> aTask, const TaskGroup * aGroup = nullptr);
+
+	/** Returns true if called from one of this scheduler's worker threads. */
+	bool isWorkerThread() const;
+
+	/** Runs one queued task of the specified group (any group if nullptr) on the calling thread, the most urgent one
+	first. Returns false if there was none. */
+	bool runPendingTask(const TaskGroup * aGroup = nullptr);
+
+
+protected:
+
+	struct Task
+	{
+		std::function<void()> mFn;
+		const TaskGroup * mGroup;
+	};
+
+
+	/** The queues and the thread of a single worker. */
+	struct Worker
+	{
+		/** Protects mQueues; locked by the owner and by the thieves. */
+		std::mutex mMutex;
+
+		/** The tasks submitted by this worker, for each priority; the owner takes from the back, thieves from the front. */
+		std::deque<Task> mQueues[NUM_PRIORITIES];
+
+		std::thread mThread;
+	};
+
+
+	std::vector<std::unique_ptr<Worker>> mWorkers;
+
+	/** Protects mSharedQueues and mShouldStop, and is the mutex that the idle workers sleep on. */
+	std::mutex mMutex;
+
+	/** Wakes up the idle workers when a task is queued, or when stopping. */
+	std::condition_variable mCondition;
+
+	/** The tasks submitted from outside of the workers, for each priority, the oldest first. */
+	std::deque<Task> mSharedQueues[NUM_PRIORITIES];
+
+	/** The number of tasks in all the queues; the workers only go to sleep while it is zero. */
+	std::atomic<size_t> mNumQueued = 0;
+
+	bool mShouldStop = false;
+
+
+	/** Takes the most urgent queued task of the group (any group if nullptr): at each priority from the own queue
+	first (if aWorkerIdx is a worker), then from the shared queue, then stolen from the other workers. */
+	std::optional<Task> takeTask(std::optional<size_t> aWorkerIdx, const TaskGroup * aGroup);
+
+	/** The body of each worker thread: runs the tasks until stopped. */
+	void workerThread(size_t aWorkerIdx);
+};